@@ -10,6 +10,7 @@
  */
 
 #include "rados-ceph-config.h"
+#include "rados-compression.h"
 #include <jansson.h>
 #include <climits>
 #include <unistd.h>
@@ -61,6 +62,23 @@ bool RadosCephConfig::is_valid_key_value(const std::string &key, const std::stri
     success = value.compare("default") == 0 || value.compare("ima") == 0;
   } else if (get_config()->get_metadata_storage_attribute_key().compare(key) == 0) {
     success = true;
+  } else if (get_config()->get_compression_key().compare(key) == 0) {
+    success = RadosCompression::is_valid_codec(value);
+  } else if (get_config()->get_compression_level_key().compare(key) == 0) {
+    // (negative) integer
+    std::size_t start = value[0] == '-' ? 1 : 0;
+    success = value.length() > start && value.find_first_not_of("0123456789", start) == std::string::npos;
+  } else if (get_config()->get_compression_dict_key().compare(key) == 0 ||
+             get_config()->get_compression_dict_mail_size_key().compare(key) == 0) {
+    success = value.find_first_not_of("0123456789") == std::string::npos;
+  } else if (get_config()->get_single_instance_key().compare(key) == 0) {
+    success = value.compare("true") == 0 || value.compare("false") == 0;
+  } else if (get_config()->get_single_instance_min_size_key().compare(key) == 0) {
+    success = value.find_first_not_of("0123456789") == std::string::npos;
+  } else if (get_config()->get_striping_key().compare(key) == 0) {
+    success = value.compare("true") == 0 || value.compare("false") == 0;
+  } else if (get_config()->get_stripe_size_key().compare(key) == 0) {
+    success = value.find_first_not_of("0123456789") == std::string::npos;
   }
   return success;
 }
@@ -97,6 +115,49 @@ bool RadosCephConfig::update_valid_key_value(const std::string &key, const std::
   } else if (get_config()->get_metadata_storage_attribute_key().compare(key) == 0) {
     get_config()->set_metadata_storage_attribute(value);
     success = true;
+  } else if (get_config()->get_compression_key().compare(key) == 0) {
+    // codec needs to be compiled in
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_compression(value);
+    }
+  } else if (get_config()->get_compression_level_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_compression_level(value);
+    }
+  } else if (get_config()->get_compression_dict_key().compare(key) == 0) {
+    // dictionary needs to exist, e.g. to switch back to an older one
+    librados::bufferlist dict;
+    success = is_valid_key_value(key, value) && (value.compare("0") == 0 || read_dict(std::stoul(value), &dict) >= 0);
+    if (success) {
+      get_config()->set_compression_dict(value);
+    }
+  } else if (get_config()->get_compression_dict_mail_size_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_compression_dict_mail_size(value);
+    }
+  } else if (get_config()->get_single_instance_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_single_instance(value);
+    }
+  } else if (get_config()->get_single_instance_min_size_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_single_instance_min_size(value);
+    }
+  } else if (get_config()->get_striping_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_striping(value);
+    }
+  } else if (get_config()->get_stripe_size_key().compare(key) == 0) {
+    success = is_valid_key_value(key, value);
+    if (success) {
+      get_config()->set_stripe_size(value);
+    }
   }
   return success;
 }
@@ -130,6 +191,37 @@ int RadosCephConfig::read_object(const std::string &oid, librados::bufferlist *b
   return ret_read;
 }
 
+std::string RadosCephConfig::get_dict_object_name(uint32_t dict_id) {
+  return config.get_cfg_object_name() + "_dict_" + std::to_string(dict_id);
+}
+
+int RadosCephConfig::save_dict(uint32_t dict_id, librados::bufferlist &dict) {
+  if (io_ctx == nullptr) {
+    return -1;
+  }
+  // dictionaries are stored next to the configuration object, never overwrite one
+  std::string ns = io_ctx->get_namespace();
+  io_ctx->set_namespace("");
+  librados::ObjectWriteOperation write_op;
+  write_op.create(true);
+  write_op.write_full(dict);
+  int ret = io_ctx->operate(get_dict_object_name(dict_id), &write_op);
+  io_ctx->set_namespace(ns);
+  return ret;
+}
+
+int RadosCephConfig::read_dict(uint32_t dict_id, librados::bufferlist *dict) {
+  if (io_ctx == nullptr) {
+    return -1;
+  }
+  // may be called while the io_ctx is set to the users namespace
+  std::string ns = io_ctx->get_namespace();
+  io_ctx->set_namespace("");
+  int ret = read_object(get_dict_object_name(dict_id), dict);
+  io_ctx->set_namespace(ns);
+  return ret;
+}
+
 void RadosCephConfig::set_io_ctx_namespace(const std::string &namespace_) {
   if (io_ctx != nullptr) {
     io_ctx->set_namespace(namespace_);
@@ -64,6 +64,15 @@ class RadosCephConfig {
 
   const std::string &get_metadata_storage_module() { return config.get_metadata_storage_module(); }
   const std::string &get_metadata_storage_attribute() { return config.get_metadata_storage_attribute(); }
+  const std::string &get_compression() { return config.get_compression(); }
+  int get_compression_level() { return std::stoi(config.get_compression_level()); }
+  uint32_t get_compression_dict_id() { return std::stoul(config.get_compression_dict()); }
+  void set_compression_dict_id(uint32_t dict_id) { config.set_compression_dict(std::to_string(dict_id)); }
+  uint64_t get_compression_dict_mail_size() { return std::stoull(config.get_compression_dict_mail_size()); }
+  bool is_single_instance() { return !config.get_single_instance().compare("true"); }
+  uint64_t get_single_instance_min_size() { return std::stoull(config.get_single_instance_min_size()); }
+  bool is_striping() { return !config.get_striping().compare("true"); }
+  uint64_t get_stripe_size() { return std::stoull(config.get_stripe_size()); }
 
   const std::string &get_mail_attribute_key() { return config.get_mail_attribute_key(); }
   const std::string &get_updateable_attribute_key() { return config.get_updateable_attribute_key(); }
@@ -73,6 +82,18 @@ class RadosCephConfig {
   int read_object(const std::string &oid, librados::bufferlist *buffer);
   void set_io_ctx_namespace(const std::string &namespace_);
 
+  std::string get_dict_object_name(uint32_t dict_id);
+  /*!
+   * save a trained compression dictionary (fails if the dictionary already exists)
+   * @return linux error code or 0 if sucessful
+   */
+  int save_dict(uint32_t dict_id, librados::bufferlist &dict);
+  /*!
+   * read a compression dictionary
+   * @return linux error code or >= 0 if sucessful
+   */
+  int read_dict(uint32_t dict_id, librados::bufferlist *dict);
+
  private:
   RadosCephJsonConfig config;
   librados::IoCtx *io_ctx;
@@ -26,6 +26,14 @@ RadosCephJsonConfig::RadosCephJsonConfig()
       update_attributes("false"),
       metadata_storage_module("default"),
       metadata_storage_attribute("ima"),
+      compression("none"),
+      compression_level("0"),
+      compression_dict("0"),
+      compression_dict_mail_size("65536"),
+      single_instance("false"),
+      single_instance_min_size("4096"),
+      striping("false"),
+      stripe_size("0"),
       key_user_mapping("user_mapping"),
       key_user_ns("user_ns"),
       key_user_suffix("user_suffix"),
@@ -34,7 +42,15 @@ RadosCephJsonConfig::RadosCephJsonConfig()
       key_update_attributes("rbox_update_attributes"),
       key_updateable_attributes("rbox_updateable_attributes"),
       key_metadata_storage_module("rbox_metadata_storage"),
-      key_metadata_storage_attribute("rbox_storage_metadata_attr") {
+      key_metadata_storage_attribute("rbox_storage_metadata_attr"),
+      key_compression("rbox_compression"),
+      key_compression_level("rbox_compression_level"),
+      key_compression_dict("rbox_compression_dict"),
+      key_compression_dict_mail_size("rbox_compression_dict_mail_size"),
+      key_single_instance("rbox_single_instance"),
+      key_single_instance_min_size("rbox_single_instance_min_size"),
+      key_striping("rbox_striping"),
+      key_stripe_size("rbox_stripe_size") {
   set_default_mail_attributes();
   set_default_updateable_attributes();
 }
@@ -90,6 +106,40 @@ bool RadosCephJsonConfig::from_json(librados::bufferlist *buffer) {
     json_t *metadata_storage_attr_ = json_object_get(root, key_metadata_storage_attribute.c_str());
     metadata_storage_attribute = json_string_value(metadata_storage_attr_);
 
+    // optional, not available in configurations of older versions
+    json_t *compression_ = json_object_get(root, key_compression.c_str());
+    if (compression_ != NULL) {
+      compression = json_string_value(compression_);
+    }
+    json_t *compression_level_ = json_object_get(root, key_compression_level.c_str());
+    if (compression_level_ != NULL) {
+      compression_level = json_string_value(compression_level_);
+    }
+    json_t *compression_dict_ = json_object_get(root, key_compression_dict.c_str());
+    if (compression_dict_ != NULL) {
+      compression_dict = json_string_value(compression_dict_);
+    }
+    json_t *compression_dict_mail_size_ = json_object_get(root, key_compression_dict_mail_size.c_str());
+    if (compression_dict_mail_size_ != NULL) {
+      compression_dict_mail_size = json_string_value(compression_dict_mail_size_);
+    }
+    json_t *single_instance_ = json_object_get(root, key_single_instance.c_str());
+    if (single_instance_ != NULL) {
+      single_instance = json_string_value(single_instance_);
+    }
+    json_t *single_instance_min_size_ = json_object_get(root, key_single_instance_min_size.c_str());
+    if (single_instance_min_size_ != NULL) {
+      single_instance_min_size = json_string_value(single_instance_min_size_);
+    }
+    json_t *striping_ = json_object_get(root, key_striping.c_str());
+    if (striping_ != NULL) {
+      striping = json_string_value(striping_);
+    }
+    json_t *stripe_size_ = json_object_get(root, key_stripe_size.c_str());
+    if (stripe_size_ != NULL) {
+      stripe_size = json_string_value(stripe_size_);
+    }
+
     ret = valid = true;
     json_decref(root);
   }
@@ -110,6 +160,14 @@ bool RadosCephJsonConfig::to_json(librados::bufferlist *buffer) {
   json_object_set_new(root, key_update_attributes.c_str(), json_string(update_attributes.c_str()));
   json_object_set_new(root, key_metadata_storage_module.c_str(), json_string(metadata_storage_module.c_str()));
   json_object_set_new(root, key_metadata_storage_attribute.c_str(), json_string(metadata_storage_attribute.c_str()));
+  json_object_set_new(root, key_compression.c_str(), json_string(compression.c_str()));
+  json_object_set_new(root, key_compression_level.c_str(), json_string(compression_level.c_str()));
+  json_object_set_new(root, key_compression_dict.c_str(), json_string(compression_dict.c_str()));
+  json_object_set_new(root, key_compression_dict_mail_size.c_str(), json_string(compression_dict_mail_size.c_str()));
+  json_object_set_new(root, key_single_instance.c_str(), json_string(single_instance.c_str()));
+  json_object_set_new(root, key_single_instance_min_size.c_str(), json_string(single_instance_min_size.c_str()));
+  json_object_set_new(root, key_striping.c_str(), json_string(striping.c_str()));
+  json_object_set_new(root, key_stripe_size.c_str(), json_string(stripe_size.c_str()));
 
   char *s = json_dumps(root, 0);
   buffer->append(s);
@@ -130,6 +188,14 @@ std::string RadosCephJsonConfig::to_string() {
   ss << "  " << key_updateable_attributes << "=" << updateable_attributes << std::endl;
   ss << "  " << key_metadata_storage_module << "=" << metadata_storage_module << std::endl;
   ss << "  " << key_metadata_storage_attribute << "=" << metadata_storage_attribute << std::endl;
+  ss << "  " << key_compression << "=" << compression << std::endl;
+  ss << "  " << key_compression_level << "=" << compression_level << std::endl;
+  ss << "  " << key_compression_dict << "=" << compression_dict << std::endl;
+  ss << "  " << key_compression_dict_mail_size << "=" << compression_dict_mail_size << std::endl;
+  ss << "  " << key_single_instance << "=" << single_instance << std::endl;
+  ss << "  " << key_single_instance_min_size << "=" << single_instance_min_size << std::endl;
+  ss << "  " << key_striping << "=" << striping << std::endl;
+  ss << "  " << key_stripe_size << "=" << stripe_size << std::endl;
   return ss.str();
 }
 
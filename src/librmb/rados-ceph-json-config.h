@@ -79,6 +79,27 @@ class RadosCephJsonConfig {
   }
   const std::string& get_metadata_storage_attribute() { return metadata_storage_attribute; }
 
+  void set_compression(const std::string& compression_) { compression = compression_; }
+  const std::string& get_compression() { return compression; }
+  void set_compression_level(const std::string& compression_level_) { compression_level = compression_level_; }
+  const std::string& get_compression_level() { return compression_level; }
+  void set_compression_dict(const std::string& compression_dict_) { compression_dict = compression_dict_; }
+  const std::string& get_compression_dict() { return compression_dict; }
+  void set_compression_dict_mail_size(const std::string& compression_dict_mail_size_) {
+    compression_dict_mail_size = compression_dict_mail_size_;
+  }
+  const std::string& get_compression_dict_mail_size() { return compression_dict_mail_size; }
+  void set_single_instance(const std::string& single_instance_) { single_instance = single_instance_; }
+  const std::string& get_single_instance() { return single_instance; }
+  void set_single_instance_min_size(const std::string& single_instance_min_size_) {
+    single_instance_min_size = single_instance_min_size_;
+  }
+  const std::string& get_single_instance_min_size() { return single_instance_min_size; }
+  void set_striping(const std::string& striping_) { striping = striping_; }
+  const std::string& get_striping() { return striping; }
+  void set_stripe_size(const std::string& stripe_size_) { stripe_size = stripe_size_; }
+  const std::string& get_stripe_size() { return stripe_size; }
+
   void update_mail_attribute(const char* value);
   void update_updateable_attribute(const char* value);
 
@@ -93,6 +114,14 @@ class RadosCephJsonConfig {
 
   const std::string& get_metadata_storage_module_key() { return key_metadata_storage_module; }
   const std::string& get_metadata_storage_attribute_key() { return key_metadata_storage_attribute; }
+  const std::string& get_compression_key() { return key_compression; }
+  const std::string& get_compression_level_key() { return key_compression_level; }
+  const std::string& get_compression_dict_key() { return key_compression_dict; }
+  const std::string& get_compression_dict_mail_size_key() { return key_compression_dict_mail_size; }
+  const std::string& get_single_instance_key() { return key_single_instance; }
+  const std::string& get_single_instance_min_size_key() { return key_single_instance_min_size; }
+  const std::string& get_striping_key() { return key_striping; }
+  const std::string& get_stripe_size_key() { return key_stripe_size; }
 
  private:
   void set_default_mail_attributes();
@@ -113,6 +142,15 @@ class RadosCephJsonConfig {
   std::string metadata_storage_module;
   std::string metadata_storage_attribute;
 
+  std::string compression;
+  std::string compression_level;
+  std::string compression_dict;
+  std::string compression_dict_mail_size;
+  std::string single_instance;
+  std::string single_instance_min_size;
+  std::string striping;
+  std::string stripe_size;
+
   std::string key_user_mapping;
   std::string key_user_ns;
   std::string key_user_suffix;
@@ -124,6 +162,15 @@ class RadosCephJsonConfig {
 
   std::string key_metadata_storage_module;
   std::string key_metadata_storage_attribute;
+
+  std::string key_compression;
+  std::string key_compression_level;
+  std::string key_compression_dict;
+  std::string key_compression_dict_mail_size;
+  std::string key_single_instance;
+  std::string key_single_instance_min_size;
+  std::string key_striping;
+  std::string key_stripe_size;
 };
 
 } /* namespace librmb */
@@ -0,0 +1,148 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-checksum.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace librmb {
+
+// reflected Castagnoli polynomial
+#define RBOX_CRC32C_POLY 0x82F63B78
+
+typedef uint32_t (*crc32c_impl)(uint32_t crc, const unsigned char *data, size_t length);
+
+/* slicing-by-8 tables, table[0] is the classic byte wise table */
+struct Crc32cTable {
+  uint32_t table[8][256];
+  Crc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; j++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? RBOX_CRC32C_POLY : 0);
+      }
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int t = 1; t < 8; t++) {
+        table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *data, size_t length) {
+  static const Crc32cTable crc_table;
+  const uint32_t(*t)[256] = crc_table.table;
+
+  while (length >= 8) {
+    uint32_t low;
+    uint32_t high;
+    memcpy(&low, data, 4);
+    memcpy(&high, data + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    low = __builtin_bswap32(low);
+    high = __builtin_bswap32(high);
+#endif
+    low ^= crc;
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+          t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t crc, const unsigned char *data,
+                                                            size_t length) {
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    uint64_t value;
+    memcpy(&value, data, 8);
+    crc64 = _mm_crc32_u64(crc64, value);
+    data += 8;
+    length -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (length-- > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+static crc32c_impl crc32c_select() { return __builtin_cpu_supports("sse4.2") ? crc32c_hw : crc32c_sw; }
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *data, size_t length) {
+  while (length >= 8) {
+    uint64_t value;
+    memcpy(&value, data, 8);
+    crc = __crc32cd(crc, value);
+    data += 8;
+    length -= 8;
+  }
+  while (length-- > 0) {
+    crc = __crc32cb(crc, *data++);
+  }
+  return crc;
+}
+
+static crc32c_impl crc32c_select() { return crc32c_hw; }
+
+#else
+static crc32c_impl crc32c_select() { return crc32c_sw; }
+#endif
+
+static crc32c_impl crc32c_get_impl() {
+  static crc32c_impl impl = crc32c_select();
+  return impl;
+}
+
+uint32_t RadosChecksum::crc32c(uint32_t crc, const void *data, size_t length) {
+  return ~crc32c_get_impl()(~crc, static_cast<const unsigned char *>(data), length);
+}
+
+uint32_t RadosChecksum::crc32c(uint32_t crc, const librados::bufferlist &data) {
+  for (const auto &segment : data.buffers()) {
+    crc = crc32c(crc, segment.c_str(), segment.length());
+  }
+  return crc;
+}
+
+std::string RadosChecksum::to_string(uint32_t crc) {
+  char buf[9];
+  snprintf(buf, sizeof(buf), "%08x", crc);
+  return std::string(buf);
+}
+
+bool RadosChecksum::from_string(const std::string &value, uint32_t *crc) {
+  if (value.length() != 8 || value.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+    return false;
+  }
+  *crc = static_cast<uint32_t>(strtoul(value.c_str(), NULL, 16));
+  return true;
+}
+
+bool RadosChecksum::is_hw_accelerated() { return crc32c_get_impl() != crc32c_sw; }
+
+}  // namespace librmb
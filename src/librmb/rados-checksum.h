@@ -0,0 +1,53 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_CHECKSUM_H_
+#define SRC_LIBRMB_RADOS_CHECKSUM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * RadosChecksum
+ *
+ * CRC32C (Castagnoli) of the mail content, stored as RBOX_METADATA_CHECKSUM.
+ * Uses the crc32 instruction of SSE4.2 (x86_64) or ARMv8 if available,
+ * a table driven implementation otherwise.
+ */
+class RadosChecksum {
+ public:
+  /*!
+   * continue crc with the given data (crc = 0 to start a new checksum).
+   */
+  static uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+  static uint32_t crc32c(uint32_t crc, const librados::bufferlist &data);
+
+  /*!
+   * @return crc as 8 hex digits
+   */
+  static std::string to_string(uint32_t crc);
+  /*!
+   * @return false if value is not a valid checksum
+   */
+  static bool from_string(const std::string &value, uint32_t *crc);
+  /*!
+   * @return true if the hardware implementation is used
+   */
+  static bool is_hw_accelerated();
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_CHECKSUM_H_
@@ -118,6 +118,21 @@ std::map<std::string, std::vector<std::string>> RadosClusterImpl::list_pgs_osd_f
     RadosClusterImpl::cluster->mon_command(cmd, inbl, &outbl, nullptr);
     return RadosUtils::extractPgAndPrimaryOsd(std::string(outbl.c_str()));
 }
+bool RadosClusterImpl::is_erasure_coded_pool(const std::string &pool_name) {
+  // only erasure coded pools have an erasure code profile, mon returns -EACCES for replicated pools.
+  const string cmd =
+  "{"
+  "\"prefix\": \"osd pool get\", "
+  "\"pool\": \"" + pool_name + "\", "
+  "\"var\": \"erasure_code_profile\", "
+  "\"format\": \"json\""
+  "}";
+
+  librados::bufferlist inbl;
+  librados::bufferlist outbl;
+  return RadosClusterImpl::cluster->mon_command(cmd, inbl, &outbl, nullptr) == 0;
+}
+
 int RadosClusterImpl::initialize() {
   int ret = 0;
 
@@ -44,6 +44,7 @@ class RadosClusterImpl : public RadosCluster {
 
   std::vector<std::string> list_pgs_for_pool(std::string &pool_name) override;
   std::map<std::string, std::vector<std::string>> list_pgs_osd_for_pool(std::string &pool_name) override;
+  bool is_erasure_coded_pool(const std::string &pool_name) override;
 
  private:
   int initialize();
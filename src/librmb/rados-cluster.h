@@ -88,6 +88,11 @@ class RadosCluster {
   virtual std::vector<std::string> list_pgs_for_pool(std::string &pool_name) = 0;
   virtual std::map<std::string, std::vector<std::string>> list_pgs_osd_for_pool(std::string &pool_name) = 0;
 
+  /*!
+   * @return true if pool is an erasure coded pool (no omap support)
+   */
+  virtual bool is_erasure_coded_pool(const std::string &pool_name) = 0;
+
   
 };
 
@@ -0,0 +1,493 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "dovecot-ceph-plugin-config.h"
+#include "rados-compression.h"
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <utility>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+namespace librmb {
+
+// output size if the uncompressed size is not stored in the frame
+#define RBOX_COMPRESSION_OUT_SIZE (64 * 1024)
+
+/**
+ * Collects codec output in page aligned buffers, which are appended to
+ * the bufferlist (no copy) once they are full.
+ */
+class RadosCompressionOutput {
+ public:
+  explicit RadosCompressionOutput(librados::bufferlist *out_) : out(out_), pos(0) {}
+  ~RadosCompressionOutput() { flush(); }
+
+  // make sure there are at least size bytes available
+  void reserve(size_t size) {
+    if (ptr.length() - pos < size) {
+      flush();
+      ptr = ceph::buffer::create_page_aligned(size);
+    }
+  }
+  char *data() { return ptr.c_str() + pos; }
+  size_t available() { return ptr.length() - pos; }
+  void produced(size_t size) { pos += size; }
+
+  void flush() {
+    if (pos > 0) {
+      out->append(ptr, 0, pos);
+    }
+    ptr = ceph::bufferptr();
+    pos = 0;
+  }
+
+ private:
+  librados::bufferlist *out;
+  ceph::bufferptr ptr;
+  size_t pos;
+};
+
+// enough to hold any zstd or lz4 frame header
+#define RBOX_COMPRESSION_HEADER_SIZE 32
+
+// copy the start of in, the frame header may be split across segments
+static size_t copy_frame_header(const librados::bufferlist &in, char *header) {
+  size_t size = std::min<size_t>(in.length(), RBOX_COMPRESSION_HEADER_SIZE);
+  if (size > 0) {
+    in.begin().copy(size, header);
+  }
+  return size;
+}
+
+#ifdef HAVE_ZSTD
+class RadosDecompressorZstd : public RadosDecompressor {
+ public:
+  explicit RadosDecompressorZstd(ZSTD_DCtx *dctx_) : dctx(dctx_) {}
+  ~RadosDecompressorZstd() { ZSTD_freeDCtx(dctx); }
+
+  int decompress(const char *src, size_t *src_size, char *dst, size_t *dst_size) override {
+    ZSTD_inBuffer in = {src, *src_size, 0};
+    ZSTD_outBuffer out = {dst, *dst_size, 0};
+    size_t hint = ZSTD_decompressStream(dctx, &out, &in);
+    *src_size = in.pos;
+    *dst_size = out.pos;
+    if (ZSTD_isError(hint)) {
+      return -EIO;
+    }
+    return hint == 0 ? 0 : 1;
+  }
+  void reset() override {
+    // keeps the referenced dictionary
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+  }
+
+ private:
+  ZSTD_DCtx *dctx;
+};
+
+class RadosCompressionZstd : public RadosCompression {
+ public:
+  RadosCompressionZstd() : name("zstd") {}
+  ~RadosCompressionZstd() {
+    for (auto &cdict : cdicts) {
+      ZSTD_freeCDict(cdict.second);
+    }
+    for (auto &ddict : ddicts) {
+      ZSTD_freeDDict(ddict.second);
+    }
+  }
+  const std::string &get_name() const override { return name; }
+  bool is_dict_supported() const override { return true; }
+
+  int compress(const librados::bufferlist &in, librados::bufferlist *out, int level,
+               RadosCompressionDict *dict) override {
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if (cctx == nullptr) {
+      return -ENOMEM;
+    }
+    if (dict != nullptr) {
+      ZSTD_CDict *cdict = get_cdict(dict, level);
+      if (cdict == nullptr) {
+        ZSTD_freeCCtx(cctx);
+        return -EINVAL;
+      }
+      // level is part of the digested dictionary
+      ZSTD_CCtx_refCDict(cctx, cdict);
+    } else {
+      // level 0 is zstd's default level
+      ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    }
+    ZSTD_CCtx_setPledgedSrcSize(cctx, in.length());
+
+    int ret = 0;
+    RadosCompressionOutput output(out);
+    // with compressBound the whole frame fits into one buffer
+    output.reserve(ZSTD_compressBound(in.length()));
+    ZSTD_outBuffer dst = {output.data(), output.available(), 0};
+    for (auto it = in.buffers().begin(); ret == 0 && it != in.buffers().end(); ++it) {
+      ZSTD_inBuffer src = {it->c_str(), it->length(), 0};
+      while (src.pos < src.size) {
+        if (ZSTD_isError(ZSTD_compressStream2(cctx, &dst, &src, ZSTD_e_continue))) {
+          ret = -EIO;
+          break;
+        }
+      }
+    }
+    if (ret == 0) {
+      ZSTD_inBuffer src = {nullptr, 0, 0};
+      size_t remaining = ZSTD_compressStream2(cctx, &dst, &src, ZSTD_e_end);
+      ret = (ZSTD_isError(remaining) || remaining > 0) ? -EIO : 0;
+    }
+    output.produced(dst.pos);
+    ZSTD_freeCCtx(cctx);
+    return ret;
+  }
+
+  int decompress(const librados::bufferlist &in, librados::bufferlist *out, RadosCompressionDict *dict) override {
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (dctx == nullptr) {
+      return -ENOMEM;
+    }
+    if (dict != nullptr) {
+      ZSTD_DDict *ddict = get_ddict(dict);
+      if (ddict == nullptr) {
+        ZSTD_freeDCtx(dctx);
+        return -EINVAL;
+      }
+      ZSTD_DCtx_refDDict(dctx, ddict);
+    }
+    size_t out_size = ZSTD_DStreamOutSize();
+    if (in.buffers().size() > 0) {
+      unsigned long long content_size =
+          ZSTD_getFrameContentSize(in.buffers().front().c_str(), in.buffers().front().length());
+      if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR && content_size > 0) {
+        out_size = content_size;
+      }
+    }
+
+    int ret = 0;
+    size_t hint = 0;
+    RadosCompressionOutput output(out);
+    output.reserve(out_size);
+    ZSTD_outBuffer dst = {output.data(), output.available(), 0};
+    for (auto it = in.buffers().begin(); ret == 0 && it != in.buffers().end(); ++it) {
+      ZSTD_inBuffer src = {it->c_str(), it->length(), 0};
+      while (src.pos < src.size || (dst.pos == dst.size && hint > 0)) {
+        if (dst.pos == dst.size) {
+          output.produced(dst.pos);
+          output.reserve(ZSTD_DStreamOutSize());
+          dst = {output.data(), output.available(), 0};
+        }
+        hint = ZSTD_decompressStream(dctx, &dst, &src);
+        if (ZSTD_isError(hint)) {
+          ret = -EIO;
+          break;
+        }
+      }
+    }
+    if (ret == 0 && hint != 0) {
+      // truncated frame
+      ret = -EIO;
+    }
+    output.produced(dst.pos);
+    ZSTD_freeDCtx(dctx);
+    return ret;
+  }
+
+  RadosDecompressor *create_decompressor(RadosCompressionDict *dict) override {
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (dctx == nullptr) {
+      return nullptr;
+    }
+    if (dict != nullptr) {
+      ZSTD_DDict *ddict = get_ddict(dict);
+      if (ddict == nullptr) {
+        ZSTD_freeDCtx(dctx);
+        return nullptr;
+      }
+      ZSTD_DCtx_refDDict(dctx, ddict);
+    }
+    return new RadosDecompressorZstd(dctx);
+  }
+
+  uint64_t get_content_size(const librados::bufferlist &in) override {
+    char header[RBOX_COMPRESSION_HEADER_SIZE];
+    unsigned long long content_size = ZSTD_getFrameContentSize(header, copy_frame_header(in, header));
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR) {
+      return 0;
+    }
+    return content_size;
+  }
+
+ private:
+  // dictionaries are digested once per process, they never change for a given id.
+  ZSTD_CDict *get_cdict(RadosCompressionDict *dict, int level) {
+    std::pair<uint32_t, int> key(dict->get_id(), level);
+    auto it = cdicts.find(key);
+    if (it != cdicts.end()) {
+      return it->second;
+    }
+    ZSTD_CDict *cdict = ZSTD_createCDict(dict->get_buffer(), dict->get_length(),
+                                         level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    if (cdict != nullptr) {
+      cdicts[key] = cdict;
+    }
+    return cdict;
+  }
+  ZSTD_DDict *get_ddict(RadosCompressionDict *dict) {
+    auto it = ddicts.find(dict->get_id());
+    if (it != ddicts.end()) {
+      return it->second;
+    }
+    ZSTD_DDict *ddict = ZSTD_createDDict(dict->get_buffer(), dict->get_length());
+    if (ddict != nullptr) {
+      ddicts[dict->get_id()] = ddict;
+    }
+    return ddict;
+  }
+
+ private:
+  std::string name;
+  std::map<std::pair<uint32_t, int>, ZSTD_CDict *> cdicts;
+  std::map<uint32_t, ZSTD_DDict *> ddicts;
+};
+#endif
+
+#ifdef HAVE_LZ4
+class RadosDecompressorLz4 : public RadosDecompressor {
+ public:
+  explicit RadosDecompressorLz4(LZ4F_dctx *dctx_) : dctx(dctx_) {}
+  ~RadosDecompressorLz4() { LZ4F_freeDecompressionContext(dctx); }
+
+  int decompress(const char *src, size_t *src_size, char *dst, size_t *dst_size) override {
+    size_t hint = LZ4F_decompress(dctx, dst, dst_size, src, src_size, nullptr);
+    if (LZ4F_isError(hint)) {
+      return -EIO;
+    }
+    return hint == 0 ? 0 : 1;
+  }
+  void reset() override { LZ4F_resetDecompressionContext(dctx); }
+
+ private:
+  LZ4F_dctx *dctx;
+};
+
+class RadosCompressionLz4 : public RadosCompression {
+ public:
+  RadosCompressionLz4() : name("lz4") {}
+  const std::string &get_name() const override { return name; }
+
+  int compress(const librados::bufferlist &in, librados::bufferlist *out, int level,
+               RadosCompressionDict *dict) override {
+    if (dict != nullptr) {
+      return -ENOTSUP;
+    }
+    LZ4F_cctx *cctx = nullptr;
+    if (LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) {
+      return -ENOMEM;
+    }
+    LZ4F_preferences_t prefs;
+    memset(&prefs, 0, sizeof(prefs));
+    prefs.frameInfo.contentSize = in.length();
+    prefs.compressionLevel = level;
+
+    int ret = 0;
+    RadosCompressionOutput output(out);
+    output.reserve(LZ4F_compressFrameBound(in.length(), &prefs));
+    size_t n = LZ4F_compressBegin(cctx, output.data(), output.available(), &prefs);
+    if (LZ4F_isError(n)) {
+      ret = -EIO;
+    } else {
+      output.produced(n);
+    }
+    for (auto it = in.buffers().begin(); ret == 0 && it != in.buffers().end(); ++it) {
+      output.reserve(LZ4F_compressBound(it->length(), &prefs));
+      n = LZ4F_compressUpdate(cctx, output.data(), output.available(), it->c_str(), it->length(), nullptr);
+      if (LZ4F_isError(n)) {
+        ret = -EIO;
+        break;
+      }
+      output.produced(n);
+    }
+    if (ret == 0) {
+      output.reserve(LZ4F_compressBound(0, &prefs));
+      n = LZ4F_compressEnd(cctx, output.data(), output.available(), nullptr);
+      if (LZ4F_isError(n)) {
+        ret = -EIO;
+      } else {
+        output.produced(n);
+      }
+    }
+    LZ4F_freeCompressionContext(cctx);
+    return ret;
+  }
+
+  int decompress(const librados::bufferlist &in, librados::bufferlist *out, RadosCompressionDict *dict) override {
+    if (dict != nullptr) {
+      return -ENOTSUP;
+    }
+    LZ4F_dctx *dctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+      return -ENOMEM;
+    }
+    int ret = 0;
+    size_t hint = 1;
+    size_t out_size = RBOX_COMPRESSION_OUT_SIZE;
+    RadosCompressionOutput output(out);
+    for (auto it = in.buffers().begin(); ret == 0 && it != in.buffers().end(); ++it) {
+      const char *src = it->c_str();
+      size_t src_left = it->length();
+
+      if (it == in.buffers().begin()) {
+        // read the frame header, to allocate the output at once.
+        LZ4F_frameInfo_t info;
+        size_t consumed = src_left;
+        hint = LZ4F_getFrameInfo(dctx, &info, src, &consumed);
+        if (LZ4F_isError(hint)) {
+          ret = -EIO;
+          break;
+        }
+        if (info.contentSize > 0) {
+          out_size = info.contentSize;
+        }
+        src += consumed;
+        src_left -= consumed;
+      }
+      while (src_left > 0) {
+        output.reserve(out_size);
+        size_t dst_size = output.available();
+        size_t src_size = src_left;
+        hint = LZ4F_decompress(dctx, output.data(), &dst_size, src, &src_size, nullptr);
+        if (LZ4F_isError(hint)) {
+          ret = -EIO;
+          break;
+        }
+        output.produced(dst_size);
+        src += src_size;
+        src_left -= src_size;
+        out_size = RBOX_COMPRESSION_OUT_SIZE;
+      }
+    }
+    if (ret == 0 && hint != 0) {
+      // truncated frame
+      ret = -EIO;
+    }
+    LZ4F_freeDecompressionContext(dctx);
+    return ret;
+  }
+
+  RadosDecompressor *create_decompressor(RadosCompressionDict *dict) override {
+    if (dict != nullptr) {
+      return nullptr;
+    }
+    LZ4F_dctx *dctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+      return nullptr;
+    }
+    return new RadosDecompressorLz4(dctx);
+  }
+
+  uint64_t get_content_size(const librados::bufferlist &in) override {
+    LZ4F_dctx *dctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+      return 0;
+    }
+    char header[RBOX_COMPRESSION_HEADER_SIZE];
+    size_t header_size = copy_frame_header(in, header);
+    LZ4F_frameInfo_t info;
+    size_t ret = LZ4F_getFrameInfo(dctx, &info, header, &header_size);
+    LZ4F_freeDecompressionContext(dctx);
+    return LZ4F_isError(ret) ? 0 : info.contentSize;
+  }
+
+ private:
+  std::string name;
+};
+#endif
+
+RadosCompression *RadosCompression::get_codec(const std::string &name) {
+#ifdef HAVE_ZSTD
+  static RadosCompressionZstd zstd;
+  if (name.compare(zstd.get_name()) == 0) {
+    return &zstd;
+  }
+#endif
+#ifdef HAVE_LZ4
+  static RadosCompressionLz4 lz4;
+  if (name.compare(lz4.get_name()) == 0) {
+    return &lz4;
+  }
+#endif
+  return nullptr;
+}
+
+bool RadosCompression::is_valid_codec(const std::string &name) {
+  return name.compare("none") == 0 || get_codec(name) != nullptr;
+}
+
+std::string RadosCompression::to_marker(const std::string &name, uint32_t dict_id) {
+  return dict_id > 0 ? name + ":" + std::to_string(dict_id) : name;
+}
+
+bool RadosCompression::parse_marker(const std::string &marker, std::string *name, uint32_t *dict_id) {
+  std::size_t separator = marker.find(':');
+  *name = marker.substr(0, separator);
+  *dict_id = 0;
+  if (separator == std::string::npos) {
+    return !name->empty();
+  }
+  try {
+    *dict_id = static_cast<uint32_t>(std::stoul(marker.substr(separator + 1)));
+  } catch (std::exception &ex) {
+    return false;
+  }
+  return !name->empty() && *dict_id > 0;
+}
+
+int RadosCompression::train_dict(std::list<librados::bufferlist> &samples, size_t dict_size,
+                                 librados::bufferlist *dict, uint32_t *dict_id) {
+#ifdef HAVE_ZSTD
+  // zdict expects the samples concatenated
+  librados::bufferlist sample_buffer;
+  std::vector<size_t> sample_sizes;
+  for (auto &sample : samples) {
+    sample_buffer.append(sample);
+    sample_sizes.push_back(sample.length());
+  }
+  if (sample_sizes.empty()) {
+    return -EINVAL;
+  }
+  ceph::bufferptr dict_buffer = ceph::buffer::create_page_aligned(dict_size);
+  size_t ret = ZDICT_trainFromBuffer(dict_buffer.c_str(), dict_size, sample_buffer.c_str(), sample_sizes.data(),
+                                     sample_sizes.size());
+  if (ZDICT_isError(ret)) {
+    return -EINVAL;
+  }
+  dict->append(dict_buffer, 0, ret);
+  *dict_id = ZDICT_getDictID(dict_buffer.c_str(), ret);
+  return *dict_id > 0 ? 0 : -EINVAL;
+#else
+  return -ENOTSUP;
+#endif
+}
+
+}  // namespace librmb
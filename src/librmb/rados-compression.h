@@ -0,0 +1,151 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_COMPRESSION_H_
+#define SRC_LIBRMB_RADOS_COMPRESSION_H_
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <rados/librados.hpp>
+
+/** max. size of a trained compression dictionary (zstd default) **/
+#define RBOX_COMPRESSION_DICT_SIZE 112640
+
+namespace librmb {
+
+/**
+ * RadosCompressionDict
+ *
+ * trained compression dictionary (zstd). Dictionaries are stored versioned
+ * next to the configuration object (see RadosCephConfig::save_dict) and never change,
+ * the id is stored with every object compressed with it.
+ */
+class RadosCompressionDict {
+ public:
+  RadosCompressionDict(uint32_t id_, const librados::bufferlist &data_) : id(id_), data(data_) {}
+  uint32_t get_id() const { return id; }
+  // contiguous dictionary content
+  const char *get_buffer() { return data.c_str(); }
+  size_t get_length() const { return data.length(); }
+
+ private:
+  uint32_t id;
+  librados::bufferlist data;
+};
+
+/**
+ * RadosDecompressor
+ *
+ * Incremental decompression of one frame, used to decompress a mail
+ * while it is streamed instead of decompressing the whole object at once.
+ */
+class RadosDecompressor {
+ public:
+  virtual ~RadosDecompressor() {}
+  /*!
+   * decompress the next part of the frame.
+   * @param[in] src compressed input
+   * @param[in,out] src_size in: size of src, out: consumed bytes
+   * @param[out] dst uncompressed output
+   * @param[in,out] dst_size in: size of dst, out: produced bytes
+   * @return 0 if the frame is complete, 1 if more input is required, or linux error code
+   */
+  virtual int decompress(const char *src, size_t *src_size, char *dst, size_t *dst_size) = 0;
+  /*!
+   * start the frame again, e.g. to seek backwards.
+   */
+  virtual void reset() = 0;
+};
+
+/**
+ * RadosCompression
+ *
+ * Codec used to compress the mail body before it is written to
+ * rados. The codec name is stored with the object (RBOX_METADATA_COMPRESSION),
+ * so that the read path can select the matching codec.
+ *
+ * Available codecs depend on the libraries found by configure
+ * (zstd: HAVE_ZSTD, lz4: HAVE_LZ4).
+ */
+class RadosCompression {
+ public:
+  virtual ~RadosCompression() {}
+
+  /*!
+   * @return name of the codec as stored with the object e.g. zstd
+   */
+  virtual const std::string &get_name() const = 0;
+  /*!
+   * compress in into out (one frame).
+   * @param[in] in uncompressed data (may consist of several segments)
+   * @param[out] out compressed data
+   * @param[in] level codec specific compression level, 0 = codec default
+   * @param[in] dict optional trained dictionary, see is_dict_supported
+   * @return linux error code or 0 if sucessful
+   */
+  virtual int compress(const librados::bufferlist &in, librados::bufferlist *out, int level,
+                       RadosCompressionDict *dict = nullptr) = 0;
+  /*!
+   * decompress in into out.
+   * @param[in] in compressed data (may consist of several segments)
+   * @param[out] out uncompressed data
+   * @param[in] dict dictionary the data has been compressed with or nullptr
+   * @return linux error code or 0 if sucessful
+   */
+  virtual int decompress(const librados::bufferlist &in, librados::bufferlist *out,
+                         RadosCompressionDict *dict = nullptr) = 0;
+  virtual bool is_dict_supported() const { return false; }
+  /*!
+   * @param[in] dict dictionary the data has been compressed with or nullptr
+   * @return new decompressor (delete it) or nullptr if it cannot be created
+   */
+  virtual RadosDecompressor *create_decompressor(RadosCompressionDict *dict = nullptr) = 0;
+  /*!
+   * @param[in] in compressed data, at least the frame header
+   * @return uncompressed size stored in the frame header or 0 if unknown
+   */
+  virtual uint64_t get_content_size(const librados::bufferlist &in) = 0;
+
+  /*!
+   * @param[in] name codec name e.g. zstd, lz4
+   * @return the codec or nullptr if name is "none", unknown, or not compiled in.
+   *         the codec is shared, don't delete it.
+   */
+  static RadosCompression *get_codec(const std::string &name);
+  /*!
+   * @return true if name is a valid codec configuration (none or a compiled in codec)
+   */
+  static bool is_valid_codec(const std::string &name);
+
+  /*!
+   * value of the RBOX_METADATA_COMPRESSION attribute: <codec>[:<dict_id>]
+   */
+  static std::string to_marker(const std::string &name, uint32_t dict_id);
+  /*!
+   * @return false if marker is not valid.
+   */
+  static bool parse_marker(const std::string &marker, std::string *name, uint32_t *dict_id);
+  /*!
+   * train a zstd dictionary.
+   * @param[in] samples e.g. small mails
+   * @param[in] dict_size max. size of the dictionary
+   * @param[out] dict trained dictionary
+   * @param[out] dict_id id of the trained dictionary
+   * @return linux error code or 0 if sucessful
+   */
+  static int train_dict(std::list<librados::bufferlist> &samples, size_t dict_size, librados::bufferlist *dict,
+                        uint32_t *dict_id);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_COMPRESSION_H_
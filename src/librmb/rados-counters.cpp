@@ -0,0 +1,130 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-counters.h"
+
+#include <cmath>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+namespace librmb {
+
+// concurrent updates of the same counters, see RadosCounters::update
+#define RBOX_COUNTERS_MAX_RETRIES 32
+
+static int64_t counters_parse(const librados::bufferlist &value) {
+  std::string str = value.to_str();
+  try {
+    size_t pos = 0;
+    int64_t result = std::stoll(str, &pos);
+    if (pos == str.length()) {
+      return result;
+    }
+    // written by numops (older versions) as double, may be in scientific notation (>= 1e10)
+    return std::llround(std::stod(str));
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+static int64_t counters_get(const std::map<std::string, librados::bufferlist> &omap, const std::string &key) {
+  std::map<std::string, librados::bufferlist>::const_iterator it = omap.find(key);
+  return it != omap.end() ? counters_parse(it->second) : 0;
+}
+
+static void counters_add(const std::map<std::string, librados::bufferlist> &omap, const std::string &mailbox_guid,
+                         const RadosCounters &delta, std::map<std::string, librados::bufferlist> *values) {
+  std::string keys[] = {RadosCounters::get_key(mailbox_guid, RBOX_COUNTERS_MESSAGES),
+                        RadosCounters::get_key(mailbox_guid, RBOX_COUNTERS_BYTES),
+                        RadosCounters::get_key(mailbox_guid, RBOX_COUNTERS_ALT_BYTES)};
+  int64_t deltas[] = {delta.messages, delta.bytes, delta.alt_bytes};
+  for (int i = 0; i < 3; i++) {
+    if (deltas[i] != 0) {
+      (*values)[keys[i]].append(std::to_string(counters_get(omap, keys[i]) + deltas[i]));
+    }
+  }
+}
+
+int RadosCounters::update(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                          const RadosCounters &delta) {
+  if (delta.is_empty()) {
+    return 0;
+  }
+  std::set<std::string> keys;
+  for (const std::string &guid : {mailbox_guid, std::string()}) {
+    keys.insert(get_key(guid, RBOX_COUNTERS_MESSAGES));
+    keys.insert(get_key(guid, RBOX_COUNTERS_BYTES));
+    keys.insert(get_key(guid, RBOX_COUNTERS_ALT_BYTES));
+  }
+  int ret = -ECANCELED;
+  for (int i = 0; i < RBOX_COUNTERS_MAX_RETRIES && ret == -ECANCELED; i++) {
+    std::map<std::string, librados::bufferlist> omap;
+    ret = io_ctx->omap_get_vals_by_keys(oid, keys, &omap);
+    if (ret < 0 && ret != -ENOENT) {
+      return ret;
+    }
+    std::map<std::string, librados::bufferlist> values;
+    counters_add(omap, mailbox_guid, delta, &values);
+    if (!mailbox_guid.empty()) {
+      counters_add(omap, "", delta, &values);
+    }
+    // the values are written, if they have not been changed since they were read (missing keys compare as empty)
+    std::map<std::string, std::pair<librados::bufferlist, int>> assertions;
+    for (std::map<std::string, librados::bufferlist>::iterator it = values.begin(); it != values.end(); ++it) {
+      std::map<std::string, librados::bufferlist>::iterator read = omap.find(it->first);
+      assertions[it->first] =
+          std::make_pair(read != omap.end() ? read->second : librados::bufferlist(), LIBRADOS_CMPXATTR_OP_EQ);
+    }
+    int cmp_ret = 0;
+    librados::ObjectWriteOperation write_op;
+    write_op.create(false);
+    write_op.omap_cmp(assertions, &cmp_ret);
+    write_op.omap_set(values);
+    ret = io_ctx->operate(oid, &write_op);
+  }
+  return ret;
+}
+
+int RadosCounters::read(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                        RadosCounters *counters) {
+  std::set<std::string> keys;
+  keys.insert(get_key(mailbox_guid, RBOX_COUNTERS_MESSAGES));
+  keys.insert(get_key(mailbox_guid, RBOX_COUNTERS_BYTES));
+  keys.insert(get_key(mailbox_guid, RBOX_COUNTERS_ALT_BYTES));
+
+  std::map<std::string, librados::bufferlist> omap;
+  counters->clear();
+  int ret = io_ctx->omap_get_vals_by_keys(oid, keys, &omap);
+  if (ret == -ENOENT) {
+    // nothing has been counted yet
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  counters->messages = counters_get(omap, get_key(mailbox_guid, RBOX_COUNTERS_MESSAGES));
+  counters->bytes = counters_get(omap, get_key(mailbox_guid, RBOX_COUNTERS_BYTES));
+  counters->alt_bytes = counters_get(omap, get_key(mailbox_guid, RBOX_COUNTERS_ALT_BYTES));
+  return 0;
+}
+
+int RadosCounters::write(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                         const RadosCounters &counters) {
+  std::map<std::string, librados::bufferlist> omap;
+  omap[get_key(mailbox_guid, RBOX_COUNTERS_MESSAGES)].append(std::to_string(counters.messages));
+  omap[get_key(mailbox_guid, RBOX_COUNTERS_BYTES)].append(std::to_string(counters.bytes));
+  omap[get_key(mailbox_guid, RBOX_COUNTERS_ALT_BYTES)].append(std::to_string(counters.alt_bytes));
+  return io_ctx->omap_set(oid, omap);
+}
+
+}  // namespace librmb
@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_COUNTERS_H_
+#define SRC_LIBRMB_RADOS_COUNTERS_H_
+
+#include <stdint.h>
+#include <string>
+#include <rados/librados.hpp>
+
+/** the counters of a user are stored in <namespace of the user><suffix> (index pool) **/
+#define RBOX_COUNTERS_OID_SUFFIX "_counters"
+/** omap keys of the counters, the keys of a mailbox are prefixed with "<mailbox guid>." **/
+#define RBOX_COUNTERS_MESSAGES "messages"
+#define RBOX_COUNTERS_BYTES "bytes"
+#define RBOX_COUNTERS_ALT_BYTES "alt_bytes"
+
+namespace librmb {
+
+/**
+ * RadosCounters
+ *
+ * message count and size (physical size of the mails) of a mailbox or of all
+ * mailboxes of a user. bytes includes the mails in alt storage, alt_bytes is
+ * the part of it which is in alt storage.
+ *
+ * The counters are kept as exact int64 in the omap of one object per user. An
+ * update of a mailbox reads the mailbox and the user counters and writes the
+ * sums within one operation, guarded by omap_cmp, and is retried if another
+ * process changed them meanwhile. Values written by numops (older versions, doubles
+ * in scientific notation from 1e10 on) are still read.
+ */
+struct RadosCounters {
+  int64_t messages;
+  int64_t bytes;
+  int64_t alt_bytes;
+
+  RadosCounters() : messages(0), bytes(0), alt_bytes(0) {}
+
+  bool is_empty() const { return messages == 0 && bytes == 0 && alt_bytes == 0; }
+  void clear() { messages = bytes = alt_bytes = 0; }
+  RadosCounters &operator+=(const RadosCounters &other) {
+    messages += other.messages;
+    bytes += other.bytes;
+    alt_bytes += other.alt_bytes;
+    return *this;
+  }
+
+  /*!
+   * @param[in] ns namespace of the user
+   * @return oid of the counter object
+   */
+  static std::string get_oid(const std::string &ns) { return ns + RBOX_COUNTERS_OID_SUFFIX; }
+  /*!
+   * @param[in] mailbox_guid empty for the user counters
+   * @return omap key of the counter
+   */
+  static std::string get_key(const std::string &mailbox_guid, const std::string &name) {
+    return mailbox_guid.empty() ? name : mailbox_guid + "." + name;
+  }
+
+  /*!
+   * add delta to the counters of the mailbox and the user
+   * @return linux error code or 0 if sucessful (-ECANCELED if concurrent updates won all retries)
+   */
+  static int update(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                    const RadosCounters &delta);
+  /*!
+   * @param[in] mailbox_guid empty for the user counters
+   * @param[out] counters 0 if the counters do not exist yet
+   * @return linux error code or 0 if sucessful
+   */
+  static int read(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                  RadosCounters *counters);
+  /*!
+   * overwrite the counters (e.g. recalculated from the index), the other counters are not changed.
+   * @param[in] mailbox_guid empty for the user counters
+   * @return linux error code or 0 if sucessful
+   */
+  static int write(librados::IoCtx *io_ctx, const std::string &oid, const std::string &mailbox_guid,
+                   const RadosCounters &counters);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_COUNTERS_H_
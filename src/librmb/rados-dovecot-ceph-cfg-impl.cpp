@@ -19,6 +19,27 @@ RadosDovecotCephCfgImpl::RadosDovecotCephCfgImpl(librados::IoCtx *io_ctx_) {
 
 RadosDovecotCephCfgImpl::RadosDovecotCephCfgImpl(RadosConfig &dovecot_cfg_, RadosCephConfig &rados_cfg_) : dovecot_cfg(dovecot_cfg_), rados_cfg(rados_cfg_) {}
 
+RadosDovecotCephCfgImpl::~RadosDovecotCephCfgImpl() {
+  for (std::map<uint32_t, RadosCompressionDict *>::iterator it = compression_dicts.begin();
+       it != compression_dicts.end(); ++it) {
+    delete it->second;
+  }
+}
+
+RadosCompressionDict *RadosDovecotCephCfgImpl::load_compression_dict(uint32_t dict_id) {
+  std::map<uint32_t, RadosCompressionDict *>::iterator it = compression_dicts.find(dict_id);
+  if (it != compression_dicts.end()) {
+    return it->second;
+  }
+  librados::bufferlist buffer;
+  if (dict_id == 0 || rados_cfg.read_dict(dict_id, &buffer) < 0 || buffer.length() == 0) {
+    return nullptr;
+  }
+  RadosCompressionDict *dict = new RadosCompressionDict(dict_id, buffer);
+  compression_dicts[dict_id] = dict;
+  return dict;
+}
+
 
 int RadosDovecotCephCfgImpl::save_default_rados_config() {
   bool valid = rados_cfg.save_cfg() == 0 ? true : false;
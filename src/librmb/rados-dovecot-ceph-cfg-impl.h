@@ -26,7 +26,7 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
  public:
   explicit RadosDovecotCephCfgImpl(librados::IoCtx *io_ctx_);
   RadosDovecotCephCfgImpl(RadosConfig &dovecot_cfg_, RadosCephConfig &rados_cfg_);
-  virtual ~RadosDovecotCephCfgImpl() {}
+  virtual ~RadosDovecotCephCfgImpl();
 
   // dovecot config
 
@@ -34,11 +34,32 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
   const std::string &get_rados_username() override { return dovecot_cfg.get_rados_username(); }
   void update_pool_name_metadata(const char *value) override { dovecot_cfg.update_pool_name_metadata(value); }
   const std::string &get_rados_save_log_file() override { return dovecot_cfg.get_rados_save_log_file(); }
+  bool is_save_log_group_commit() override { return dovecot_cfg.is_save_log_group_commit(); }
+  int get_save_log_flush_size() override { return std::stoi(dovecot_cfg.get_save_log_flush_size()); }
+  int get_save_log_flush_interval() override { return std::stoi(dovecot_cfg.get_save_log_flush_interval()); }
+  bool is_save_log_fsync() override { return dovecot_cfg.is_save_log_fsync(); }
   const std::string &get_pool_name_metadata_key() override { return dovecot_cfg.get_pool_name_metadata_key(); }
  
   int get_write_method() override { return std::stoi(dovecot_cfg.get_write_method());}
 
   int get_chunk_size() override { return std::stoi(dovecot_cfg.get_chunk_size());}
+  int get_stream_watermark() override { return std::stoi(dovecot_cfg.get_stream_watermark());}
+  int get_save_inflight_window() override { return std::stoi(dovecot_cfg.get_save_inflight_window());}
+  int get_chunk_write_window() override { return std::stoi(dovecot_cfg.get_chunk_write_window());}
+  int get_header_read_size() override { return std::stoi(dovecot_cfg.get_header_read_size());}
+  int get_read_chunk_size() override { return std::stoi(dovecot_cfg.get_read_chunk_size());}
+  int get_read_ahead() override { return std::stoi(dovecot_cfg.get_read_ahead());}
+  int get_prefetch_window() override { return std::stoi(dovecot_cfg.get_prefetch_window());}
+  int get_mail_cache_size() override { return std::stoi(dovecot_cfg.get_mail_cache_size());}
+  const std::string &get_shared_cache_dir() override { return dovecot_cfg.get_shared_cache_dir(); }
+  uint64_t get_shared_cache_size() override { return std::stoull(dovecot_cfg.get_shared_cache_size()); }
+  const std::string &get_read_policy() override { return dovecot_cfg.get_read_policy(); }
+  int get_hedged_read_percentile() override { return std::stoi(dovecot_cfg.get_hedged_read_percentile()); }
+  int get_hedged_read_min_delay() override { return std::stoi(dovecot_cfg.get_hedged_read_min_delay()); }
+  int get_warmup_count() override { return std::stoi(dovecot_cfg.get_warmup_count()); }
+  bool is_warmup_headers() override { return dovecot_cfg.is_warmup_headers(); }
+  int get_pop3_preload_window() override { return std::stoi(dovecot_cfg.get_pop3_preload_window()); }
+  bool is_mailbox_counters() override { return dovecot_cfg.is_mailbox_counters(); }
   std::string &get_pool_name() override { return dovecot_cfg.get_pool_name(); }
   std::string &get_index_pool_name() override { return dovecot_cfg.get_index_pool_name(); };
 
@@ -50,6 +71,7 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
   bool is_ceph_posix_bugfix_enabled() override { return dovecot_cfg.is_ceph_posix_bugfix_enabled(); }
   bool is_ceph_aio_wait_for_safe_and_cb() override { return dovecot_cfg.is_ceph_aio_wait_for_safe_and_cb(); }
   bool is_write_chunks() override { return dovecot_cfg.is_write_chunks(); }
+  bool is_verify_checksum() override { return dovecot_cfg.is_verify_checksum(); }
   
   // rados config
   bool is_user_mapping() override { return rados_cfg.is_user_mapping(); }
@@ -88,6 +110,15 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
 
   const std::string &get_metadata_storage_module() override { return rados_cfg.get_metadata_storage_module(); };
   const std::string &get_metadata_storage_attribute() override { return rados_cfg.get_metadata_storage_attribute(); };
+  RadosCompression *get_compression() override { return RadosCompression::get_codec(rados_cfg.get_compression()); }
+  int get_compression_level() override { return rados_cfg.get_compression_level(); }
+  uint32_t get_compression_dict_id() override { return rados_cfg.get_compression_dict_id(); }
+  uint64_t get_compression_dict_mail_size() override { return rados_cfg.get_compression_dict_mail_size(); }
+  RadosCompressionDict *load_compression_dict(uint32_t dict_id) override;
+  bool is_single_instance() override { return rados_cfg.is_single_instance(); }
+  uint64_t get_single_instance_min_size() override { return rados_cfg.get_single_instance_min_size(); }
+  bool is_striping() override { return rados_cfg.is_striping(); }
+  uint64_t get_stripe_size() override { return rados_cfg.get_stripe_size(); }
 
   const std::string &get_mail_attributes_key() override { return rados_cfg.get_mail_attribute_key(); }
   const std::string &get_updateable_attributes_key() override { return rados_cfg.get_updateable_attribute_key(); }
@@ -115,6 +146,7 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
  private:
   RadosConfig dovecot_cfg;
   RadosCephConfig rados_cfg;
+  std::map<uint32_t, RadosCompressionDict *> compression_dicts;
 };
 
 } /* namespace librmb */
@@ -15,6 +15,7 @@
 #include <string>
 #include <map>
 #include "rados-storage.h"
+#include "rados-compression.h"
 namespace librmb {
 
 /**
@@ -32,6 +33,13 @@ class RadosDovecotCephCfg {
   virtual const std::string &get_rados_cluster_name() = 0;
   virtual const std::string &get_rados_username() = 0;
   virtual const std::string &get_rados_save_log_file() = 0;
+  /*!
+   * @return true if the save log is written in the binary group commit format (rados_save_log_format=binary)
+   */
+  virtual bool is_save_log_group_commit() = 0;
+  virtual int get_save_log_flush_size() = 0;
+  virtual int get_save_log_flush_interval() = 0;
+  virtual bool is_save_log_fsync() = 0;
   virtual bool is_mail_attribute(enum rbox_metadata_key key) = 0;
   virtual bool is_updateable_attribute(enum rbox_metadata_key key) = 0;
   virtual void set_update_attributes(const std::string &update_attributes_) = 0;
@@ -41,7 +49,77 @@ class RadosDovecotCephCfg {
   virtual bool is_ceph_posix_bugfix_enabled() = 0;
   virtual bool is_ceph_aio_wait_for_safe_and_cb() = 0;
   virtual bool is_write_chunks() = 0;
+  /*!
+   * @return true if the crc32c of a mail is verified when it is read (rbox_verify_checksum)
+   */
+  virtual bool is_verify_checksum() = 0;
   virtual int get_chunk_size() = 0;
+  virtual int get_stream_watermark() = 0;
+  virtual int get_save_inflight_window() = 0;
+  virtual int get_chunk_write_window() = 0;
+  /*!
+   * @return number of bytes read if only the header of a mail is requested (rbox_header_read_size),
+   *         0 to always read the whole mail.
+   */
+  virtual int get_header_read_size() = 0;
+  /*!
+   * @return chunk size of mails read on demand (rbox_read_chunk_size), 0 to read mails at once.
+   */
+  virtual int get_read_chunk_size() = 0;
+  /*!
+   * @return number of chunks read ahead (rbox_read_ahead)
+   */
+  virtual int get_read_ahead() = 0;
+  /*!
+   * @return max. number of mails prefetched async (rbox_prefetch_window), 0 to disable prefetching.
+   */
+  virtual int get_prefetch_window() = 0;
+  /*!
+   * @return size of the process local mail cache in bytes (rbox_mail_cache_size), 0 to disable it.
+   */
+  virtual int get_mail_cache_size() = 0;
+  /*!
+   * @return directory of the mail cache shared by the processes of the host (rbox_shared_cache_dir),
+   *         empty if disabled.
+   */
+  virtual const std::string &get_shared_cache_dir() = 0;
+  /*!
+   * @return size of the shared mail cache in bytes (rbox_shared_cache_size)
+   */
+  virtual uint64_t get_shared_cache_size() = 0;
+  /*!
+   * @return replicas to read from (rbox_read_policy): primary, balance or localize
+   */
+  virtual const std::string &get_read_policy() = 0;
+  /*!
+   * @return percentile of the read latency, after which a hedged read is sent to a replica
+   *         (rbox_hedged_read_percentile), 0 if disabled.
+   */
+  virtual int get_hedged_read_percentile() = 0;
+  /*!
+   * @return min. delay of a hedged read in ms (rbox_hedged_read_min_delay)
+   */
+  virtual int get_hedged_read_min_delay() = 0;
+  /*!
+   * @return number of the newest mails of the INBOX, which are read async when it is opened
+   *         (rbox_warmup_count), 0 if disabled.
+   */
+  virtual int get_warmup_count() = 0;
+  /*!
+   * @return true if the warmup reads the header and the metadata, false for the metadata only
+   *         (rbox_warmup_headers)
+   */
+  virtual bool is_warmup_headers() = 0;
+  /*!
+   * @return max. number of concurrent metadata reads of a POP3 session (rbox_pop3_preload_window),
+   *         0 reads the metadata mail by mail.
+   */
+  virtual int get_pop3_preload_window() = 0;
+  /*!
+   * @return true if the message and byte counters of the mailboxes and the user are maintained
+   *         (rbox_mailbox_counters)
+   */
+  virtual bool is_mailbox_counters() = 0;
   virtual int get_write_method() = 0;
 
   virtual int get_object_search_method()  = 0;
@@ -54,6 +132,37 @@ class RadosDovecotCephCfg {
 
   virtual const std::string &get_metadata_storage_module() = 0;
   virtual const std::string &get_metadata_storage_attribute() = 0;
+  /*!
+   * @return codec configured for the pool (rbox_compression) or nullptr if mails are not compressed.
+   */
+  virtual RadosCompression *get_compression() = 0;
+  virtual int get_compression_level() = 0;
+  /*!
+   * @return id of the current compression dictionary or 0 if no dictionary is configured.
+   */
+  virtual uint32_t get_compression_dict_id() = 0;
+  /*!
+   * @return mails up to this size are compressed with the dictionary
+   */
+  virtual uint64_t get_compression_dict_mail_size() = 0;
+  /*!
+   * load (and cache) a compression dictionary.
+   * @return the dictionary or nullptr if it does not exist, don't delete it.
+   */
+  virtual RadosCompressionDict *load_compression_dict(uint32_t dict_id) = 0;
+  /*!
+   * @return true if mail bodies are stored once per pool (rbox_single_instance)
+   */
+  virtual bool is_single_instance() = 0;
+  virtual uint64_t get_single_instance_min_size() = 0;
+  /*!
+   * @return true if mails larger than the stripe size are split into stripe objects (rbox_striping)
+   */
+  virtual bool is_striping() = 0;
+  /*!
+   * @return size of one stripe, 0 to use osd_max_object_size
+   */
+  virtual uint64_t get_stripe_size() = 0;
 
   virtual std::map<std::string, std::string> *get_config() = 0;
 
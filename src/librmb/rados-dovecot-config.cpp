@@ -26,10 +26,32 @@ RadosConfig::RadosConfig()
       prefix_keyword("k"),
       bugfix_cephfs_posix_hardlinks("rbox_bugfix_cephfs_21652"),
       save_log("rados_save_log"),
+      save_log_format("rados_save_log_format"),
+      save_log_flush_size("rados_save_log_flush_size"),
+      save_log_flush_interval("rados_save_log_flush_interval"),
+      save_log_fsync("rados_save_log_fsync"),
       rbox_check_empty_mailboxes("rados_check_empty_mailboxes"),
       rbox_ceph_aio_wait_for_safe_and_cb("rbox_ceph_aio_wait_for_safe_and_cb"),
       rbox_ceph_write_chunks("rbox_ceph_write_chunks"),
       rbox_chunk_size("rbox_chunk_size"),
+      rbox_stream_watermark("rbox_stream_watermark"),
+      rbox_save_inflight_window("rbox_save_inflight_window"),
+      rbox_chunk_write_window("rbox_chunk_write_window"),
+      rbox_verify_checksum("rbox_verify_checksum"),
+      rbox_header_read_size("rbox_header_read_size"),
+      rbox_read_chunk_size("rbox_read_chunk_size"),
+      rbox_read_ahead("rbox_read_ahead"),
+      rbox_prefetch_window("rbox_prefetch_window"),
+      rbox_mail_cache_size("rbox_mail_cache_size"),
+      rbox_shared_cache_dir("rbox_shared_cache_dir"),
+      rbox_shared_cache_size("rbox_shared_cache_size"),
+      rbox_read_policy("rbox_read_policy"),
+      rbox_hedged_read_percentile("rbox_hedged_read_percentile"),
+      rbox_hedged_read_min_delay("rbox_hedged_read_min_delay"),
+      rbox_warmup_count("rbox_warmup_count"),
+      rbox_warmup_headers("rbox_warmup_headers"),
+      rbox_pop3_preload_window("rbox_pop3_preload_window"),
+      rbox_mailbox_counters("rbox_mailbox_counters"),
       rbox_write_method("rbox_write_method"),
       rbox_object_search_method("rbox_object_search_method"),
       rbox_object_search_threads("rbox_object_search_threads") {
@@ -41,10 +63,32 @@ RadosConfig::RadosConfig()
   config[rados_username] = "client.admin";
   config[bugfix_cephfs_posix_hardlinks] = "false";
   config[save_log] = "";
+  config[save_log_format] = "csv";
+  config[save_log_flush_size] = "65536";
+  config[save_log_flush_interval] = "1000";
+  config[save_log_fsync] = "false";
   config[rbox_check_empty_mailboxes] = "false";
   config[rbox_ceph_aio_wait_for_safe_and_cb] = "false";
   config[rbox_ceph_write_chunks] = "false";
   config[rbox_chunk_size] = "10240";
+  config[rbox_stream_watermark] = "0";
+  config[rbox_save_inflight_window] = "0";
+  config[rbox_chunk_write_window] = "8";
+  config[rbox_verify_checksum] = "false";
+  config[rbox_header_read_size] = "0";
+  config[rbox_read_chunk_size] = "0";
+  config[rbox_read_ahead] = "2";
+  config[rbox_prefetch_window] = "16";
+  config[rbox_mail_cache_size] = "16777216";
+  config[rbox_shared_cache_dir] = "";
+  config[rbox_shared_cache_size] = "1073741824";
+  config[rbox_read_policy] = "primary";
+  config[rbox_hedged_read_percentile] = "0";
+  config[rbox_hedged_read_min_delay] = "20";
+  config[rbox_warmup_count] = "0";
+  config[rbox_warmup_headers] = "true";
+  config[rbox_pop3_preload_window] = "64";
+  config[rbox_mailbox_counters] = "false";
   config[rbox_write_method] = "0";
   config[rbox_object_search_method] = "0";
   config[rbox_object_search_threads] = "4";
@@ -83,11 +127,33 @@ std::string RadosConfig::to_string() {
   ss << "  " << rados_username << "=" << config[rados_username] << std::endl;
   ss << "  " << bugfix_cephfs_posix_hardlinks << "=" << config[bugfix_cephfs_posix_hardlinks] << std::endl;
   ss << "  " << save_log << "=" << config[save_log] << std::endl;
+  ss << "  " << save_log_format << "=" << config[save_log_format] << std::endl;
+  ss << "  " << save_log_flush_size << "=" << config[save_log_flush_size] << std::endl;
+  ss << "  " << save_log_flush_interval << "=" << config[save_log_flush_interval] << std::endl;
+  ss << "  " << save_log_fsync << "=" << config[save_log_fsync] << std::endl;
   ss << "  " << rbox_check_empty_mailboxes << "=" << config[rbox_check_empty_mailboxes] << std::endl;
   ss << "  " << rbox_ceph_aio_wait_for_safe_and_cb << "=" << config[rbox_ceph_aio_wait_for_safe_and_cb] << std::endl;
   ss << "  " << rbox_ceph_write_chunks << "=" << config[rbox_ceph_write_chunks] << std::endl;
   ss << "  " << rbox_write_method << "=" << config[rbox_write_method] << std::endl;
   ss << "  " << rbox_chunk_size << "=" << config[rbox_chunk_size] << std::endl;
+  ss << "  " << rbox_stream_watermark << "=" << config[rbox_stream_watermark] << std::endl;
+  ss << "  " << rbox_save_inflight_window << "=" << config[rbox_save_inflight_window] << std::endl;
+  ss << "  " << rbox_chunk_write_window << "=" << config[rbox_chunk_write_window] << std::endl;
+  ss << "  " << rbox_verify_checksum << "=" << config[rbox_verify_checksum] << std::endl;
+  ss << "  " << rbox_header_read_size << "=" << config[rbox_header_read_size] << std::endl;
+  ss << "  " << rbox_read_chunk_size << "=" << config[rbox_read_chunk_size] << std::endl;
+  ss << "  " << rbox_read_ahead << "=" << config[rbox_read_ahead] << std::endl;
+  ss << "  " << rbox_prefetch_window << "=" << config[rbox_prefetch_window] << std::endl;
+  ss << "  " << rbox_mail_cache_size << "=" << config[rbox_mail_cache_size] << std::endl;
+  ss << "  " << rbox_shared_cache_dir << "=" << config[rbox_shared_cache_dir] << std::endl;
+  ss << "  " << rbox_shared_cache_size << "=" << config[rbox_shared_cache_size] << std::endl;
+  ss << "  " << rbox_read_policy << "=" << config[rbox_read_policy] << std::endl;
+  ss << "  " << rbox_hedged_read_percentile << "=" << config[rbox_hedged_read_percentile] << std::endl;
+  ss << "  " << rbox_hedged_read_min_delay << "=" << config[rbox_hedged_read_min_delay] << std::endl;
+  ss << "  " << rbox_warmup_count << "=" << config[rbox_warmup_count] << std::endl;
+  ss << "  " << rbox_warmup_headers << "=" << config[rbox_warmup_headers] << std::endl;
+  ss << "  " << rbox_pop3_preload_window << "=" << config[rbox_pop3_preload_window] << std::endl;
+  ss << "  " << rbox_mailbox_counters << "=" << config[rbox_mailbox_counters] << std::endl;
   ss << "  " << rbox_object_search_method << "=" << config[rbox_object_search_method] << std::endl;
   ss << "  " << rbox_object_search_threads << "=" << config[rbox_object_search_threads] << std::endl;
   
@@ -39,6 +39,10 @@ class RadosConfig {
   std::string &get_index_pool_name() { return config[index_pool_name]; };
 
   const std::string &get_rados_save_log_file() { return config[save_log]; }
+  bool is_save_log_group_commit() { return config[save_log_format].compare("binary") == 0 ? true : false; }
+  const std::string &get_save_log_flush_size() { return config[save_log_flush_size]; }
+  const std::string &get_save_log_flush_interval() { return config[save_log_flush_interval]; }
+  bool is_save_log_fsync() { return config[save_log_fsync].compare("true") == 0 ? true : false; }
   bool is_config_valid() { return is_valid; }
   void set_config_valid(bool is_valid_) { this->is_valid = is_valid_; }
 
@@ -48,6 +52,23 @@ class RadosConfig {
 
   const std::string &get_write_method() { return config[rbox_write_method]; }
   const std::string &get_chunk_size() { return config[rbox_chunk_size]; }
+  const std::string &get_stream_watermark() { return config[rbox_stream_watermark]; }
+  const std::string &get_save_inflight_window() { return config[rbox_save_inflight_window]; }
+  const std::string &get_chunk_write_window() { return config[rbox_chunk_write_window]; }
+  const std::string &get_header_read_size() { return config[rbox_header_read_size]; }
+  const std::string &get_read_chunk_size() { return config[rbox_read_chunk_size]; }
+  const std::string &get_read_ahead() { return config[rbox_read_ahead]; }
+  const std::string &get_prefetch_window() { return config[rbox_prefetch_window]; }
+  const std::string &get_mail_cache_size() { return config[rbox_mail_cache_size]; }
+  const std::string &get_shared_cache_dir() { return config[rbox_shared_cache_dir]; }
+  const std::string &get_shared_cache_size() { return config[rbox_shared_cache_size]; }
+  const std::string &get_read_policy() { return config[rbox_read_policy]; }
+  const std::string &get_hedged_read_percentile() { return config[rbox_hedged_read_percentile]; }
+  const std::string &get_hedged_read_min_delay() { return config[rbox_hedged_read_min_delay]; }
+  const std::string &get_warmup_count() { return config[rbox_warmup_count]; }
+  bool is_warmup_headers() { return config[rbox_warmup_headers].compare("true") == 0 ? true : false; }
+  const std::string &get_pop3_preload_window() { return config[rbox_pop3_preload_window]; }
+  bool is_mailbox_counters() { return config[rbox_mailbox_counters].compare("true") == 0 ? true : false; }
 
   const std::string &get_rbox_cluster_name() { return config[rbox_cluster_name]; }
   const std::string &get_rados_username() { return config[rados_username]; }
@@ -69,6 +90,9 @@ class RadosConfig {
   bool is_write_chunks() {
     return config[rbox_ceph_write_chunks].compare("true") == 0 ? true : false;
   }
+  bool is_verify_checksum() {
+    return config[rbox_verify_checksum].compare("true") == 0 ? true : false;
+  }
 
   /*!
    * print configuration
@@ -88,10 +112,32 @@ class RadosConfig {
   std::string prefix_keyword;
   std::string bugfix_cephfs_posix_hardlinks;
   std::string save_log;
+  std::string save_log_format;
+  std::string save_log_flush_size;
+  std::string save_log_flush_interval;
+  std::string save_log_fsync;
   std::string rbox_check_empty_mailboxes;
   std::string rbox_ceph_aio_wait_for_safe_and_cb;
   std::string rbox_ceph_write_chunks;
   std::string rbox_chunk_size;
+  std::string rbox_stream_watermark;
+  std::string rbox_save_inflight_window;
+  std::string rbox_chunk_write_window;
+  std::string rbox_verify_checksum;
+  std::string rbox_header_read_size;
+  std::string rbox_read_chunk_size;
+  std::string rbox_read_ahead;
+  std::string rbox_prefetch_window;
+  std::string rbox_mail_cache_size;
+  std::string rbox_shared_cache_dir;
+  std::string rbox_shared_cache_size;
+  std::string rbox_read_policy;
+  std::string rbox_hedged_read_percentile;
+  std::string rbox_hedged_read_min_delay;
+  std::string rbox_warmup_count;
+  std::string rbox_warmup_headers;
+  std::string rbox_pop3_preload_window;
+  std::string rbox_mailbox_counters;
   std::string rbox_write_method;
   std::string rbox_object_search_method;
   std::string rbox_object_search_threads;
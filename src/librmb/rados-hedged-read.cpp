@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-hedged-read.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+
+namespace librmb {
+
+RadosReadLatency &RadosReadLatency::get_instance() {
+  static RadosReadLatency instance;
+  return instance;
+}
+
+void RadosReadLatency::add(uint64_t latency_us) {
+  std::lock_guard<std::mutex> lock(mutex);
+  latencies[next] = latency_us;
+  next = (next + 1) % SAMPLES;
+  if (count < SAMPLES) {
+    count++;
+  }
+}
+
+uint64_t RadosReadLatency::get_deadline(int percentile, uint64_t min_us) {
+  uint64_t sorted[SAMPLES];
+  unsigned int n;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    n = count;
+    std::copy(latencies, latencies + n, sorted);
+  }
+  if (n < MIN_SAMPLES) {
+    return min_us;
+  }
+  unsigned int index = std::min(n - 1, n * std::min(std::max(percentile, 1), 100) / 100);
+  std::nth_element(sorted, sorted + index, sorted + n);
+  return std::max(sorted[index], min_us);
+}
+
+struct RadosHedgedRead::Read {
+  RadosHedgedRead::Shared *shared;
+  int index;
+  librados::AioCompletion *completion;
+  std::function<void()> cleanup;
+  bool complete;
+  bool taken;
+  int ret;
+};
+
+struct RadosHedgedRead::Shared {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<Read *> reads;
+  // index of the first complete read or -1
+  int first;
+  // the owner is gone, the callbacks free the reads
+  bool abandoned;
+  // owner and reads in flight
+  int refs;
+};
+
+RadosHedgedRead::RadosHedgedRead() : shared(new Shared()) {
+  shared->first = -1;
+  shared->abandoned = false;
+  shared->refs = 1;
+}
+
+RadosHedgedRead::~RadosHedgedRead() {
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  shared->abandoned = true;
+  for (Read *read : shared->reads) {
+    if (!read->complete) {
+      // released by complete_callback
+      continue;
+    }
+    if (!read->taken && read->cleanup) {
+      read->cleanup();
+    }
+    if (read->completion != nullptr) {
+      read->completion->release();
+    }
+    delete read;
+    shared->refs--;
+  }
+  bool last = --shared->refs == 0;
+  lock.unlock();
+  if (last) {
+    delete shared;
+  }
+}
+
+librados::AioCompletion *RadosHedgedRead::add_read(const std::function<void()> &cleanup) {
+  Read *read = new Read();
+  read->shared = shared;
+  read->cleanup = cleanup;
+  read->complete = false;
+  read->taken = false;
+  read->ret = 0;
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  read->index = shared->reads.size();
+  read->completion = librados::Rados::aio_create_completion(read, complete_callback, nullptr);
+  shared->reads.push_back(read);
+  shared->refs++;
+  return read->completion;
+}
+
+void RadosHedgedRead::cancel(int index) {
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  Read *read = shared->reads[index];
+  // the callback is never called
+  read->completion->release();
+  read->completion = nullptr;
+  read->complete = true;
+  read->taken = true;
+  read->ret = -ECANCELED;
+}
+
+void RadosHedgedRead::complete_callback(librados::completion_t, void *arg) {
+  Read *read = reinterpret_cast<Read *>(arg);
+  Shared *shared = read->shared;
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  read->ret = read->completion->get_return_value();
+  read->complete = true;
+  if (shared->first < 0) {
+    shared->first = read->index;
+  }
+  shared->cond.notify_all();
+  if (!shared->abandoned) {
+    return;
+  }
+  // the data is not needed anymore
+  if (read->cleanup) {
+    read->cleanup();
+  }
+  read->completion->release();
+  delete read;
+  bool last = --shared->refs == 0;
+  lock.unlock();
+  if (last) {
+    delete shared;
+  }
+}
+
+int RadosHedgedRead::wait_any(int64_t timeout_us) {
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  if (timeout_us < 0) {
+    shared->cond.wait(lock, [this] { return shared->first >= 0; });
+  } else {
+    shared->cond.wait_for(lock, std::chrono::microseconds(timeout_us), [this] { return shared->first >= 0; });
+  }
+  return shared->first;
+}
+
+int RadosHedgedRead::wait(int index) {
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  Read *read = shared->reads[index];
+  shared->cond.wait(lock, [read] { return read->complete; });
+  return read->ret;
+}
+
+void RadosHedgedRead::take(int index) {
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  shared->reads[index]->taken = true;
+}
+
+}  // namespace librmb
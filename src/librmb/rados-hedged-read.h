@@ -0,0 +1,107 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_HEDGED_READ_H_
+#define SRC_LIBRMB_RADOS_HEDGED_READ_H_
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * RadosReadLatency
+ *
+ * Latencies of the last reads of this process, used to find the deadline of
+ * a hedged read.
+ */
+class RadosReadLatency {
+ public:
+  RadosReadLatency() : count(0), next(0) {}
+  virtual ~RadosReadLatency() {}
+
+  /*!
+   * @return the latencies of this process
+   */
+  static RadosReadLatency &get_instance();
+
+  void add(uint64_t latency_us);
+  /*!
+   * @param[in] percentile 1-100
+   * @param[in] min_us lower bound, returned until enough latencies are known.
+   * @return the percentile of the last latencies in us.
+   */
+  uint64_t get_deadline(int percentile, uint64_t min_us);
+
+ private:
+  static const unsigned int SAMPLES = 256;
+  static const unsigned int MIN_SAMPLES = 32;
+
+  std::mutex mutex;
+  uint64_t latencies[SAMPLES];
+  unsigned int count;
+  unsigned int next;
+};
+
+/**
+ * RadosHedgedRead
+ *
+ * Waits for the first of several async reads of the same data, e.g. the read
+ * of the primary and a duplicate read of a replica, which is sent if the
+ * first one is late.
+ *
+ * Reads, which are still in flight when the object is destroyed, are
+ * abandoned: once librados completes them, their completion is released and
+ * their cleanup is called (in a librados thread).
+ */
+class RadosHedgedRead {
+ public:
+  RadosHedgedRead();
+  virtual ~RadosHedgedRead();
+
+  /*!
+   * @param[in] cleanup frees the outputs (buffers, return values) of the read, if it is not taken.
+   * @return completion of the next read, owned by this object.
+   */
+  librados::AioCompletion *add_read(const std::function<void()> &cleanup);
+  /*!
+   * the read could not be sent, the caller keeps its outputs.
+   */
+  void cancel(int index);
+  /*!
+   * wait until one of the reads is complete.
+   * @param[in] timeout_us < 0 waits without a timeout
+   * @return index of the first complete read (in add_read order), -1 on timeout.
+   */
+  int wait_any(int64_t timeout_us);
+  /*!
+   * @return linux error code or number of bytes read.
+   */
+  int wait(int index);
+  /*!
+   * the caller uses the outputs of this read, its cleanup is not called.
+   */
+  void take(int index);
+
+ private:
+  struct Read;
+  struct Shared;
+  static void complete_callback(librados::completion_t cb, void *arg);
+
+  Shared *shared;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_HEDGED_READ_H_
@@ -0,0 +1,117 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-mail-cache.h"
+
+namespace librmb {
+
+RadosMailCache &RadosMailCache::get_instance() {
+  static RadosMailCache instance;
+  return instance;
+}
+
+void RadosMailCache::set_capacity(uint64_t capacity_) {
+  std::lock_guard<std::mutex> lock(mutex);
+  capacity = capacity_;
+  evict(capacity);
+}
+
+uint64_t RadosMailCache::get_capacity() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return capacity;
+}
+
+uint64_t RadosMailCache::get_size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return size;
+}
+
+bool RadosMailCache::get(const std::string &key, librados::bufferlist *data, time_t *save_date) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, lru_list::iterator>::iterator it = entries.find(key);
+    if (it != entries.end()) {
+      lru.splice(lru.begin(), lru, it->second);
+      data->clear();
+      data->append(it->second->second.data);
+      *save_date = it->second->second.save_date;
+      return true;
+    }
+  }
+  if (file_cache == nullptr || !file_cache->get(key, data, save_date)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  put_entry(key, *data, *save_date);
+  return true;
+}
+
+void RadosMailCache::put(const std::string &key, const librados::bufferlist &data, time_t save_date) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    put_entry(key, data, save_date);
+  }
+  if (file_cache != nullptr) {
+    file_cache->put(key, data, save_date);
+  }
+}
+
+void RadosMailCache::put_entry(const std::string &key, const librados::bufferlist &data, time_t save_date) {
+  if (capacity == 0 || data.length() == 0 || data.length() > capacity / 4) {
+    return;
+  }
+  std::map<std::string, lru_list::iterator>::iterator it = entries.find(key);
+  if (it != entries.end()) {
+    // objects are immutable, it is the same mail
+    lru.splice(lru.begin(), lru, it->second);
+    return;
+  }
+  evict(capacity - data.length());
+
+  Entry entry;
+  entry.data = data;
+  entry.save_date = save_date;
+  lru.push_front(std::make_pair(key, entry));
+  entries[key] = lru.begin();
+  size += data.length();
+}
+
+void RadosMailCache::remove(const std::string &key) {
+  if (file_cache != nullptr) {
+    file_cache->remove(key);
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, lru_list::iterator>::iterator it = entries.find(key);
+  if (it == entries.end()) {
+    return;
+  }
+  size -= it->second->second.data.length();
+  lru.erase(it->second);
+  entries.erase(it);
+}
+
+void RadosMailCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  lru.clear();
+  entries.clear();
+  size = 0;
+}
+
+/* drop the least recently used mails until the cache is not larger than max_size */
+void RadosMailCache::evict(uint64_t max_size) {
+  while (size > max_size && !lru.empty()) {
+    size -= lru.back().second.data.length();
+    entries.erase(lru.back().first);
+    lru.pop_back();
+  }
+}
+
+}  // namespace librmb
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_MAIL_CACHE_H_
+#define SRC_LIBRMB_RADOS_MAIL_CACHE_H_
+
+#include <time.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <rados/librados.hpp>
+#include "rados-mail-file-cache.h"
+
+namespace librmb {
+
+/**
+ * RadosMailCache
+ *
+ * Process local LRU cache of mails. Mail objects are immutable after save, so
+ * entries are never revalidated, they are only removed on expunge. The cache
+ * holds the mail as it is streamed to dovecot (uncompressed and complete) and
+ * is bounded by the sum of the mail sizes.
+ *
+ * If a file cache is set, it is the second level: misses are looked up there,
+ * mails are added to and removed from both.
+ */
+class RadosMailCache {
+ public:
+  explicit RadosMailCache(uint64_t capacity_ = 0) : capacity(capacity_), size(0), file_cache(nullptr) {}
+  virtual ~RadosMailCache() {}
+
+  /*!
+   * @return the cache of this process
+   */
+  static RadosMailCache &get_instance();
+  /*!
+   * @return cache key of a mail object
+   */
+  static std::string get_key(const std::string &pool, const std::string &ns, const std::string &oid) {
+    return pool + "/" + ns + "/" + oid;
+  }
+
+  /*!
+   * set the max. size of all cached mails in bytes, 0 disables the cache.
+   */
+  void set_capacity(uint64_t capacity_);
+  uint64_t get_capacity();
+  /*!
+   * @param[in] file_cache_ node local cache shared with other processes or nullptr
+   */
+  void set_file_cache(RadosMailFileCache *file_cache_) { file_cache = file_cache_; }
+  /*!
+   * @return size of all cached mails in bytes
+   */
+  uint64_t get_size();
+  /*!
+   * @param[out] data the mail, shares the buffers of the cache entry.
+   * @return false if the mail is not cached.
+   */
+  bool get(const std::string &key, librados::bufferlist *data, time_t *save_date);
+  /*!
+   * add the mail, mails larger than a quarter of the capacity are not cached.
+   */
+  void put(const std::string &key, const librados::bufferlist &data, time_t save_date);
+  void remove(const std::string &key);
+  void clear();
+
+ private:
+  struct Entry {
+    librados::bufferlist data;
+    time_t save_date;
+  };
+  typedef std::list<std::pair<std::string, Entry>> lru_list;
+
+  void evict(uint64_t max_size);
+  void put_entry(const std::string &key, const librados::bufferlist &data, time_t save_date);
+
+  uint64_t capacity;
+  uint64_t size;
+  // most recently used first
+  lru_list lru;
+  std::map<std::string, lru_list::iterator> entries;
+  std::mutex mutex;
+  RadosMailFileCache *file_cache;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_MAIL_CACHE_H_
@@ -0,0 +1,391 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-mail-file-cache.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#define RBOX_MAIL_FILE_CACHE_MAGIC 0x52424d43  // RBMC
+#define RBOX_MAIL_FILE_CACHE_VERSION 2
+#define RBOX_MAIL_FILE_CACHE_INDEX "index"
+#define RBOX_MAIL_FILE_CACHE_TMP_PREFIX "tmp."
+// the hash table of the index is sized for mails of this size on average
+#define RBOX_MAIL_FILE_CACHE_MAIL_SIZE 8192
+#define RBOX_MAIL_FILE_CACHE_MIN_ENTRIES 1024
+#define RBOX_MAIL_FILE_CACHE_MAX_ENTRIES (1 << 24)
+
+namespace librmb {
+
+/* header of each cached mail file */
+struct RadosMailFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  int64_t save_date;
+};
+
+RadosMailFileCache::RadosMailFileCache() : capacity(0), index_fd(-1), index(nullptr), index_size(0) {}
+
+RadosMailFileCache::~RadosMailFileCache() { close(); }
+
+RadosMailFileCache &RadosMailFileCache::get_instance() {
+  static RadosMailFileCache instance;
+  return instance;
+}
+
+bool RadosMailFileCache::open(const std::string &directory_, uint64_t capacity_) {
+  close();
+  if (directory_.empty() || capacity_ == 0) {
+    return false;
+  }
+  if (mkdir(directory_.c_str(), 0770) < 0 && errno != EEXIST) {
+    return false;
+  }
+  std::string index_path = directory_ + "/" + RBOX_MAIL_FILE_CACHE_INDEX;
+  int fd = ::open(index_path.c_str(), O_RDWR | O_CREAT, 0660);
+  if (fd < 0) {
+    return false;
+  }
+  flock(fd, LOCK_EX);
+  struct stat st;
+  if (fstat(fd, &st) < 0 || ((size_t)st.st_size < sizeof(Index) && ftruncate(fd, sizeof(Index)) < 0)) {
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return false;
+  }
+  void *addr = mmap(nullptr, sizeof(Index), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return false;
+  }
+  Index *header = reinterpret_cast<Index *>(addr);
+  uint32_t entry_count = header->entry_count;
+  bool valid = header->magic == RBOX_MAIL_FILE_CACHE_MAGIC && header->version == RBOX_MAIL_FILE_CACHE_VERSION &&
+               entry_count > 0 && (size_t)st.st_size >= get_index_size(entry_count);
+  munmap(addr, sizeof(Index));
+  if (!valid) {
+    // new or incompatible index: the cached files are unknown, start empty
+    entry_count = std::min<uint64_t>(
+        std::max<uint64_t>(capacity_ / RBOX_MAIL_FILE_CACHE_MAIL_SIZE, RBOX_MAIL_FILE_CACHE_MIN_ENTRIES),
+        RBOX_MAIL_FILE_CACHE_MAX_ENTRIES);
+    remove_files(directory_);
+    // the entries are zeroed (free)
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, get_index_size(entry_count)) < 0) {
+      flock(fd, LOCK_UN);
+      ::close(fd);
+      return false;
+    }
+  }
+  size_t size = get_index_size(entry_count);
+  addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return false;
+  }
+  Index *index_ = reinterpret_cast<Index *>(addr);
+  if (!valid) {
+    index_->size.store(0);
+    index_->entry_count = entry_count;
+    index_->used = 0;
+    index_->clock = 0;
+    index_->version = RBOX_MAIL_FILE_CACHE_VERSION;
+    index_->magic = RBOX_MAIL_FILE_CACHE_MAGIC;
+  }
+  flock(fd, LOCK_UN);
+
+  directory = directory_;
+  capacity = capacity_;
+  index_fd = fd;
+  index = index_;
+  index_size = size;
+  return true;
+}
+
+void RadosMailFileCache::close() {
+  if (index != nullptr) {
+    munmap(index, index_size);
+    index = nullptr;
+  }
+  if (index_fd >= 0) {
+    ::close(index_fd);
+    index_fd = -1;
+  }
+}
+
+uint64_t RadosMailFileCache::get_hash(const std::string &key) {
+  uint64_t hash = 14695981039346656037ull;  // FNV-1a
+  for (std::string::const_iterator it = key.begin(); it != key.end(); ++it) {
+    hash = (hash ^ (unsigned char)*it) * 1099511628211ull;
+  }
+  // 0 marks a free entry
+  return hash != 0 ? hash : 1;
+}
+
+size_t RadosMailFileCache::get_index_size(uint32_t entry_count) {
+  return sizeof(Index) + (size_t)entry_count * sizeof(IndexEntry);
+}
+
+/* removes the files of all cached mails (and of crashed puts) */
+void RadosMailFileCache::remove_files(const std::string &directory_) {
+  DIR *cache_dir = opendir(directory_.c_str());
+  if (cache_dir == nullptr) {
+    return;
+  }
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(cache_dir)) != nullptr) {
+    if (dir_entry->d_name[0] == '.' || strcmp(dir_entry->d_name, RBOX_MAIL_FILE_CACHE_INDEX) == 0) {
+      continue;
+    }
+    std::string dir = directory_ + "/" + dir_entry->d_name;
+    DIR *sub_dir = opendir(dir.c_str());
+    if (sub_dir == nullptr) {
+      continue;
+    }
+    struct dirent *file_entry;
+    while ((file_entry = readdir(sub_dir)) != nullptr) {
+      if (file_entry->d_name[0] != '.') {
+        unlink((dir + "/" + file_entry->d_name).c_str());
+      }
+    }
+    closedir(sub_dir);
+  }
+  closedir(cache_dir);
+}
+
+void RadosMailFileCache::lock() {
+  mutex.lock();
+  flock(index_fd, LOCK_EX);
+}
+
+void RadosMailFileCache::unlock() {
+  flock(index_fd, LOCK_UN);
+  mutex.unlock();
+}
+
+RadosMailFileCache::IndexEntry *RadosMailFileCache::find_entry(const std::string &key, uint64_t hash) {
+  IndexEntry *entries = get_entries();
+  // linear probing, the table is never full (see put)
+  uint32_t i = hash % index->entry_count;
+  while (entries[i].hash != 0) {
+    if (entries[i].hash == hash && key.compare(entries[i].key) == 0) {
+      break;
+    }
+    i = (i + 1) % index->entry_count;
+  }
+  return &entries[i];
+}
+
+void RadosMailFileCache::erase_entry(IndexEntry *entry) {
+  IndexEntry *entries = get_entries();
+  uint32_t count = index->entry_count;
+  uint64_t size = index->size.load();
+  // the size may be off (e.g. crashed process), it never drops below 0
+  index->size.store(size > entry->size ? size - entry->size : 0);
+  index->used--;
+
+  // move the following entries of the probe sequence into the gap, so lookups need no tombstones
+  uint32_t i = entry - entries;
+  uint32_t j = i;
+  for (;;) {
+    entries[i].hash = 0;
+    uint32_t home;
+    do {
+      j = (j + 1) % count;
+      if (entries[j].hash == 0) {
+        return;
+      }
+      home = entries[j].hash % count;
+      // entry j stays, if its home is cyclically in (i, j]
+    } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+    entries[i] = entries[j];
+    i = j;
+  }
+}
+
+void RadosMailFileCache::evict_locked(uint64_t max_size, uint32_t max_used) {
+  if (index->size.load() <= max_size && index->used <= max_used) {
+    return;
+  }
+  // least recently used first
+  IndexEntry *entries = get_entries();
+  std::vector<std::pair<uint64_t, std::string>> lru;
+  lru.reserve(index->used);
+  for (uint32_t i = 0; i < index->entry_count; i++) {
+    if (entries[i].hash != 0) {
+      lru.push_back(std::make_pair(entries[i].atime, std::string(entries[i].key)));
+    }
+  }
+  std::sort(lru.begin(), lru.end());
+  for (std::vector<std::pair<uint64_t, std::string>>::iterator it = lru.begin();
+       it != lru.end() && (index->size.load() > max_size || index->used > max_used); ++it) {
+    // erase_entry moves entries, find it again
+    IndexEntry *entry = find_entry(it->second, get_hash(it->second));
+    if (entry->hash != 0 && (unlink(get_path(it->second).c_str()) == 0 || errno == ENOENT)) {
+      erase_entry(entry);
+    }
+  }
+}
+
+/* <directory>/<hash>/<escaped key>, the hash spreads the files over 256 directories */
+std::string RadosMailFileCache::get_path(const std::string &key) {
+  uint32_t hash = 2166136261u;  // FNV-1a
+  std::string name;
+  for (std::string::const_iterator it = key.begin(); it != key.end(); ++it) {
+    unsigned char c = *it;
+    hash = (hash ^ c) * 16777619u;
+    if (isalnum(c) || c == '-' || c == '_') {
+      name += c;
+    } else {
+      char escaped[4];
+      snprintf(escaped, sizeof(escaped), "%%%02x", c);
+      name += escaped;
+    }
+  }
+  char dir[3];
+  snprintf(dir, sizeof(dir), "%02x", hash & 0xff);
+  return directory + "/" + dir + "/" + name;
+}
+
+bool RadosMailFileCache::get(const std::string &key, librados::bufferlist *data, time_t *save_date) {
+  if (index == nullptr) {
+    return false;
+  }
+  std::string path = get_path(key);
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool found = false;
+  struct stat st;
+  RadosMailFileHeader header;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(header) &&
+      read(fd, &header, sizeof(header)) == sizeof(header) && header.magic == RBOX_MAIL_FILE_CACHE_MAGIC &&
+      header.version == RBOX_MAIL_FILE_CACHE_VERSION) {
+    size_t length = st.st_size - sizeof(header);
+    data->clear();
+    found = data->read_fd(fd, length) == (ssize_t)length;
+    if (found) {
+      *save_date = header.save_date;
+    } else {
+      data->clear();
+    }
+  }
+  ::close(fd);
+  if (found) {
+    // least recently used is evicted first
+    lock();
+    IndexEntry *entry = find_entry(key, get_hash(key));
+    if (entry->hash != 0) {
+      entry->atime = ++index->clock;
+    }
+    unlock();
+  }
+  return found;
+}
+
+void RadosMailFileCache::put(const std::string &key, const librados::bufferlist &data, time_t save_date) {
+  if (index == nullptr || data.length() == 0 || data.length() > capacity / 4 ||
+      key.length() >= sizeof(IndexEntry::key)) {
+    return;
+  }
+  std::string path = get_path(key);
+  if (access(path.c_str(), F_OK) == 0) {
+    // objects are immutable, it is the same mail
+    return;
+  }
+  std::string dir = path.substr(0, path.rfind('/'));
+  if (mkdir(dir.c_str(), 0770) < 0 && errno != EEXIST) {
+    return;
+  }
+  std::string tmp_path = dir + "/" + RBOX_MAIL_FILE_CACHE_TMP_PREFIX + std::to_string(getpid()) + "." +
+                         path.substr(path.rfind('/') + 1);
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0660);
+  if (fd < 0) {
+    return;
+  }
+  RadosMailFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RBOX_MAIL_FILE_CACHE_MAGIC;
+  header.version = RBOX_MAIL_FILE_CACHE_VERSION;
+  header.save_date = save_date;
+  bool ok = write(fd, &header, sizeof(header)) == sizeof(header) && data.write_fd(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok) {
+    unlink(tmp_path.c_str());
+    return;
+  }
+  uint64_t size = sizeof(header) + data.length();
+  uint64_t hash = get_hash(key);
+  lock();
+  if (find_entry(key, hash)->hash == 0) {
+    // room for the mail and a free entry, the hash table is at most 3/4 full
+    uint32_t max_used = index->entry_count / 4 * 3;
+    uint64_t max_size = capacity / 10 * 9;
+    if (index->size.load() + size > capacity || index->used >= max_used) {
+      evict_locked(max_size > size ? max_size - size : 0, max_used / 10 * 9);
+    }
+    // readers see the whole mail or nothing
+    if (rename(tmp_path.c_str(), path.c_str()) == 0) {
+      IndexEntry *entry = find_entry(key, hash);
+      entry->hash = hash;
+      entry->size = size;
+      entry->atime = ++index->clock;
+      memcpy(entry->key, key.c_str(), key.length() + 1);
+      index->used++;
+      index->size.fetch_add(size);
+      tmp_path.clear();
+    }
+  }
+  unlock();
+  if (!tmp_path.empty()) {
+    // cached by another process meanwhile or rename failed
+    unlink(tmp_path.c_str());
+  }
+}
+
+void RadosMailFileCache::remove(const std::string &key) {
+  if (index == nullptr) {
+    return;
+  }
+  uint64_t hash = get_hash(key);
+  lock();
+  IndexEntry *entry = find_entry(key, hash);
+  if ((unlink(get_path(key).c_str()) == 0 || errno == ENOENT) && entry->hash != 0) {
+    erase_entry(entry);
+  }
+  unlock();
+}
+
+uint64_t RadosMailFileCache::get_size() { return index != nullptr ? index->size.load() : 0; }
+
+void RadosMailFileCache::evict() {
+  if (index == nullptr) {
+    return;
+  }
+  lock();
+  evict_locked(capacity / 10 * 9, index->entry_count / 4 * 3);
+  unlock();
+}
+
+}  // namespace librmb
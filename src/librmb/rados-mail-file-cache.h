@@ -0,0 +1,119 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_MAIL_FILE_CACHE_H_
+#define SRC_LIBRMB_RADOS_MAIL_FILE_CACHE_H_
+
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * RadosMailFileCache
+ *
+ * Node local cache of mails, shared by all processes of the host (e.g. the
+ * imap processes of the phone, desktop and webmail of a user). Each mail is a
+ * file in the cache directory (tmpfs or NVMe), named after its key (see
+ * RadosMailCache::get_key). Files are written to a temp file and renamed, so
+ * readers never see partial mails.
+ *
+ * The cached mails (key, size, last access) are kept in a hash table in the
+ * mmap'ed index file, which is changed under the index lock. If the size of all
+ * cached mails exceeds the capacity, the least recently used ones are removed
+ * based on the index, the cache directory is never scanned (except for
+ * removing the files of a new or incompatible index).
+ */
+class RadosMailFileCache {
+ public:
+  RadosMailFileCache();
+  virtual ~RadosMailFileCache();
+
+  /*!
+   * @return the cache of this process
+   */
+  static RadosMailFileCache &get_instance();
+
+  /*!
+   * open (or create) the cache in directory.
+   * @param[in] capacity max. size of all cached mails in bytes
+   * @return false if the directory is not usable, the cache is disabled.
+   */
+  bool open(const std::string &directory_, uint64_t capacity_);
+  void close();
+  bool is_open() { return index != nullptr; }
+
+  /*!
+   * @return false if the mail is not cached.
+   */
+  bool get(const std::string &key, librados::bufferlist *data, time_t *save_date);
+  /*!
+   * add the mail, mails larger than a quarter of the capacity are not cached.
+   */
+  void put(const std::string &key, const librados::bufferlist &data, time_t save_date);
+  void remove(const std::string &key);
+  /*!
+   * @return size of all cached mails in bytes (all processes)
+   */
+  uint64_t get_size();
+  /*!
+   * remove the least recently used mails until the cache is not larger than 90% of the capacity.
+   */
+  void evict();
+
+ private:
+  struct IndexEntry {
+    // hash of the key, 0 if the entry is free
+    uint64_t hash;
+    uint64_t size;
+    // value of Index::clock at the last access
+    uint64_t atime;
+    char key[232];
+  };
+  struct Index {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> size;
+    // number of entries (hash table size) and used entries
+    uint32_t entry_count;
+    uint32_t used;
+    // incremented on each access
+    uint64_t clock;
+    // followed by entry_count entries
+  };
+  std::string get_path(const std::string &key);
+  static uint64_t get_hash(const std::string &key);
+  static size_t get_index_size(uint32_t entry_count);
+  static void remove_files(const std::string &directory_);
+
+  IndexEntry *get_entries() { return reinterpret_cast<IndexEntry *>(index + 1); }
+  void lock();
+  void unlock();
+  // the entry of key or the free entry, where it is inserted
+  IndexEntry *find_entry(const std::string &key, uint64_t hash);
+  void erase_entry(IndexEntry *entry);
+  void evict_locked(uint64_t max_size, uint32_t max_used);
+
+  std::string directory;
+  uint64_t capacity;
+  int index_fd;
+  Index *index;
+  size_t index_size;
+  // the index lock (flock) does not exclude the threads of this process
+  std::mutex mutex;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_MAIL_FILE_CACHE_H_
@@ -63,6 +63,12 @@ std::string RadosMail::to_string(const string& padding) {
   RadosUtils::get_metadata(RBOX_METADATA_PVT_FLAGS, &attrset, &pvt_flags);
   char* from_envelope = NULL;
   RadosUtils::get_metadata(RBOX_METADATA_FROM_ENVELOPE, &attrset, &from_envelope);
+  char* compression = NULL;
+  RadosUtils::get_metadata(RBOX_METADATA_COMPRESSION, &attrset, &compression);
+  char* stripes = NULL;
+  RadosUtils::get_metadata(RBOX_METADATA_STRIPES, &attrset, &stripes);
+  char* header_size = NULL;
+  RadosUtils::get_metadata(RBOX_METADATA_HEADER_SIZE, &attrset, &header_size);
 
   time_t ts = -1;
   if (recv_time_str != NULL) {
@@ -155,5 +161,19 @@ std::string RadosMail::to_string(const string& padding) {
        << "(from envelope): " << from_envelope << endl;
   }
 
+  if (compression != NULL) {
+    ss << padding << "        " << static_cast<char>(RBOX_METADATA_COMPRESSION) << "(compression): " << compression
+       << endl;
+  }
+
+  if (stripes != NULL) {
+    ss << padding << "        " << static_cast<char>(RBOX_METADATA_STRIPES) << "(stripes): " << stripes << endl;
+  }
+
+  if (header_size != NULL) {
+    ss << padding << "        " << static_cast<char>(RBOX_METADATA_HEADER_SIZE) << "(header_size): " << header_size
+       << endl;
+  }
+
   return ss.str();
 }
@@ -31,11 +31,46 @@ int RadosMetadataStorageDefault::load_metadata(RadosMail *mail) {
   ret = io_ctx->getxattrs(*mail->get_oid(), *mail->get_metadata());
 
   if (ret >= 0) {
-    ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
+    if (RadosUtils::is_omap_supported(io_ctx)) {
+      ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
+    } else {
+      RadosUtils::move_keyword_xattrs(mail->get_metadata(), mail->get_extended_metadata());
+    }
   }
 
   return ret;
 }
+
+void RadosMetadataStorageDefault::add_load_metadata(librados::ObjectReadOperation *read_op,
+                                                    RadosMetadataRead *read) {
+  read_op->getxattrs(&read->xattrs, &read->xattrs_err);
+  read->omap = RadosUtils::is_omap_supported(io_ctx);
+  if (read->omap) {
+    RadosUtils::get_all_keys_and_values(read_op, &read->omap_vals, &read->omap_err);
+  }
+}
+
+int RadosMetadataStorageDefault::load_metadata(RadosMail *mail, RadosMetadataRead *read) {
+  if (mail == nullptr) {
+    return -1;
+  }
+  if (read->xattrs_err < 0) {
+    return read->xattrs_err;
+  }
+  mail->get_metadata()->swap(read->xattrs);
+  read->xattrs.clear();
+
+  if (!read->omap) {
+    RadosUtils::move_keyword_xattrs(mail->get_metadata(), mail->get_extended_metadata());
+    return 0;
+  }
+  if (read->omap_err < 0) {
+    return read->omap_err;
+  }
+  mail->get_extended_metadata()->insert(read->omap_vals.begin(), read->omap_vals.end());
+  return 0;
+}
+
 int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xattr) {
   mail->add_metadata(xattr);
   return io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl);
@@ -44,11 +79,8 @@ int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xa
 int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xattr,
                                               librados::ObjectWriteOperation *write_op) {
   mail->add_metadata(xattr);
-  if (mail->get_completion() == nullptr) {
-    mail->set_completion(librados::Rados::aio_create_completion());
-    mail->set_active_op(1);
-  }
-  return io_ctx->aio_operate(*mail->get_oid(), mail->get_completion(), write_op);
+  write_op->setxattr(xattr.key.c_str(), xattr.bl);
+  return RadosUtils::aio_operate_mail(io_ctx, mail, write_op);
 }
 
 void RadosMetadataStorageDefault::save_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail) {
@@ -58,7 +90,7 @@ void RadosMetadataStorageDefault::save_metadata(librados::ObjectWriteOperation *
     write_op->setxattr((*it).first.c_str(), (*it).second);
   }
   if (mail->get_extended_metadata()->size() > 0) {
-    write_op->omap_set(*mail->get_extended_metadata());
+    RadosUtils::set_keyword_metadata(write_op, RadosUtils::is_omap_supported(io_ctx), *mail->get_extended_metadata());
   }
 }
 bool RadosMetadataStorageDefault::update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) {
@@ -78,6 +110,9 @@ bool RadosMetadataStorageDefault::update_metadata(const std::string &oid, std::l
 int RadosMetadataStorageDefault::update_keyword_metadata(const std::string &oid, RadosMetadata *metadata) {
   int ret = -1;
   if (metadata != nullptr) {
+    if (!RadosUtils::is_omap_supported(io_ctx)) {
+      return io_ctx->setxattr(oid, RadosUtils::get_keyword_xattr_key(metadata->key).c_str(), metadata->bl);
+    }
     std::map<std::string, librados::bufferlist> map;
     map.insert(std::pair<string, librados::bufferlist>(metadata->key, metadata->bl));
     ret = io_ctx->omap_set(oid, map);
@@ -85,12 +120,18 @@ int RadosMetadataStorageDefault::update_keyword_metadata(const std::string &oid,
   return ret;
 }
 int RadosMetadataStorageDefault::remove_keyword_metadata(const std::string &oid, std::string &key) {
+  if (!RadosUtils::is_omap_supported(io_ctx)) {
+    return io_ctx->rmxattr(oid, RadosUtils::get_keyword_xattr_key(key).c_str());
+  }
   std::set<std::string> keys;
   keys.insert(key);
   return io_ctx->omap_rm_keys(oid, keys);
 }
 int RadosMetadataStorageDefault::load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
                                                        std::map<std::string, ceph::bufferlist> *metadata) {
+  if (!RadosUtils::is_omap_supported(io_ctx)) {
+    return RadosUtils::load_keyword_xattrs(io_ctx, oid, keys, metadata);
+  }
   return io_ctx->omap_get_vals_by_keys(oid, keys, metadata);
 }
 
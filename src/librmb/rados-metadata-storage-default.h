@@ -31,6 +31,8 @@ class RadosMetadataStorageDefault : public RadosStorageMetadataModule {
   void set_io_ctx(librados::IoCtx *io_ctx_) override { this->io_ctx = io_ctx_; }
 
   int load_metadata(RadosMail *mail) override;
+  void add_load_metadata(librados::ObjectReadOperation *read_op, RadosMetadataRead *read) override;
+  int load_metadata(RadosMail *mail, RadosMetadataRead *read) override;
   int set_metadata(RadosMail *mail, RadosMetadata &xattr) override;
   bool update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) override;
   void save_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail) override;
@@ -81,7 +81,56 @@ int RadosMetadataStorageIma::load_metadata(RadosMail *mail) {
   if (ret < 0) {
     return ret;
   }
+  load_attributes(mail, &attr);
 
+  // load other omap values.
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    if (RadosUtils::is_omap_supported(io_ctx)) {
+      ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
+    } else {
+      RadosUtils::move_keyword_xattrs(mail->get_metadata(), mail->get_extended_metadata());
+    }
+  }
+
+  return ret;
+}
+
+void RadosMetadataStorageIma::add_load_metadata(librados::ObjectReadOperation *read_op, RadosMetadataRead *read) {
+  read_op->getxattrs(&read->xattrs, &read->xattrs_err);
+  read->omap = cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) &&
+               RadosUtils::is_omap_supported(io_ctx);
+  if (read->omap) {
+    RadosUtils::get_all_keys_and_values(read_op, &read->omap_vals, &read->omap_err);
+  }
+}
+
+int RadosMetadataStorageIma::load_metadata(RadosMail *mail, RadosMetadataRead *read) {
+  if (mail == nullptr) {
+    return -1;
+  }
+  if (mail->get_metadata()->size() > 0) {
+    return 0;
+  }
+  if (read->xattrs_err < 0) {
+    return read->xattrs_err;
+  }
+  load_attributes(mail, &read->xattrs);
+
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    if (read->omap) {
+      if (read->omap_err < 0) {
+        return read->omap_err;
+      }
+      mail->get_extended_metadata()->insert(read->omap_vals.begin(), read->omap_vals.end());
+    } else {
+      RadosUtils::move_keyword_xattrs(mail->get_metadata(), mail->get_extended_metadata());
+    }
+  }
+  return 0;
+}
+
+void RadosMetadataStorageIma::load_attributes(RadosMail *mail, std::map<std::string, ceph::bufferlist> *attr_) {
+  std::map<std::string, ceph::bufferlist> &attr = *attr_;
   if (attr.find(cfg->get_metadata_storage_attribute()) != attr.end()) {
     // json object for immutable attributes.
     json_t *root;
@@ -98,13 +147,6 @@ int RadosMetadataStorageIma::load_metadata(RadosMail *mail) {
       (*mail->get_metadata())[(*it).first] = (*it).second;
     }
   }
-
-  // load other omap values.
-  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
-    ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
-  }
-
-  return ret;
 }
 
 // it is required that mail->get_metadata is up to date before update.
@@ -120,18 +162,16 @@ int RadosMetadataStorageIma::set_metadata(RadosMail *mail, RadosMetadata &xattr)
   }
 }
 
-// TODO(jrse): make set metadata async!
 int RadosMetadataStorageIma::set_metadata(RadosMail *mail, RadosMetadata &xattr,
                                           librados::ObjectWriteOperation *write_op) {
   enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*xattr.key.c_str());
   if (!cfg->is_updateable_attribute(k)) {
     mail->add_metadata(xattr);
-    librados::ObjectWriteOperation op;
-    save_metadata(&op, mail);
-    return io_ctx->operate(*mail->get_oid(), &op);
+    save_metadata(write_op, mail);
   } else {
-    return io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl);
+    write_op->setxattr(xattr.key.c_str(), xattr.bl);
   }
+  return RadosUtils::aio_operate_mail(io_ctx, mail, write_op);
 
 }  // namespace librmb
 
@@ -160,7 +200,8 @@ void RadosMetadataStorageIma::save_metadata(librados::ObjectWriteOperation *writ
       }
       json_object_set_new(root, RadosMetadataStorageIma::keyword_key.c_str(), keyword);
     } else {
-      write_op->omap_set(*mail->get_extended_metadata());
+      RadosUtils::set_keyword_metadata(write_op, RadosUtils::is_omap_supported(io_ctx),
+                                       *mail->get_extended_metadata());
     }
   }
 
@@ -203,6 +244,8 @@ int RadosMetadataStorageIma::update_keyword_metadata(const std::string &oid, Rad
   int ret = -1;
   if (metadata != nullptr) {
     if (!cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) || !cfg->is_update_attributes()) {
+    } else if (!RadosUtils::is_omap_supported(io_ctx)) {
+      ret = io_ctx->setxattr(oid, RadosUtils::get_keyword_xattr_key(metadata->key).c_str(), metadata->bl);
     } else {
       std::map<std::string, librados::bufferlist> map;
       map.insert(std::pair<string, librados::bufferlist>(metadata->key, metadata->bl));
@@ -212,6 +255,9 @@ int RadosMetadataStorageIma::update_keyword_metadata(const std::string &oid, Rad
   return ret;
 }
 int RadosMetadataStorageIma::remove_keyword_metadata(const std::string &oid, std::string &key) {
+  if (!RadosUtils::is_omap_supported(io_ctx)) {
+    return io_ctx->rmxattr(oid, RadosUtils::get_keyword_xattr_key(key).c_str());
+  }
   std::set<std::string> keys;
   keys.insert(key);
   return io_ctx->omap_rm_keys(oid, keys);
@@ -219,6 +265,9 @@ int RadosMetadataStorageIma::remove_keyword_metadata(const std::string &oid, std
 
 int RadosMetadataStorageIma::load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
                                                    std::map<std::string, ceph::bufferlist> *metadata) {
+  if (!RadosUtils::is_omap_supported(io_ctx)) {
+    return RadosUtils::load_keyword_xattrs(io_ctx, oid, keys, metadata);
+  }
   return io_ctx->omap_get_vals_by_keys(oid, keys, metadata);
 }
 
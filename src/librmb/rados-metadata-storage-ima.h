@@ -35,12 +35,16 @@ namespace librmb {
 class RadosMetadataStorageIma : public RadosStorageMetadataModule {
  private:
   int parse_attribute(RadosMail *mail, json_t *root);
+  /* parses the immutable attributes (json) and copies the others */
+  void load_attributes(RadosMail *mail, std::map<std::string, ceph::bufferlist> *attr);
 
  public:
   RadosMetadataStorageIma(librados::IoCtx *io_ctx_, RadosDovecotCephCfg *cfg_);
   virtual ~RadosMetadataStorageIma();
   void set_io_ctx(librados::IoCtx *io_ctx_) override { this->io_ctx = io_ctx_; }
   int load_metadata(RadosMail *mail) override;
+  void add_load_metadata(librados::ObjectReadOperation *read_op, RadosMetadataRead *read) override;
+  int load_metadata(RadosMail *mail, RadosMetadataRead *read) override;
   int set_metadata(RadosMail *mail, RadosMetadata &xattr) override;
   int set_metadata(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op) override;
   bool update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) override;
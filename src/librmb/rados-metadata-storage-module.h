@@ -17,6 +17,19 @@
 #include "rados-mail.h"
 
 namespace librmb {
+/**
+ * results of the metadata reads, which RadosStorageMetadataModule::add_load_metadata added
+ * to a read operation.
+ */
+struct RadosMetadataRead {
+  std::map<std::string, ceph::bufferlist> xattrs;
+  int xattrs_err = 0;
+  /* keywords are read from omap */
+  bool omap = false;
+  std::map<std::string, ceph::bufferlist> omap_vals;
+  int omap_err = 0;
+};
+
 class RadosStorageMetadataModule {
  public:
   virtual ~RadosStorageMetadataModule(){};
@@ -24,9 +37,15 @@ class RadosStorageMetadataModule {
   virtual void set_io_ctx(librados::IoCtx *io_ctx){};
   /* load the metadta into RadosMail */
   virtual int load_metadata(RadosMail *mail) = 0;
+  /* add the reads of load_metadata to read_op, e.g. to read the metadata and the mail data in one op. read needs
+   * to be valid until read_op is complete, then load_metadata(mail, read) loads the results into RadosMail. */
+  virtual void add_load_metadata(librados::ObjectReadOperation *read_op, RadosMetadataRead *read) = 0;
+  virtual int load_metadata(RadosMail *mail, RadosMetadataRead *read) = 0;
   /* set a new metadata attribute to a mail object */
   virtual int set_metadata(RadosMail *mail, RadosMetadata &xattr) = 0;
-  /* set a new metadata attribute to a mail object */
+  /* set a new metadata attribute to a mail object (async): the attribute is added to write_op, which is
+   * executed with the mail's completion. write_op needs to be valid until RadosStorage::wait_for_rados_operations
+   * has been called for the mail. */
   virtual int set_metadata(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op) = 0;
   /* update the given metadata attributes */
   virtual bool update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) = 0;
@@ -11,21 +11,145 @@
 
 #include "rados-save-log.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rados-checksum.h"
+
 namespace librmb {
 
+static void save_log_put_le32(std::string *out, uint32_t value) {
+  char buf[4];
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = (value >> 24) & 0xff;
+  out->append(buf, 4);
+}
+
+static uint32_t save_log_get_le32(const char *data) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void save_log_put_string(std::string *out, const std::string &value) {
+  save_log_put_le32(out, value.length());
+  out->append(value);
+}
+
+static bool save_log_get_string(const char **data, size_t *length, std::string *value) {
+  if (*length < 4) {
+    return false;
+  }
+  uint32_t value_length = save_log_get_le32(*data);
+  if (*length - 4 < value_length) {
+    return false;
+  }
+  value->assign(*data + 4, value_length);
+  *data += 4 + value_length;
+  *length -= 4 + value_length;
+  return true;
+}
+
+void RadosSaveLogEntry::to_binary(std::string *record) const {
+  std::string payload;
+  save_log_put_string(&payload, op);
+  save_log_put_string(&payload, pool);
+  save_log_put_string(&payload, ns);
+  save_log_put_string(&payload, oid);
+
+  record->append(RBOX_SAVE_LOG_RECORD_MAGIC, RBOX_SAVE_LOG_RECORD_MAGIC_LEN);
+  save_log_put_le32(record, payload.length());
+  save_log_put_le32(record, RadosChecksum::crc32c(0, payload.data(), payload.length()));
+  record->append(payload);
+}
+
+bool RadosSaveLogEntry::from_binary(const char *payload, size_t length) {
+  if (!save_log_get_string(&payload, &length, &op) || !save_log_get_string(&payload, &length, &pool) ||
+      !save_log_get_string(&payload, &length, &ns) || !save_log_get_string(&payload, &length, &oid) || length != 0) {
+    return false;
+  }
+  parse_mv_op();
+  return true;
+}
+
+void RadosSaveLog::init_group_commit() {
+  group_commit = false;
+  fd = -1;
+  flush_size = 0;
+  flush_interval = std::chrono::milliseconds(0);
+  fsync_on_flush = false;
+}
+
+void RadosSaveLog::set_group_commit(int flush_size_, int flush_interval_, bool fsync_) {
+  group_commit = true;
+  flush_size = flush_size_ > 0 ? flush_size_ : 0;
+  flush_interval = std::chrono::milliseconds(flush_interval_ > 0 ? flush_interval_ : 0);
+  fsync_on_flush = fsync_;
+}
+
 bool RadosSaveLog::open() {
-  if (this->log_active && !ofs.is_open()) {
+  if (this->log_active && group_commit) {
+    if (fd < 0) {
+      fd = ::open(this->logfile.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+      this->log_active = fd >= 0;
+    }
+  } else if (this->log_active && !ofs.is_open()) {
     ofs.open(this->logfile, std::ofstream::out | std::ofstream::app);
     this->log_active = ofs.is_open();
   }
   return this->log_active;
 }
+
 void RadosSaveLog::append(const RadosSaveLogEntry &entry) {
-  if (this->log_active && ofs.is_open()) {
+  if (!this->log_active) {
+    return;
+  }
+  if (fd >= 0) {
+    if (buffer.empty()) {
+      first_buffered = std::chrono::steady_clock::now();
+    }
+    entry.to_binary(&buffer);
+    if (buffer.length() >= flush_size || std::chrono::steady_clock::now() - first_buffered >= flush_interval) {
+      flush();
+    }
+  } else if (ofs.is_open()) {
     ofs << entry;
   }
 }
+
+bool RadosSaveLog::flush() {
+  if (fd < 0 || buffer.empty()) {
+    return true;
+  }
+  // one write per flush: with O_APPEND the records of concurrent processes do not interleave.
+  const char *data = buffer.data();
+  size_t length = buffer.length();
+  while (length > 0) {
+    ssize_t ret = ::write(fd, data, length);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      buffer.clear();
+      return false;
+    }
+    data += ret;
+    length -= ret;
+  }
+  buffer.clear();
+  return !fsync_on_flush || ::fdatasync(fd) == 0;
+}
+
 bool RadosSaveLog::close() {
+  if (fd >= 0) {
+    bool ret = flush();
+    ret = ::close(fd) == 0 && ret;
+    fd = -1;
+    return ret;
+  }
   if (this->log_active && ofs.is_open()) {
     ofs.close();
     return !ofs.is_open();
@@ -33,4 +157,35 @@ bool RadosSaveLog::close() {
   return true;
 }
 
+int RadosSaveLogReader::read_binary(RadosSaveLogEntry *entry) {
+  char header[RBOX_SAVE_LOG_RECORD_HEADER_LEN];
+  if (!is->read(header, sizeof(header)) ||
+      memcmp(header, RBOX_SAVE_LOG_RECORD_MAGIC, RBOX_SAVE_LOG_RECORD_MAGIC_LEN) != 0) {
+    // truncated record
+    return -1;
+  }
+  uint32_t length = save_log_get_le32(header + 4);
+  uint32_t crc = save_log_get_le32(header + 8);
+  if (length > RBOX_SAVE_LOG_RECORD_MAX_LEN) {
+    return -1;
+  }
+  std::string payload(length, '\0');
+  if (!is->read(&payload[0], length) || RadosChecksum::crc32c(0, payload.data(), length) != crc) {
+    return -1;
+  }
+  return entry->from_binary(payload.data(), length) ? 1 : -1;
+}
+
+int RadosSaveLogReader::read(RadosSaveLogEntry *entry) {
+  int next = is->peek();
+  if (next == std::char_traits<char>::eof()) {
+    return 0;
+  }
+  if (next == RBOX_SAVE_LOG_RECORD_MAGIC[0]) {
+    return read_binary(entry);
+  }
+  *is >> *entry;
+  return is->fail() ? -1 : 1;
+}
+
 } /* namespace librmb */
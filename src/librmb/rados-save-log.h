@@ -19,9 +19,18 @@
 #include <sstream>
 #include <list>
 #include <iostream>
+#include <chrono>
+#include <string>
 
 #include "rados-metadata.h"
 
+/** first bytes of a binary save log record, a csv line never starts with it **/
+#define RBOX_SAVE_LOG_RECORD_MAGIC "\x7fRSL"
+#define RBOX_SAVE_LOG_RECORD_MAGIC_LEN 4
+/** magic, payload length, crc32c of the payload **/
+#define RBOX_SAVE_LOG_RECORD_HEADER_LEN 12
+#define RBOX_SAVE_LOG_RECORD_MAX_LEN (1024 * 1024)
+
 namespace librmb {
 /**
  * RadosSaveLogEntry
@@ -113,6 +122,18 @@ class RadosSaveLogEntry {
     return is;
   }
 
+  /*!
+   * append the entry as binary record:
+   * magic, payload length (le32), crc32c of the payload (le32),
+   * payload: op, pool, ns, oid each as length (le32) and data.
+   */
+  void to_binary(std::string *record) const;
+  /*!
+   * @param[in] payload record without header (checksum already verified)
+   * @return false if the payload is not valid
+   */
+  bool from_binary(const char *payload, size_t length);
+
   static std::string convert_metadata(std::list<librmb::RadosMetadata *> &metadata, const std::string &separator) {
     std::stringstream metadata_str;
     std::list<librmb::RadosMetadata *>::iterator list_it;
@@ -140,24 +161,85 @@ class RadosSaveLogEntry {
   std::list<librmb::RadosMetadata> metadata;
 };
 
+/**
+ * RadosSaveLog
+ *
+ * Log of saved, copied and moved mail objects (rados_save_log).
+ *
+ * csv: one line per entry, written through immediately.
+ * group commit: binary records with checksums, buffered per process and
+ * written with one append (O_APPEND) on flush(), which is called at the end
+ * of each transaction, or if flush_size bytes or flush_interval ms are
+ * exceeded. Optionally fsynced after each flush.
+ */
 class RadosSaveLog {
  public:
-  explicit RadosSaveLog(const std::string &logfile_) : logfile(logfile_) { log_active = !logfile.empty(); }
-  RadosSaveLog() { log_active = false; }
+  explicit RadosSaveLog(const std::string &logfile_) : logfile(logfile_) {
+    log_active = !logfile.empty();
+    init_group_commit();
+  }
+  RadosSaveLog() {
+    log_active = false;
+    init_group_commit();
+  }
   void set_save_log_file(const std::string &logfile_) {
     this->logfile = logfile_;
     this->log_active = !logfile.empty();
   }
-  virtual ~RadosSaveLog(){};
+  /*!
+   * switch to the binary group commit format, call before open.
+   * @param[in] flush_size_ flush if the buffer exceeds flush_size_ bytes
+   * @param[in] flush_interval_ flush if the oldest buffered entry is older than flush_interval_ ms
+   * @param[in] fsync_ fsync after each flush
+   */
+  void set_group_commit(int flush_size_, int flush_interval_, bool fsync_);
+  virtual ~RadosSaveLog() { close(); };
   bool open();
   void append(const RadosSaveLogEntry &entry);
+  /*!
+   * write the buffered entries (group commit)
+   * @return false if write or fsync failed
+   */
+  bool flush();
   bool close();
-  bool is_open() { return ofs.is_open(); }
+  bool is_open() { return ofs.is_open() || fd >= 0; }
+  bool is_group_commit() { return group_commit; }
+
+ private:
+  void init_group_commit();
 
  private:
   std::string logfile;
   bool log_active;
   std::ofstream ofs;
+
+  bool group_commit;
+  int fd;
+  std::string buffer;
+  size_t flush_size;
+  std::chrono::milliseconds flush_interval;
+  bool fsync_on_flush;
+  std::chrono::steady_clock::time_point first_buffered;
+};
+
+/**
+ * RadosSaveLogReader
+ *
+ * reads csv and binary records, also from a file with both formats.
+ */
+class RadosSaveLogReader {
+ public:
+  explicit RadosSaveLogReader(std::istream *is_) : is(is_) {}
+  /*!
+   * @return 1 if entry has been read, 0 at the end of the log, -1 if the entry is not valid
+   */
+  int read(RadosSaveLogEntry *entry);
+
+ private:
+  int read_binary(RadosSaveLogEntry *entry);
+
+ private:
+  std::istream *is;
 };
 
 } /* namespace librmb */
@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-single-instance.h"
+
+#include <limits.h>
+#include <map>
+#include <utility>
+#include "encoding.h"
+
+namespace librmb {
+
+void RadosSingleInstance::get_io_ctx(librados::IoCtx *io_ctx, librados::IoCtx *sis_io_ctx) {
+  sis_io_ctx->dup(*io_ctx);
+  sis_io_ctx->set_namespace(RBOX_SINGLE_INSTANCE_NAMESPACE);
+}
+
+static int sis_add_ref(librados::IoCtx *sis_io_ctx, const std::string &body_oid, const std::string &value) {
+  librados::bufferlist in;
+  encode(std::string(RBOX_SINGLE_INSTANCE_REFCOUNT_KEY), in);
+  encode(value, in);
+
+  librados::ObjectWriteOperation write_op;
+  // never create a body without data, it could have been removed in the meantime.
+  write_op.assert_exists();
+  write_op.exec("numops", "add", in);
+  return sis_io_ctx->operate(body_oid, &write_op);
+}
+
+int RadosSingleInstance::add_body(librados::IoCtx *io_ctx, const std::string &body_oid, librados::bufferlist &body) {
+  librados::IoCtx sis_io_ctx;
+  get_io_ctx(io_ctx, &sis_io_ctx);
+
+  for (int i = 0; i < RBOX_SINGLE_INSTANCE_MAX_RETRY; i++) {
+    // new body: data and first reference within one atomic operation
+    std::map<std::string, librados::bufferlist> refcount;
+    refcount[RBOX_SINGLE_INSTANCE_REFCOUNT_KEY].append("1");
+    librados::ObjectWriteOperation write_op;
+    write_op.create(true);
+    write_op.write_full(body);
+    write_op.omap_set(refcount);
+    int ret = sis_io_ctx.operate(body_oid, &write_op);
+    if (ret != -EEXIST) {
+      return ret;
+    }
+    ret = sis_add_ref(&sis_io_ctx, body_oid, "1");
+    if (ret != -ENOENT) {
+      return ret;
+    }
+    // last reference has been removed concurrently, store it again.
+  }
+  return -EAGAIN;
+}
+
+int RadosSingleInstance::add_ref(librados::IoCtx *io_ctx, const std::string &body_oid) {
+  librados::IoCtx sis_io_ctx;
+  get_io_ctx(io_ctx, &sis_io_ctx);
+  return sis_add_ref(&sis_io_ctx, body_oid, "1");
+}
+
+int RadosSingleInstance::remove_ref(librados::IoCtx *io_ctx, const std::string &body_oid) {
+  librados::IoCtx sis_io_ctx;
+  get_io_ctx(io_ctx, &sis_io_ctx);
+
+  int ret = sis_add_ref(&sis_io_ctx, body_oid, "-1");
+  if (ret < 0) {
+    return ret;
+  }
+  // remove the body if this was the last reference. If a reference has been
+  // added in the meantime, the compare fails and the body is kept.
+  librados::bufferlist zero;
+  zero.append("0");
+  std::map<std::string, std::pair<librados::bufferlist, int>> assertions;
+  assertions[RBOX_SINGLE_INSTANCE_REFCOUNT_KEY] = std::make_pair(zero, LIBRADOS_CMPXATTR_OP_EQ);
+  int cmp_ret = 0;
+  librados::ObjectWriteOperation write_op;
+  write_op.omap_cmp(assertions, &cmp_ret);
+  write_op.remove();
+  ret = sis_io_ctx.operate(body_oid, &write_op);
+  return ret == -ECANCELED || ret == -ENOENT ? 0 : ret;
+}
+
+int RadosSingleInstance::read_body(librados::IoCtx *io_ctx, const std::string &body_oid, librados::bufferlist *body) {
+  librados::IoCtx sis_io_ctx;
+  get_io_ctx(io_ctx, &sis_io_ctx);
+  return sis_io_ctx.read(body_oid, *body, INT_MAX, 0);
+}
+
+int RadosSingleInstance::read_body(librados::IoCtx *io_ctx, const std::string &body_oid, size_t length,
+                                   librados::bufferlist *body) {
+  librados::IoCtx sis_io_ctx;
+  get_io_ctx(io_ctx, &sis_io_ctx);
+  return sis_io_ctx.read(body_oid, *body, length, 0);
+}
+
+}  // namespace librmb
@@ -0,0 +1,76 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_SINGLE_INSTANCE_H_
+#define SRC_LIBRMB_RADOS_SINGLE_INSTANCE_H_
+
+#include <string>
+#include <rados/librados.hpp>
+
+/** namespace of the shared mail bodies **/
+#define RBOX_SINGLE_INSTANCE_NAMESPACE "rbox_single_instance"
+/** omap key of the reference counter (cls numops) **/
+#define RBOX_SINGLE_INSTANCE_REFCOUNT_KEY "refcount"
+#define RBOX_SINGLE_INSTANCE_MAX_RETRY 10
+
+namespace librmb {
+
+/**
+ * RadosSingleInstance
+ *
+ * Single instance storage: identical mail bodies (e.g. a newsletter delivered
+ * to many users) are stored once per pool, content addressed by their hash.
+ * The mail object of each recipient only holds the metadata and references
+ * the body with RBOX_METADATA_EXT_REF. The body is reference counted in its
+ * omap (cls numops), the last reference removes it.
+ */
+class RadosSingleInstance {
+ public:
+  /*!
+   * @param[in] content_hash hex encoded hash of the body
+   * @return oid of the shared body
+   */
+  static std::string get_body_oid(const std::string &content_hash) { return "sis_" + content_hash; }
+
+  /*!
+   * store the body, or add a reference if it already exists.
+   * @param[in] io_ctx io_ctx of the pool (any namespace)
+   * @return linux error code or 0 if sucessful
+   */
+  static int add_body(librados::IoCtx *io_ctx, const std::string &body_oid, librados::bufferlist &body);
+  /*!
+   * add a reference to an existing body (e.g. mail object copied)
+   * @return linux error code (-ENOENT if the body does not exist) or 0 if sucessful
+   */
+  static int add_ref(librados::IoCtx *io_ctx, const std::string &body_oid);
+  /*!
+   * remove a reference, the body is removed with the last reference.
+   * @return linux error code or 0 if sucessful
+   */
+  static int remove_ref(librados::IoCtx *io_ctx, const std::string &body_oid);
+  /*!
+   * read the body
+   * @return linux error code or >= 0 if sucessful
+   */
+  static int read_body(librados::IoCtx *io_ctx, const std::string &body_oid, librados::bufferlist *body);
+  /*!
+   * read the first length bytes of the body (e.g. the mail header)
+   * @return linux error code or >= 0 if sucessful
+   */
+  static int read_body(librados::IoCtx *io_ctx, const std::string &body_oid, size_t length, librados::bufferlist *body);
+
+ private:
+  static void get_io_ctx(librados::IoCtx *io_ctx, librados::IoCtx *sis_io_ctx);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_SINGLE_INSTANCE_H_
@@ -9,6 +9,10 @@
  * Foundation.  See file COPYING.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "dovecot-ceph-plugin-config.h"
+#endif
+
 #include "rados-storage-impl.h"
 
 #include <algorithm>
@@ -20,6 +24,7 @@
 #include <mutex>
 
 #include "rados-util.h"
+#include "rados-striping.h"
 
 #include <rados/librados.hpp>
 
@@ -42,7 +47,11 @@ RadosStorageImpl::RadosStorageImpl(RadosCluster *_cluster) {
   max_write_size = 10;
   max_object_size = 134217728; //ceph default 128MB
   io_ctx_created = false;
+  erasure_coded = false;
+  stripe_alignment = 0;
   wait_method = WAIT_FOR_COMPLETE_AND_CB;
+  read_flags = 0;
+  ceph_index_cached_size = -1;
 }
 
 RadosStorageImpl::~RadosStorageImpl() {}
@@ -128,8 +137,19 @@ int RadosStorageImpl::read_mail(const std::string &oid, librados::bufferlist *bu
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
-  size_t max = INT_MAX;
-  return get_io_ctx().read(oid, *buffer, max, 0);
+  int read_err = 0;
+  int stripes_err = 0;
+  librados::bufferlist stripes;
+  librados::ObjectReadOperation read_op;
+  read_op.read(0, INT_MAX, buffer, &read_err);
+  read_op.getxattr(rbox_metadata_key_to_char(RBOX_METADATA_STRIPES), &stripes, &stripes_err);
+  // only set for striped mails
+  read_op.set_op_flags2(librados::OP_FAILOK);
+  int ret = get_io_ctx().operate(oid, &read_op, NULL);
+  if (ret >= 0 && stripes.length() > 0) {
+    ret = RadosStriping::read_stripes(&get_io_ctx(), oid, stripes.to_str(), buffer);
+  }
+  return ret < 0 ? ret : buffer->length();
 }
 
 int RadosStorageImpl::delete_mail(RadosMail *mail) {
@@ -164,7 +184,16 @@ int RadosStorageImpl::read_operate(const std::string &oid, librados::ObjectReadO
 if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
-  return get_io_ctx().operate(oid, read_operation, bufferlist);
+  return get_io_ctx().operate(oid, read_operation, bufferlist, read_flags);
+}
+
+int RadosStorageImpl::aio_read_operate(const std::string &oid, librados::AioCompletion *c,
+                                       librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist,
+                                       int flags) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  return get_io_ctx().aio_operate(oid, c, read_operation, read_flags | flags, bufferlist);
 }
 
 int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
@@ -180,6 +209,22 @@ int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &o
   }
 }
 
+int RadosStorageImpl::aio_read(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                               librados::bufferlist *pbl, size_t len, uint64_t off) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+
+  librados::IoCtx *ctx = io_ctx_ != nullptr ? io_ctx_ : &get_io_ctx();
+  if (read_flags != 0) {
+    // aio_read has no flags, the op is copied by aio_operate
+    librados::ObjectReadOperation read_op;
+    read_op.read(off, len, pbl, nullptr);
+    return ctx->aio_operate(oid, c, &read_op, read_flags, nullptr);
+  }
+  return ctx->aio_read(oid, c, pbl, len, off);
+}
+
 int RadosStorageImpl::stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
@@ -188,6 +233,10 @@ int RadosStorageImpl::stat_mail(const std::string &oid, uint64_t *psize, time_t
 }
 
 void RadosStorageImpl::set_namespace(const std::string &_nspace) {
+  if (_nspace != nspace) {
+    // the cached size belongs to the index object of the old namespace
+    ceph_index_cached_size = -1;
+  }
   get_io_ctx().set_namespace(_nspace);
   this->nspace = _nspace;
 }
@@ -363,6 +412,31 @@ int RadosStorageImpl::create_connection(const std::string &poolname, const std::
     return err;
   }
   max_object_size = std::stoi(max_object_size_str);
+
+  // erasure coded pools without overwrites require stripe aligned appends
+  bool requires_alignment = false;
+  stripe_alignment = 0;
+#ifdef HAVE_POOL_REQUIRES_ALIGNMENT_2
+  if (io_ctx.pool_requires_alignment2(&requires_alignment) == 0 && requires_alignment) {
+    io_ctx.pool_required_alignment2(&stripe_alignment);
+  }
+#else
+  requires_alignment = io_ctx.pool_requires_alignment();
+  if (requires_alignment) {
+    stripe_alignment = io_ctx.pool_required_alignment();
+  }
+#endif
+  bool omap_supported;
+  if (requires_alignment) {
+    erasure_coded = true;
+  } else if (RadosUtils::get_omap_supported(io_ctx.get_id(), &omap_supported)) {
+    // known from a previous connection, the pool type never changes
+    erasure_coded = !omap_supported;
+  } else {
+    // mon command
+    erasure_coded = cluster->is_erasure_coded_pool(poolname);
+  }
+  RadosUtils::set_omap_supported(io_ctx.get_id(), !erasure_coded);
   
   if (err == 0) {
     io_ctx_created = true;
@@ -403,34 +477,40 @@ bool RadosStorageImpl::wait_for_write_operations_complete(librados::AioCompletio
 
   return failed;
 }
-//DEPRECATED and buggy
 bool RadosStorageImpl::wait_for_rados_operations(const std::list<librmb::RadosMail *> &object_list) {
   bool ctx_failed = false;
-  if(object_list.size() == 0){
-    return ctx_failed;
-  }
   // wait for all writes to finish!
   // imaptest shows it's possible that begin -> continue -> finish cycle is invoked several times before
   // rbox_transaction_save_commit_pre is called.
   for (std::list<librmb::RadosMail *>::const_iterator it_cur_obj = object_list.begin(); it_cur_obj != object_list.end();
        ++it_cur_obj) {
     // if we come from copy mail, there is no operation to wait for.
-    if ((*it_cur_obj)->has_active_op()) {
-      bool op_failed =
-          wait_for_write_operations_complete((*it_cur_obj)->get_completion(), (*it_cur_obj)->get_write_operation());
-
-      ctx_failed = ctx_failed ? ctx_failed : op_failed;
-      (*it_cur_obj)->set_active_op(0);
-      // (*it_cur_obj)->set_completion(nullptr);
-      (*it_cur_obj)->set_write_operation(nullptr);
+    if (!(*it_cur_obj)->has_active_op()) {
+      continue;
     }
-    // free mail's buffer cause we don't need it anymore
-    librados::bufferlist *mail_buffer = (*it_cur_obj)->get_mail_buffer();
-    delete mail_buffer;
+    // releases the completion
+    bool op_failed =
+        wait_for_write_operations_complete((*it_cur_obj)->get_completion(), (*it_cur_obj)->get_write_operation());
+    ctx_failed = ctx_failed || op_failed;
+
+    delete (*it_cur_obj)->get_write_operation();
+    (*it_cur_obj)->set_write_operation(nullptr);
+    (*it_cur_obj)->set_completion(nullptr);
+    (*it_cur_obj)->set_active_op(0);
   }
   return ctx_failed;
 }
 
+int RadosStorageImpl::wait_for_read_operation_complete(librados::AioCompletion *completion) {
+  if (completion == nullptr) {
+    return -EINVAL;
+  }
+  completion->wait_for_complete();
+  int ret = completion->get_return_value();
+  completion->release();
+  return ret;
+}
+
 // assumes that destination io ctx is current io_ctx;
 int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                            std::list<RadosMetadata> &to_update, bool delete_source) {
@@ -441,8 +521,7 @@ int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string
   int ret = 0;
   librados::ObjectWriteOperation write_op;
   librados::IoCtx src_io_ctx, dest_io_ctx;
-
-  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  std::string manifest;
 
   // destination io_ctx is current io_ctx
   dest_io_ctx = io_ctx;
@@ -452,6 +531,16 @@ int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string
     src_io_ctx.set_namespace(src_ns);
     dest_io_ctx.set_namespace(dest_ns);
 
+    // striped mail: the stripes need to exist before the mail object references them
+    RadosStriping::get_manifest(&src_io_ctx, src_oid, &manifest);
+    if (!manifest.empty()) {
+      ret = RadosStriping::copy_stripes(&src_io_ctx, src_oid, &dest_io_ctx, dest_oid, manifest);
+      if (ret < 0) {
+        RadosStriping::remove_stripes(&dest_io_ctx, dest_oid, manifest);
+        return ret;
+      }
+    }
+
 #if LIBRADOS_VERSION_CODE >= 30000
     write_op.copy_from(src_oid, src_io_ctx, 0, 0);
 #else
@@ -478,12 +567,16 @@ int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string
   for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
     write_op.setxattr((*it).key.c_str(), (*it).bl);
   }
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
   ret = aio_operate(&dest_io_ctx, dest_oid, completion, &write_op);
   if (ret >= 0) {
     completion->wait_for_complete();
     ret = completion->get_return_value();
     if (delete_source && strcmp(src_ns, dest_ns) != 0 && ret == 0) {
       ret = src_io_ctx.remove(src_oid);
+      if (ret == 0 && !manifest.empty()) {
+        RadosStriping::remove_stripes(&src_io_ctx, src_oid, manifest);
+      }
     }
   }
   completion->release();
@@ -582,7 +675,7 @@ bool RadosStorageImpl::save_mail(RadosMail *mail) {
   }
 
   if (mail->get_extended_metadata()->size() > 0) {
-    write_op_xattr.omap_set(*mail->get_extended_metadata());
+    RadosUtils::set_keyword_metadata(&write_op_xattr, !erasure_coded, *mail->get_extended_metadata());
   }
   return save_mail(&write_op_xattr, mail);
 }
@@ -597,27 +690,47 @@ void RadosStorageImpl::free_rados_mail(librmb::RadosMail *mail) {
 }
 
 uint64_t RadosStorageImpl::ceph_index_size(){
-  uint64_t psize;
+  if (ceph_index_cached_size >= 0) {
+    return ceph_index_cached_size;
+  }
+  uint64_t psize = 0;
   time_t pmtime;
-  get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime);
+  if (get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime) < 0) {
+    // index object does not exist (yet)
+    psize = 0;
+  }
+  ceph_index_cached_size = psize;
   return psize;
 }
 
 int RadosStorageImpl::ceph_index_append(const std::string &oid) {  
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oid));
-  return get_recovery_io_ctx().append( get_namespace(),bl, bl.length());
+  return ceph_index_append_buffer(bl);
 }
 
 int RadosStorageImpl::ceph_index_append(const std::set<std::string> &oids) {
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oids));
-  return get_recovery_io_ctx().append( get_namespace(),bl, bl.length());
+  return ceph_index_append_buffer(bl);
+}
+
+int RadosStorageImpl::ceph_index_append_buffer(librados::bufferlist &bl) {
+  int ret = get_recovery_io_ctx().append( get_namespace(),bl, bl.length());
+  if (ret < 0) {
+    ceph_index_cached_size = -1;
+  } else if (ceph_index_cached_size >= 0) {
+    ceph_index_cached_size += bl.length();
+  }
+  return ret;
 }
+
 int RadosStorageImpl::ceph_index_overwrite(const std::set<std::string> &oids) {
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oids));
-  return get_recovery_io_ctx().write_full( get_namespace(),bl);
+  int ret = get_recovery_io_ctx().write_full( get_namespace(),bl);
+  ceph_index_cached_size = ret < 0 ? -1 : bl.length();
+  return ret;
 }
 std::set<std::string> RadosStorageImpl::ceph_index_read() {
   std::set<std::string> index;
@@ -640,6 +753,30 @@ std::set<std::string> RadosStorageImpl::ceph_index_read() {
   return index;
 }
 int RadosStorageImpl::ceph_index_delete() {
+  ceph_index_cached_size = -1;
   return get_recovery_io_ctx().remove(get_namespace());
 }
 
+/* the counters are kept next to the ceph index object, the index pool supports omap */
+int RadosStorageImpl::update_counters(const std::string &mailbox_guid, const RadosCounters &delta) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  return RadosCounters::update(&get_recovery_io_ctx(), RadosCounters::get_oid(get_namespace()), mailbox_guid, delta);
+}
+
+int RadosStorageImpl::read_counters(const std::string &mailbox_guid, RadosCounters *counters) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  return RadosCounters::read(&get_recovery_io_ctx(), RadosCounters::get_oid(get_namespace()), mailbox_guid, counters);
+}
+
+int RadosStorageImpl::write_counters(const std::string &mailbox_guid, const RadosCounters &counters) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  return RadosCounters::write(&get_recovery_io_ctx(), RadosCounters::get_oid(get_namespace()), mailbox_guid,
+                              counters);
+}
+
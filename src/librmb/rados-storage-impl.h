@@ -41,9 +41,13 @@ class RadosStorageImpl : public RadosStorage {
   std::string get_pool_name() override { return pool_name; }
 
   void set_ceph_wait_method(enum rbox_ceph_aio_wait_method wait_method_) { this->wait_method = wait_method_; }
+  void set_read_flags(int read_flags_) override { this->read_flags = read_flags_; }
+  int get_read_flags() override { return read_flags; }
   int get_max_write_size() override { return max_write_size; }
   int get_max_write_size_bytes() override { return max_write_size * 1024 * 1024; }
   int get_max_object_size() override {return max_object_size;}
+  bool is_erasure_coded() override { return erasure_coded; }
+  uint64_t get_stripe_alignment() override { return stripe_alignment; }
 
   int split_buffer_and_exec_op(RadosMail *current_object, librados::ObjectWriteOperation *write_op_xattr,
                                const uint64_t &max_write) override;
@@ -53,6 +57,8 @@ class RadosStorageImpl : public RadosStorage {
 
   int aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                   librados::ObjectWriteOperation *op) override;
+  int aio_read(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+               librados::bufferlist *pbl, size_t len, uint64_t off) override;
   librados::NObjectIterator find_mails(const RadosMetadata *attr) override;
   
   std::set<std::string> find_mails_async(const RadosMetadata *attr, std::string &pool_name, int num_threads, void (*ptr)(std::string&)) override;
@@ -71,6 +77,7 @@ class RadosStorageImpl : public RadosStorage {
                                           librados::ObjectWriteOperation *write_operation) override;
 
   bool wait_for_rados_operations(const std::list<librmb::RadosMail *> &object_list) override;
+  int wait_for_read_operation_complete(librados::AioCompletion *completion) override;
 
   int read_mail(const std::string &oid, librados::bufferlist *buffer) override;
   int move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
@@ -92,17 +99,27 @@ class RadosStorageImpl : public RadosStorage {
   std::set<std::string> ceph_index_read() override;
   int ceph_index_delete() override;
 
+  int update_counters(const std::string &mailbox_guid, const RadosCounters &delta) override;
+  int read_counters(const std::string &mailbox_guid, RadosCounters *counters) override;
+  int write_counters(const std::string &mailbox_guid, const RadosCounters &counters) override;
+
   bool execute_operation(std::string &oid, librados::ObjectWriteOperation *write_op_xattr) override;
   bool append_to_object(std::string &oid, librados::bufferlist &bufferlist, int length) override;
   int read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist) override;
+  int aio_read_operate(const std::string &oid, librados::AioCompletion *c,
+                       librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist,
+                       int flags) override;
 
  private:
   int create_connection(const std::string &poolname,const std::string &index_pool);
+  int ceph_index_append_buffer(librados::bufferlist &bl);
 
  private:
   RadosCluster *cluster;
   int max_write_size;
   int max_object_size;
+  bool erasure_coded;
+  uint64_t stripe_alignment;
   std::string nspace;
   librados::IoCtx io_ctx;
   librados::IoCtx recovery_io_ctx;
@@ -110,6 +127,9 @@ class RadosStorageImpl : public RadosStorage {
   bool io_ctx_created;
   std::string pool_name;
   enum rbox_ceph_aio_wait_method wait_method;
+  int read_flags;
+  /** size of the ceph index object of the current namespace, -1 if unknown **/
+  int64_t ceph_index_cached_size;
 
   static const char *CFG_OSD_MAX_WRITE_SIZE;
   static const char *CFG_OSD_MAX_OBJECT_SIZE;
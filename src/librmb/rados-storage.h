@@ -18,6 +18,7 @@
 
 #include <rados/librados.hpp>
 #include "rados-cluster.h"
+#include "rados-counters.h"
 #include "rados-mail.h"
 #include "rados-types.h"
 
@@ -74,6 +75,9 @@ underTest.ceph_index_add("dkfkjdf")
 
   /* set the wait method for async operations */
   virtual void set_ceph_wait_method(enum rbox_ceph_aio_wait_method wait_method) = 0;
+  /* set the librados operation flags of all reads (e.g. librados::OPERATION_BALANCE_READS), 0 reads from the primary */
+  virtual void set_read_flags(int read_flags) = 0;
+  virtual int get_read_flags() = 0;
 
   /*! get the max operation size in mb
    * @return the maximal number of mb to write in a single write operation*/
@@ -86,6 +90,14 @@ underTest.ceph_index_add("dkfkjdf")
    */
   virtual int get_max_object_size() = 0;
 
+  /*! erasure coded pools do not support omap, metadata is kept in xattrs and
+   *  mails are written with full (or stripe aligned append) writes.
+   * @return true if the mail pool is erasure coded
+   */
+  virtual bool is_erasure_coded() = 0;
+  /*! @return required write alignment (stripe width) of the pool or 0 */
+  virtual uint64_t get_stripe_alignment() = 0;
+
   /*! In case the current object size exceeds the max_write (bytes), object should be split into
    * max smaller operations and executed separately.
    *
@@ -118,6 +130,15 @@ underTest.ceph_index_add("dkfkjdf")
    * */
   virtual int aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                           librados::ObjectWriteOperation *op) = 0;
+  /*! asynchron read of len bytes at offset off
+   *
+   * @param[in] io_ctx valid io context or nullptr for the io context of the storage
+   * @param[in] oid object identifier
+   * @param[in] c valid pointer to a completion.
+   * @param[out] pbl valid pointer to the bufferlist, which is filled when the read completes.
+   * */
+  virtual int aio_read(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                       librados::bufferlist *pbl, size_t len, uint64_t off) = 0;
   /*! search for mails based on given Filter
    * @param[in] attr a list of filter attributes
    *
@@ -176,13 +197,18 @@ underTest.ceph_index_add("dkfkjdf")
   virtual bool wait_for_write_operations_complete(librados::AioCompletion *completion,
                                                   librados::ObjectWriteOperation *write_operation) = 0;
   /*!
-   * wait for all rados operations
+   * wait for all rados operations (aio) of the given mails. The completion
+   * is released and the write operation is deleted for each mail.
    *
    * @param[in] object_list list of outstanding rados objects
    *
-   * @return true if successful
+   * @return false if successful !!!!
    */
   virtual bool wait_for_rados_operations(const std::list<librmb::RadosMail *> &object_list) = 0;
+  /*! wait for a read started with aio_read or aio_read_operate, the completion is released.
+   * @return linux error code or number of bytes read
+   */
+  virtual int wait_for_read_operation_complete(librados::AioCompletion *completion) = 0;
 
   /*! save the mail object
    *
@@ -221,10 +247,31 @@ underTest.ceph_index_add("dkfkjdf")
   virtual int ceph_index_delete() = 0;
 
   /**
-   * returns the ceph index size
+   * returns the ceph index size. The size is stat'ed once per namespace and
+   * then updated by the appends of this process, so appends of other
+   * processes are not included.
   */
   virtual uint64_t ceph_index_size() = 0;
 
+  /**
+   * add delta to the counters of the mailbox and of the user (current namespace)
+   * within one atomic operation.
+   * @return linux errorcode or 0 if successful
+  */
+  virtual int update_counters(const std::string &mailbox_guid, const RadosCounters &delta) = 0;
+
+  /**
+   * read the counters of the mailbox, or of the user if mailbox_guid is empty.
+   * @return linux errorcode or 0 if successful
+  */
+  virtual int read_counters(const std::string &mailbox_guid, RadosCounters *counters) = 0;
+
+  /**
+   * overwrite the counters of the mailbox, or of the user if mailbox_guid is empty.
+   * @return linux errorcode or 0 if successful
+  */
+  virtual int write_counters(const std::string &mailbox_guid, const RadosCounters &counters) = 0;
+
   /*! read the complete mail object into bufferlist
    *
    * @param[in] oid unique object identifier
@@ -242,6 +289,19 @@ underTest.ceph_index_add("dkfkjdf")
    * */
   virtual int read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist) = 0;
 
+  /*! asynchron read operation, wait for it with wait_for_read_operation_complete
+   *
+   * @param[in] oid unique object identifier
+   * @param[in] c valid pointer to a completion.
+   * @param[in] read_operation read operation
+   * @param[out] buffer valid ptr to bufferlist.
+   * @param[in] flags librados operation flags in addition to the read flags
+   * @return linux errorcode or 0 if successful
+   * */
+  virtual int aio_read_operate(const std::string &oid, librados::AioCompletion *c,
+                               librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist,
+                               int flags) = 0;
+
   /*! move a object from the given namespace to the other, updates the metadata given in to_update list
    *
    * @param[in] src_oid unique identifier of source object
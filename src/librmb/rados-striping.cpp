@@ -0,0 +1,265 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-striping.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <list>
+#include "rados-types.h"
+
+namespace librmb {
+
+struct RadosStripeOp {
+  librados::AioCompletion *completion;
+  librados::ObjectWriteOperation *write_op;
+};
+
+/* wait for the oldest op in flight, -ENOENT is ignored if ignore_enoent is set */
+static int wait_for_stripe_op(std::list<RadosStripeOp> *pending, bool ignore_enoent) {
+  RadosStripeOp op = pending->front();
+  pending->pop_front();
+  op.completion->wait_for_complete();
+  int ret = op.completion->get_return_value();
+  op.completion->release();
+  delete op.write_op;
+  if (ret == -ENOENT && ignore_enoent) {
+    ret = 0;
+  }
+  return ret < 0 ? ret : 0;
+}
+
+static int wait_for_stripe_ops(std::list<RadosStripeOp> *pending, bool ignore_enoent) {
+  int ret = 0;
+  while (!pending->empty()) {
+    int op_ret = wait_for_stripe_op(pending, ignore_enoent);
+    if (op_ret < 0) {
+      ret = op_ret;
+    }
+  }
+  return ret;
+}
+
+/* issue the write op, ops in flight are limited to RBOX_STRIPE_MAX_PENDING_OPS */
+static int aio_stripe_op(librados::IoCtx *io_ctx, const std::string &oid, librados::ObjectWriteOperation *write_op,
+                         std::list<RadosStripeOp> *pending, bool ignore_enoent) {
+  RadosStripeOp op;
+  op.write_op = write_op;
+  op.completion = librados::Rados::aio_create_completion();
+  int ret = io_ctx->aio_operate(oid, op.completion, op.write_op);
+  if (ret < 0) {
+    op.completion->release();
+    delete op.write_op;
+    return ret;
+  }
+  pending->push_back(op);
+  if (pending->size() > RBOX_STRIPE_MAX_PENDING_OPS) {
+    return wait_for_stripe_op(pending, ignore_enoent);
+  }
+  return 0;
+}
+
+std::string RadosStriping::to_manifest(uint64_t stripe_size, uint64_t size) {
+  return std::to_string(get_stripe_count(stripe_size, size)) + ":" + std::to_string(stripe_size) + ":" +
+         std::to_string(size);
+}
+
+bool RadosStriping::parse_manifest(const std::string &manifest, uint32_t *stripe_count, uint64_t *stripe_size,
+                                   uint64_t *size) {
+  std::size_t first = manifest.find(':');
+  std::size_t second = first == std::string::npos ? std::string::npos : manifest.find(':', first + 1);
+  if (second == std::string::npos) {
+    return false;
+  }
+  try {
+    *stripe_count = static_cast<uint32_t>(std::stoul(manifest.substr(0, first)));
+    *stripe_size = std::stoull(manifest.substr(first + 1, second - first - 1));
+    *size = std::stoull(manifest.substr(second + 1));
+  } catch (std::exception &ex) {
+    return false;
+  }
+  return *stripe_size > 0 && *stripe_count > 1 && *stripe_count == get_stripe_count(*stripe_size, *size);
+}
+
+uint32_t RadosStriping::get_stripe_count(uint64_t stripe_size, uint64_t size) {
+  if (stripe_size == 0 || size == 0) {
+    return 1;
+  }
+  return static_cast<uint32_t>((size + stripe_size - 1) / stripe_size);
+}
+
+std::string RadosStriping::get_stripe_oid(const std::string &oid, uint32_t index) {
+  return oid + "." + std::to_string(index);
+}
+
+void RadosStriping::get_extents(uint64_t offset, uint64_t length, uint64_t stripe_size,
+                                std::vector<RadosStripeExtent> *extents) {
+  uint64_t buffer_offset = 0;
+  while (buffer_offset < length) {
+    RadosStripeExtent extent;
+    extent.index = static_cast<uint32_t>(offset / stripe_size);
+    extent.object_offset = offset % stripe_size;
+    extent.buffer_offset = buffer_offset;
+    extent.length = std::min(stripe_size - extent.object_offset, length - buffer_offset);
+    extents->push_back(extent);
+    offset += extent.length;
+    buffer_offset += extent.length;
+  }
+}
+
+void RadosStriping::get_io_ctx(librados::IoCtx *io_ctx, librados::IoCtx *stripe_io_ctx) {
+  stripe_io_ctx->dup(*io_ctx);
+  stripe_io_ctx->set_namespace(io_ctx->get_namespace() + RBOX_STRIPE_NAMESPACE_SUFFIX);
+}
+
+int RadosStriping::write_stripes(librados::IoCtx *io_ctx, const std::string &oid, librados::bufferlist &data,
+                                 uint64_t offset, uint64_t stripe_size) {
+  if (stripe_size == 0 || offset < stripe_size) {
+    // stripe 0 is the mail object, which is written by the caller.
+    return -EINVAL;
+  }
+  librados::IoCtx stripe_io_ctx;
+  get_io_ctx(io_ctx, &stripe_io_ctx);
+
+  std::vector<RadosStripeExtent> extents;
+  get_extents(offset, data.length(), stripe_size, &extents);
+
+  std::list<RadosStripeOp> pending;
+  int ret = 0;
+  for (const auto &extent : extents) {
+    librados::bufferlist stripe;
+    stripe.substr_of(data, extent.buffer_offset, extent.length);
+    librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
+    if (extent.object_offset == 0) {
+      // full stripe (or the first part of it): also valid on erasure coded pools
+      write_op->write_full(stripe);
+    } else {
+      write_op->write(extent.object_offset, stripe);
+    }
+    ret = aio_stripe_op(&stripe_io_ctx, get_stripe_oid(oid, extent.index), write_op, &pending, false);
+    if (ret < 0) {
+      break;
+    }
+  }
+  int wait_ret = wait_for_stripe_ops(&pending, false);
+  return ret < 0 ? ret : wait_ret;
+}
+
+int RadosStriping::read_stripes(librados::IoCtx *io_ctx, const std::string &oid, const std::string &manifest,
+                                librados::bufferlist *data) {
+  uint32_t stripe_count;
+  uint64_t stripe_size;
+  uint64_t size;
+  if (!parse_manifest(manifest, &stripe_count, &stripe_size, &size) || data->length() != stripe_size) {
+    return -EIO;
+  }
+  librados::IoCtx stripe_io_ctx;
+  get_io_ctx(io_ctx, &stripe_io_ctx);
+
+  // all stripes are read in parallel, a window would only delay the last stripes.
+  std::vector<librados::bufferlist> stripes(stripe_count);
+  std::vector<librados::AioCompletion *> completions(stripe_count, nullptr);
+  int ret = 0;
+  for (uint32_t i = 1; i < stripe_count; i++) {
+    uint64_t length = std::min(stripe_size, size - i * stripe_size);
+    completions[i] = librados::Rados::aio_create_completion();
+    ret = stripe_io_ctx.aio_read(get_stripe_oid(oid, i), completions[i], &stripes[i], length, 0);
+    if (ret < 0) {
+      completions[i]->release();
+      completions[i] = nullptr;
+      break;
+    }
+  }
+  for (uint32_t i = 1; i < stripe_count; i++) {
+    if (completions[i] == nullptr) {
+      break;
+    }
+    completions[i]->wait_for_complete();
+    int read_ret = completions[i]->get_return_value();
+    completions[i]->release();
+    if (ret >= 0 && read_ret < 0) {
+      ret = read_ret;
+    } else if (ret >= 0 && stripes[i].length() != std::min(stripe_size, size - i * stripe_size)) {
+      // truncated stripe
+      ret = -EIO;
+    }
+  }
+  if (ret < 0) {
+    return ret == -ENOENT ? -EIO : ret;
+  }
+  for (uint32_t i = 1; i < stripe_count; i++) {
+    data->claim_append(stripes[i]);
+  }
+  return 0;
+}
+
+int RadosStriping::remove_stripes(librados::IoCtx *io_ctx, const std::string &oid, const std::string &manifest) {
+  uint32_t stripe_count;
+  uint64_t stripe_size;
+  uint64_t size;
+  if (!parse_manifest(manifest, &stripe_count, &stripe_size, &size)) {
+    return -EINVAL;
+  }
+  librados::IoCtx stripe_io_ctx;
+  get_io_ctx(io_ctx, &stripe_io_ctx);
+
+  std::list<RadosStripeOp> pending;
+  int ret = 0;
+  for (uint32_t i = 1; i < stripe_count && ret >= 0; i++) {
+    librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
+    write_op->remove();
+    ret = aio_stripe_op(&stripe_io_ctx, get_stripe_oid(oid, i), write_op, &pending, true);
+  }
+  int wait_ret = wait_for_stripe_ops(&pending, true);
+  return ret < 0 ? ret : wait_ret;
+}
+
+int RadosStriping::copy_stripes(librados::IoCtx *src_io_ctx, const std::string &src_oid,
+                                librados::IoCtx *dest_io_ctx, const std::string &dest_oid,
+                                const std::string &manifest) {
+  uint32_t stripe_count;
+  uint64_t stripe_size;
+  uint64_t size;
+  if (!parse_manifest(manifest, &stripe_count, &stripe_size, &size)) {
+    return -EINVAL;
+  }
+  librados::IoCtx src_stripe_io_ctx;
+  get_io_ctx(src_io_ctx, &src_stripe_io_ctx);
+  librados::IoCtx dest_stripe_io_ctx;
+  get_io_ctx(dest_io_ctx, &dest_stripe_io_ctx);
+
+  std::list<RadosStripeOp> pending;
+  int ret = 0;
+  for (uint32_t i = 1; i < stripe_count && ret >= 0; i++) {
+    librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
+#if LIBRADOS_VERSION_CODE >= 30000
+    write_op->copy_from(get_stripe_oid(src_oid, i), src_stripe_io_ctx, 0, 0);
+#else
+    write_op->copy_from(get_stripe_oid(src_oid, i), src_stripe_io_ctx, 0);
+#endif
+    ret = aio_stripe_op(&dest_stripe_io_ctx, get_stripe_oid(dest_oid, i), write_op, &pending, false);
+  }
+  int wait_ret = wait_for_stripe_ops(&pending, false);
+  return ret < 0 ? ret : wait_ret;
+}
+
+int RadosStriping::get_manifest(librados::IoCtx *io_ctx, const std::string &oid, std::string *manifest) {
+  librados::bufferlist bl;
+  int ret = io_ctx->getxattr(oid, rbox_metadata_key_to_char(RBOX_METADATA_STRIPES), bl);
+  if (ret == -ENODATA) {
+    // not striped
+    ret = 0;
+  }
+  *manifest = ret >= 0 ? bl.to_str() : "";
+  return ret < 0 ? ret : 0;
+}
+
+}  // namespace librmb
@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_STRIPING_H_
+#define SRC_LIBRMB_RADOS_STRIPING_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <rados/librados.hpp>
+
+/** the stripes of a mail are stored in <namespace of the mail><suffix> **/
+#define RBOX_STRIPE_NAMESPACE_SUFFIX "_stripes"
+/** max. number of stripe reads/writes in flight **/
+#define RBOX_STRIPE_MAX_PENDING_OPS 8
+
+namespace librmb {
+
+/**
+ * part of a write / read, which belongs to one stripe object
+ */
+struct RadosStripeExtent {
+  uint32_t index;
+  /** offset within the stripe object **/
+  uint64_t object_offset;
+  /** offset within the buffer, which is written / read **/
+  uint64_t buffer_offset;
+  uint64_t length;
+};
+
+/**
+ * RadosStriping
+ *
+ * Mails larger than the stripe size are split into stripe objects of equal size.
+ * Stripe 0 is the mail object itself, which also holds the metadata and the
+ * manifest (RBOX_METADATA_STRIPES). Stripes 1..n-1 are named <oid>.<index> and
+ * stored in a separate namespace, so that they are not listed as mails.
+ * The manifest is always stored as xattr.
+ */
+class RadosStriping {
+ public:
+  /*!
+   * @return value of the RBOX_METADATA_STRIPES attribute: <stripe_count>:<stripe_size>:<size>
+   */
+  static std::string to_manifest(uint64_t stripe_size, uint64_t size);
+  /*!
+   * @return false if manifest is not valid
+   */
+  static bool parse_manifest(const std::string &manifest, uint32_t *stripe_count, uint64_t *stripe_size,
+                             uint64_t *size);
+  static uint32_t get_stripe_count(uint64_t stripe_size, uint64_t size);
+  static std::string get_stripe_oid(const std::string &oid, uint32_t index);
+  /*!
+   * split the range [offset, offset + length) of the mail at the stripe boundaries.
+   */
+  static void get_extents(uint64_t offset, uint64_t length, uint64_t stripe_size,
+                          std::vector<RadosStripeExtent> *extents);
+  /*!
+   * io_ctx of the stripes of the mails in io_ctx's pool and namespace.
+   */
+  static void get_io_ctx(librados::IoCtx *io_ctx, librados::IoCtx *stripe_io_ctx);
+
+  /*!
+   * write data, which starts at offset (>= stripe_size) of the mail, to the stripes 1..n-1.
+   * The stripes are written in parallel, stripes starting at object offset 0 are written with write_full.
+   * @return linux error code or 0 if sucessful
+   */
+  static int write_stripes(librados::IoCtx *io_ctx, const std::string &oid, librados::bufferlist &data,
+                           uint64_t offset, uint64_t stripe_size);
+  /*!
+   * read the stripes 1..n-1 in parallel and append them to data (which holds stripe 0).
+   * @return linux error code or 0 if sucessful
+   */
+  static int read_stripes(librados::IoCtx *io_ctx, const std::string &oid, const std::string &manifest,
+                          librados::bufferlist *data);
+  /*!
+   * remove the stripes 1..n-1, already removed stripes are ignored.
+   * @return linux error code or 0 if sucessful
+   */
+  static int remove_stripes(librados::IoCtx *io_ctx, const std::string &oid, const std::string &manifest);
+  /*!
+   * copy the stripes 1..n-1 (server side) to the stripes of dest_oid
+   * @return linux error code or 0 if sucessful
+   */
+  static int copy_stripes(librados::IoCtx *src_io_ctx, const std::string &src_oid, librados::IoCtx *dest_io_ctx,
+                          const std::string &dest_oid, const std::string &manifest);
+  /*!
+   * @param[out] manifest empty if the mail is not striped
+   * @return linux error code or 0 if sucessful
+   */
+  static int get_manifest(librados::IoCtx *io_ctx, const std::string &oid, std::string *manifest);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_STRIPING_H_
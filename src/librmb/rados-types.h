@@ -14,6 +14,8 @@
 
 namespace librmb {
 #define GUID_128_SIZE 16
+/** keywords (extended metadata) are stored as xattr with this prefix if the pool has no omap (erasure coded) **/
+#define RBOX_KEYWORD_XATTR_PREFIX "kw."
 /**
  * The available metadata keys used as rados
  * omap / xattribute
@@ -39,7 +41,8 @@ enum rbox_metadata_key {
   /** Virtual message size in hex (line feeds counted as CRLF) **/
   RBOX_METADATA_VIRTUAL_SIZE = 'V',
   /** Pointer to external message data. Format is:
-     1*(<start offset> <byte count> <options> <ref>) **/
+     1*(<start offset> <byte count> <options> <ref>)
+     rbox: oid of the shared body (single instance storage), always stored as xattr. **/
   RBOX_METADATA_EXT_REF = 'X',
   /** Mailbox name where this message was originally saved to.
      When rebuild finds a message whose mailbox is unknown, it's
@@ -62,6 +65,26 @@ enum rbox_metadata_key {
    * private flags.
    */
   RBOX_METADATA_PVT_FLAGS = 'C',
+  /**
+   * codec (e.g. zstd) the mail body is compressed with by librmb.
+   * Always stored as xattr, independent of the metadata storage module.
+   */
+  RBOX_METADATA_COMPRESSION = 'Y',
+  /**
+   * crc32c of the mail content as written by dovecot (8 hex digits),
+   * calculated before librmb compression.
+   */
+  RBOX_METADATA_CHECKSUM = 'H',
+  /**
+   * manifest of a mail, which is split into stripe objects (see RadosStriping).
+   * Always stored as xattr.
+   */
+  RBOX_METADATA_STRIPES = 'T',
+  /**
+   * length of the mail header including the empty line, which terminates it.
+   * Allows header only reads (ENVELOPE, BODY[HEADER]). Always stored as xattr.
+   */
+  RBOX_METADATA_HEADER_SIZE = 'L',
   /** metadata used by old Dovecot versions **/
   RBOX_METADATA_OLDV1_EXPUNGED = 'E',
   /** saved as uint**/
@@ -107,6 +130,14 @@ static const char *rbox_metadata_key_to_char(rbox_metadata_key type) {
       return "A";
     case RBOX_METADATA_PVT_FLAGS:
       return "C";
+    case RBOX_METADATA_COMPRESSION:
+      return "Y";
+    case RBOX_METADATA_CHECKSUM:
+      return "H";
+    case RBOX_METADATA_STRIPES:
+      return "T";
+    case RBOX_METADATA_HEADER_SIZE:
+      return "L";
     case RBOX_METADATA_OLDV1_EXPUNGED:
       return "E";
     case RBOX_METADATA_OLDV1_FLAGS:
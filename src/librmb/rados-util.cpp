@@ -22,10 +22,17 @@
 #include <set>
 #include <cctype>
 #include <algorithm>
+#include <mutex>
 #include "encoding.h"
+#include "rados-striping.h"
+#include "rados-single-instance.h"
 
 namespace librmb {
 
+  // pool id -> omap supported, known for every pool a connection has been created for
+  static std::mutex pools_omap_supported_mutex;
+  static std::map<int64_t, bool> pools_omap_supported;
+
   RadosUtils::RadosUtils() {}
 
   RadosUtils::~RadosUtils() {}
@@ -123,6 +130,15 @@ namespace librmb {
     return io_ctx->omap_get_vals_by_keys(oid, extended_keys, kv_map);
   }
 
+  void RadosUtils::get_all_keys_and_values(librados::ObjectReadOperation *read_op,
+                                           std::map<std::string, librados::bufferlist> *kv_map, int *prval) {
+  #ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+    read_op->omap_get_vals2("", LONG_MAX, kv_map, nullptr, prval);
+  #else
+    read_op->omap_get_vals("", LONG_MAX, kv_map, prval);
+  #endif
+  }
+
   void RadosUtils::resolve_flags(const uint8_t &flags, std::string *flat) {
     std::stringbuf buf;
     std::ostream os(&buf);
@@ -166,6 +182,29 @@ namespace librmb {
     return osd_add(ioctx, oid, key, -value_to_subtract);
   }
 
+  void RadosUtils::osd_add(librados::ObjectWriteOperation *write_op, const std::string &key, long long value_to_add) {
+    librados::bufferlist in;
+    encode(key, in);
+    encode(std::to_string(value_to_add), in);
+    write_op->exec("numops", "add", in);
+  }
+
+  int RadosUtils::aio_operate_mail(librados::IoCtx *ioctx, RadosMail *mail, librados::ObjectWriteOperation *write_op) {
+    if (mail->get_completion() == nullptr) {
+      mail->set_completion(librados::Rados::aio_create_completion());
+    }
+    int ret = ioctx->aio_operate(*mail->get_oid(), mail->get_completion(), write_op);
+    if (ret < 0) {
+      // nothing to wait for
+      mail->get_completion()->release();
+      mail->set_completion(nullptr);
+      mail->set_active_op(0);
+    } else {
+      mail->set_active_op(1);
+    }
+    return ret;
+  }
+
   /*!
     * @return reference to all write operations related with this object
     */
@@ -233,10 +272,18 @@ namespace librmb {
     int ret = -1;
     ret = copy_to_alt(oid, oid, primary, alt_storage, metadata, inverse);
     if (ret > 0) {
-      if (inverse) {
-        ret = alt_storage->get_io_ctx().remove(oid);
-      } else {
-        ret = primary->get_io_ctx().remove(oid);
+      librados::IoCtx *src_io_ctx = inverse ? &alt_storage->get_io_ctx() : &primary->get_io_ctx();
+      std::string manifest;
+      RadosStriping::get_manifest(src_io_ctx, oid, &manifest);
+      librados::bufferlist ext_ref;
+      src_io_ctx->getxattr(oid, rbox_metadata_key_to_char(RBOX_METADATA_EXT_REF), ext_ref);
+      ret = src_io_ctx->remove(oid);
+      if (ret >= 0 && !manifest.empty()) {
+        RadosStriping::remove_stripes(src_io_ctx, oid, manifest);
+      }
+      // the moved mail holds its own copy of the body (see copy_to_alt)
+      if (ret >= 0 && ext_ref.length() > 0) {
+        RadosSingleInstance::remove_ref(src_io_ctx, ext_ref.to_str());
       }
     }
     return ret;
@@ -256,7 +303,21 @@ namespace librmb {
     librados::bufferlist *bl = new librados::bufferlist();
     mail.set_mail_buffer(bl);
 
-    if (inverse) {
+    // striped mail: the mail object is copied with the first stripe, the other stripes server side.
+    librados::IoCtx *src_io_ctx = inverse ? &alt_storage->get_io_ctx() : &primary->get_io_ctx();
+    librados::IoCtx *dest_io_ctx = inverse ? &primary->get_io_ctx() : &alt_storage->get_io_ctx();
+    std::string manifest;
+    RadosStriping::get_manifest(src_io_ctx, src_oid, &manifest);
+
+    if (!manifest.empty()) {
+      ret = src_io_ctx->read(src_oid, *mail.get_mail_buffer(), INT_MAX, 0);
+      if (ret >= 0) {
+        ret = RadosStriping::copy_stripes(src_io_ctx, src_oid, dest_io_ctx, dest_oid, manifest);
+      }
+      if (inverse) {
+        metadata->get_storage()->set_io_ctx(&alt_storage->get_io_ctx());
+      }
+    } else if (inverse) {
       ret = alt_storage->read_mail(src_oid, mail.get_mail_buffer());
       metadata->get_storage()->set_io_ctx(&alt_storage->get_io_ctx());
     } else {
@@ -275,10 +336,28 @@ namespace librmb {
       return ret;
     }
 
+    // single instance storage: the shared body is only referenced in the pool it was saved to,
+    // so the copy gets the full body instead of the reference.
+    std::map<std::string, librados::bufferlist>::iterator ext_ref =
+        mail.get_metadata()->find(rbox_metadata_key_to_char(RBOX_METADATA_EXT_REF));
+    if (ext_ref != mail.get_metadata()->end()) {
+      ret = RadosSingleInstance::read_body(src_io_ctx, ext_ref->second.to_str(), mail.get_mail_buffer());
+      if (ret < 0) {
+        return ret;
+      }
+      mail.get_metadata()->erase(ext_ref);
+      mail.set_mail_size(mail.get_mail_buffer()->length());
+    }
+
     mail.set_oid(dest_oid);
 
     librados::ObjectWriteOperation write_op;  // = new librados::ObjectWriteOperation();
     metadata->get_storage()->save_metadata(&write_op, &mail);
+    if (!manifest.empty()) {
+      librados::bufferlist manifest_bl;
+      manifest_bl.append(manifest);
+      write_op.setxattr(rbox_metadata_key_to_char(RBOX_METADATA_STRIPES), manifest_bl);
+    }
 
     bool success;
     if (inverse) {
@@ -399,4 +478,89 @@ namespace librmb {
       return RadosUtils::object_size_percent(object_size, max_object_size) > 80;
   }
 
+  void RadosUtils::set_omap_supported(int64_t pool_id, bool supported) {
+    std::lock_guard<std::mutex> lock(pools_omap_supported_mutex);
+    pools_omap_supported[pool_id] = supported;
+  }
+
+  bool RadosUtils::get_omap_supported(int64_t pool_id, bool *supported) {
+    std::lock_guard<std::mutex> lock(pools_omap_supported_mutex);
+    auto it = pools_omap_supported.find(pool_id);
+    if (it == pools_omap_supported.end()) {
+      return false;
+    }
+    *supported = it->second;
+    return true;
+  }
+
+  bool RadosUtils::is_omap_supported(librados::IoCtx *io_ctx) {
+    bool supported = true;
+    get_omap_supported(io_ctx->get_id(), &supported);
+    return supported;
+  }
+
+  void RadosUtils::set_keyword_metadata(librados::ObjectWriteOperation *write_op, bool omap_supported,
+                                        const std::map<std::string, ceph::bufferlist> &keywords) {
+    if (omap_supported) {
+      write_op->omap_set(keywords);
+      return;
+    }
+    for (std::map<std::string, ceph::bufferlist>::const_iterator it = keywords.begin(); it != keywords.end(); ++it) {
+      ceph::bufferlist bl = it->second;
+      write_op->setxattr(get_keyword_xattr_key(it->first).c_str(), bl);
+    }
+  }
+
+  int RadosUtils::load_keyword_xattrs(librados::IoCtx *io_ctx, const std::string &oid,
+                                      const std::set<std::string> &keys,
+                                      std::map<std::string, ceph::bufferlist> *keywords) {
+    std::map<std::string, ceph::bufferlist> xattrs;
+    int ret = io_ctx->getxattrs(oid, xattrs);
+    if (ret < 0) {
+      return ret;
+    }
+    for (std::set<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+      std::map<std::string, ceph::bufferlist>::iterator xattr = xattrs.find(get_keyword_xattr_key(*it));
+      if (xattr != xattrs.end()) {
+        (*keywords)[*it] = xattr->second;
+      }
+    }
+    return 0;
+  }
+
+  void RadosUtils::move_keyword_xattrs(std::map<std::string, ceph::bufferlist> *metadata,
+                                       std::map<std::string, ceph::bufferlist> *keywords) {
+    size_t prefix_length = strlen(RBOX_KEYWORD_XATTR_PREFIX);
+    for (std::map<std::string, ceph::bufferlist>::iterator it = metadata->begin(); it != metadata->end();) {
+      if (it->first.compare(0, prefix_length, RBOX_KEYWORD_XATTR_PREFIX) == 0) {
+        (*keywords)[it->first.substr(prefix_length)] = it->second;
+        it = metadata->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  int64_t RadosUtils::scan_header_end(const char *data, size_t size, int *state) {
+    // state: 0 = at the start of a line, 1 = start of line + CR, 2 = within a line
+    for (size_t i = 0; i < size; i++) {
+      switch (data[i]) {
+        case '\n':
+          if (*state != 2) {
+            *state = 0;
+            return i + 1;
+          }
+          *state = 0;
+          break;
+        case '\r':
+          *state = *state == 0 ? 1 : 2;
+          break;
+        default:
+          *state = 2;
+          break;
+      }
+    }
+    return -1;
+  }
+
 }  // namespace librmb
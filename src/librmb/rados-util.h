@@ -19,6 +19,7 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <set>
 #include <regex>
 
 #include <string>
@@ -109,6 +110,14 @@ class RadosUtils {
    */
   static int get_all_keys_and_values(librados::IoCtx *io_ctx, const std::string &oid,
                                      std::map<std::string, librados::bufferlist> *kv_map);
+  /*!
+   * add the read of all key value pairs to the read operation
+   * @param[in] read_op valid read operation
+   * @param[out] kv_map valid ptr to key value map, filled when read_op is complete.
+   * @param[out] prval return value of the read
+   */
+  static void get_all_keys_and_values(librados::ObjectReadOperation *read_op,
+                                      std::map<std::string, librados::bufferlist> *kv_map, int *prval);
   /*!
    * get the text representation of uint flags.
    * @param[in] flags
@@ -160,6 +169,24 @@ class RadosUtils {
    */
   static int osd_sub(librados::IoCtx *ioctx, const std::string &oid, const std::string &key,
                      long long value_to_subtract);
+  /*!
+   * add the increment (add) of the value to write_op, several keys of an object can be
+   * incremented within one atomic operation.
+   * @param[in] write_op
+   * @param[in] key
+   * @param[in] value_to_add (negative to decrement)
+   */
+  static void osd_add(librados::ObjectWriteOperation *write_op, const std::string &key, long long value_to_add);
+  /*!
+   * execute write_op async with the mail's completion (created if not yet set).
+   * wait with RadosStorage::wait_for_rados_operations.
+   * @param[in] ioctx
+   * @param[in] mail
+   * @param[in] write_op
+   *
+   * @return linux error code or 0 if sucessful
+   */
+  static int aio_operate_mail(librados::IoCtx *ioctx, RadosMail *mail, librados::ObjectWriteOperation *write_op);
 
   /*!
    * check all given metadata key is valid
@@ -203,6 +230,43 @@ class RadosUtils {
   static std::set<std::string> ceph_index_to_set(const std::string &str);
   static double object_size_percent(const double object_size, const double max_object_size);
   static bool object_size_close_to_reach_max(const double object_size, const double max_object_size);
+
+  /*!
+   * register if the pool supports omap (erasure coded pools do not).
+   */
+  static void set_omap_supported(int64_t pool_id, bool supported);
+  /*!
+   * @param[out] supported registered value
+   * @return false if nothing is registered for the pool yet
+   */
+  static bool get_omap_supported(int64_t pool_id, bool *supported);
+  /*!
+   * @return false if keywords need to be stored as xattr (RBOX_KEYWORD_XATTR_PREFIX)
+   */
+  static bool is_omap_supported(librados::IoCtx *io_ctx);
+  /*!
+   * add keywords to write_op, as omap or as prefixed xattrs.
+   */
+  static void set_keyword_metadata(librados::ObjectWriteOperation *write_op, bool omap_supported,
+                                   const std::map<std::string, ceph::bufferlist> &keywords);
+  /*!
+   * move the prefixed keyword xattrs from metadata to keywords.
+   */
+  static void move_keyword_xattrs(std::map<std::string, ceph::bufferlist> *metadata,
+                                  std::map<std::string, ceph::bufferlist> *keywords);
+  static std::string get_keyword_xattr_key(const std::string &key) { return RBOX_KEYWORD_XATTR_PREFIX + key; }
+  /*!
+   * load the given keywords stored as xattr, missing keywords are skipped (like omap_get_vals_by_keys).
+   */
+  static int load_keyword_xattrs(librados::IoCtx *io_ctx, const std::string &oid, const std::set<std::string> &keys,
+                                 std::map<std::string, ceph::bufferlist> *keywords);
+  /*!
+   * scan the next part of a mail for the empty line, which terminates the header.
+   * @param[in,out] state scan state between the parts, 0 at the start of the mail
+   * @return number of bytes of data up to and including the empty line or -1 if
+   *         the header does not end within data.
+   */
+  static int64_t scan_header_end(const char *data, size_t size, int *state);
 };
 
 }  // namespace librmb
@@ -13,6 +13,7 @@
 #include <time.h>
 #include <algorithm>  // std::sort
 #include <cstdio>
+#include <climits>
 
 #include "../../rados-cluster-impl.h"
 #include "../../rados-storage-impl.h"
@@ -23,6 +24,10 @@
 #include "rados-metadata-storage-ima.h"
 #include "rados-metadata-storage-default.h"
 #include "ls_cmd_parser.h"
+#include "rados-checksum.h"
+#include "rados-compression.h"
+#include "rados-single-instance.h"
+#include "rados-striping.h"
 
 namespace librmb {
 
@@ -42,6 +47,29 @@ void RmbCommands::print_debug(const std::string &msg) {
     std::cout << msg << std::endl;
   }
 }
+
+int RmbCommands::delete_mail_object(librmb::RadosStorage *storage, const std::string &oid) {
+  std::string manifest;
+  librmb::RadosStriping::get_manifest(&storage->get_io_ctx(), oid, &manifest);
+  librados::bufferlist ext_ref;
+  storage->get_io_ctx().getxattr(oid, librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_EXT_REF), ext_ref);
+  int ret = storage->delete_mail(oid);
+  if (ret >= 0 && !manifest.empty()) {
+    int ret_stripes = librmb::RadosStriping::remove_stripes(&storage->get_io_ctx(), oid, manifest);
+    if (ret_stripes < 0) {
+      std::cerr << "removing stripes (" << manifest << ") of " << oid << " failed: " << ret_stripes << std::endl;
+    }
+  }
+  if (ret >= 0 && ext_ref.length() > 0) {
+    int ret_ref = librmb::RadosSingleInstance::remove_ref(&storage->get_io_ctx(), ext_ref.to_str());
+    if (ret_ref < 0) {
+      std::cerr << "releasing shared body " << ext_ref.to_str() << " of " << oid << " failed: " << ret_ref
+                << std::endl;
+    }
+  }
+  return ret;
+}
+
 int RmbCommands::delete_with_save_log(const std::string &save_log, const std::string &rados_cluster,
                                       const std::string &rados_user,
                                       std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items) {
@@ -54,20 +82,21 @@ int RmbCommands::delete_with_save_log(const std::string &save_log, const std::st
   }
 
   /** check content **/
-  std::ifstream read(save_log);
+  std::ifstream read(save_log, std::ifstream::in | std::ifstream::binary);
   if (!read.is_open()) {
     std::cerr << " path to log file not valid " << std::endl;
     return -1;
   }
+  librmb::RadosSaveLogReader reader(&read);
   int line_count = 0;
   while (true) {
     line_count++;
     librmb::RadosSaveLogEntry entry;
-    read >> entry;
-    if (read.eof()) {
+    int ret_read = reader.read(&entry);
+    if (ret_read == 0) {
       break;
     }
-    if (read.fail()) {
+    if (ret_read < 0) {
       std::cout << "Objectentry at line '" << line_count << "' is not valid: " << std::endl;
       break;
     }
@@ -86,7 +115,7 @@ int RmbCommands::delete_with_save_log(const std::string &save_log, const std::st
     }
     storage.set_namespace(entry.ns);
     if (entry.op.compare("save") == 0 || entry.op.compare("cpy") == 0) {
-      int ret_delete = storage.delete_mail(entry.oid);
+      int ret_delete = delete_mail_object(&storage, entry.oid);
       if (ret_delete < 0) {
         std::cout << "Object " << entry.oid << " not deleted: errorcode: " << ret_delete << std::endl;
       } else {
@@ -115,6 +144,30 @@ int RmbCommands::delete_with_save_log(const std::string &save_log, const std::st
   return count;
 }
 
+int RmbCommands::print_save_log(const std::string &save_log) {
+  std::ifstream read(save_log, std::ifstream::in | std::ifstream::binary);
+  if (!read.is_open()) {
+    std::cerr << " path to log file not valid " << std::endl;
+    return -1;
+  }
+  librmb::RadosSaveLogReader reader(&read);
+  int count = 0;
+  while (true) {
+    librmb::RadosSaveLogEntry entry;
+    int ret_read = reader.read(&entry);
+    if (ret_read == 0) {
+      break;
+    }
+    if (ret_read < 0) {
+      std::cerr << "entry '" << count + 1 << "' is not valid" << std::endl;
+      return -1;
+    }
+    std::cout << entry;
+    count++;
+  }
+  return count;
+}
+
 int RmbCommands::lspools() {
   librmb::RadosClusterImpl cluster;
 
@@ -174,7 +227,7 @@ int RmbCommands::delete_mail(bool confirmed) {
               << " add --yes-i-really-really-mean-it to confirm the delete " << std::endl;
   } else {
     std::cout << " deleting mail : " << storage->get_pool_name() << " ns: " << storage->get_namespace() << std::endl;
-    ret = storage->delete_mail((*opts)["to_delete"]);
+    ret = delete_mail_object(storage, (*opts)["to_delete"]);
     if (ret < 0) {
       std::cout << "unable to delete e-mail object with oid: " << (*opts)["to_delete"] << std::endl;
     } else {
@@ -262,6 +315,13 @@ int RmbCommands::configuration(bool confirmed, librmb::RadosCephConfig &ceph_cfg
     return 0;
   }
 
+  if ((*opts).find("train_dict") != (*opts).end()) {
+    int max_samples = std::atoi((*opts)["train_dict"].c_str());
+    int ret = train_compression_dict(ceph_cfg, max_samples);
+    print_debug("end: configuration");
+    return ret;
+  }
+
   if (!has_update) {
     std::cerr << "create configuration failed, check parameter" << std::endl;
 
@@ -424,6 +484,251 @@ static void aio_cb(rados_completion_t cb, void *arg) {
   delete stat;
 }
 
+/* gzip magic bytes, mails compressed by the dovecot zlib plugin (see check_is_zlib) */
+static bool is_gzip(const librados::bufferlist &data) {
+  if (data.length() < 2) {
+    return false;
+  }
+  char magic[2];
+  data.copy(0, sizeof(magic), magic);
+  return (unsigned char)magic[0] == 0x1f && (unsigned char)magic[1] == 0x8b;
+}
+
+int RmbCommands::train_compression_dict(librmb::RadosCephConfig &ceph_cfg, int max_samples) {
+  print_debug("entry: train_compression_dict");
+  if (max_samples <= 0) {
+    std::cerr << "number of samples needs to be > 0" << std::endl;
+    print_debug("end: train_compression_dict");
+    return -1;
+  }
+  uint64_t max_mail_size = ceph_cfg.get_compression_dict_mail_size();
+  std::string compression_key(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_COMPRESSION));
+  std::string guid_key(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_GUID));
+  std::string stripe_ns_suffix(RBOX_STRIPE_NAMESPACE_SUFFIX);
+  std::list<librados::bufferlist> samples;
+
+  // sample small, uncompressed mails of all users. Namespace "" holds the configuration,
+  // the user namespace holds the mailbox index objects (shared bodies and stripes are skipped as well).
+  librados::IoCtx &io_ctx = storage->get_io_ctx();
+  std::string ns = io_ctx.get_namespace();
+  io_ctx.set_namespace(librados::all_nspaces);
+  librados::NObjectIterator iter = io_ctx.nobjects_begin();
+  for (; iter != librados::NObjectIterator::__EndObjectIterator && samples.size() < (size_t)max_samples; ++iter) {
+    const std::string &obj_ns = iter->get_nspace();
+    if (obj_ns.empty() || obj_ns.compare(ceph_cfg.get_user_ns()) == 0 ||
+        obj_ns.compare(RBOX_SINGLE_INSTANCE_NAMESPACE) == 0 ||
+        (obj_ns.length() > stripe_ns_suffix.length() &&
+         obj_ns.compare(obj_ns.length() - stripe_ns_suffix.length(), stripe_ns_suffix.length(), stripe_ns_suffix) ==
+             0)) {
+      continue;
+    }
+    io_ctx.locator_set_key(iter->get_locator());
+    io_ctx.set_namespace(obj_ns);
+
+    // only mail objects (mail guid) which are not compressed yet (rbox compression or zlib plugin)
+    uint64_t size = 0;
+    time_t save_date;
+    librados::bufferlist compression;
+    librados::bufferlist guid;
+    if (io_ctx.stat(iter->get_oid(), &size, &save_date) < 0 || size == 0 || size > max_mail_size ||
+        io_ctx.getxattr(iter->get_oid(), compression_key.c_str(), compression) >= 0 ||
+        io_ctx.getxattr(iter->get_oid(), guid_key.c_str(), guid) <= 0) {
+      io_ctx.set_namespace(librados::all_nspaces);
+      continue;
+    }
+    librados::bufferlist sample;
+    if (io_ctx.read(iter->get_oid(), sample, size, 0) > 0 && !is_gzip(sample)) {
+      samples.push_back(sample);
+    }
+    io_ctx.set_namespace(librados::all_nspaces);
+  }
+  io_ctx.locator_set_key("");
+  io_ctx.set_namespace(ns);
+  std::cout << "sampled " << samples.size() << " mails" << std::endl;
+
+  librados::bufferlist dict;
+  uint32_t dict_id = 0;
+  int ret = librmb::RadosCompression::train_dict(samples, RBOX_COMPRESSION_DICT_SIZE, &dict, &dict_id);
+  if (ret < 0) {
+    std::cerr << "training the compression dictionary failed: " << ret << std::endl;
+    print_debug("end: train_compression_dict");
+    return ret;
+  }
+  ret = ceph_cfg.save_dict(dict_id, dict);
+  if (ret < 0) {
+    std::cerr << "saving compression dictionary " << dict_id << " failed: " << ret << std::endl;
+    print_debug("end: train_compression_dict");
+    return ret;
+  }
+  ceph_cfg.set_compression_dict_id(dict_id);
+  if (ceph_cfg.save_cfg() < 0) {
+    std::cerr << "saving cfg failed" << std::endl;
+    print_debug("end: train_compression_dict");
+    return -1;
+  }
+  std::cout << "compression dictionary " << dict_id << " (" << dict.length() << " bytes) saved as "
+            << ceph_cfg.get_dict_object_name(dict_id) << std::endl;
+  print_debug("end: train_compression_dict");
+  return 0;
+}
+
+struct ScrubRead {
+  librmb::RadosMail *mail;
+  librados::AioCompletion *completion;
+  librados::ObjectReadOperation read_op;
+  librados::bufferlist data;
+  librados::bufferlist compression;
+  librados::bufferlist ext_ref;
+  librados::bufferlist stripes;
+  int read_err;
+  int compression_err;
+  int ext_ref_err;
+  int stripes_err;
+};
+
+static int scrub_uncompress(librmb::RadosCephConfig *cfg, std::map<uint32_t, librmb::RadosCompressionDict *> *dicts,
+                            ScrubRead *read, librados::bufferlist *out) {
+  std::string codec_name;
+  uint32_t dict_id = 0;
+  librmb::RadosCompression *codec = nullptr;
+  if (librmb::RadosCompression::parse_marker(read->compression.to_str(), &codec_name, &dict_id)) {
+    codec = librmb::RadosCompression::get_codec(codec_name);
+  }
+  if (codec == nullptr) {
+    return -ENOTSUP;
+  }
+  librmb::RadosCompressionDict *dict = nullptr;
+  if (dict_id > 0) {
+    if (dicts->find(dict_id) == dicts->end()) {
+      librados::bufferlist dict_buffer;
+      (*dicts)[dict_id] =
+          cfg->read_dict(dict_id, &dict_buffer) >= 0 ? new librmb::RadosCompressionDict(dict_id, dict_buffer) : nullptr;
+    }
+    dict = (*dicts)[dict_id];
+    if (dict == nullptr) {
+      return -ENOENT;
+    }
+  }
+  return codec->decompress(read->data, out, dict);
+}
+
+/* @return 1 if the mail is corrupt */
+static int scrub_verify(librmb::RadosStorage *storage, librmb::RadosCephConfig *cfg,
+                        std::map<uint32_t, librmb::RadosCompressionDict *> *dicts, ScrubRead *read, int *no_checksum,
+                        int *failed) {
+  int ret = read->completion->get_return_value();
+  read->completion->release();
+  if (ret >= 0 && read->ext_ref_err >= 0 && read->ext_ref.length() > 0) {
+    // single instance storage: mail object without data, verify the shared body
+    ret = librmb::RadosSingleInstance::read_body(&storage->get_io_ctx(), read->ext_ref.to_str(), &read->data);
+  }
+  if (ret >= 0 && read->read_err >= 0 && read->stripes_err >= 0 && read->stripes.length() > 0) {
+    // striped mail: the mail object holds the first stripe
+    ret = librmb::RadosStriping::read_stripes(&storage->get_io_ctx(), *read->mail->get_oid(), read->stripes.to_str(),
+                                              &read->data);
+  }
+  if (ret < 0 || read->read_err < 0) {
+    std::cerr << "oid: " << *read->mail->get_oid() << " read failed: " << ret << std::endl;
+    (*failed)++;
+    return 0;
+  }
+  char *value = NULL;
+  uint32_t expected;
+  librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_CHECKSUM, read->mail->get_metadata(), &value);
+  if (value == NULL || !librmb::RadosChecksum::from_string(value, &expected)) {
+    (*no_checksum)++;
+    return 0;
+  }
+
+  uint32_t calculated;
+  if (read->compression_err >= 0 && read->compression.length() > 0) {
+    librados::bufferlist uncompressed;
+    int uncompress_ret = scrub_uncompress(cfg, dicts, read, &uncompressed);
+    if (uncompress_ret < 0) {
+      std::cerr << "oid: " << *read->mail->get_oid() << " decompression (" << read->compression.to_str()
+                << ") failed: " << uncompress_ret << std::endl;
+      return 1;
+    }
+    calculated = librmb::RadosChecksum::crc32c(0, uncompressed);
+  } else {
+    calculated = librmb::RadosChecksum::crc32c(0, read->data);
+  }
+  if (calculated != expected) {
+    std::cout << "oid: " << *read->mail->get_oid() << " checksum mismatch, stored: " << value
+              << " calculated: " << librmb::RadosChecksum::to_string(calculated) << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int RmbCommands::scrub(librmb::RadosCephConfig *cfg, std::list<librmb::RadosMail *> &mail_objects, int window) {
+  print_debug("entry: scrub");
+  std::map<uint32_t, librmb::RadosCompressionDict *> dicts;
+  std::list<ScrubRead *> pending;
+  int corrupt = 0;
+  int no_checksum = 0;
+  int failed = 0;
+  int checked = 0;
+  std::string compression_key(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_COMPRESSION));
+  std::string ext_ref_key(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_EXT_REF));
+  std::string stripes_key(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_STRIPES));
+
+  for (std::list<librmb::RadosMail *>::iterator it = mail_objects.begin(); it != mail_objects.end(); ++it) {
+    if (!(*it)->is_valid()) {
+      continue;
+    }
+    ScrubRead *read = new ScrubRead();
+    read->mail = *it;
+    read->read_err = 0;
+    read->compression_err = 0;
+    read->ext_ref_err = 0;
+    read->stripes_err = 0;
+    read->read_op.read(0, INT_MAX, &read->data, &read->read_err);
+    read->read_op.getxattr(compression_key.c_str(), &read->compression, &read->compression_err);
+    // uncompressed mails don't have the attribute
+    read->read_op.set_op_flags2(librados::OP_FAILOK);
+    read->read_op.getxattr(ext_ref_key.c_str(), &read->ext_ref, &read->ext_ref_err);
+    read->read_op.set_op_flags2(librados::OP_FAILOK);
+    read->read_op.getxattr(stripes_key.c_str(), &read->stripes, &read->stripes_err);
+    read->read_op.set_op_flags2(librados::OP_FAILOK);
+    read->completion = librados::Rados::aio_create_completion();
+    int ret = storage->get_io_ctx().aio_operate(*read->mail->get_oid(), read->completion, &read->read_op, NULL);
+    if (ret < 0) {
+      std::cerr << "oid: " << *read->mail->get_oid() << " aio_operate failed: " << ret << std::endl;
+      read->completion->release();
+      delete read;
+      failed++;
+      continue;
+    }
+    pending.push_back(read);
+    checked++;
+
+    // bound the number of reads (and memory) in flight
+    while (pending.size() >= (size_t)window) {
+      ScrubRead *oldest = pending.front();
+      pending.pop_front();
+      oldest->completion->wait_for_complete();
+      corrupt += scrub_verify(storage, cfg, &dicts, oldest, &no_checksum, &failed);
+      delete oldest;
+    }
+  }
+  while (!pending.empty()) {
+    ScrubRead *oldest = pending.front();
+    pending.pop_front();
+    oldest->completion->wait_for_complete();
+    corrupt += scrub_verify(storage, cfg, &dicts, oldest, &no_checksum, &failed);
+    delete oldest;
+  }
+  for (std::map<uint32_t, librmb::RadosCompressionDict *>::iterator it = dicts.begin(); it != dicts.end(); ++it) {
+    delete it->second;
+  }
+
+  std::cout << "scrub: " << checked << " mails checked, " << corrupt << " corrupt, " << no_checksum
+            << " without checksum, " << failed << " read errors" << std::endl;
+  print_debug("end: scrub");
+  return failed > 0 ? -1 : corrupt;
+}
+
 int RmbCommands::overwrite_ceph_object_index(std::set<std::string> &mail_oids){
     return storage->ceph_index_overwrite(mail_oids);
 }
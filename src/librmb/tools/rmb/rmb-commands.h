@@ -30,6 +30,9 @@
 #include "rados-metadata-storage-module.h"
 #include "rados-save-log.h"
 
+/** default number of parallel reads of rmb scrub **/
+#define RMB_SCRUB_READ_WINDOW 32
+
 namespace librmb {
 
 class RmbCommands {
@@ -41,6 +44,17 @@ class RmbCommands {
   static int delete_with_save_log(const std::string &save_log, const std::string &rados_cluster,
                                   const std::string &rados_user,
                                   std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items);
+  /*!
+   * print all entries of the save log (csv or binary records) as csv.
+   * @return number of entries or -1 if the log is not readable or contains an invalid entry
+   */
+  static int print_save_log(const std::string &save_log);
+  /*!
+   * remove a mail object together with its stripes (if striped) and release the reference
+   * to its shared body (single instance storage).
+   * @return result of the mail object removal
+   */
+  static int delete_mail_object(librmb::RadosStorage *storage, const std::string &oid);
   void print_debug(const std::string &msg);
   static int lspools();
   int delete_mail(bool confirmed);
@@ -50,9 +64,18 @@ class RmbCommands {
   int rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const std::string &uid);
 
   int configuration(bool confirmed, librmb::RadosCephConfig &ceph_cfg);
+  /*!
+   * train a zstd dictionary from up to max_samples small mails and make it the current dictionary.
+   */
+  int train_compression_dict(librmb::RadosCephConfig &ceph_cfg, int max_samples);
 
   int load_objects(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
                    std::string &sort_string, bool load_metadata = true);
+  /*!
+   * verify the crc32c checksum of all mails in mail_objects, reading up to window mails in parallel.
+   * @return number of corrupt mails or < 0 in case of error
+   */
+  int scrub(librmb::RadosCephConfig *cfg, std::list<librmb::RadosMail *> &mail_objects, int window);
   int update_attributes(librmb::RadosStorageMetadataModule *ms, std::map<std::string, std::string> *metadata);
   int print_mail(std::map<std::string, librmb::RadosMailBox *> *mailbox, std::string &output_dir, bool download);
   int query_mail_storage(std::list<librmb::RadosMail *> *mail_objects, librmb::CmdLineParser *parser, bool download,
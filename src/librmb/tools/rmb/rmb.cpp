@@ -166,8 +166,9 @@ static void usage(std::ostream &out) {
          "   -u    rados user name, default: 'client.admin' \n"
          "   -D    debug output \n"
          "   -r    save log with objects to delete => deletes all entries (save,mv,cp) from object store, use with \n"
+         "care!!!! \n"
+         "   -l    print save log entries as csv (csv and binary format)\n"
          "   -v    print plugin version\n"
-         "care!!!! \n "
          "\n"
          "\nMAIL COMMANDS\n"
          "    ls -    list all mails and mailbox statistic\n"
@@ -182,6 +183,7 @@ static void usage(std::ostream &out) {
          "    set     oid metadata value   e.g. U 1 B INBOX R \"2017-08-22 14:30\"\n"
          "    sort    values: uid, recv_date, save_date, phy_size\n"
          "    lspools list all available pools\n"
+         "    scrub   verify the checksum of all mails, value: number of parallel reads or - (default)\n"
          "\n"
          "    delete  deletes the ceph object, use oid attribute to identify mail.\n"
          "    rename  dovecot_user_name, rename a user\n"
@@ -193,6 +195,8 @@ static void usage(std::ostream &out) {
          "    cfg show              print configuration to screen\n"
          "    cfg update key=value  sets the configuration value key=value\n"
          "                          e.g. user_mapping=true\n"
+         "    cfg train-dict samples  train a zstd dictionary from small mails and activate it\n"
+         "                          e.g. train-dict 10000\n"
          "\n";
 }
 
@@ -244,18 +248,24 @@ static void parse_cmd_line_args(std::map<std::string, std::string> *opts, bool &
       (*opts)["debug"] = "true";
     } else if (ceph_argparse_witharg(args, &i, &val, "-r", "--remove", static_cast<char>(NULL))) {
       (*opts)["remove_save_log"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "-l", "--log", static_cast<char>(NULL))) {
+      (*opts)["print_save_log"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "ls", "--ls", static_cast<char>(NULL))) {
       (*opts)["ls"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "get", "--get", static_cast<char>(NULL))) {
       (*opts)["get"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "set", "--set", static_cast<char>(NULL))) {
       (*opts)["set"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "scrub", "--scrub", static_cast<char>(NULL))) {
+      (*opts)["scrub"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "sort", "--sort", static_cast<char>(NULL))) {
       (*opts)["sort"] = val;
     } else if (ceph_argparse_flag(*args, i, "cfg", "--config", static_cast<char>(NULL))) {
       is_config = true;
     } else if (ceph_argparse_witharg(args, &i, &val, "update", "--update", static_cast<char>(NULL))) {
       (*opts)["update"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "train-dict", "--train-dict", static_cast<char>(NULL))) {
+      (*opts)["train_dict"] = val;
     } else if (ceph_argparse_flag(*args, i, "create", "--create", static_cast<char>(NULL))) {
       create_config = true;
     } else if (ceph_argparse_flag(*args, i, "show", "--show", static_cast<char>(NULL))) {
@@ -313,6 +323,10 @@ int main(int argc, const char **argv) {
     usage_exit();
   }
 
+  if (opts.find("print_save_log") != opts.end()) {
+    return librmb::RmbCommands::print_save_log(opts["print_save_log"]) < 0 ? 1 : 0;
+  }
+
   is_lspools_cmd = strcmp(args[0], "lspools") == 0;
   delete_mail_option = opts.find("to_delete") != opts.end();
   sort_type = (opts.find("sort") != opts.end()) ? opts["sort"] : "uid";
@@ -443,6 +457,12 @@ int main(int argc, const char **argv) {
     }
   } else if (opts.find("set") != opts.end()) {
     rmb_commands->update_attributes(ms, &metadata);
+  } else if (opts.find("scrub") != opts.end()) {
+    int window = opts["scrub"].compare("-") == 0 ? RMB_SCRUB_READ_WINDOW : std::atoi(opts["scrub"].c_str());
+    rmb_commands->load_objects(ms, mail_objects, sort_type);
+    if (rmb_commands->scrub(&ceph_cfg, mail_objects, window > 0 ? window : RMB_SCRUB_READ_WINDOW) != 0) {
+      std::cerr << "scrub found corrupt or unreadable mails" << std::endl;
+    }
   }
 
   delete rmb_commands;
@@ -764,8 +764,9 @@ static int cmd_rmb_check_indices_run(struct doveadm_mail_cmd_context *ctx, struc
   for (auto mo : mail_objects) {
     std::cout << mo->to_string("  ") << std::endl;
     if (open >= 0 && ctx_->delete_not_referenced_objects && !mo->is_index_ref()) {
+      int ret_delete = librmb::RmbCommands::delete_mail_object(plugin.storage, *mo->get_oid());
       std::cout << "mail object: " << mo->get_oid()->c_str()
-                << " deleted: " << (plugin.storage->delete_mail(mo) < 0 ? " FALSE " : " TRUE") << std::endl;
+                << " deleted: " << (ret_delete < 0 ? " FALSE " : " TRUE") << std::endl;
       ctx->exit_code = 2;
     }
     delete mo;
@@ -912,6 +913,118 @@ static int iterate_list_objects(struct mail_namespace* ns, const struct mailbox_
   
   return 0;
 }
+/* message count and size of the mailbox, as in the index */
+static int count_mailbox(struct mailbox *box, librmb::RadosCounters *counters) {
+  struct mailbox_transaction_context *mailbox_transaction;
+  struct mail_search_context *search_ctx;
+  struct mail_search_args *search_args;
+  struct mail *mail;
+  int ret = 0;
+
+  mailbox_transaction = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, "rmb_counters");
+
+  search_args = mail_search_build_init();
+  mail_search_build_add(search_args, SEARCH_ALL);
+
+  search_ctx = mailbox_search_init(mailbox_transaction, search_args, NULL, MAIL_FETCH_PHYSICAL_SIZE, NULL);
+  mail_search_args_unref(&search_args);
+
+  while (mailbox_search_next(search_ctx, &mail)) {
+    uoff_t size;
+    counters->messages++;
+    if (mail_get_physical_size(mail, &size) < 0) {
+      i_warning("unable to determine the physical size of uid %u in mailbox %s", mail->uid, box->vname);
+      continue;
+    }
+    counters->bytes += size;
+    if (is_alternate_storage_set(index_mail_get_flags(mail)) && is_alternate_pool_valid(box)) {
+      counters->alt_bytes += size;
+    }
+  }
+  if (mailbox_search_deinit(&search_ctx) < 0) {
+    ret = -1;
+  }
+  if (mailbox_transaction_commit(&mailbox_transaction) < 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+static void print_counters(const char *name, const librmb::RadosCounters &counters) {
+  std::cout << name << ": messages=" << counters.messages << " bytes=" << counters.bytes
+            << " alt_bytes=" << counters.alt_bytes << std::endl;
+}
+
+static int cmd_rmb_counters_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user) {
+  struct counters_cmd_context *ctx = (struct counters_cmd_context *)_ctx;
+  librmb::RadosStorage *rados_storage = nullptr;
+  librmb::RadosCounters user_counters;
+  int ret = 0;
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(user->namespaces);
+  for (; ns != NULL && ret >= 0; ns = ns->next) {
+    struct mailbox_list_iterate_context *iter;
+    const struct mailbox_info *info;
+
+    iter = mailbox_list_iter_init(ns->list, "*", static_cast<enum mailbox_list_iter_flags>(
+                                                     MAILBOX_LIST_ITER_RAW_LIST | MAILBOX_LIST_ITER_RETURN_NO_FLAGS));
+    while ((info = mailbox_list_iter_next(iter)) != NULL) {
+      if ((info->flags & (MAILBOX_NONEXISTENT | MAILBOX_NOSELECT)) != 0) {
+        continue;
+      }
+      struct mailbox *box = mailbox_alloc(ns->list, info->vname, MAILBOX_FLAG_READONLY);
+      if (strcmp(box->storage->name, "rbox") != 0 || mailbox_open(box) < 0 ||
+          rbox_open_rados_connection(box, false) < 0) {
+        i_error("Error opening rbox mailbox %s", info->vname);
+        mailbox_free(&box);
+        ret = -1;
+        break;
+      }
+      struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+      std::string mailbox_guid = guid_128_to_string(((struct rbox_mailbox *)box)->mailbox_guid);
+      rados_storage = r_storage->s;
+
+      librmb::RadosCounters counters;
+      if (ctx->recalculate) {
+        // no saves or expunges, while the mailbox is counted
+        mail_index_lock_sync(box->index, "LOCKED_FOR_COUNTERS");
+        ret = count_mailbox(box, &counters);
+        if (ret >= 0) {
+          ret = rados_storage->write_counters(mailbox_guid, counters);
+        }
+        mail_index_unlock(box->index, "UNLOCKED_FOR_COUNTERS");
+      } else {
+        ret = rados_storage->read_counters(mailbox_guid, &counters);
+      }
+      mailbox_free(&box);
+      if (ret < 0) {
+        i_error("Error processing the counters of mailbox %s: %d", info->vname, ret);
+        break;
+      }
+      print_counters(info->vname, counters);
+      user_counters += counters;
+    }
+    if (mailbox_list_iter_deinit(&iter) < 0) {
+      ret = -1;
+    }
+  }
+
+  if (ret >= 0 && rados_storage != nullptr) {
+    if (ctx->recalculate) {
+      ret = rados_storage->write_counters("", user_counters);
+    } else {
+      ret = rados_storage->read_counters("", &user_counters);
+    }
+    if (ret < 0) {
+      i_error("Error processing the counters of user %s: %d", user->username, ret);
+    } else {
+      print_counters(user->username, user_counters);
+    }
+  }
+  _ctx->exit_code = ret < 0 ? -1 : 0;
+  return ret < 0 ? -1 : 0;
+}
+
 static int i_strcmp_reverse_p(const char *const *s1, const char *const *s2) { return -strcmp(*s1, *s2); }
 static int get_child_mailboxes(struct mail_user *user, ARRAY_TYPE(const_string) * mailboxes, const char *name) {
   struct mailbox_list_iterate_context *iter;
@@ -1077,6 +1190,11 @@ static void cmd_rmb_create_ceph_index_init(struct doveadm_mail_cmd_context *ctx
     doveadm_mail_help_name("rmb create ceph index");
   }
 }
+static void cmd_rmb_counters_init(struct doveadm_mail_cmd_context *ctx ATTR_UNUSED, const char *const args[]) {
+  if (args[0] != NULL) {
+    doveadm_mail_help_name("rmb counters");
+  }
+}
 static void cmd_rmb_mailbox_delete_init(struct doveadm_mail_cmd_context *_ctx ATTR_UNUSED, const char *const args[]) {
   struct delete_cmd_context *ctx = (struct delete_cmd_context *)_ctx;
   const char *name;
@@ -1190,6 +1308,28 @@ struct doveadm_mail_cmd_context *cmd_rmb_create_ceph_index_alloc(void) {
   return &ctx->ctx;
 }
 
+static bool cmd_counters_parse_arg(struct doveadm_mail_cmd_context *_ctx, int c) {
+  struct counters_cmd_context *ctx = (struct counters_cmd_context *)_ctx;
+
+  switch (c) {
+    case 'r':
+      ctx->recalculate = true;
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+struct doveadm_mail_cmd_context *cmd_rmb_counters_alloc(void) {
+  struct counters_cmd_context *ctx;
+  ctx = doveadm_mail_cmd_alloc(struct counters_cmd_context);
+  ctx->ctx.v.run = cmd_rmb_counters_run;
+  ctx->ctx.v.init = cmd_rmb_counters_init;
+  ctx->ctx.v.parse_arg = cmd_counters_parse_arg;
+  ctx->ctx.getopt_args = "r";
+  return &ctx->ctx;
+}
+
 static bool cmd_mailbox_delete_parse_arg(struct doveadm_mail_cmd_context *_ctx, int c) {
   struct delete_cmd_context *ctx = (struct delete_cmd_context *)_ctx;
 
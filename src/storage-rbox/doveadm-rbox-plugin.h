@@ -22,6 +22,11 @@ struct create_ceph_index_cmd_context {
   bool full_refresh;
 };
 
+struct counters_cmd_context {
+  struct doveadm_mail_cmd_context ctx;
+  bool recalculate;
+};
+
 struct delete_cmd_context {
   struct doveadm_mail_cmd_context ctx;
   ARRAY_TYPE(const_string) mailboxes;
@@ -60,5 +65,6 @@ extern struct doveadm_mail_cmd_context *cmd_rmb_save_log_alloc(void);
 extern struct doveadm_mail_cmd_context *cmd_rmb_check_indices_alloc(void);
 extern struct doveadm_mail_cmd_context *cmd_rmb_create_ceph_index_alloc(void);
 extern struct doveadm_mail_cmd_context *cmd_rmb_mailbox_delete_alloc(void);
+extern struct doveadm_mail_cmd_context *cmd_rmb_counters_alloc(void);
 
 #endif  // SRC_DOVEADM_RBOX_PLUGIN_H_
@@ -9,55 +9,173 @@
  * License version 2.1, as published by the Free Software
  * Foundation.  See file COPYING.
  */
+#include <algorithm>
+#include <vector>
 
 extern "C" {
 #include "lib.h"
 #include "istream-private.h"
+#if DOVECOT_PREREQ(2, 3)
+#include "memarea.h"
+#endif
 }
 
 #include "istream-bufferlist.h"
 #include <rados/librados.hpp>
 
+struct bufferlist_istream_segment {
+  // offset within the stream
+  uoff_t offset;
+  const unsigned char *data;
+  size_t length;
+};
+
 struct bufferlist_istream {
   struct istream_private istream;
   librados::bufferlist *bl;
+  uoff_t size;
+  // the buffers of bl, ordered by offset
+  std::vector<bufferlist_istream_segment> *segments;
+#if !DOVECOT_PREREQ(2, 3)
+  // data which did not fit in one segment, see i_stream_bufferlist_copy
+  unsigned char *copy;
+#endif
 };
-static ssize_t i_stream_data_read(struct istream_private *stream) {
-  stream->istream.eof = TRUE;  // all in!
-  return -1;
+
+#if DOVECOT_PREREQ(2, 3)
+static void i_stream_bufferlist_free_copy(void *copy) { i_free(copy); }
+
+/* replaces the memarea of the buffer. The previous one is freed, once no snapshot (see i_stream_read) uses it. */
+static void i_stream_bufferlist_set_memarea(struct istream_private *stream, struct memarea *memarea) {
+  if (stream->memarea != NULL) {
+    memarea_unref(&stream->memarea);
+  }
+  stream->memarea = memarea;
+}
+#endif
+
+static struct bufferlist_istream_segment *i_stream_bufferlist_find_segment(struct bufferlist_istream *bstream,
+                                                                           uoff_t offset) {
+  std::vector<bufferlist_istream_segment>::iterator it =
+      std::upper_bound(bstream->segments->begin(), bstream->segments->end(), offset,
+                       [](uoff_t o, const bufferlist_istream_segment &s) { return o < s.offset; });
+  // offset < size, so the first segment starts before it
+  --it;
+  return &(*it);
+}
+
+/* the unread data ends at a segment boundary and the caller wants more: join it with the next block */
+static ssize_t i_stream_bufferlist_copy(struct bufferlist_istream *bstream, uoff_t offset) {
+  struct istream_private *stream = &bstream->istream;
+  size_t unread = stream->pos - stream->skip;
+  size_t size = std::min<uoff_t>(IO_BLOCK_SIZE, bstream->size - offset);
+
+  unsigned char *copy = (unsigned char *)i_malloc(unread + size);
+  memcpy(copy, stream->buffer + stream->skip, unread);
+  size_t copied = 0;
+  while (copied < size) {
+    struct bufferlist_istream_segment *segment = i_stream_bufferlist_find_segment(bstream, offset + copied);
+    size_t segment_pos = offset + copied - segment->offset;
+    size_t length = std::min(size - copied, segment->length - segment_pos);
+    memcpy(copy + unread + copied, segment->data + segment_pos, length);
+    copied += length;
+  }
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_bufferlist_set_memarea(stream, memarea_init(copy, unread + size, i_stream_bufferlist_free_copy, copy));
+#else
+  // the previous buffer is only valid until read returns
+  i_free(bstream->copy);
+  bstream->copy = copy;
+#endif
+
+  stream->buffer = copy;
+  stream->skip = 0;
+  stream->pos = unread + size;
+  return size;
 }
 
-static void i_stream_data_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
-  stream->skip = v_offset;
+static ssize_t i_stream_bufferlist_read(struct istream_private *stream) {
+  struct bufferlist_istream *bstream = (struct bufferlist_istream *)stream;
+  // offset of the first byte behind the buffered data
+  uoff_t offset = stream->istream.v_offset + (stream->pos - stream->skip);
+
+  if (offset >= bstream->size) {
+    stream->istream.eof = TRUE;
+    return -1;
+  }
+  if (stream->skip < stream->pos) {
+    return i_stream_bufferlist_copy(bstream, offset);
+  }
+  // serve the segment as it is, no copy
+  struct bufferlist_istream_segment *segment = i_stream_bufferlist_find_segment(bstream, offset);
+#if DOVECOT_PREREQ(2, 3)
+  // the segments are valid until the stream is destroyed
+  i_stream_bufferlist_set_memarea(stream, memarea_init_empty());
+#endif
+  size_t segment_pos = offset - segment->offset;
+  stream->buffer = segment->data + segment_pos;
+  stream->skip = 0;
+  stream->pos = segment->length - segment_pos;
+  return stream->pos;
+}
+
+static void i_stream_bufferlist_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
+  // the next read serves the segment of v_offset
   stream->istream.v_offset = v_offset;
+  stream->skip = stream->pos = 0;
 }
 
 static void rbox_istream_destroy(struct iostream_private *stream) {
-  // nothing to do. but required, so that default destroy is not evoked!
-  // buffer is member of RboxMailObjec, which destroys the bufferlist
+  // required, so that default destroy is not evoked! The buffer is never w_buffer.
   struct bufferlist_istream *bstream = (struct bufferlist_istream *)stream;
+  delete bstream->segments;
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_bufferlist_set_memarea(&bstream->istream, NULL);
+#else
+  i_free(bstream->copy);
+#endif
   delete bstream->bl;
 }
 struct istream *i_stream_create_from_bufferlist(librados::bufferlist *data, const size_t &size) {
   struct bufferlist_istream *bstream;
 
   bstream = i_new(struct bufferlist_istream, 1);
-  // use unsigned char* for binary data!
-  bstream->istream.buffer = reinterpret_cast<unsigned char *>(data->c_str());
-  bstream->istream.pos = size;
+  bstream->bl = data;
+  bstream->size = std::min<uoff_t>(size, data->length());
+  bstream->segments = new std::vector<bufferlist_istream_segment>();
+  // the segments are used in place, a rebuild (c_str()) would copy the whole mail
+  uoff_t offset = 0;
+  for (const auto &ptr : data->buffers()) {
+    if (offset >= bstream->size) {
+      break;
+    }
+    if (ptr.length() == 0) {
+      continue;
+    }
+    struct bufferlist_istream_segment segment;
+    segment.offset = offset;
+    // use unsigned char* for binary data!
+    segment.data = reinterpret_cast<const unsigned char *>(ptr.c_str());
+    segment.length = std::min<uoff_t>(ptr.length(), bstream->size - offset);
+    bstream->segments->push_back(segment);
+    offset += segment.length;
+  }
+#if !DOVECOT_PREREQ(2, 3)
+  bstream->copy = nullptr;
+#endif
   bstream->istream.max_buffer_size = (size_t)-1;
 
-  bstream->istream.read = i_stream_data_read;
-  bstream->istream.seek = i_stream_data_seek;  // use default
+  bstream->istream.read = i_stream_bufferlist_read;
+  bstream->istream.seek = i_stream_bufferlist_seek;
 
   bstream->istream.istream.readable_fd = FALSE;
   bstream->istream.istream.blocking = TRUE;
   bstream->istream.istream.seekable = TRUE;
   bstream->istream.iostream.destroy = rbox_istream_destroy;
-  bstream->bl = data;
 
 #if DOVECOT_PREREQ(2, 3)
-  i_stream_create(&bstream->istream, NULL, -1, ISTREAM_CREATE_FLAG_NOOP_SNAPSHOT);
+  // the default snapshot keeps the memarea of the buffer
+  i_stream_create(&bstream->istream, NULL, -1, 0);
 #else
   i_stream_create(&bstream->istream, NULL, -1);
 #endif
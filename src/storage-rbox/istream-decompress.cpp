@@ -0,0 +1,182 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+#include <algorithm>
+
+extern "C" {
+#include "lib.h"
+#include "istream-private.h"
+}
+
+#include "istream-decompress.h"
+
+struct decompress_istream {
+  struct istream_private istream;
+  librmb::RadosDecompressor *decompressor;
+  uoff_t size;
+
+  // offset of the next byte, which is decompressed into the stream buffer
+  uoff_t read_offset;
+  bool frame_end;
+};
+
+static ssize_t i_stream_decompress_error(struct decompress_istream *dstream, const char *error) {
+  struct istream_private *stream = &dstream->istream;
+
+  i_error("decompressing %s at offset %lu: %s", i_stream_get_name(stream->parent), dstream->read_offset, error);
+  stream->istream.stream_errno = EIO;
+  return -1;
+}
+
+static ssize_t i_stream_decompress_read(struct istream_private *stream) {
+  struct decompress_istream *dstream = (struct decompress_istream *)stream;
+
+  if (dstream->frame_end) {
+    if (dstream->read_offset != dstream->size) {
+      return i_stream_decompress_error(dstream, "size does not match the frame");
+    }
+    stream->istream.eof = TRUE;
+    return -1;
+  }
+  size_t size;
+  if (!i_stream_try_alloc(stream, IO_BLOCK_SIZE, &size)) {
+    return -2;
+  }
+  size_t produced = 0;
+  while (produced == 0 && !dstream->frame_end) {
+    const unsigned char *data;
+    size_t data_size;
+    int ret = i_stream_read_data(stream->parent, &data, &data_size, 0);
+    if (ret == 0) {
+      // the parent is not blocking
+      return 0;
+    }
+    if (ret < 0 && stream->parent->stream_errno != 0) {
+      stream->istream.stream_errno = stream->parent->stream_errno;
+      return -1;
+    }
+    // at the end of the input, the decompressor may still flush buffered output
+    size_t src_size = data_size;
+    size_t dst_size = size - produced;
+    ret = dstream->decompressor->decompress(reinterpret_cast<const char *>(data), &src_size,
+                                            reinterpret_cast<char *>(stream->w_buffer + stream->pos), &dst_size);
+    if (ret < 0) {
+      return i_stream_decompress_error(dstream, "corrupted frame");
+    }
+    i_stream_skip(stream->parent, src_size);
+    stream->pos += dst_size;
+    produced += dst_size;
+    dstream->read_offset += dst_size;
+    dstream->frame_end = ret == 0;
+    if (data_size == 0 && dst_size == 0 && !dstream->frame_end) {
+      return i_stream_decompress_error(dstream, "truncated frame");
+    }
+  }
+  if (produced == 0) {
+    // the frame ended with the previous read
+    return i_stream_decompress_read(stream);
+  }
+  return produced;
+}
+
+static void i_stream_decompress_reset(struct decompress_istream *dstream) {
+  struct istream_private *stream = &dstream->istream;
+
+  dstream->decompressor->reset();
+  dstream->read_offset = 0;
+  dstream->frame_end = false;
+  stream->istream.v_offset = 0;
+  stream->skip = stream->pos = 0;
+  stream->parent_expected_offset = stream->parent_start_offset;
+  i_stream_seek(stream->parent, stream->parent_start_offset);
+}
+
+static void i_stream_decompress_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
+  struct decompress_istream *dstream = (struct decompress_istream *)stream;
+  // offset of the first buffered byte
+  uoff_t start_offset = stream->istream.v_offset - stream->skip;
+
+  if (v_offset < start_offset) {
+    // the frame can only be decompressed from its start
+    i_stream_decompress_reset(dstream);
+    start_offset = 0;
+  }
+  if (v_offset <= start_offset + stream->pos) {
+    // buffered
+    stream->istream.v_offset = v_offset;
+    stream->skip = v_offset - start_offset;
+    return;
+  }
+  // decompress and drop the data up to v_offset
+  stream->istream.v_offset = start_offset + stream->pos;
+  stream->skip = stream->pos;
+  while (stream->istream.v_offset < v_offset) {
+    if (i_stream_read(&stream->istream) <= 0) {
+      // stream_errno is set or v_offset is behind the end
+      break;
+    }
+    i_stream_skip(&stream->istream,
+                  std::min<uoff_t>(stream->pos - stream->skip, v_offset - stream->istream.v_offset));
+  }
+}
+
+static int i_stream_decompress_stat(struct istream_private *stream, bool exact) {
+  struct decompress_istream *dstream = (struct decompress_istream *)stream;
+  const struct stat *st;
+
+  if (i_stream_stat(stream->parent, exact, &st) < 0) {
+    stream->istream.stream_errno = stream->parent->stream_errno;
+    return -1;
+  }
+  stream->statbuf = *st;
+  stream->statbuf.st_size = dstream->size;
+  return 0;
+}
+
+static void i_stream_decompress_close(struct iostream_private *stream, bool close_parent) {
+  struct decompress_istream *dstream = (struct decompress_istream *)stream;
+
+  delete dstream->decompressor;
+  dstream->decompressor = nullptr;
+  if (close_parent) {
+    i_stream_close(dstream->istream.parent);
+  }
+}
+
+struct istream *i_stream_create_decompress(struct istream *input, librmb::RadosDecompressor *decompressor,
+                                           uoff_t size) {
+  struct decompress_istream *dstream;
+
+  dstream = i_new(struct decompress_istream, 1);
+  dstream->decompressor = decompressor;
+  dstream->size = size;
+  dstream->read_offset = 0;
+  dstream->frame_end = false;
+
+  dstream->istream.max_buffer_size = input->real_stream->max_buffer_size;
+  dstream->istream.read = i_stream_decompress_read;
+  dstream->istream.seek = i_stream_decompress_seek;
+  dstream->istream.stat = i_stream_decompress_stat;
+  dstream->istream.iostream.close = i_stream_decompress_close;
+
+  dstream->istream.istream.readable_fd = FALSE;
+  dstream->istream.istream.blocking = input->blocking;
+  dstream->istream.istream.seekable = input->seekable;
+
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_create(&dstream->istream, input, -1, 0);
+#else
+  i_stream_create(&dstream->istream, input, -1);
+#endif
+  dstream->istream.statbuf.st_size = size;
+  i_stream_set_name(&dstream->istream.istream, "(decompress)");
+  return &dstream->istream.istream;
+}
@@ -0,0 +1,34 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_STORAGE_RBOX_ISTREAM_DECOMPRESS_H_
+#define SRC_STORAGE_RBOX_ISTREAM_DECOMPRESS_H_
+
+extern "C" {
+#include "lib.h"
+}
+#include "rados-compression.h"
+
+/**
+ * @brief: creates a seekable istream, which decompresses the input while it is read.
+ *
+ * Only the buffered part of the mail is held uncompressed. Seeking backwards
+ * decompresses the input again from its start.
+ *
+ * @param[in] input compressed mail (one frame), e.g. a bufferlist or rados istream
+ * @param[in] decompressor decompressor of the codec of the mail, the stream takes ownership.
+ * @param[in] size uncompressed size of the mail
+ */
+struct istream *i_stream_create_decompress(struct istream *input, librmb::RadosDecompressor *decompressor,
+                                           uoff_t size);
+
+#endif /* SRC_STORAGE_RBOX_ISTREAM_DECOMPRESS_H_ */
@@ -0,0 +1,242 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+#include <algorithm>
+#include <list>
+#include <string>
+
+extern "C" {
+#include "lib.h"
+#include "istream-private.h"
+}
+
+#include "istream-rados.h"
+#include "rados-striping.h"
+
+struct rados_istream_chunk {
+  // offset within the mail
+  uoff_t offset;
+  size_t length;
+  librados::bufferlist *bl;
+  // nullptr once the read is complete
+  librados::AioCompletion *completion;
+};
+
+struct rados_istream {
+  struct istream_private istream;
+  librmb::RadosStorage *rados_storage;
+  std::string *oid;
+  uoff_t size;
+  size_t chunk_size;
+  unsigned int read_ahead;
+  uint64_t stripe_size;
+  librados::IoCtx *stripe_io_ctx;
+
+  // offset of the next byte, which is copied into the stream buffer
+  uoff_t read_offset;
+  // reads in flight or complete, ordered by offset. Only the first one may start before read_offset.
+  std::list<rados_istream_chunk> *chunks;
+};
+
+static int i_stream_rados_wait_chunk(struct rados_istream *rstream, struct rados_istream_chunk *chunk) {
+  if (chunk->completion == nullptr) {
+    return 0;
+  }
+  // releases the completion
+  int ret = rstream->rados_storage->wait_for_read_operation_complete(chunk->completion);
+  chunk->completion = nullptr;
+  if (ret >= 0 && chunk->bl->length() != chunk->length) {
+    i_error("reading oid: %s, offset: %lu returned %u of %lu bytes", rstream->oid->c_str(), chunk->offset,
+            chunk->bl->length(), chunk->length);
+    ret = -EIO;
+  }
+  if (ret < 0) {
+    i_error("reading oid: %s, offset: %lu failed with %d", rstream->oid->c_str(), chunk->offset, ret);
+    rstream->istream.istream.stream_errno = ret == -ENOENT ? ENOENT : EIO;
+    return -1;
+  }
+  return 0;
+}
+
+static void i_stream_rados_free_chunk(struct rados_istream *rstream, struct rados_istream_chunk *chunk) {
+  // the buffer is filled by librados until the read is complete
+  (void)i_stream_rados_wait_chunk(rstream, chunk);
+  delete chunk->bl;
+  chunk->bl = nullptr;
+}
+
+static int i_stream_rados_read_chunk(struct rados_istream *rstream, uoff_t offset) {
+  struct rados_istream_chunk chunk;
+  chunk.offset = offset;
+  chunk.length = std::min<uoff_t>(rstream->chunk_size, rstream->size - offset);
+
+  librados::IoCtx *io_ctx = nullptr;
+  std::string oid = *rstream->oid;
+  uint64_t object_offset = offset;
+  if (rstream->stripe_size > 0) {
+    // never read across a stripe boundary
+    uint32_t index = offset / rstream->stripe_size;
+    object_offset = offset % rstream->stripe_size;
+    chunk.length = std::min<uoff_t>(chunk.length, rstream->stripe_size - object_offset);
+    if (index > 0) {
+      if (rstream->stripe_io_ctx == nullptr) {
+        rstream->stripe_io_ctx = new librados::IoCtx();
+        librmb::RadosStriping::get_io_ctx(&rstream->rados_storage->get_io_ctx(), rstream->stripe_io_ctx);
+      }
+      io_ctx = rstream->stripe_io_ctx;
+      oid = librmb::RadosStriping::get_stripe_oid(oid, index);
+    }
+  }
+  chunk.bl = new librados::bufferlist();
+  chunk.completion = librados::Rados::aio_create_completion();
+  int ret = rstream->rados_storage->aio_read(io_ctx, oid, chunk.completion, chunk.bl, chunk.length, object_offset);
+  if (ret < 0) {
+    i_error("aio_read oid: %s, offset: %lu failed with %d", oid.c_str(), object_offset, ret);
+    chunk.completion->release();
+    delete chunk.bl;
+    rstream->istream.istream.stream_errno = EIO;
+    return -1;
+  }
+  rstream->chunks->push_back(chunk);
+  return 0;
+}
+
+/* the chunk of read_offset and read_ahead chunks behind it are read or in flight */
+static int i_stream_rados_read_ahead(struct rados_istream *rstream) {
+  uoff_t end = std::min<uoff_t>(rstream->size, rstream->read_offset + (uoff_t)(rstream->read_ahead + 1) *
+                                                                          rstream->chunk_size);
+  uoff_t offset = rstream->read_offset;
+  if (!rstream->chunks->empty()) {
+    offset = rstream->chunks->back().offset + rstream->chunks->back().length;
+  }
+  while (offset < end) {
+    if (i_stream_rados_read_chunk(rstream, offset) < 0) {
+      return -1;
+    }
+    offset += rstream->chunks->back().length;
+  }
+  return 0;
+}
+
+static ssize_t i_stream_rados_read(struct istream_private *stream) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+
+  if (rstream->read_offset >= rstream->size) {
+    stream->istream.eof = TRUE;
+    return -1;
+  }
+  if (i_stream_rados_read_ahead(rstream) < 0) {
+    return -1;
+  }
+  struct rados_istream_chunk *chunk = &rstream->chunks->front();
+  if (i_stream_rados_wait_chunk(rstream, chunk) < 0) {
+    // read it again, if the caller retries
+    i_stream_rados_free_chunk(rstream, chunk);
+    rstream->chunks->pop_front();
+    return -1;
+  }
+  size_t chunk_pos = rstream->read_offset - chunk->offset;
+  size_t size;
+  if (!i_stream_try_alloc(stream, chunk->length - chunk_pos, &size)) {
+    return -2;
+  }
+  size = std::min(size, chunk->length - chunk_pos);
+  chunk->bl->copy(chunk_pos, size, reinterpret_cast<char *>(stream->w_buffer + stream->pos));
+  stream->pos += size;
+  rstream->read_offset += size;
+
+  if (rstream->read_offset == chunk->offset + chunk->length) {
+    i_stream_rados_free_chunk(rstream, chunk);
+    rstream->chunks->pop_front();
+  }
+  return size;
+}
+
+static void i_stream_rados_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+
+  stream->istream.v_offset = v_offset;
+  stream->skip = stream->pos = 0;
+  rstream->read_offset = v_offset;
+
+  // keep the chunks from v_offset on, e.g. a forward seek behind the buffered data
+  while (!rstream->chunks->empty()) {
+    struct rados_istream_chunk *chunk = &rstream->chunks->front();
+    if (v_offset >= chunk->offset && v_offset < chunk->offset + chunk->length) {
+      break;
+    }
+    i_stream_rados_free_chunk(rstream, chunk);
+    rstream->chunks->pop_front();
+  }
+}
+
+static void i_stream_rados_close(struct iostream_private *stream, bool close_parent ATTR_UNUSED) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+
+  if (rstream->chunks != nullptr) {
+    for (auto &chunk : *rstream->chunks) {
+      i_stream_rados_free_chunk(rstream, &chunk);
+    }
+    delete rstream->chunks;
+    rstream->chunks = nullptr;
+  }
+  delete rstream->stripe_io_ctx;
+  rstream->stripe_io_ctx = nullptr;
+  delete rstream->oid;
+  rstream->oid = nullptr;
+}
+
+struct istream *i_stream_create_rados(librmb::RadosStorage *rados_storage, const std::string &oid, uoff_t size,
+                                      librados::bufferlist *first_chunk, size_t chunk_size, unsigned int read_ahead,
+                                      uint64_t stripe_size) {
+  struct rados_istream *rstream;
+
+  rstream = i_new(struct rados_istream, 1);
+  rstream->rados_storage = rados_storage;
+  rstream->oid = new std::string(oid);
+  rstream->size = size;
+  rstream->chunk_size = chunk_size;
+  rstream->read_ahead = read_ahead;
+  rstream->stripe_size = stripe_size;
+  rstream->stripe_io_ctx = nullptr;
+  rstream->read_offset = 0;
+  rstream->chunks = new std::list<rados_istream_chunk>();
+  if (first_chunk != nullptr) {
+    if (first_chunk->length() > 0) {
+      struct rados_istream_chunk chunk;
+      chunk.offset = 0;
+      chunk.length = first_chunk->length();
+      chunk.bl = first_chunk;
+      chunk.completion = nullptr;
+      rstream->chunks->push_back(chunk);
+    } else {
+      delete first_chunk;
+    }
+  }
+
+  rstream->istream.max_buffer_size = chunk_size;
+  rstream->istream.read = i_stream_rados_read;
+  rstream->istream.seek = i_stream_rados_seek;
+  rstream->istream.iostream.close = i_stream_rados_close;
+
+  rstream->istream.istream.readable_fd = FALSE;
+  rstream->istream.istream.blocking = TRUE;
+  rstream->istream.istream.seekable = TRUE;
+
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_create(&rstream->istream, NULL, -1, 0);
+#else
+  i_stream_create(&rstream->istream, NULL, -1);
+#endif
+  rstream->istream.statbuf.st_size = size;
+  i_stream_set_name(&rstream->istream.istream, "(rados)");
+  return &rstream->istream.istream;
+}
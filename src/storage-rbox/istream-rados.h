@@ -0,0 +1,43 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_STORAGE_RBOX_ISTREAM_RADOS_H_
+#define SRC_STORAGE_RBOX_ISTREAM_RADOS_H_
+
+extern "C" {
+#include "lib.h"
+}
+#include <string>
+#include <rados/librados.hpp>
+#include "rados-storage.h"
+
+/**
+ * @brief: creates a seekable istream, which reads the mail object in chunks on demand.
+ *
+ * Up to read_ahead chunks behind the current one are read async. Seeking drops
+ * the chunks, which are not needed anymore, so only the chunks around the current
+ * offset are held in memory.
+ *
+ * @param[in] rados_storage storage of the mail, reads use its io context.
+ * @param[in] oid mail object
+ * @param[in] size size of the mail
+ * @param[in] first_chunk nullptr or the first bytes of the mail (already read), the stream takes ownership.
+ * @param[in] chunk_size size of the reads
+ * @param[in] read_ahead number of chunks read ahead
+ * @param[in] stripe_size 0 or the stripe size of a striped mail (see RadosStriping), reads
+ *            never cross a stripe boundary.
+ */
+struct istream *i_stream_create_rados(librmb::RadosStorage *rados_storage, const std::string &oid, uoff_t size,
+                                      librados::bufferlist *first_chunk, size_t chunk_size, unsigned int read_ahead,
+                                      uint64_t stripe_size);
+
+#endif /* SRC_STORAGE_RBOX_ISTREAM_RADOS_H_ */
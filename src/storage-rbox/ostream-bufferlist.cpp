@@ -11,12 +11,28 @@
  */
 #include <string>
 #include <list>
+#include <vector>
+#include <algorithm>
 
 extern "C" {
 #include "lib.h"
 #include "ostream-private.h"
 }
 #include "ostream-bufferlist.h"
+#include "rados-checksum.h"
+#include "rados-striping.h"
+#include "rados-util.h"
+
+// max. number of chunk writes in flight before sendv waits for the oldest one
+#define RBOX_STREAM_MAX_PENDING_WRITES 4
+// growth policy of the write buffer if the mail size is unknown (or exceeded)
+#define RBOX_STREAM_MIN_ALLOC_SIZE 4096
+#define RBOX_STREAM_MAX_ALLOC_SIZE (4 * 1024 * 1024)
+
+struct bufferlist_ostream_write {
+  librados::AioCompletion *completion;
+  librados::ObjectWriteOperation *write_op;
+};
 
 struct bufferlist_ostream {
   struct ostream_private ostream;
@@ -24,9 +40,180 @@ struct bufferlist_ostream {
   bool seeked;
   librmb::RadosStorage *rados_storage;
   librmb::RadosMail *rados_mail;
-  bool execute_write_ops;
+
+  // streaming save: once buf reaches watermark, full chunks are written async.
+  uint64_t watermark;
+  uint64_t chunk_size;
+  uint64_t flushed_offset;
+  std::list<bufferlist_ostream_write> *pending_writes;
+  // striping: chunks behind the first stripe are written to the stripe objects
+  uint64_t stripe_size;
+  librados::IoCtx *stripe_io_ctx;
+
+  // sendv copies into the unused part of tail, which is then appended to buf
+  // (sharing the page aligned allocation, contiguous appends are merged).
+  ceph::bufferptr *tail;
+  uint64_t size_hint;
+  uint64_t last_alloc_size;
+
+  // crc32c of everything sent, invalid once the stream has been seeked.
+  uint32_t crc32c;
+  // length of the mail header (0 = end of header not sent yet), see RadosUtils::scan_header_end
+  uint64_t header_size;
+  int header_state;
 };
 
+static uint64_t o_stream_bufferlist_length(struct bufferlist_ostream *bstream) {
+  return bstream->buf->length() + bstream->tail->length();
+}
+
+static void o_stream_bufferlist_seal_tail(struct bufferlist_ostream *bstream) {
+  if (bstream->tail->length() == 0) {
+    return;
+  }
+  bstream->buf->append(*bstream->tail, 0, bstream->tail->length());
+  // keep on writing behind the appended data into the same allocation
+  bstream->tail->set_offset(bstream->tail->offset() + bstream->tail->length());
+  bstream->tail->set_length(0);
+}
+
+static void o_stream_bufferlist_alloc_tail(struct bufferlist_ostream *bstream) {
+  uint64_t written = bstream->flushed_offset + o_stream_bufferlist_length(bstream);
+  uint64_t alloc_size;
+  if (bstream->size_hint > written) {
+    // mail size is known (LMTP/APPEND): allocate the rest at once
+    alloc_size = bstream->size_hint - written;
+  } else {
+    alloc_size = bstream->last_alloc_size > 0 ? bstream->last_alloc_size * 2 : RBOX_STREAM_MIN_ALLOC_SIZE;
+    alloc_size = std::min<uint64_t>(alloc_size, RBOX_STREAM_MAX_ALLOC_SIZE);
+  }
+  if (bstream->chunk_size > 0) {
+    // streaming save: written chunks are only freed once the whole allocation is unreferenced.
+    alloc_size = std::min(alloc_size, bstream->chunk_size);
+  }
+  alloc_size = (alloc_size + RBOX_STREAM_MIN_ALLOC_SIZE - 1) & ~((uint64_t)RBOX_STREAM_MIN_ALLOC_SIZE - 1);
+
+  *bstream->tail = ceph::buffer::create_page_aligned(alloc_size);
+  bstream->tail->set_length(0);
+  bstream->last_alloc_size = alloc_size;
+}
+
+static void o_stream_bufferlist_append(struct bufferlist_ostream *bstream, const char *data, size_t size) {
+  while (size > 0) {
+    if (bstream->tail->unused_tail_length() == 0) {
+      o_stream_bufferlist_seal_tail(bstream);
+      o_stream_bufferlist_alloc_tail(bstream);
+    }
+    size_t n = std::min<size_t>(size, bstream->tail->unused_tail_length());
+    bstream->tail->append(data, n);
+    data += n;
+    size -= n;
+  }
+}
+
+static int o_stream_bufferlist_wait_oldest(struct bufferlist_ostream *bstream) {
+  bufferlist_ostream_write write = bstream->pending_writes->front();
+  bstream->pending_writes->pop_front();
+
+  // wait_for_write_operations_complete releases the completion
+  bool failed = bstream->rados_storage->wait_for_write_operations_complete(write.completion, write.write_op);
+  delete write.write_op;
+  if (failed) {
+    i_error("streaming write of oid: %s failed", bstream->rados_mail->get_oid()->c_str());
+    bstream->ostream.ostream.stream_errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+static int o_stream_bufferlist_wait_all(struct bufferlist_ostream *bstream) {
+  int ret = 0;
+  while (!bstream->pending_writes->empty()) {
+    if (o_stream_bufferlist_wait_oldest(bstream) < 0) {
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+static int o_stream_bufferlist_write_chunk(struct bufferlist_ostream *bstream, librados::IoCtx *io_ctx,
+                                           const std::string &oid, uint64_t offset, librados::bufferlist &chunk) {
+  bufferlist_ostream_write write;
+  write.write_op = new librados::ObjectWriteOperation();
+  write.write_op->write(offset, chunk);
+  write.completion = librados::Rados::aio_create_completion();
+
+  int ret = bstream->rados_storage->aio_operate(io_ctx, oid, write.completion, write.write_op);
+  if (ret < 0) {
+    i_error("aio_operate oid: %s, offset: %lu failed with %d", oid.c_str(), offset, ret);
+    write.completion->release();
+    delete write.write_op;
+    bstream->ostream.ostream.stream_errno = EIO;
+    return -1;
+  }
+  bstream->pending_writes->push_back(write);
+  return 0;
+}
+
+static int o_stream_bufferlist_flush_chunks(struct bufferlist_ostream *bstream) {
+  if (bstream->buf->length() < bstream->watermark) {
+    return 0;
+  }
+  while (bstream->buf->length() >= bstream->chunk_size) {
+    if (bstream->stripe_size == 0 &&
+        bstream->flushed_offset + bstream->chunk_size > (uint64_t)bstream->rados_storage->get_max_object_size()) {
+      i_error("configured CEPH Object size %d < then mail size %lu ", bstream->rados_storage->get_max_object_size(),
+              bstream->flushed_offset + bstream->chunk_size);
+      bstream->ostream.ostream.stream_errno = EFBIG;
+      return -1;
+    }
+    // move the chunk out of the mail buffer, the write op keeps a reference until it completes.
+    librados::bufferlist chunk;
+    bstream->buf->splice(0, bstream->chunk_size, &chunk);
+
+    if (bstream->stripe_size == 0) {
+      if (o_stream_bufferlist_write_chunk(bstream, &bstream->rados_storage->get_io_ctx(),
+                                          *bstream->rados_mail->get_oid(), bstream->flushed_offset, chunk) < 0) {
+        return -1;
+      }
+    } else {
+      // a chunk may span two stripes
+      std::vector<librmb::RadosStripeExtent> extents;
+      librmb::RadosStriping::get_extents(bstream->flushed_offset, chunk.length(), bstream->stripe_size, &extents);
+      for (const auto &extent : extents) {
+        librados::bufferlist part;
+        part.substr_of(chunk, extent.buffer_offset, extent.length);
+        int ret;
+        if (extent.index == 0) {
+          ret = o_stream_bufferlist_write_chunk(bstream, &bstream->rados_storage->get_io_ctx(),
+                                                *bstream->rados_mail->get_oid(), extent.object_offset, part);
+        } else {
+          if (bstream->stripe_io_ctx == nullptr) {
+            bstream->stripe_io_ctx = new librados::IoCtx();
+            librmb::RadosStriping::get_io_ctx(&bstream->rados_storage->get_io_ctx(), bstream->stripe_io_ctx);
+          }
+          ret = o_stream_bufferlist_write_chunk(
+              bstream, bstream->stripe_io_ctx,
+              librmb::RadosStriping::get_stripe_oid(*bstream->rados_mail->get_oid(), extent.index),
+              extent.object_offset, part);
+        }
+        if (ret < 0) {
+          return -1;
+        }
+      }
+    }
+    bstream->flushed_offset += chunk.length();
+
+    // bound the memory held by in flight chunks
+    while (bstream->pending_writes->size() > RBOX_STREAM_MAX_PENDING_WRITES) {
+      if (o_stream_bufferlist_wait_oldest(bstream) < 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
 static int o_stream_buffer_seek(struct ostream_private *stream, uoff_t offset) {
   struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
   bstream->seeked = TRUE;
@@ -41,15 +228,19 @@ int o_stream_buffer_write_at(struct ostream_private *stream, const void *data, s
 }
 
 static void rbox_ostream_destroy(struct iostream_private *stream) {
-  // nothing to do. but required, so that default destroy is not evoked!
+  // required, so that default destroy is not evoked!
   // buffer is member of RboxMailObjec, which destroys the bufferlist
-
-  // wait for write operation
   struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
   i_assert(bstream->buf != nullptr);
 
-  // do not free the outbut stream! cause, it is needed until all write operations are finished!
-  // delete bstream->buf;
+  // e.g. save was canceled: make sure no streamed chunk is still in flight
+  (void)o_stream_bufferlist_wait_all(bstream);
+  delete bstream->pending_writes;
+  bstream->pending_writes = nullptr;
+  delete bstream->stripe_io_ctx;
+  bstream->stripe_io_ctx = nullptr;
+  delete bstream->tail;
+  bstream->tail = nullptr;
 }
 
 static ssize_t o_stream_buffer_sendv(struct ostream_private *stream, const struct const_iovec *iov,
@@ -57,29 +248,53 @@ static ssize_t o_stream_buffer_sendv(struct ostream_private *stream, const struc
   struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
   ssize_t ret = 0;
   unsigned int i;
-  uint64_t val = stream->ostream.offset;
-  if (bstream->execute_write_ops) {
-    bstream->buf->clear();
-  }
+
   for (i = 0; i < iov_count; i++) {
-    // use unsigned char* for binary data!
-    bstream->buf->append(reinterpret_cast<const unsigned char *>(iov[i].iov_base), iov[i].iov_len);
+    bstream->crc32c = librmb::RadosChecksum::crc32c(bstream->crc32c, iov[i].iov_base, iov[i].iov_len);
+    if (bstream->header_size == 0) {
+      int64_t header_end = librmb::RadosUtils::scan_header_end(reinterpret_cast<const char *>(iov[i].iov_base),
+                                                               iov[i].iov_len, &bstream->header_state);
+      if (header_end >= 0) {
+        bstream->header_size = stream->ostream.offset + header_end;
+      }
+    }
+    o_stream_bufferlist_append(bstream, reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
     stream->ostream.offset += iov[i].iov_len;
     ret += iov[i].iov_len;
   }
+  o_stream_bufferlist_seal_tail(bstream);
 
-  if (bstream->execute_write_ops) {
-    librados::ObjectWriteOperation write_op;
-    write_op.write(val, *bstream->buf);
-
-    bstream->rados_storage->aio_operate(&bstream->rados_storage->get_io_ctx(), *bstream->rados_mail->get_oid(),
-                                        bstream->rados_mail->get_completion(), &write_op);
+  if (bstream->watermark > 0 && o_stream_bufferlist_flush_chunks(bstream) < 0) {
+    return -1;
   }
   return ret;
 }
 
+int o_stream_bufferlist_wait_flushed(struct ostream *output) {
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)output->real_stream;
+  return o_stream_bufferlist_wait_all(bstream);
+}
+
+bool o_stream_bufferlist_get_crc32c(struct ostream *output, uint32_t *crc32c) {
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)output->real_stream;
+  *crc32c = bstream->crc32c;
+  return !bstream->seeked;
+}
+
+bool o_stream_bufferlist_get_header_size(struct ostream *output, uint64_t *header_size) {
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)output->real_stream;
+  *header_size = bstream->header_size;
+  return !bstream->seeked && bstream->header_size > 0;
+}
+
+void o_stream_bufferlist_set_size_hint(struct ostream *output, uoff_t size) {
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)output->real_stream;
+  bstream->size_hint = size;
+}
+
 struct ostream *o_stream_create_bufferlist(librmb::RadosMail *rados_mail, librmb::RadosStorage *rados_storage,
-                                           bool execute_write_ops) {
+                                           const uint64_t &watermark, const uint64_t &chunk_size,
+                                           const uint64_t &stripe_size) {
   struct bufferlist_ostream *bstream;
   struct ostream *output;
 
@@ -93,15 +308,23 @@ struct ostream *o_stream_create_bufferlist(librmb::RadosMail *rados_mail, librmb
   bstream->ostream.sendv = o_stream_buffer_sendv;
   bstream->ostream.write_at = o_stream_buffer_write_at;
   bstream->ostream.iostream.destroy = rbox_ostream_destroy;
-  //  bstream->buf = execute_write_ops ? new librados::bufferlist() : rados_mail->get_mail_buffer();
   bstream->buf = rados_mail->get_mail_buffer();
   bstream->rados_storage = rados_storage;
   bstream->rados_mail = rados_mail;
-  bstream->execute_write_ops = execute_write_ops;
-  if (execute_write_ops) {
-    rados_mail->set_completion(librados::Rados::aio_create_completion());
-    rados_mail->set_active_op(1);
-  }
+  // a watermark below one chunk would flush nothing.
+  bstream->chunk_size = chunk_size;
+  bstream->watermark = (watermark > 0 && watermark < chunk_size) ? chunk_size : watermark;
+  bstream->flushed_offset = 0;
+  bstream->pending_writes = new std::list<bufferlist_ostream_write>();
+  bstream->stripe_size = stripe_size;
+  bstream->stripe_io_ctx = nullptr;
+  bstream->tail = new ceph::bufferptr();
+  bstream->size_hint = 0;
+  bstream->last_alloc_size = 0;
+  bstream->crc32c = 0;
+  bstream->header_size = 0;
+  bstream->header_state = 0;
+
   output = o_stream_create(&bstream->ostream, NULL, -1);
   o_stream_set_name(output, "(buffer)");
   return output;
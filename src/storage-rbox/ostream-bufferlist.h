@@ -20,7 +20,36 @@ extern "C" {
 #include "rados-storage.h"
 #include "rados-mail.h"
 
+/*!
+ * creates a ostream which appends to the mail buffer of rados_mail.
+ * If watermark > 0, the buffered data is written to rados in chunk_size
+ * pieces (aio) as soon as the buffer reaches the watermark, so that only
+ * the tail of the mail remains in memory.
+ * If stripe_size > 0, data behind the first stripe is written to the
+ * stripe objects of the mail (see RadosStriping).
+ */
 struct ostream *o_stream_create_bufferlist(librmb::RadosMail *rados_mail, librmb::RadosStorage *rados_storage,
-                                           bool execute_write_ops);
+                                           const uint64_t &watermark, const uint64_t &chunk_size,
+                                           const uint64_t &stripe_size);
+/*!
+ * wait until all chunks written by the stream are complete.
+ * @return -1 if one of the writes failed.
+ */
+int o_stream_bufferlist_wait_flushed(struct ostream *output);
+/*!
+ * expected size of the mail (e.g. LMTP/APPEND), the write buffer is
+ * preallocated (page aligned) to this size instead of growing in small steps.
+ */
+void o_stream_bufferlist_set_size_hint(struct ostream *output, uoff_t size);
+/*!
+ * crc32c of the data written to the stream so far (calculated in sendv).
+ * @return false if the checksum is not valid (stream has been seeked).
+ */
+bool o_stream_bufferlist_get_crc32c(struct ostream *output, uint32_t *crc32c);
+/*!
+ * length of the mail header including the terminating empty line (scanned in sendv).
+ * @return false if the end of the header has not been sent or the stream has been seeked.
+ */
+bool o_stream_bufferlist_get_header_size(struct ostream *output, uint64_t *header_size);
 int o_stream_buffer_write_at(struct ostream_private *stream, const void *data, size_t size, uoff_t offset);
 #endif /* SRC_STORAGE_RBOX_OSTREAM_BUFFERLIST_H_ */
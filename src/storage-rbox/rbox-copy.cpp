@@ -30,6 +30,8 @@ extern "C" {
 #include "rbox-sync.h"
 #include "rbox-copy.h"
 #include "rados-util.h"
+#include "rados-single-instance.h"
+#include "rados-striping.h"
 
 const char *SETTINGS_RBOX_UPDATE_IMMUTABLE = "rbox_update_immutable";
 const char *SETTINGS_DEF_UPDATE_IMMUTABLE = "false";
@@ -177,6 +179,65 @@ static void mail_copy_set_failed(struct mail_save_context *ctx, struct mail *mai
   errstr = mail_storage_get_last_error(mail->box->storage, &error);
   mail_storage_set_error(ctx->transaction->box->storage, error, t_strdup_printf("%s (%s)", errstr, func));
 }
+/**
+ * single instance storage: the copy references the same shared body as the source,
+ * add the reference before the copy, so that an expunge of the source can't remove the body.
+ */
+static int add_shared_body_ref(librmb::RadosStorage *rados_storage, const std::string &src_oid,
+                               const std::string &ns_src, std::string *body_oid) {
+  // gated on the xattr of the source, not on the config: mails stored with single instance storage
+  // keep referencing their shared body, after the config was changed.
+  librados::IoCtx src_io_ctx;
+  src_io_ctx.dup(rados_storage->get_io_ctx());
+  src_io_ctx.set_namespace(ns_src);
+  librados::bufferlist ext_ref;
+  int ret = src_io_ctx.getxattr(src_oid, librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_EXT_REF), ext_ref);
+  if (ret < 0 || ext_ref.length() == 0) {
+    // no shared body (-ENODATA), a missing source is handled by the copy itself.
+    return 0;
+  }
+  *body_oid = ext_ref.to_str();
+  ret = librmb::RadosSingleInstance::add_ref(&src_io_ctx, *body_oid);
+  if (ret < 0) {
+    i_error("adding reference to shared body %s of oid %s failed: %d", body_oid->c_str(), src_oid.c_str(), ret);
+    body_oid->clear();
+    return -1;
+  }
+  return 0;
+}
+
+static void get_namespace_io_ctx(librmb::RadosStorage *rados_storage, const std::string &ns,
+                                 librados::IoCtx *io_ctx) {
+  io_ctx->dup(rados_storage->get_io_ctx());
+  io_ctx->set_namespace(ns);
+}
+
+/**
+ * striping: the copy gets its own stripes, they are copied (server side) before the mail object,
+ * so that the copy never references missing stripes.
+ */
+static int copy_stripes(librmb::RadosStorage *rados_storage, const std::string &src_oid, const std::string &ns_src,
+                        const std::string &dest_oid, const std::string &ns_dest, std::string *manifest) {
+  librados::IoCtx src_io_ctx;
+  get_namespace_io_ctx(rados_storage, ns_src, &src_io_ctx);
+  int ret = librmb::RadosStriping::get_manifest(&src_io_ctx, src_oid, manifest);
+  if (ret < 0 || manifest->empty()) {
+    // not striped, a missing source is handled by the copy itself.
+    manifest->clear();
+    return 0;
+  }
+  librados::IoCtx dest_io_ctx;
+  get_namespace_io_ctx(rados_storage, ns_dest, &dest_io_ctx);
+  ret = librmb::RadosStriping::copy_stripes(&src_io_ctx, src_oid, &dest_io_ctx, dest_oid, *manifest);
+  if (ret < 0) {
+    i_error("copying stripes (%s) of oid %s failed: %d", manifest->c_str(), src_oid.c_str(), ret);
+    librmb::RadosStriping::remove_stripes(&dest_io_ctx, dest_oid, *manifest);
+    manifest->clear();
+    return -1;
+  }
+  return 0;
+}
+
 static int copy_mail(struct mail_save_context *ctx, librmb::RadosStorage *rados_storage, struct rbox_mail *rmail,
                      const std::string *ns_src, const std::string *ns_dest) {
   struct rbox_save_context *r_ctx = (struct rbox_save_context *)ctx;
@@ -191,7 +252,23 @@ static int copy_mail(struct mail_save_context *ctx, librmb::RadosStorage *rados_
 
   set_mailbox_metadata(ctx, &metadata_update);
 
-  int ret_val = rados_storage->copy(src_oid, ns_src->c_str(), dest_oid, ns_dest->c_str(), metadata_update);
+  std::string body_oid;
+  std::string manifest;
+  int ret_val = add_shared_body_ref(rados_storage, src_oid, *ns_src, &body_oid);
+  if (ret_val >= 0) {
+    ret_val = copy_stripes(rados_storage, src_oid, *ns_src, dest_oid, *ns_dest, &manifest);
+  }
+  if (ret_val >= 0) {
+    ret_val = rados_storage->copy(src_oid, ns_src->c_str(), dest_oid, ns_dest->c_str(), metadata_update);
+    if (ret_val < 0 && !manifest.empty()) {
+      librados::IoCtx dest_io_ctx;
+      get_namespace_io_ctx(rados_storage, *ns_dest, &dest_io_ctx);
+      librmb::RadosStriping::remove_stripes(&dest_io_ctx, dest_oid, manifest);
+    }
+  }
+  if (ret_val < 0 && !body_oid.empty()) {
+    librmb::RadosSingleInstance::remove_ref(&rados_storage->get_io_ctx(), body_oid);
+  }
   if (ret_val < 0) {
     if (ret_val == -ENOENT) {
       i_debug(
@@ -214,7 +291,26 @@ static int copy_mail(struct mail_save_context *ctx, librmb::RadosStorage *rados_
     return -1;
   }
   r_ctx->failed = ret_val < 0 ? true : false;
+  // in memory only: the reference and the stripes of the copy are released by clean_up_failed, if the
+  // transaction is rolled back.
+  if (!body_oid.empty()) {
+    r_ctx->rados_mail->add_metadata(librmb::RadosMetadata(librmb::RBOX_METADATA_EXT_REF, body_oid));
+  }
+  if (!manifest.empty()) {
+    r_ctx->rados_mail->add_metadata(librmb::RadosMetadata(librmb::RBOX_METADATA_STRIPES, manifest));
+  }
 
+  if (r_storage->config->is_mailbox_counters()) {
+    // the copy keeps the physical size metadata, it is subtracted again on expunge.
+    uoff_t size;
+    r_ctx->counters.messages++;
+    if (mail_get_physical_size((struct mail *)rmail, &size) == 0) {
+      r_ctx->counters.bytes += size;
+      if (rados_storage == r_storage->alt) {
+        r_ctx->counters.alt_bytes += size;
+      }
+    }
+  }
   rbox_add_to_index(ctx);
   if (r_storage->save_log->is_open()) {
     r_storage->save_log->append(librmb::RadosSaveLogEntry(dest_oid, *ns_dest, rados_storage->get_pool_name(),
@@ -17,6 +17,8 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 
+#include <chrono>
+#include <deque>
 #include <map>
 #include <string>
 #include <iostream>
@@ -41,12 +43,21 @@ extern "C" {
 #include "rbox-storage.hpp"
 #include "../librmb/rados-storage-impl.h"
 #include "istream-bufferlist.h"
+#include "istream-decompress.h"
+#include "istream-rados.h"
 #include "rbox-mail.h"
 #include "rados-util.h"
+#include "rados-checksum.h"
+#include "rados-single-instance.h"
+#include "rados-striping.h"
+#include "rados-mail-cache.h"
+#include "rados-hedged-read.h"
 
 using librmb::RadosMail;
 using librmb::rbox_metadata_key;
 
+static void rbox_mail_warmup_load_metadata(struct rbox_mail *rmail);
+
 void rbox_mail_set_expunged(struct rbox_mail *mail) {
   FUNC_START();
 
@@ -155,7 +166,16 @@ static int rbox_mail_metadata_get(struct rbox_mail *rmail, enum rbox_metadata_ke
     i_info("mail uid: %d , oid '%s', guid: %s, index-oid: %s ",mail->uid,rmail->rados_mail->get_oid()->c_str(), guid_128_to_string(rmail->index_guid),  guid_128_to_string(rmail->index_oid) );
     rmail->rados_mail->set_oid(rmail->index_oid);
   }
-  int ret_load_metadata = r_storage->ms->get_storage()->load_metadata(rmail->rados_mail);
+  if (rmail->rados_mail->get_metadata()->empty()) {
+    if (!alt_storage) {
+      rbox_mail_warmup_pop3(rmail);
+    }
+    rbox_mail_warmup_load_metadata(rmail);
+  }
+  // may have been read together with the mail (rbox_mail_read)
+  int ret_load_metadata = rmail->rados_mail->get_metadata()->empty()
+                              ? r_storage->ms->get_storage()->load_metadata(rmail->rados_mail)
+                              : 0;
   if (ret_load_metadata < 0) {
     std::string metadata_key = librmb::rbox_metadata_key_to_char(key);
     if (ret_load_metadata == -ENOENT) { 
@@ -423,12 +443,10 @@ static int rbox_mail_get_physical_size(struct mail *_mail, uoff_t *size_r) {
   return ret;
 }
 
-static int get_mail_stream(struct rbox_mail *mail, librados::bufferlist *buffer, const size_t physical_size,
-                           struct istream **stream_r) {
+static int get_mail_stream(struct rbox_mail *mail, struct istream *input, struct istream **stream_r) {
   struct mail_private *pmail = &mail->imail.mail;
   int ret = 0;
 
-  struct istream *input = i_stream_create_from_bufferlist(buffer, physical_size);
   i_stream_seek(input, 0);
 
   *stream_r = input;
@@ -442,28 +460,595 @@ static int get_mail_stream(struct rbox_mail *mail, librados::bufferlist *buffer,
   return ret;
 }
 
+/**
+ * @brief: first read of a mail object: the data, the attributes needed to interpret it and
+ * the mail metadata (if not loaded yet), in one read op. Heap allocated, librados writes into
+ * the members until the op is complete.
+ */
+struct rbox_mail_read {
+  librmb::RadosStorage *rados_storage;
+  uint64_t read_size;
+  bool get_body;
+  // false if only the metadata is read
+  bool read_data;
+  librados::ObjectReadOperation op;
+  librados::bufferlist buffer;
+  uint64_t psize;
+  time_t save_date;
+  librados::bufferlist compression;
+  librados::bufferlist ext_ref;
+  librados::bufferlist stripes;
+  librados::bufferlist header_size_bl;
+  int read_err;
+  int stat_err;
+  int compression_err;
+  int ext_ref_err;
+  int stripes_err;
+  int header_size_err;
+  // metadata module, which added its reads to op or nullptr
+  librmb::RadosStorageMetadataModule *ms;
+  librmb::RadosMetadataRead metadata;
+  // nullptr for synchronous reads or once the async read is complete
+  librados::AioCompletion *completion;
+  // result of the async read, once it is complete
+  int ret;
+};
+
+/* async reads of the mails of a mailbox, which are accessed soon (rbox_mail_warmup, rbox_mail_warmup_pop3) */
+struct rbox_mail_warmup {
+  // in flight or complete, by oid
+  std::map<std::string, struct rbox_mail_read *> reads;
+  // oids of the mails to read next
+  std::deque<std::string> queue;
+  // max. number of reads
+  unsigned int window;
+  uint64_t read_size;
+  bool read_data;
+  // rbox_mail_warmup_pop3 has been called
+  bool pop3;
+};
+
+static struct rbox_mail_read *rbox_mail_read_alloc_op(struct rbox_storage *r_storage,
+                                                      librmb::RadosStorage *rados_storage, uint64_t read_size,
+                                                      bool get_body, bool load_metadata, bool read_data) {
+  struct rbox_mail_read *read = new rbox_mail_read();
+  read->rados_storage = rados_storage;
+  read->read_size = read_size;
+  read->get_body = get_body;
+  read->read_data = read_data;
+  read->psize = 0;
+  read->save_date = 0;
+  read->read_err = read->stat_err = read->compression_err = 0;
+  read->ext_ref_err = read->stripes_err = read->header_size_err = 0;
+  read->completion = nullptr;
+  read->ret = 0;
+  read->ms = nullptr;
+  if (load_metadata) {
+    // FETCH of flags, dates, sizes, ... and body: no extra round trip for the metadata
+    read->ms = r_storage->ms->get_storage();
+    read->ms->set_io_ctx(&rados_storage->get_io_ctx());
+    read->ms->add_load_metadata(&read->op, &read->metadata);
+  }
+  if (!read_data) {
+    return read;
+  }
+
+  /* duplicate code: get_attribute */
+  read->op.read(0, read_size > 0 ? read_size : INT_MAX, &read->buffer, &read->read_err);
+  read->op.stat(&read->psize, &read->save_date, &read->stat_err);
+  read->op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_COMPRESSION), &read->compression,
+                    &read->compression_err);
+  // uncompressed mails don't have the attribute
+  read->op.set_op_flags2(librados::OP_FAILOK);
+  read->op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_EXT_REF), &read->ext_ref,
+                    &read->ext_ref_err);
+  // only set for mails with a shared body (single instance storage)
+  read->op.set_op_flags2(librados::OP_FAILOK);
+  read->op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_STRIPES), &read->stripes,
+                    &read->stripes_err);
+  // only set for striped mails
+  read->op.set_op_flags2(librados::OP_FAILOK);
+  if (read_size > 0 && !get_body) {
+    read->op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_HEADER_SIZE), &read->header_size_bl,
+                      &read->header_size_err);
+    // not set for mails saved by older versions
+    read->op.set_op_flags2(librados::OP_FAILOK);
+  }
+  return read;
+}
+
+static struct rbox_mail_read *rbox_mail_read_alloc(struct rbox_mail *rmail, librmb::RadosStorage *rados_storage,
+                                                   uint64_t read_size, bool get_body) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+  return rbox_mail_read_alloc_op(r_storage, rados_storage, read_size, get_body,
+                                 rmail->rados_mail->get_metadata()->empty(), true);
+}
+
+/* waits for the async read (if any) */
+static int rbox_mail_read_wait(struct rbox_mail_read *read) {
+  if (read->completion != nullptr) {
+    // releases the completion
+    read->ret = read->rados_storage->wait_for_read_operation_complete(read->completion);
+    read->completion = nullptr;
+  }
+  return read->ret;
+}
+
+/* waits for the async read (if any) and frees it */
+static int rbox_mail_read_free(struct rbox_mail_read *read) {
+  int ret = rbox_mail_read_wait(read);
+  delete read;
+  return ret;
+}
+
+/* the read can be used for a read of read_size (rbox_mail_get_read_size) */
+static bool rbox_mail_read_matches(struct rbox_mail_read *read, librmb::RadosStorage *rados_storage,
+                                   uint64_t read_size, bool get_body) {
+  return read->read_data && read->rados_storage == rados_storage && read->read_size == read_size &&
+         read->get_body == get_body;
+}
+
+/* @return the warmup read of the mail or nullptr */
+static struct rbox_mail_read *rbox_mail_warmup_find(struct rbox_mail *rmail) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)rmail->imail.mail.mail.box;
+  if (rbox->warmup == nullptr || rmail->rados_mail->get_oid() == nullptr) {
+    return nullptr;
+  }
+  std::map<std::string, struct rbox_mail_read *>::iterator it =
+      rbox->warmup->reads.find(*rmail->rados_mail->get_oid());
+  return it != rbox->warmup->reads.end() ? it->second : nullptr;
+}
+
+/* start the reads of the queued mails until the window is full */
+static void rbox_mail_warmup_fill(struct rbox_mailbox *rbox) {
+  struct rbox_mail_warmup *warmup = rbox->warmup;
+  librmb::RadosStorage *rados_storage = rbox->storage->s;
+
+  while (!warmup->queue.empty() && warmup->reads.size() < warmup->window) {
+    std::string oid = warmup->queue.front();
+    warmup->queue.pop_front();
+    if (warmup->reads.find(oid) != warmup->reads.end()) {
+      continue;
+    }
+    librados::bufferlist cached;
+    time_t save_date;
+    bool is_cached = warmup->read_data && librmb::RadosMailCache::get_instance().get(
+        librmb::RadosMailCache::get_key(rados_storage->get_pool_name(), rados_storage->get_namespace(), oid), &cached,
+        &save_date);
+    struct rbox_mail_read *read = rbox_mail_read_alloc_op(rbox->storage, rados_storage, warmup->read_size, false,
+                                                          true, warmup->read_data && !is_cached);
+    read->completion = librados::Rados::aio_create_completion();
+    int ret = rados_storage->aio_read_operate(oid, read->completion, &read->op, &read->buffer, 0);
+    if (ret < 0) {
+      i_warning("warmup of mail %s failed with %d", oid.c_str(), ret);
+      read->completion->release();
+      read->completion = nullptr;
+      (void)rbox_mail_read_free(read);
+      // read synchronously on access
+      warmup->queue.clear();
+      break;
+    }
+    warmup->reads[oid] = read;
+  }
+}
+
+static void rbox_mail_warmup_remove(struct rbox_mail *rmail) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)rmail->imail.mail.mail.box;
+  rbox->warmup->reads.erase(*rmail->rados_mail->get_oid());
+  rbox_mail_warmup_fill(rbox);
+}
+
+/* queue the mails seq_first..seq_last (in this order) of view, which are in the primary storage */
+static void rbox_mail_warmup_queue(struct rbox_mailbox *rbox, struct mail_index_view *view, uint32_t seq_first,
+                                   uint32_t seq_last) {
+  int step = seq_first <= seq_last ? 1 : -1;
+  for (uint32_t seq = seq_first;; seq += step) {
+    const struct mail_index_record *rec = mail_index_lookup(view, seq);
+    const void *rec_data = NULL;
+    mail_index_lookup_ext(view, seq, rbox->ext_id, &rec_data, NULL);
+    if (rec_data != NULL && (rec->flags & RBOX_INDEX_FLAG_ALT) == 0) {
+      const struct obox_mail_index_record *obox_rec = static_cast<const struct obox_mail_index_record *>(rec_data);
+      rbox->warmup->queue.push_back(guid_128_to_string(obox_rec->oid));
+    }
+    if (seq == seq_last) {
+      break;
+    }
+  }
+}
+
+/* POP3 UIDL and LIST: the metadata of all mails is needed. It is not in the index cache, if this is called
+ * (rbox_mail_metadata_get), so read the metadata of this and the following mails async. */
+static void rbox_mail_warmup_pop3(struct rbox_mail *rmail) {
+  struct mail *_mail = &rmail->imail.mail.mail;
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)_mail->box;
+  struct rbox_storage *r_storage = rbox->storage;
+
+  const char *service = _mail->box->storage->user->service;
+  if ((rbox->warmup != nullptr && rbox->warmup->pop3) || _mail->seq == 0 || service == NULL ||
+      strcmp(service, "pop3") != 0 || r_storage->config->get_pop3_preload_window() <= 0) {
+    return;
+  }
+  if (rbox->warmup == nullptr) {
+    rbox->warmup = new rbox_mail_warmup();
+  }
+  rbox->warmup->pop3 = true;
+  rbox->warmup->window = r_storage->config->get_pop3_preload_window();
+  rbox->warmup->read_size = 0;
+  rbox->warmup->read_data = false;
+  rbox_mail_warmup_queue(rbox, _mail->transaction->view, _mail->seq,
+                         mail_index_view_get_messages_count(_mail->transaction->view));
+  rbox_mail_warmup_fill(rbox);
+}
+
+/* the metadata has been read by rbox_mail_warmup, the data (if any) is kept for rbox_mail_get_stream */
+static void rbox_mail_warmup_load_metadata(struct rbox_mail *rmail) {
+  struct rbox_mail_read *read = rbox_mail_warmup_find(rmail);
+  if (read == nullptr || read->ms == nullptr) {
+    return;
+  }
+  int ret = rbox_mail_read_wait(read);
+  if (ret >= 0) {
+    read->ms->set_io_ctx(&read->rados_storage->get_io_ctx());
+    if (read->ms->load_metadata(rmail->rados_mail, &read->metadata) < 0) {
+      // loaded again by rbox_mail_metadata_get
+      rmail->rados_mail->get_metadata()->clear();
+      rmail->rados_mail->get_extended_metadata()->clear();
+    }
+  }
+  read->ms = nullptr;
+  if (ret < 0 || !read->read_data) {
+    rbox_mail_warmup_remove(rmail);
+    (void)rbox_mail_read_free(read);
+  }
+}
+
+/* a header stream is enough, unless the body is parsed with it (MIME parts, BODYSTRUCTURE, body size): these
+ * would be computed from an empty body and cached. */
+static bool rbox_mail_get_body(struct rbox_mail *rmail, bool get_body) {
+  struct index_mail_data *data = &rmail->imail.data;
+  return get_body || (data->access_part & (READ_BODY | PARSE_BODY)) != 0 || data->save_message_parts ||
+         data->save_bodystructure_body;
+}
+
+static uint64_t rbox_mail_get_read_size(librmb::RadosDovecotCephCfg *config, bool get_body) {
+  // ENVELOPE, BODY[HEADER], cache fill: read the header range only.
+  // Otherwise mails larger than a chunk are read on demand (if configured).
+  if (!get_body) {
+    return config->get_header_read_size() > 0 ? config->get_header_read_size() : 0;
+  }
+  if (config->get_read_chunk_size() > 0 && !config->is_verify_checksum()) {
+    return config->get_read_chunk_size();
+  }
+  return 0;
+}
+
+/* drops a prefetched read, which has not been consumed by rbox_mail_get_stream */
+static void rbox_mail_prefetch_free(struct rbox_mail *rmail) {
+  if (rmail->prefetch == nullptr) {
+    return;
+  }
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+  (void)rbox_mail_read_free(rmail->prefetch);
+  rmail->prefetch = nullptr;
+  i_assert(r_storage->prefetch_count > 0);
+  r_storage->prefetch_count--;
+}
+
+/**
+ * @brief: synchronous read. If rbox_hedged_read_percentile is set and the read is not complete
+ * after that percentile of the last read latencies, the same read is sent to a replica and the first
+ * answer is used. read_r is replaced by the read which is used, the other one is freed once it completes.
+ */
+static int rbox_mail_read_operate(struct rbox_mail *rmail, librmb::RadosStorage *rados_storage,
+                                  struct rbox_mail_read **read_r) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+  const std::string &oid = *rmail->rados_mail->get_oid();
+  struct rbox_mail_read *reads[2] = {*read_r, nullptr};
+  int percentile = r_storage->config->get_hedged_read_percentile();
+  if (percentile <= 0) {
+    return rados_storage->read_operate(oid, &reads[0]->op, &reads[0]->buffer);
+  }
+
+  librmb::RadosReadLatency &latency = librmb::RadosReadLatency::get_instance();
+  uint64_t min_delay = r_storage->config->get_hedged_read_min_delay() > 0
+                           ? r_storage->config->get_hedged_read_min_delay() * 1000
+                           : 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  librmb::RadosHedgedRead hedged;
+  struct rbox_mail_read *primary = reads[0];
+  int ret = rados_storage->aio_read_operate(oid, hedged.add_read([primary]() { delete primary; }), &primary->op,
+                                            &primary->buffer, 0);
+  if (ret < 0) {
+    hedged.cancel(0);
+    return ret;
+  }
+  int index = hedged.wait_any(latency.get_deadline(percentile, min_delay));
+  if (index < 0) {
+    // the OSD is slow (e.g. recovering), ask another replica
+    struct rbox_mail_read *hedge = rbox_mail_read_alloc(rmail, rados_storage, primary->read_size, primary->get_body);
+    if (rados_storage->aio_read_operate(oid, hedged.add_read([hedge]() { delete hedge; }), &hedge->op,
+                                        &hedge->buffer, librados::OPERATION_BALANCE_READS) < 0) {
+      hedged.cancel(1);
+      delete hedge;
+    } else {
+      reads[1] = hedge;
+    }
+    index = hedged.wait_any(-1);
+  }
+  ret = hedged.wait(index);
+  if (ret < 0 && ret != -ENOENT && reads[1 - index] != nullptr) {
+    // the other one may still succeed
+    index = 1 - index;
+    ret = hedged.wait(index);
+  }
+  hedged.take(index);
+  if (ret >= 0) {
+    latency.add(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+  *read_r = reads[index];
+  return ret;
+}
+
 static int read_mail_from_storage(librmb::RadosStorage *rados_storage, 
                                   struct rbox_mail *rmail,
                                   uint64_t *psize,
-                                  time_t *save_date) {
+                                  time_t *save_date,
+                                  librados::bufferlist *compression,
+                                  librados::bufferlist *ext_ref,
+                                  librados::bufferlist *stripes,
+                                  uint64_t read_size,
+                                  bool get_body,
+                                  uint64_t *header_size,
+                                  uint64_t *lazy_size) {
     
-    int stat_err = 0;
-    int read_err = 0;
+    librados::bufferlist header_size_bl;
+    librados::bufferlist *buffer = rmail->rados_mail->get_mail_buffer();
+    *header_size = 0;
+    *lazy_size = 0;
+
+    int ret;
+    struct rbox_mail_read *read = rmail->prefetch;
+    struct rbox_mail_read *warmup = rbox_mail_warmup_find(rmail);
+    if (read != nullptr && rbox_mail_read_matches(read, rados_storage, read_size, get_body)) {
+      // started by rbox_mail_prefetch, the data is in flight or already there
+      struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+      rmail->prefetch = nullptr;
+      r_storage->prefetch_count--;
+      ret = rbox_mail_read_wait(read);
+    } else if (warmup != nullptr && rbox_mail_read_matches(warmup, rados_storage, read_size, get_body)) {
+      // started by rbox_mail_warmup, when the mailbox has been opened
+      rbox_mail_prefetch_free(rmail);
+      rbox_mail_warmup_remove(rmail);
+      read = warmup;
+      ret = rbox_mail_read_wait(read);
+    } else {
+      rbox_mail_prefetch_free(rmail);
+      read = rbox_mail_read_alloc(rmail, rados_storage, read_size, get_body);
+      ret = rbox_mail_read_operate(rmail, rados_storage, &read);
+    }
+    *psize = read->psize;
+    *save_date = read->save_date;
+    buffer->claim_append(read->buffer);
+    compression->claim_append(read->compression);
+    ext_ref->claim_append(read->ext_ref);
+    stripes->claim_append(read->stripes);
+    header_size_bl.claim_append(read->header_size_bl);
+    if (ret >= 0 && read->ms != nullptr && rmail->rados_mail->get_metadata()->empty()) {
+      read->ms->set_io_ctx(&rados_storage->get_io_ctx());
+      if (read->ms->load_metadata(rmail->rados_mail, &read->metadata) < 0) {
+        // loaded again by rbox_mail_metadata_get
+        rmail->rados_mail->get_metadata()->clear();
+        rmail->rados_mail->get_extended_metadata()->clear();
+      }
+    }
+    (void)rbox_mail_read_free(read);
+
+    if (ret >= 0 && get_body && read_size > 0 && ext_ref->length() == 0 && compression->length() == 0 &&
+        buffer->length() == read_size && !check_is_zlib(buffer)) {
+      // the first chunk has been read, the rest is read on demand (i_stream_create_rados)
+      uint64_t mail_size = *psize;
+      uint32_t stripe_count;
+      uint64_t stripe_size;
+      if (stripes->length() > 0 &&
+          !librmb::RadosStriping::parse_manifest(stripes->to_str(), &stripe_count, &stripe_size, &mail_size)) {
+        mail_size = 0;
+      }
+      if (mail_size > read_size) {
+        *lazy_size = mail_size;
+        return ret;
+      }
+    }
 
-    /* duplicate code: get_attribute */
-    librados::ObjectReadOperation *read_mail = new librados::ObjectReadOperation();
-    read_mail->read(0, INT_MAX, rmail->rados_mail->get_mail_buffer(), &read_err);
-    read_mail->stat(psize, save_date, &stat_err);
+    uint64_t mail_header_size = 0;
+    if (ret >= 0 && read_size > 0) {
+      if (!get_body && header_size_bl.length() > 0 && compression->length() == 0) {
+        // the header size refers to the uncompressed mail
+        try {
+          mail_header_size = std::stoull(header_size_bl.to_str());
+        } catch (std::exception &ex) {
+          mail_header_size = 0;
+        }
+      }
+      if (ext_ref->length() == 0) {
+        if (mail_header_size > *psize) {
+          // header is not within the mail object (stripe 0)
+          mail_header_size = 0;
+        }
+        // header larger than the range read so far or whole mail requested, read the rest
+        uint64_t wanted = mail_header_size > 0 ? mail_header_size : *psize;
+        if (buffer->length() == read_size && wanted > read_size) {
+          int rest_err = 0;
+          librados::bufferlist rest;
+          librados::ObjectReadOperation read_rest;
+          read_rest.read(read_size, wanted - read_size, &rest, &rest_err);
+          ret = rados_storage->read_operate(*rmail->rados_mail->get_oid(), &read_rest, &rest);
+          buffer->claim_append(rest);
+        }
+      }
+    }
+    if (ret >= 0 && ext_ref->length() > 0) {
+      // the mail object only holds the metadata, read the shared body
+      ret = mail_header_size > 0 ? librmb::RadosSingleInstance::read_body(&rados_storage->get_io_ctx(),
+                                                                          ext_ref->to_str(), mail_header_size, buffer)
+                                 : librmb::RadosSingleInstance::read_body(&rados_storage->get_io_ctx(),
+                                                                          ext_ref->to_str(), buffer);
+      if (ret == -ENOENT) {
+        i_error("shared body %s of mail %s does not exist", ext_ref->to_str().c_str(),
+                rmail->rados_mail->get_oid()->c_str());
+        ret = -EIO;
+      }
+      *psize = buffer->length();
+    }
+    if (ret >= 0 && mail_header_size > 0) {
+      if (buffer->length() < mail_header_size) {
+        i_error("mail %s is shorter (%u) than its header (%lu)", rmail->rados_mail->get_oid()->c_str(),
+                buffer->length(), mail_header_size);
+        return -EIO;
+      }
+      if (buffer->length() > mail_header_size) {
+        librados::bufferlist body;
+        buffer->splice(mail_header_size, buffer->length() - mail_header_size, &body);
+      }
+      // header only, the stripes (if any) are read with the body.
+      *header_size = mail_header_size;
+      return ret;
+    }
+    if (ret >= 0 && stripes->length() > 0) {
+      // the mail object holds the first stripe, read the others in parallel
+      ret = librmb::RadosStriping::read_stripes(&rados_storage->get_io_ctx(), *rmail->rados_mail->get_oid(),
+                                                stripes->to_str(), rmail->rados_mail->get_mail_buffer());
+      if (ret < 0) {
+        i_error("reading stripes (%s) of mail %s failed with %d", stripes->to_str().c_str(),
+                rmail->rados_mail->get_oid()->c_str(), ret);
+        ret = -EIO;
+      }
+      *psize = rmail->rados_mail->get_mail_buffer()->length();
+    }
+    return ret;
+}
 
-    int ret = rados_storage->read_operate(*rmail->rados_mail->get_oid(), read_mail,
-                                                  rmail->rados_mail->get_mail_buffer());
-    
-    delete read_mail;
+static int rbox_mail_get_codec(struct rbox_mail *rmail, librmb::RadosDovecotCephCfg *config,
+                               const std::string &marker, librmb::RadosCompression **codec_r,
+                               librmb::RadosCompressionDict **dict_r) {
+  std::string codec_name;
+  uint32_t dict_id = 0;
+  librmb::RadosCompression *codec = nullptr;
+  if (librmb::RadosCompression::parse_marker(marker, &codec_name, &dict_id)) {
+    codec = librmb::RadosCompression::get_codec(codec_name);
+  }
+  if (codec == nullptr) {
+    i_error("mail %s is compressed with unsupported codec '%s'", rmail->rados_mail->get_oid()->c_str(),
+            marker.c_str());
+    return -1;
+  }
+  librmb::RadosCompressionDict *dict = nullptr;
+  if (dict_id > 0) {
+    dict = config->load_compression_dict(dict_id);
+    if (dict == nullptr) {
+      i_error("mail %s is compressed with dictionary %u, which is not available",
+              rmail->rados_mail->get_oid()->c_str(), dict_id);
+      return -1;
+    }
+  }
+  *codec_r = codec;
+  *dict_r = dict;
+  return 0;
+}
 
-    return ret;
+static int rbox_mail_decompress(struct rbox_mail *rmail, librmb::RadosCompression *codec,
+                                librmb::RadosCompressionDict *dict, const std::string &marker, int *physical_size) {
+  librados::bufferlist *decompressed = new librados::bufferlist();
+  int ret = codec->decompress(*rmail->rados_mail->get_mail_buffer(), decompressed, dict);
+  if (ret < 0) {
+    i_error("decompressing mail %s (%s) failed with %d", rmail->rados_mail->get_oid()->c_str(), marker.c_str(),
+            ret);
+    delete decompressed;
+    return -1;
+  }
+  delete rmail->rados_mail->get_mail_buffer();
+  rmail->rados_mail->set_mail_buffer(decompressed);
+  *physical_size = decompressed->length();
+  return 0;
+}
+
+static int rbox_mail_verify_checksum(struct rbox_mail *rmail) {
+  std::string stored;
+  char *value = NULL;
+  librmb::RadosUtils::get_metadata(rbox_metadata_key::RBOX_METADATA_CHECKSUM, rmail->rados_mail->get_metadata(),
+                                   &value);
+  if (value != NULL) {
+    stored = value;
+  } else if (rmail->rados_mail->get_metadata()->empty() &&
+             rbox_mail_metadata_get(rmail, rbox_metadata_key::RBOX_METADATA_CHECKSUM, &value) >= 0) {
+    stored = value;
+    i_free(value);
+  }
+  uint32_t expected;
+  if (!librmb::RadosChecksum::from_string(stored, &expected)) {
+    // saved before checksums have been introduced
+    i_debug("mail %s has no checksum, skipping verification", rmail->rados_mail->get_oid()->c_str());
+    return 0;
+  }
+  uint32_t calculated = librmb::RadosChecksum::crc32c(0, *rmail->rados_mail->get_mail_buffer());
+  if (calculated != expected) {
+    i_error("checksum mismatch for mail %s: stored %s, calculated %s", rmail->rados_mail->get_oid()->c_str(),
+            stored.c_str(), librmb::RadosChecksum::to_string(calculated).c_str());
+    return -1;
+  }
+  return 0;
 }
 
-static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, struct message_size *hdr_size,
+/* connects the storage of the mail and makes sure, that the rados mail knows its oid */
+static int rbox_mail_open_rados_mail(struct rbox_mail *rmail, bool alt_storage,
+                                     librmb::RadosStorage **rados_storage_r) {
+  struct mail *_mail = &rmail->imail.mail.mail;
+
+  if (rbox_open_rados_connection(_mail->box, alt_storage) < 0) {
+    i_error("ERROR, cannot open rados connection (rbox_mail_get_stream)");
+    return -1;
+  }
+
+  librmb::RadosStorage *rados_storage = alt_storage ? ((struct rbox_storage *)_mail->box->storage)->alt
+                                                    : ((struct rbox_storage *)_mail->box->storage)->s;
+  if (alt_storage) {
+    rados_storage->set_namespace(rados_storage->get_namespace());
+  }
+
+  /* Pop3 and virtual box needs this. it looks like rbox_index_mail_set_seq is not called. */
+  if (rmail->rados_mail == nullptr) {
+    // make sure that mail_object is initialized,
+    // else create and load guid from index.
+    rmail->rados_mail = rados_storage->alloc_rados_mail();
+    rmail->last_seq = -1;
+  }
+
+  if (rmail->rados_mail->get_oid() == nullptr || rmail->rados_mail->get_oid()->empty()) {
+    // reload get index_record.
+    if (rbox_get_index_record(_mail) < 0) {
+      i_error("Error rbox_get_index uid(%d)", _mail->uid);
+      return -1;
+    }
+  }
+  *rados_storage_r = rados_storage;
+  return 0;
+}
+
+/* the stream takes the mail buffer */
+static int rbox_mail_set_stream(struct rbox_mail *rmail, struct istream *input, bool header_only) {
+  if (get_mail_stream(rmail, input, &input) < 0) {
+    // mail buffer has been freed with the stream
+    i_debug("get mail failed");
+    return -1;
+  }
+
+  rmail->imail.data.stream = input;
+  rmail->header_only = header_only;
+  index_mail_set_read_buffer_size(&rmail->imail.mail.mail, input);
+  return 0;
+}
+
+static int rbox_mail_get_stream(struct mail *_mail, bool get_body, struct message_size *hdr_size,
                                 struct message_size *body_size, struct istream **stream_r) {
   FUNC_START();
   struct rbox_mail *rmail = (struct rbox_mail *)_mail;
@@ -472,43 +1057,50 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
   int ret = -1;
   enum mail_flags flags = index_mail_get_flags(_mail);
   bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(_mail->box);
-  
+
+  get_body = rbox_mail_get_body(rmail, get_body);
+  if (get_body && rmail->header_only && data->stream != NULL) {
+    // only the header has been read so far, read the whole mail now.
+    index_mail_close_streams(&rmail->imail);
+  }
   if (data->stream == NULL) {
-    if (rbox_open_rados_connection(_mail->box, alt_storage) < 0) {
-      FUNC_END_RET("ret == -1;  connection to rados failed");
-      i_error("ERROR, cannot open rados connection (rbox_mail_get_stream)");
+    librmb::RadosStorage *rados_storage;
+    if (rbox_mail_open_rados_mail(rmail, alt_storage, &rados_storage) < 0) {
+      FUNC_END_RET("ret == -1");
       return -1;
     }
-    
-    librmb::RadosStorage *rados_storage = alt_storage ? ((struct rbox_storage *)_mail->box->storage)->alt
-                                                      : ((struct rbox_storage *)_mail->box->storage)->s;
-    if (alt_storage) {
-      rados_storage->set_namespace(rados_storage->get_namespace());
-    }
-
-    /* Pop3 and virtual box needs this. it looks like rbox_index_mail_set_seq is not called. */
-    if (rmail->rados_mail == nullptr) {
-      // make sure that mail_object is initialized,
-      // else create and load guid from index.
-      rmail->rados_mail = rados_storage->alloc_rados_mail();  
-      rmail->last_seq = -1; 
-    }
-
-    if(rmail->rados_mail->get_oid() == nullptr || rmail->rados_mail->get_oid()->empty()){
-       //reload get index_record.
-       if (rbox_get_index_record(_mail) < 0) {
-        i_error("Error rbox_get_index uid(%d)", _mail->uid);
-        FUNC_END();
-        return -1;
-      }
-    }
     // create mail buffer!
     rmail->rados_mail->set_mail_buffer(new librados::bufferlist());
 
     uint64_t psize;
     time_t save_date;
+    librados::bufferlist compression;
+    librados::bufferlist ext_ref;
+    librados::bufferlist stripes;
+    librmb::RadosDovecotCephCfg *config = ((struct rbox_storage *)_mail->box->storage)->config;
+    std::string cache_key = librmb::RadosMailCache::get_key(
+        rados_storage->get_pool_name(), rados_storage->get_namespace(), *rmail->rados_mail->get_oid());
+    if (librmb::RadosMailCache::get_instance().get(cache_key, rmail->rados_mail->get_mail_buffer(), &save_date)) {
+      // mail objects are immutable, no need to read it again
+      rbox_mail_prefetch_free(rmail);
+      rmail->rados_mail->set_mail_size(rmail->rados_mail->get_mail_buffer()->length());
+      rmail->rados_mail->set_rados_save_date(save_date);
+      input = i_stream_create_from_bufferlist(rmail->rados_mail->get_mail_buffer(),
+                                              rmail->rados_mail->get_mail_buffer()->length());
+      if (rbox_mail_set_stream(rmail, input, false) < 0) {
+        FUNC_END_RET("ret == -1");
+        return -1;
+      }
+      ret = index_mail_init_stream(&rmail->imail, hdr_size, body_size, stream_r);
+      FUNC_END();
+      return ret;
+    }
+    uint64_t read_size = rbox_mail_get_read_size(config, get_body);
+    uint64_t header_size = 0;
+    uint64_t lazy_size = 0;
 
-    ret = read_mail_from_storage(rados_storage, rmail,&psize,&save_date);
+    ret = read_mail_from_storage(rados_storage, rmail, &psize, &save_date, &compression, &ext_ref, &stripes,
+                                 read_size, get_body, &header_size, &lazy_size);
 
     if (ret < 0) {
       if (ret == -ENOENT) {
@@ -526,7 +1118,11 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
       else if(ret == -ETIMEDOUT) {
         int max_retry = 10; //TODO FIX 
         for(int i=0;i<max_retry;i++){
-          ret = read_mail_from_storage(rados_storage, rmail,&psize,&save_date);
+          compression.clear();
+          ext_ref.clear();
+          stripes.clear();
+          ret = read_mail_from_storage(rados_storage, rmail, &psize, &save_date, &compression, &ext_ref, &stripes,
+                                       read_size, get_body, &header_size, &lazy_size);
           if(ret >= 0){
             i_error("READ TIMEOUT %d reading mail object %s ", ret,rmail->rados_mail != NULL ? rmail->rados_mail->to_string(" ").c_str() : " no rados_mail");
             break;
@@ -552,7 +1148,11 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
         return -1;
       }
     }
-    int physical_size = psize;
+    if (lazy_size > 0) {
+      // the mail buffer only holds the first chunk
+      psize = lazy_size;
+    }
+    int physical_size = header_size > 0 ? header_size : psize;
     rmail->rados_mail->set_mail_size(psize);
     rmail->rados_mail->set_rados_save_date(save_date);
 
@@ -578,9 +1178,36 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
     i_debug("reading stream for oid: %s, phy: %d, buffer: %d", rmail->rados_mail->get_oid()->c_str(),
                                                                physical_size, 
                                                                rmail->rados_mail->get_mail_buffer()->length());
-    // validates if object is in zlib format (first 2 byte)
-    bool isGzip = check_is_zlib(rmail->rados_mail->get_mail_buffer());
-    if(isGzip) {
+    librmb::RadosDecompressor *decompressor = nullptr;
+    if (compression.length() > 0) {
+      // compressed by librmb (rbox_compression)
+      librmb::RadosCompression *codec;
+      librmb::RadosCompressionDict *dict;
+      if (rbox_mail_get_codec(rmail, config, compression.to_str(), &codec, &dict) < 0) {
+        FUNC_END_RET("ret == -1");
+        delete rmail->rados_mail->get_mail_buffer();
+        return -1;
+      }
+      uint64_t content_size = codec->get_content_size(*rmail->rados_mail->get_mail_buffer());
+      if (!config->is_verify_checksum() && content_size > 0 && content_size < INT_MAX) {
+        // decompressed while the mail is streamed, the checksum needs the whole mail
+        decompressor = codec->create_decompressor(dict);
+      }
+      if (decompressor != nullptr) {
+        physical_size = content_size;
+      } else if (rbox_mail_decompress(rmail, codec, dict, compression.to_str(), &physical_size) < 0) {
+        FUNC_END_RET("ret == -1");
+        delete rmail->rados_mail->get_mail_buffer();
+        return -1;
+      }
+    }
+    if (header_size == 0 && config->is_verify_checksum() && rbox_mail_verify_checksum(rmail) < 0) {
+      FUNC_END_RET("ret == -1");
+      delete rmail->rados_mail->get_mail_buffer();
+      return -1;
+    }
+    if (header_size == 0 && compression.length() == 0 && check_is_zlib(rmail->rados_mail->get_mail_buffer())) {
+      // validates if object is in zlib format (first 2 byte), written by dovecot's zlib plugin
       uint32_t result = zlib_trailer_msg_length(rmail->rados_mail->get_mail_buffer(),physical_size);
       
       // get mails real physical size and compare against trailer length
@@ -594,28 +1221,48 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
       }
     }
   
-    if (get_mail_stream(rmail, rmail->rados_mail->get_mail_buffer(), physical_size, &input) < 0) {
-      i_debug("get mail failed");
+    if (lazy_size > 0) {
+      uint32_t stripe_count;
+      uint64_t stripe_size = 0;
+      uint64_t mail_size;
+      if (stripes.length() > 0) {
+        // validated by read_mail_from_storage
+        librmb::RadosStriping::parse_manifest(stripes.to_str(), &stripe_count, &stripe_size, &mail_size);
+      }
+      // the stream takes the mail buffer (first chunk) and reads the rest on demand
+      input = i_stream_create_rados(rados_storage, *rmail->rados_mail->get_oid(), lazy_size,
+                                    rmail->rados_mail->get_mail_buffer(), read_size,
+                                    config->get_read_ahead() > 0 ? config->get_read_ahead() : 0, stripe_size);
+    } else if (decompressor != nullptr) {
+      // the stream takes the compressed mail buffer, it is not cached
+      struct istream *compressed = i_stream_create_from_bufferlist(rmail->rados_mail->get_mail_buffer(),
+                                                                   rmail->rados_mail->get_mail_buffer()->length());
+      input = i_stream_create_decompress(compressed, decompressor, physical_size);
+      i_stream_unref(&compressed);
+    } else {
+      if (header_size == 0 && rmail->rados_mail->get_mail_buffer()->length() == (unsigned int)physical_size) {
+        librmb::RadosMailCache::get_instance().put(cache_key, *rmail->rados_mail->get_mail_buffer(), save_date);
+      }
+      input = i_stream_create_from_bufferlist(rmail->rados_mail->get_mail_buffer(), physical_size);
+    }
+    if (rbox_mail_set_stream(rmail, input, header_size > 0) < 0) {
       FUNC_END_RET("ret == -1");
-      delete rmail->rados_mail->get_mail_buffer();
       return -1;
     }
-    
-    i_debug("get mail failed retval of get_mail_stream %d",ret);
-
-    data->stream = input;
-    index_mail_set_read_buffer_size(_mail, input);
   }
   ret = index_mail_init_stream(&rmail->imail, hdr_size, body_size, stream_r);
   FUNC_END();
   return ret;
 }
 uint32_t zlib_trailer_msg_length(librados::bufferlist* mail_buffer, int physical_size) {
+    // copy the trailer only, c_str() would rebuild the whole mail into one buffer
+    char trailer[4];
+    mail_buffer->copy(physical_size - 4, sizeof(trailer), trailer);
     unsigned char gzip_size[] = {
-                        mail_buffer->c_str()[physical_size-1], 
-                        mail_buffer->c_str()[physical_size-2],
-                        mail_buffer->c_str()[physical_size-3],
-                        mail_buffer->c_str()[physical_size-4]
+                        (unsigned char)trailer[3],
+                        (unsigned char)trailer[2],
+                        (unsigned char)trailer[1],
+                        (unsigned char)trailer[0]
                         };        
     uint32_t result = (gzip_size[0] << 24 | gzip_size[1] << 16 | gzip_size[2] << 8 | gzip_size[3]);
     
@@ -628,8 +1275,13 @@ uint32_t zlib_trailer_msg_length(librados::bufferlist* mail_buffer, int physical
 }
 bool check_is_zlib(librados::bufferlist* mail_buffer) {
 
-    unsigned char magic1 = mail_buffer->c_str()[0];
-    unsigned char magic2 = mail_buffer->c_str()[1];
+    if (mail_buffer->length() < 2) {
+      return false;
+    }
+    char magic[2];
+    mail_buffer->copy(0, sizeof(magic), magic);
+    unsigned char magic1 = magic[0];
+    unsigned char magic2 = magic[1];
 
     i_debug("checking for z_lib header magic bytes check %x : %x compared to %x : %x",
         magic1,magic2,
@@ -861,10 +1513,112 @@ static int rbox_mail_get_special(struct mail *_mail, enum mail_fetch_field field
   return index_mail_get_special(_mail, field, value_r);
 }
 
+/* starts the read of the mail async, if its stream is wanted. rbox_mail_get_stream waits for it.
+ * @return FALSE while the read is in flight
+ */
+static bool rbox_mail_prefetch(struct mail *_mail) {
+  struct rbox_mail *rmail = (struct rbox_mail *)_mail;
+  struct index_mail_data *data = &rmail->imail.data;
+  struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
+
+  if (rmail->prefetch != nullptr) {
+    return FALSE;
+  }
+  if (data->stream != NULL || (data->access_part & (READ_HDR | READ_BODY | PARSE_HDR | PARSE_BODY)) == 0) {
+    // already read or not needed
+    return TRUE;
+  }
+  enum mail_flags flags = index_mail_get_flags(_mail);
+  bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(_mail->box);
+  librmb::RadosStorage *rados_storage;
+  if (rbox_mail_open_rados_mail(rmail, alt_storage, &rados_storage) < 0) {
+    // rbox_mail_get_stream reports the error
+    return TRUE;
+  }
+  librados::bufferlist cached;
+  time_t save_date;
+  if (librmb::RadosMailCache::get_instance().get(
+          librmb::RadosMailCache::get_key(rados_storage->get_pool_name(), rados_storage->get_namespace(),
+                                          *rmail->rados_mail->get_oid()),
+          &cached, &save_date)) {
+    // read from the cache by rbox_mail_get_stream
+    return TRUE;
+  }
+  if (r_storage->config->get_prefetch_window() <= 0 ||
+      r_storage->prefetch_count >= (unsigned int)r_storage->config->get_prefetch_window()) {
+    // read synchronously by rbox_mail_get_stream
+    return TRUE;
+  }
+
+  bool get_body = rbox_mail_get_body(rmail, false);
+  uint64_t read_size = rbox_mail_get_read_size(r_storage->config, get_body);
+  struct rbox_mail_read *warmup = rbox_mail_warmup_find(rmail);
+  if (warmup != nullptr && rbox_mail_read_matches(warmup, rados_storage, read_size, get_body)) {
+    // in flight since the mailbox has been opened
+    return TRUE;
+  }
+  struct rbox_mail_read *read = rbox_mail_read_alloc(rmail, rados_storage, read_size, get_body);
+  read->completion = librados::Rados::aio_create_completion();
+  int ret = rados_storage->aio_read_operate(*rmail->rados_mail->get_oid(), read->completion, &read->op,
+                                            &read->buffer, 0);
+  if (ret < 0) {
+    i_warning("prefetching mail %s failed with %d", rmail->rados_mail->get_oid()->c_str(), ret);
+    read->completion->release();
+    read->completion = nullptr;
+    (void)rbox_mail_read_free(read);
+    return TRUE;
+  }
+  rmail->prefetch = read;
+  r_storage->prefetch_count++;
+  return FALSE;
+}
+
+void rbox_mail_warmup(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = rbox->storage;
+
+  if (rbox->warmup != nullptr || rbox_open_rados_connection(box, false) < 0) {
+    // errors are reported by the mail access
+    return;
+  }
+  int count = r_storage->config->get_warmup_count();
+  if (count <= 0) {
+    return;
+  }
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  rbox->warmup = new rbox_mail_warmup();
+  rbox->warmup->pop3 = false;
+  rbox->warmup->window = count;
+  rbox->warmup->read_size = rbox_mail_get_read_size(r_storage->config, false);
+  rbox->warmup->read_data = r_storage->config->is_warmup_headers();
+  if (messages > 0) {
+    // newest first, that is what the clients fetch after SELECT
+    rbox_mail_warmup_queue(rbox, box->view, messages, messages > (uint32_t)count ? messages - count + 1 : 1);
+  }
+  rbox_mail_warmup_fill(rbox);
+  // only the newest mails
+  rbox->warmup->queue.clear();
+}
+
+void rbox_mail_warmup_free(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  if (rbox->warmup == nullptr) {
+    return;
+  }
+  for (std::map<std::string, struct rbox_mail_read *>::iterator it = rbox->warmup->reads.begin();
+       it != rbox->warmup->reads.end(); ++it) {
+    (void)rbox_mail_read_free(it->second);
+  }
+  delete rbox->warmup;
+  rbox->warmup = nullptr;
+}
+
 static void rbox_mail_close(struct mail *_mail) {
   struct rbox_mail *rmail_ = (struct rbox_mail *)_mail;
   struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
 
+  // the prefetched data is not needed anymore
+  rbox_mail_prefetch_free(rmail_);
   if (rmail_->rados_mail != nullptr) {
     r_storage->s->free_rados_mail(rmail_->rados_mail);
     rmail_->rados_mail = nullptr;
@@ -894,7 +1648,7 @@ struct mail_vfuncs rbox_mail_vfuncs = {rbox_mail_close,
                                        rbox_index_mail_set_seq,
                                        index_mail_set_uid,
                                        index_mail_set_uid_cache_updates,
-                                       index_mail_prefetch,
+                                       rbox_mail_prefetch,
                                        index_mail_precache,
                                        index_mail_add_temp_wanted_fields,
 
@@ -16,6 +16,8 @@
 #include <rados/librados.hpp>
 #include "../librmb/rados-mail.h"
 
+struct rbox_mail_read;
+
 /**
  * @brief: holds the rados mail object.
  */
@@ -27,6 +29,10 @@ struct rbox_mail {
   /** refrence to rados mail object **/
   librmb::RadosMail *rados_mail;
   uint32_t last_seq;  // TODO(jrse): init with -1
+  /** the stream only holds the mail header (RBOX_METADATA_HEADER_SIZE) **/
+  bool header_only;
+  /** async read started by rbox_mail_prefetch, consumed by rbox_mail_get_stream **/
+  struct rbox_mail_read *prefetch;
 };
 extern void rbox_mail_set_expunged(struct rbox_mail *mail);
 extern int rbox_get_index_record(struct mail *_mail);
@@ -36,10 +42,27 @@ extern int rbox_mail_get_virtual_size(struct mail *_mail, uoff_t *size_r);
 
 extern int rbox_get_guid_metadata(struct rbox_mail *mail, const char **value_r);
 
+/**
+ * @brief: starts async reads of the metadata and the header (rbox_warmup_headers) of the newest
+ * rbox_warmup_count mails. They are used by the first access of each mail.
+ */
+extern void rbox_mail_warmup(struct mailbox *box);
+/**
+ * @brief: waits for and frees the warmup reads, which have not been used.
+ */
+extern void rbox_mail_warmup_free(struct mailbox *box);
+
 extern int read_mail_from_storage(librmb::RadosStorage *rados_storage,
                                   struct rbox_mail *rmail,
                                   uint64_t *psize,
-                                  time_t *save_date);
+                                  time_t *save_date,
+                                  librados::bufferlist *compression,
+                                  librados::bufferlist *ext_ref,
+                                  librados::bufferlist *stripes,
+                                  uint64_t read_size,
+                                  bool get_body,
+                                  uint64_t *header_size,
+                                  uint64_t *lazy_size);
 
 
 extern bool check_is_zlib(librados::bufferlist* mail_buffer);
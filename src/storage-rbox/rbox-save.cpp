@@ -17,6 +17,7 @@
 #include <string>
 #include <map>
 #include <list>
+#include <algorithm>
 #include <rados/librados.hpp>
 
 extern "C" {
@@ -26,6 +27,8 @@ extern "C" {
 #include "istream-crlf.h"
 #include "ostream.h"
 #include "str.h"
+#include "sha2.h"
+#include "hex-binary.h"
 
 #include "rbox-sync.h"
 #include "rados-types.h"
@@ -41,6 +44,10 @@ extern "C" {
 #include "rados-util.h"
 #include "rbox-mail.h"
 #include "ostream-bufferlist.h"
+#include "rados-checksum.h"
+#include "rados-single-instance.h"
+#include "rados-striping.h"
+#include "rados-mail-cache.h"
 
 using ceph::bufferlist;
 
@@ -189,6 +196,36 @@ void rbox_move_index(struct mail_save_context *_ctx, struct mail *src_mail) {
 
   FUNC_END();
 }
+uint64_t rbox_get_write_chunk_size(struct rbox_storage *r_storage) {
+  uint64_t chunk_size = r_storage->config->get_chunk_size();
+  if (chunk_size > (uint64_t)r_storage->s->get_max_write_size_bytes()) {
+    chunk_size = r_storage->s->get_max_write_size_bytes();
+  }
+  return chunk_size;
+}
+
+/**
+ * @return size of the stripes of large mails, 0 if striping is disabled.
+ */
+uint64_t rbox_get_stripe_size(struct rbox_storage *r_storage) {
+  if (!r_storage->config->is_striping()) {
+    return 0;
+  }
+  uint64_t stripe_size = r_storage->config->get_stripe_size();
+  if (stripe_size == 0 || stripe_size > (uint64_t)r_storage->s->get_max_object_size()) {
+    stripe_size = r_storage->s->get_max_object_size();
+  }
+  // each stripe is written with one operation
+  if (stripe_size > (uint64_t)r_storage->s->get_max_write_size_bytes()) {
+    stripe_size = r_storage->s->get_max_write_size_bytes();
+  }
+  uint64_t alignment = r_storage->s->get_stripe_alignment();
+  if (alignment > 0 && stripe_size >= alignment) {
+    stripe_size -= stripe_size % alignment;
+  }
+  return stripe_size;
+}
+
 void init_output_stream(mail_save_context *_ctx) {
   FUNC_START();
 
@@ -199,10 +236,25 @@ void init_output_stream(mail_save_context *_ctx) {
     o_stream_unref(&_ctx->data.output);
   }
 
-  // create buffer ( delete is in wait_for_write_operations)
+  // streaming save: write chunks to rados as soon as the buffer reaches the watermark
+  uint64_t watermark = rbox->storage->config->get_stream_watermark();
+  uint64_t chunk_size = 0;
+  if (rbox->storage->config->get_compression() != nullptr || rbox->storage->config->is_single_instance()) {
+    // the mail is compressed / hashed as a whole in rbox_save_finish
+    watermark = 0;
+  } else if (rbox->storage->s->is_erasure_coded()) {
+    // partial writes at offsets are expensive (or not supported) on erasure coded pools
+    watermark = 0;
+  } else if (watermark > 0 || rbox->storage->config->is_write_chunks()) {
+    chunk_size = rbox_get_write_chunk_size(rbox->storage);
+    // rbox_ceph_write_chunks without explicit watermark: flush every full chunk
+    watermark = watermark > 0 ? watermark : chunk_size;
+  }
+
+  // create buffer ( delete is in save_mail_write_append)
   r_ctx->rados_mail->set_mail_buffer(new librados::bufferlist());
-  r_ctx->output_stream =
-      o_stream_create_bufferlist(r_ctx->rados_mail, &r_ctx->rados_storage, rbox->storage->config->is_write_chunks());
+  r_ctx->output_stream = o_stream_create_bufferlist(r_ctx->rados_mail, &r_ctx->rados_storage, watermark, chunk_size,
+                                                    watermark > 0 ? rbox_get_stripe_size(rbox->storage) : 0);
   o_stream_cork(r_ctx->output_stream);
   _ctx->data.output = r_ctx->output_stream;
 
@@ -221,11 +273,18 @@ int rbox_save_begin(struct mail_save_context *_ctx, struct istream *input) {
   }
   setup_mail_object(_ctx);
 
-  // init stream in any case.
+  // always save to primary storage
+  int ret = rbox_open_rados_connection(_ctx->transaction->box, false);
+
+  // init stream in any case (after connect, streaming save depends on osd_max_write_size).
   init_output_stream(_ctx);
+  uoff_t input_size;
+  if (input != NULL && i_stream_get_size(input, FALSE, &input_size) > 0) {
+    // size is known e.g. APPEND literal: preallocate the mail buffer
+    o_stream_bufferlist_set_size_hint(r_ctx->output_stream, input_size);
+  }
 
-  // always save to primary storage
-  if (rbox_open_rados_connection(_ctx->transaction->box, false) < 0) {
+  if (ret < 0) {
     i_error("ERROR, cannot open rados connection (rbox_save_finish)");
     r_ctx->failed = true;
   } else {
@@ -427,10 +486,28 @@ static void clean_up_failed(struct rbox_save_context *r_ctx, bool wait_for_opera
   // try to clean up!
   for (std::list<RadosMail *>::iterator it_cur_obj = r_ctx->rados_mails.begin(); it_cur_obj != r_ctx->rados_mails.end();
        ++it_cur_obj) {
+    librmb::RadosMailCache::get_instance().remove(librmb::RadosMailCache::get_key(
+        r_storage->s->get_pool_name(), r_storage->s->get_namespace(), *(*it_cur_obj)->get_oid()));
     int delete_ret = r_storage->s->delete_mail(*it_cur_obj);
     if (delete_ret < 0 && delete_ret != -ENOENT) {
       i_error("Librados obj: %s, could not be removed", (*it_cur_obj)->get_oid()->c_str());
     }
+    char *manifest = NULL;
+    librmb::RadosUtils::get_metadata(rbox_metadata_key::RBOX_METADATA_STRIPES, (*it_cur_obj)->get_metadata(),
+                                     &manifest);
+    if (manifest != NULL &&
+        librmb::RadosStriping::remove_stripes(&r_storage->s->get_io_ctx(), *(*it_cur_obj)->get_oid(), manifest) < 0) {
+      i_error("stripes of librados obj: %s, could not be removed", (*it_cur_obj)->get_oid()->c_str());
+    }
+    // the reference to the shared body is released, unless the mail object could not be removed.
+    char *ext_ref = NULL;
+    librmb::RadosUtils::get_metadata(rbox_metadata_key::RBOX_METADATA_EXT_REF, (*it_cur_obj)->get_metadata(),
+                                     &ext_ref);
+    if (ext_ref != NULL && (delete_ret >= 0 || delete_ret == -ENOENT) &&
+        librmb::RadosSingleInstance::remove_ref(&r_storage->s->get_io_ctx(), ext_ref) < 0) {
+      i_error("shared body %s of librados obj: %s, could not be released", ext_ref,
+              (*it_cur_obj)->get_oid()->c_str());
+    }
   }
   
   // clean up index only if index entry was added.
@@ -468,24 +545,91 @@ static void clean_up_write_finish(struct mail_save_context *_ctx) {
   FUNC_END();
 }
 
+struct rbox_chunk_write {
+  librados::AioCompletion *completion;
+  librados::ObjectWriteOperation *write_op;
+};
+
+static int wait_for_chunk_write(RadosStorage *rados_storage, std::list<rbox_chunk_write> *chunk_writes) {
+  rbox_chunk_write chunk_write = chunk_writes->front();
+  chunk_writes->pop_front();
+  // releases the completion
+  bool failed = rados_storage->wait_for_write_operations_complete(chunk_write.completion, chunk_write.write_op);
+  delete chunk_write.write_op;
+  return failed ? -1 : 0;
+}
 
+/**
+ * write the mail to rados. write_op_xattr (metadata) needs to be allocated with new.
+ * It is deleted here, or in case of an async write it is attached to the mail together
+ * with the completion until wait_for_rados_operations is called.
+ */
 int save_mail_write_append(RadosStorage *rados_storage,
                              RadosMail *current_object,
                              librados::ObjectWriteOperation *write_op_xattr,
-                             const uint64_t &max_write) {
+                             const uint64_t &max_write,
+                             bool async,
+                             int chunk_window) {
 
   int ret_val = 0;
-  uint64_t write_buffer_size = current_object->get_mail_size();
+  // in case of streaming save, the mail buffer only holds the tail of the mail,
+  // the head has already been written by the output stream.
+  uint64_t write_buffer_size = current_object->get_mail_buffer()->length();
+  uint64_t stream_offset = current_object->get_mail_size() - write_buffer_size;
 
   assert(max_write > 0);
 
-  if (write_buffer_size == 0 || max_write <= 0) {
+  if (current_object->get_mail_size() == 0 || max_write <= 0) {
     ret_val = -1;
     i_debug("write_buffer_size == 0 or max_write <=0 < -1" );
+    delete write_op_xattr;
+    return ret_val;
+  }
+
+  if (write_buffer_size <= (uint64_t)rados_storage->get_max_write_size_bytes()) {
+    // mail (or the tail of a streamed mail) fits into one op: write metadata, mtime
+    // and body within one atomic operation (one round trip).
+    if (stream_offset == 0) {
+#ifdef HAVE_ALLOC_HINT_2
+      write_op_xattr->set_alloc_hint2(current_object->get_mail_size(), write_buffer_size,
+                                      librados::ALLOC_HINT_FLAG_COMPRESSIBLE);
+#else
+      write_op_xattr->set_alloc_hint(current_object->get_mail_size(), write_buffer_size);
+#endif
+    }
+    if (write_buffer_size > 0 && rados_storage->is_erasure_coded()) {
+      // erasure coded: full object write (no streaming, stream_offset is 0)
+      write_op_xattr->write_full(*current_object->get_mail_buffer());
+    } else if (write_buffer_size > 0) {
+      write_op_xattr->write(stream_offset, *current_object->get_mail_buffer());
+    }
+    if (async) {
+      // wait is in rbox_transaction_save_commit_pre
+      librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+      ret_val = rados_storage->aio_operate(&rados_storage->get_io_ctx(), *current_object->get_oid(), completion,
+                                           write_op_xattr);
+      if (ret_val < 0) {
+        completion->release();
+        delete write_op_xattr;
+        ret_val = -1;
+      } else {
+        current_object->set_completion(completion);
+        current_object->set_write_operation(write_op_xattr);
+        current_object->set_active_op(1);
+        ret_val = 0;
+      }
+    } else {
+      ret_val = rados_storage->execute_operation(*current_object->get_oid(), write_op_xattr) ? 0 : -1;
+      delete write_op_xattr;
+    }
+    i_debug("write mail (single op, async=%d) return value: %d", async, ret_val);
+    delete current_object->get_mail_buffer();
     return ret_val;
   }
 
-  ret_val = rados_storage->execute_operation(*current_object->get_oid(), write_op_xattr);
+  // big mail: write metadata first, then split the buffer into chunks
+  ret_val = rados_storage->execute_operation(*current_object->get_oid(), write_op_xattr) ? 0 : -1;
+  delete write_op_xattr;
 
   if(ret_val< 0){
     i_debug("write metadata did not work: %d",ret_val);
@@ -493,51 +637,63 @@ int save_mail_write_append(RadosStorage *rados_storage,
     return ret_val;
   }
 
-  uint64_t rest = write_buffer_size % max_write;
-  int div = write_buffer_size / max_write + (rest > 0 ? 1 : 0);
-  for (int i = 0; i < div; ++i) {
+  // write the chunks offset based in parallel, at most chunk_window writes in flight.
+  std::list<rbox_chunk_write> chunk_writes;
+  if (chunk_window < 1) {
+    chunk_window = 1;
+  }
+  uint64_t chunk_size = max_write;
+  bool erasure_coded = rados_storage->is_erasure_coded();
+  if (erasure_coded) {
+    // erasure coded: sequential appends of full stripes, only the last chunk may be unaligned.
+    chunk_window = 1;
+    uint64_t alignment = rados_storage->get_stripe_alignment();
+    if (alignment > 0 && chunk_size >= alignment) {
+      chunk_size -= chunk_size % alignment;
+    }
+  }
+  uint64_t offset = 0;
+  while (offset < write_buffer_size) {
+    uint64_t length = std::min(chunk_size, write_buffer_size - offset);
 
-    // split the buffer.
     librados::bufferlist tmp_buffer;
+    tmp_buffer.substr_of(*current_object->get_mail_buffer(), offset, length);
+    i_debug("write chunk offset=%lu, length=%lu", stream_offset + offset, length);
 
-    librados::ObjectWriteOperation write_op;
-
-    int offset = i * max_write;
-
-    uint64_t length = max_write;
-    if (write_buffer_size < ((i + 1) * length)) {
-      length = rest;
-    }
-
-    if (div == 1) {
-      write_op.write(0, *current_object->get_mail_buffer());
-      ret_val = rados_storage->execute_operation(*current_object->get_oid(), &write_op) ? 0 : -1;
+    rbox_chunk_write chunk_write;
+    chunk_write.write_op = new librados::ObjectWriteOperation();
+    if (erasure_coded) {
+      chunk_write.write_op->append(tmp_buffer);
     } else {
-      i_debug("write chunk size %d, offset=%d,lenght=%d",write_buffer_size,offset,length);      
-      if(offset + length > write_buffer_size){
-        i_error("offset and length (%d) is bigger then write_buffer size (%d)", (offset+length), write_buffer_size);
-        return -1;
-      }else{
-        i_debug("trying to get substring of : mailsize %d, offset: %d, length %d",
-            current_object->get_mail_buffer()->length(), offset, length );        
-        if(offset + length > current_object->get_mail_buffer()->length() ){
-           i_debug("new offset : %d",current_object->get_mail_buffer()->length()-offset);
-           tmp_buffer.substr_of(*current_object->get_mail_buffer(), offset,current_object->get_mail_buffer()->length() - offset );
-        }else{
-          tmp_buffer.substr_of(*current_object->get_mail_buffer(), offset, length);
-        }
-       
-      }      
-      i_debug("tmp_buffer %d ",tmp_buffer.length());
-      ret_val = rados_storage->append_to_object(*current_object->get_oid(), tmp_buffer, length) ? 0 : -1; 
+      chunk_write.write_op->write(stream_offset + offset, tmp_buffer);
     }
-    i_debug("append mail (append) return value: %d",ret_val);
-    if(ret_val < 0){
+    chunk_write.completion = librados::Rados::aio_create_completion();
+    if (rados_storage->aio_operate(&rados_storage->get_io_ctx(), *current_object->get_oid(), chunk_write.completion,
+                                   chunk_write.write_op) < 0) {
+      i_error("aio_operate for chunk offset=%lu of oid: %s failed", stream_offset + offset,
+              current_object->get_oid()->c_str());
+      chunk_write.completion->release();
+      delete chunk_write.write_op;
       ret_val = -1;
       break;
     }
+    chunk_writes.push_back(chunk_write);
+    offset += length;
+
+    if (chunk_writes.size() >= (size_t)chunk_window && wait_for_chunk_write(rados_storage, &chunk_writes) < 0) {
+      ret_val = -1;
+      break;
+    }
+  }
+  // barrier: wait for all chunks (also in case of an error, partial object is removed by clean_up_failed)
+  while (!chunk_writes.empty()) {
+    if (wait_for_chunk_write(rados_storage, &chunk_writes) < 0) {
+      ret_val = -1;
+    }
   }
-  // deprecated unused
+  i_debug("write mail (chunks) return value: %d", ret_val);
+
+  // all chunks are complete (barrier), nothing to wait for in commit_pre
   current_object->set_write_operation(nullptr);
   current_object->set_completion(nullptr);
   current_object->set_active_op(0);
@@ -550,6 +706,151 @@ int save_mail_write_append(RadosStorage *rados_storage,
   return ret_val;
 }
 
+/**
+ * compress the mail buffer with the codec configured for the pool and mark the object with
+ * the codec name. The mail is stored uncompressed if compression fails or does not pay off.
+ */
+static void rbox_save_compress_mail(struct rbox_storage *r_storage, RadosMail *mail,
+                                    librados::ObjectWriteOperation *write_op) {
+  librmb::RadosCompression *codec = r_storage->config->get_compression();
+  if (codec == nullptr || (uint64_t)mail->get_mail_size() != mail->get_mail_buffer()->length()) {
+    // not configured, or parts of the mail have already been written by the output stream
+    return;
+  }
+  // small mails compress badly on their own, use the trained dictionary if there is one.
+  librmb::RadosCompressionDict *dict = nullptr;
+  uint32_t dict_id = r_storage->config->get_compression_dict_id();
+  if (codec->is_dict_supported() && dict_id > 0 &&
+      (uint64_t)mail->get_mail_size() <= r_storage->config->get_compression_dict_mail_size()) {
+    dict = r_storage->config->load_compression_dict(dict_id);
+    if (dict == nullptr) {
+      i_warning("compression dictionary %u not available, compressing oid: %s without dictionary", dict_id,
+                mail->get_oid()->c_str());
+    }
+  }
+  librados::bufferlist *compressed = new librados::bufferlist();
+  int ret = codec->compress(*mail->get_mail_buffer(), compressed, r_storage->config->get_compression_level(), dict);
+  if (ret < 0 || compressed->length() >= mail->get_mail_buffer()->length()) {
+    if (ret < 0) {
+      i_warning("%s compression of oid: %s failed with %d, saving uncompressed", codec->get_name().c_str(),
+                mail->get_oid()->c_str(), ret);
+    }
+    delete compressed;
+    return;
+  }
+  i_debug("compressed oid: %s (%s) %u -> %u", mail->get_oid()->c_str(), codec->get_name().c_str(),
+          mail->get_mail_buffer()->length(), compressed->length());
+  delete mail->get_mail_buffer();
+  mail->set_mail_buffer(compressed);
+  mail->set_mail_size(compressed->length());
+
+  librados::bufferlist codec_name;
+  codec_name.append(librmb::RadosCompression::to_marker(codec->get_name(), dict != nullptr ? dict->get_id() : 0));
+  write_op->setxattr(librmb::rbox_metadata_key_to_char(rbox_metadata_key::RBOX_METADATA_COMPRESSION), codec_name);
+}
+
+/**
+ * single instance storage: store the body once per pool (content addressed), the mail object
+ * itself only holds the metadata and the reference to the body. The mail is stored as usual,
+ * if it is too small or the shared body can not be written.
+ */
+static void rbox_save_single_instance(struct rbox_storage *r_storage, RadosMail *mail,
+                                      librados::ObjectWriteOperation *write_op) {
+  librados::bufferlist *body = mail->get_mail_buffer();
+  uint64_t stripe_size = rbox_get_stripe_size(r_storage);
+  // the reference count of the shared body is kept in omap, which erasure coded pools do not support.
+  // shared bodies are not striped.
+  if (!r_storage->config->is_single_instance() || r_storage->s->is_erasure_coded() ||
+      (stripe_size > 0 && body->length() > stripe_size) ||
+      (uint64_t)mail->get_mail_size() != body->length() ||
+      body->length() < r_storage->config->get_single_instance_min_size() ||
+      body->length() > (uint64_t)r_storage->s->get_max_write_size_bytes()) {
+    return;
+  }
+  struct sha256_ctx ctx;
+  unsigned char digest[SHA256_RESULTLEN];
+  sha256_init(&ctx);
+  for (const auto &segment : body->buffers()) {
+    sha256_loop(&ctx, segment.c_str(), segment.length());
+  }
+  sha256_result(&ctx, digest);
+  std::string body_oid = librmb::RadosSingleInstance::get_body_oid(binary_to_hex(digest, sizeof(digest)));
+
+  int ret = librmb::RadosSingleInstance::add_body(&r_storage->s->get_io_ctx(), body_oid, *body);
+  if (ret < 0) {
+    i_warning("storing shared body %s of oid: %s failed with %d, saving mail as usual", body_oid.c_str(),
+              mail->get_oid()->c_str(), ret);
+    return;
+  }
+  i_debug("oid: %s references shared body %s (%u bytes)", mail->get_oid()->c_str(), body_oid.c_str(),
+          body->length());
+  // mail size stays, the mail object is written without data
+  body->clear();
+  librados::bufferlist ext_ref;
+  ext_ref.append(body_oid);
+  write_op->setxattr(librmb::rbox_metadata_key_to_char(rbox_metadata_key::RBOX_METADATA_EXT_REF), ext_ref);
+  // in memory only: the reference is released by clean_up_failed, if the save fails.
+  mail->add_metadata(RadosMetadata(rbox_metadata_key::RBOX_METADATA_EXT_REF, body_oid));
+}
+
+/**
+ * striping: the mail object keeps the first stripe, the rest of the mail is written to the
+ * stripe objects (in parallel), before the mail object with the manifest is written.
+ * The mail buffer is reduced to the part of the first stripe, which is not yet written.
+ */
+static int rbox_save_stripes(struct rbox_storage *r_storage, RadosMail *mail, librados::ObjectWriteOperation *write_op,
+                             uint64_t stripe_size) {
+  uint64_t mail_size = mail->get_mail_size();
+  librados::bufferlist *buffer = mail->get_mail_buffer();
+  uint64_t stream_offset = mail_size - buffer->length();
+
+  std::string manifest = librmb::RadosStriping::to_manifest(stripe_size, mail_size);
+  // in memory only: the stripes are removed by clean_up_failed, if the save fails.
+  mail->add_metadata(RadosMetadata(rbox_metadata_key::RBOX_METADATA_STRIPES, manifest));
+
+  uint64_t head_length = stream_offset < stripe_size ? stripe_size - stream_offset : 0;
+  librados::bufferlist stripes;
+  stripes.substr_of(*buffer, head_length, buffer->length() - head_length);
+  int ret = librmb::RadosStriping::write_stripes(&r_storage->s->get_io_ctx(), *mail->get_oid(), stripes,
+                                                 stream_offset + head_length, stripe_size);
+  if (ret < 0) {
+    i_error("writing %u stripes of oid: %s failed with %d", librmb::RadosStriping::get_stripe_count(stripe_size, mail_size),
+            mail->get_oid()->c_str(), ret);
+    return -1;
+  }
+  i_debug("oid: %s striped (%s)", mail->get_oid()->c_str(), manifest.c_str());
+
+  librados::bufferlist *head = new librados::bufferlist();
+  head->substr_of(*buffer, 0, head_length);
+  delete buffer;
+  mail->set_mail_buffer(head);
+  mail->set_mail_size(stripe_size);
+
+  librados::bufferlist manifest_bl;
+  manifest_bl.append(manifest);
+  write_op->setxattr(librmb::rbox_metadata_key_to_char(rbox_metadata_key::RBOX_METADATA_STRIPES), manifest_bl);
+  return 0;
+}
+
+/**
+ * limit the number of async mail writes in flight, by waiting for the oldest ones.
+ * A failed write fails the transaction in commit_pre, not the current mail.
+ */
+static void rbox_save_wait_for_inflight_window(struct rbox_save_context *r_ctx, RadosStorage *rados_storage,
+                                               int inflight_window) {
+  if (r_ctx->rados_mail->has_active_op()) {
+    r_ctx->inflight_mails.push_back(r_ctx->rados_mail);
+  }
+  while (r_ctx->inflight_mails.size() > (size_t)inflight_window) {
+    std::list<RadosMail *> oldest(1, r_ctx->inflight_mails.front());
+    r_ctx->inflight_mails.pop_front();
+    if (rados_storage->wait_for_rados_operations(oldest)) {
+      i_error("async write of mail: %s failed, transaction is rolled back", oldest.front()->get_oid()->c_str());
+      r_ctx->async_failed = TRUE;
+    }
+  }
+}
+
 int rbox_save_finish(struct mail_save_context *_ctx) {
   FUNC_START();
 
@@ -623,30 +924,83 @@ int rbox_save_finish(struct mail_save_context *_ctx) {
 
       rbox_save_mail_set_metadata(r_ctx, r_ctx->rados_mail);
 
-      librados::ObjectWriteOperation write_op;
+      // integrity checksum, calculated while the mail was streamed in (see rmb scrub).
+      uint32_t crc32c;
+      if (o_stream_bufferlist_get_crc32c(r_ctx->output_stream, &crc32c)) {
+        librmb::RadosMetadata xattr(rbox_metadata_key::RBOX_METADATA_CHECKSUM,
+                                    librmb::RadosChecksum::to_string(crc32c));
+        r_ctx->rados_mail->add_metadata(xattr);
+      }
+
+      // deleted in save_mail_write_append or after the async write completes.
+      librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
       struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
 
-      r_storage->ms->get_storage()->save_metadata(&write_op, r_ctx->rados_mail);
+      r_storage->ms->get_storage()->save_metadata(write_op, r_ctx->rados_mail);
+
+      uint64_t header_size;
+      if (!zlib_plugin_active && o_stream_bufferlist_get_header_size(r_ctx->output_stream, &header_size)) {
+        // header only reads (rbox_mail_get_stream). Refers to the mail before librmb compression.
+        librados::bufferlist header_size_bl;
+        header_size_bl.append(std::to_string(header_size));
+        write_op->setxattr(librmb::rbox_metadata_key_to_char(rbox_metadata_key::RBOX_METADATA_HEADER_SIZE),
+                           header_size_bl);
+      }
 
       int max_object_size = r_storage->s->get_max_object_size();
+      uint64_t stripe_size = rbox_get_stripe_size(r_storage);
       i_debug("oid: %s, max_object_size %d mail_size %d",r_ctx->rados_mail->get_oid()->c_str(), max_object_size, r_ctx->rados_mail->get_mail_size() );
-      if(max_object_size < r_ctx->rados_mail->get_mail_size()) {
+      if(stripe_size == 0 && max_object_size < r_ctx->rados_mail->get_mail_size()) {
         i_error("configured CEPH Object size %d < then mail size %d ", r_storage->s->get_max_object_size(), r_ctx->rados_mail->get_mail_size() );
         mail_set_critical(r_ctx->ctx.dest_mail, "write(%s) failed: %s", o_stream_get_name(r_ctx->ctx.data.output),"MAX OBJECT SIZE REACHED");      
         r_ctx->failed = true;  
+        delete write_op;
       }else {
         
           time_t save_date = r_ctx->rados_mail->get_rados_save_date();
-          write_op.mtime(&save_date);  
+          write_op->mtime(&save_date);  
 
-          uint32_t config_chunk_size = r_storage->config->get_chunk_size();
-          if(config_chunk_size > r_storage->s->get_max_write_size_bytes()){
-            config_chunk_size = r_storage->s->get_max_write_size_bytes();
-          }
+          uint32_t config_chunk_size = rbox_get_write_chunk_size(r_storage);
 
-          int ret = save_mail_write_append(r_storage->s,r_ctx->rados_mail, &write_op, config_chunk_size);
+          // APPEND -> FETCH, LDA -> sieve: the mail is read from the cache (rbox_mail_get_stream).
+          // Streamed mails are no longer in the buffer.
+          librados::bufferlist cache_data;
+          if (!zlib_plugin_active &&
+              (uint64_t)r_ctx->rados_mail->get_mail_size() == r_ctx->rados_mail->get_mail_buffer()->length()) {
+            cache_data = *r_ctx->rados_mail->get_mail_buffer();
+          }
 
+          // streamed chunks need to be on disk before the tail is appended
+          int ret = o_stream_bufferlist_wait_flushed(r_ctx->output_stream);
+          if (ret >= 0) {
+            rbox_save_compress_mail(r_storage, r_ctx->rados_mail, write_op);
+            rbox_save_single_instance(r_storage, r_ctx->rados_mail, write_op);
+            if (stripe_size > 0 && (uint64_t)r_ctx->rados_mail->get_mail_size() > stripe_size) {
+              ret = rbox_save_stripes(r_storage, r_ctx->rados_mail, write_op, stripe_size);
+            }
+          }
+          if (ret >= 0) {
+            int inflight_window = r_storage->config->get_save_inflight_window();
+            ret = save_mail_write_append(r_storage->s,r_ctx->rados_mail, write_op, config_chunk_size,
+                                         inflight_window > 0, r_storage->config->get_chunk_write_window());
+            if (ret >= 0 && inflight_window > 0) {
+              rbox_save_wait_for_inflight_window(r_ctx, r_storage->s, inflight_window);
+            }
+          } else {
+            delete write_op;
+          }
           r_ctx->failed = ret < 0;
+          if (!r_ctx->failed && r_storage->config->is_mailbox_counters()) {
+            // physical size, as in RBOX_METADATA_PHYSICAL_SIZE
+            r_ctx->counters.messages++;
+            r_ctx->counters.bytes += r_ctx->input->v_offset;
+          }
+          if (!r_ctx->failed && cache_data.length() > 0) {
+            librmb::RadosMailCache::get_instance().put(
+                librmb::RadosMailCache::get_key(r_storage->s->get_pool_name(), r_storage->s->get_namespace(),
+                                                *r_ctx->rados_mail->get_oid()),
+                cache_data, save_date);
+          }
           i_debug("SAVE_MAIL result: %d", r_ctx->failed);        
       }
       if (r_ctx->failed) {
@@ -654,14 +1008,8 @@ int rbox_save_finish(struct mail_save_context *_ctx) {
                 r_ctx->rados_mail->get_metadata()->size(), r_ctx->rados_mail->get_mail_size());
       }else{
         if( r_storage->config->get_object_search_method() == 2){
-          // ceph config schalter an oder aus!
-          r_storage->s->ceph_index_append(*r_ctx->rados_mail->get_oid());                    
-          if( librmb::RadosUtils::object_size_close_to_reach_max(
-                                                                 (double)r_storage->s->ceph_index_size(), 
-                                                                 (double) r_storage->s->get_max_object_size())
-                                                                ) {
-            i_warning("ceph index file (%lu) close to exceed max object size(%d) 80%%",r_storage->s->ceph_index_size(), r_storage->s->get_max_object_size());
-          }
+          // appended with one operation per transaction in commit_pre
+          r_ctx->ceph_index_oids.insert(*r_ctx->rados_mail->get_oid());
         }
       }
 
@@ -708,12 +1056,18 @@ static int rbox_save_assign_uids(struct rbox_save_context *r_ctx, const ARRAY_TY
       if (r_storage->config->is_mail_attribute(rbox_metadata_key::RBOX_METADATA_MAIL_UID)) {
         metadata.convert(rbox_metadata_key::RBOX_METADATA_MAIL_UID, uid);
 
-        librados::ObjectWriteOperation write_mail_uid;
-        write_mail_uid.setxattr(metadata.key.c_str(), metadata.bl);
-
-        if (r_storage->ms->get_storage()->set_metadata(r_ctx->rados_mail, metadata, &write_mail_uid) < 0) {
+        // issue all uid updates async and wait for them once after the loop
+        librados::ObjectWriteOperation *write_mail_uid = new librados::ObjectWriteOperation();
+        if (r_storage->ms->get_storage()->set_metadata(r_ctx->rados_mail, metadata, write_mail_uid) < 0) {
+          delete write_mail_uid;
           return -1;
         }
+        if (r_ctx->rados_mail->has_active_op()) {
+          // deleted by wait_for_rados_operations
+          r_ctx->rados_mail->set_write_operation(write_mail_uid);
+        } else {
+          delete write_mail_uid;
+        }
       }
 #if DOVECOT_PREREQ(2, 3)
       if (r_ctx->highest_pop3_uidl_seq == n + 1) {
@@ -722,11 +1076,32 @@ static int rbox_save_assign_uids(struct rbox_save_context *r_ctx, const ARRAY_TY
 #endif
     }
     i_assert(!seq_range_array_iter_nth(&iter, n, &uid));
+    if (r_storage->s->wait_for_rados_operations(r_ctx->rados_mails)) {
+      i_error("rbox_save_assign_uids: writing mail uids failed");
+      return -1;
+    }
   }
 
   FUNC_END();
   return 0;
 }
+
+static void rbox_save_ceph_index_append(struct rbox_save_context *r_ctx, struct rbox_storage *r_storage) {
+  if (r_ctx->ceph_index_oids.empty()) {
+    return;
+  }
+  int ret = r_storage->s->ceph_index_append(r_ctx->ceph_index_oids);
+  if (ret < 0) {
+    i_error("ceph index append of %lu oids failed: %d (doveadm rmb create ceph index rebuilds it)",
+            r_ctx->ceph_index_oids.size(), ret);
+  } else if (librmb::RadosUtils::object_size_close_to_reach_max((double)r_storage->s->ceph_index_size(),
+                                                                (double)r_storage->s->get_max_object_size())) {
+    i_warning("ceph index file (%lu) close to exceed max object size(%d) 80%%", r_storage->s->ceph_index_size(),
+              r_storage->s->get_max_object_size());
+  }
+  r_ctx->ceph_index_oids.clear();
+}
+
 void rbox_save_update_header_flags(struct rbox_save_context *r_ctx, struct mail_index_view *sync_view, uint32_t ext_id,
                                    unsigned int flags_offset) {
   FUNC_START();
@@ -763,8 +1138,19 @@ int rbox_transaction_save_commit_pre(struct mail_save_context *_ctx) {
   FUNC_START();
 
   struct rbox_save_context *r_ctx = (struct rbox_save_context *)_ctx;
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
   i_assert(r_ctx->finished);
 
+  // wait for all outstanding mail writes (async) of this transaction
+  r_ctx->inflight_mails.clear();
+  if (r_storage->s->wait_for_rados_operations(r_ctx->rados_mails) || r_ctx->async_failed) {
+    i_error("write of at least one mail in the transaction failed");
+    r_ctx->failed = TRUE;
+    rbox_transaction_save_rollback(_ctx);
+    FUNC_END_RET("ret == -1");
+    return -1;
+  }
+
   if (rbox_sync_begin(r_ctx->mbox, &r_ctx->sync_ctx,
                       static_cast<enum rbox_sync_flags>(RBOX_SYNC_FLAG_FORCE | RBOX_SYNC_FLAG_FSYNC)) < 0) {
     r_ctx->failed = TRUE;
@@ -790,6 +1176,8 @@ int rbox_transaction_save_commit_pre(struct mail_save_context *_ctx) {
     rbox_transaction_save_rollback(_ctx);
     return -1;
   }
+  // past this point a failure does not remove the mail objects (failed is not set)
+  rbox_save_ceph_index_append(r_ctx, r_storage);
 
   if (_ctx->dest_mail != NULL) {
     if (r_ctx->dest_mail_allocated == TRUE) {
@@ -805,6 +1193,21 @@ int rbox_transaction_save_commit_pre(struct mail_save_context *_ctx) {
   return 0;
 }
 
+/* the mails of the transaction are in the index, add them to the counters */
+static void rbox_save_update_counters(struct rbox_save_context *r_ctx) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+  if (r_ctx->counters.is_empty()) {
+    return;
+  }
+  const char *mailbox_guid = guid_128_to_string(r_ctx->mbox->mailbox_guid);
+  int ret = r_storage->s->update_counters(mailbox_guid, r_ctx->counters);
+  if (ret < 0) {
+    i_error("updating the counters of mailbox %s failed: %d (doveadm rmb counters -r recalculates them)",
+            mailbox_guid, ret);
+  }
+  r_ctx->counters.clear();
+}
+
 void rbox_transaction_save_commit_post(struct mail_save_context *_ctx,
                                        struct mail_index_transaction_commit_result *result) {
   FUNC_START();
@@ -817,6 +1220,8 @@ void rbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 
   if (rbox_sync_finish(&r_ctx->sync_ctx, TRUE) < 0) {
     r_ctx->failed = TRUE;    
+  } else {
+    rbox_save_update_counters(r_ctx);
   }
   rbox_transaction_save_rollback(_ctx);
 
@@ -831,6 +1236,7 @@ void clean_up_mail_object_list(struct rbox_save_context *r_ctx, struct rbox_stor
     *it = nullptr;
   }
   r_ctx->rados_mails.clear();
+  r_ctx->inflight_mails.clear();
 
   FUNC_END();
 }
@@ -849,6 +1255,9 @@ void rbox_transaction_save_rollback(struct mail_save_context *_ctx) {
   if (r_ctx->sync_ctx != NULL)
     (void)rbox_sync_finish(&r_ctx->sync_ctx, FALSE);
 
+  // no write may be in flight, before objects are deleted or freed.
+  (void)storage->wait_for_rados_operations(r_ctx->rados_mails);
+
   // empty em.
   guid_128_empty(r_ctx->mail_guid);
   guid_128_empty(r_ctx->mail_oid);
@@ -864,6 +1273,12 @@ void rbox_transaction_save_rollback(struct mail_save_context *_ctx) {
   }
   clean_up_mail_object_list(r_ctx, (struct rbox_storage *)&r_ctx->mbox->storage->storage);
 
+  // group commit: one write for all log entries of the transaction
+  librmb::RadosSaveLog *save_log = ((struct rbox_storage *)&r_ctx->mbox->storage->storage)->save_log;
+  if (!save_log->flush()) {
+    i_warning("unable to write the rados save log file (errno=%d)", errno);
+  }
+
   r_ctx->rados_mail = nullptr;
 
   delete r_ctx;
@@ -14,6 +14,7 @@
 
 #include <string>
 #include <list>
+#include <set>
 
 #include "../librmb/rados-storage-impl.h"
 #include "mail-storage-private.h"
@@ -45,6 +46,7 @@ class rbox_save_context {
         have_pop3_uidls(0),
         have_pop3_orders(0),
         failed(1),
+        async_failed(0),
         finished(1),
         copying(0),
         dest_mail_allocated(0) {
@@ -75,12 +77,20 @@ class rbox_save_context {
   std::list<librmb::RadosMail *> rados_mails;
   /** current mail in the context **/
   librmb::RadosMail *rados_mail;
+  /** mails with an async write in flight, oldest first (rbox_save_inflight_window) **/
+  std::list<librmb::RadosMail *> inflight_mails;
+  /** oids of the saved mails, appended to the ceph index in commit_pre **/
+  std::set<std::string> ceph_index_oids;
+  /** saved and copied mails, added to the mailbox counters in commit_post **/
+  librmb::RadosCounters counters;
 #if DOVECOT_PREREQ(2, 3)
   unsigned int highest_pop3_uidl_seq : 1;
 #endif
   unsigned int have_pop3_uidls : 1;
   unsigned int have_pop3_orders : 1;
   unsigned int failed : 1;
+  /** the async write of a previous mail in the context failed, commit fails **/
+  unsigned int async_failed : 1;
   unsigned int finished : 1;
   unsigned int copying : 1;
   unsigned int dest_mail_allocated : 1;
@@ -90,6 +100,8 @@ void setup_mail_object(struct mail_save_context *_ctx);
 void rbox_add_to_index(struct mail_save_context *_ctx);
 void rbox_move_index(struct mail_save_context *_ctx, struct mail *src_mail);
 void init_output_stream(mail_save_context *_ctx);
+uint64_t rbox_get_write_chunk_size(struct rbox_storage *r_storage);
+uint64_t rbox_get_stripe_size(struct rbox_storage *r_storage);
 int allocate_mail_buffer(mail_save_context *_ctx, int &initial_mail_buffer_size);
 void clean_up_mail_object_list(struct rbox_save_context *r_ctx, struct rbox_storage *r_storage);
 void rbox_save_update_header_flags(struct rbox_save_context *r_ctx, struct mail_index_view *sync_view, uint32_t ext_id,
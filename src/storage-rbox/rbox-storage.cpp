@@ -41,6 +41,7 @@ extern "C" {
 #include "../librmb/rados-dovecot-ceph-cfg-impl.h"
 #include "../librmb/rados-guid-generator.h"
 #include "../librmb/rados-metadata-storage-impl.h"
+#include "../librmb/rados-mail-cache.h"
 
 #include "rbox-copy.h"
 #include "rbox-mail.h"
@@ -415,9 +416,25 @@ void read_plugin_configuration(struct mailbox *box) {
     }
     r_storage->config->set_config_valid(true);
     r_storage->save_log->set_save_log_file(r_storage->config->get_rados_save_log_file());
+    if (r_storage->config->is_save_log_group_commit()) {
+      r_storage->save_log->set_group_commit(r_storage->config->get_save_log_flush_size(),
+                                            r_storage->config->get_save_log_flush_interval(),
+                                            r_storage->config->is_save_log_fsync());
+    }
     if (!r_storage->save_log->open() && !r_storage->config->get_rados_save_log_file().empty()) {
       i_warning("unable to open the rados save log file %s", r_storage->config->get_rados_save_log_file().c_str());
     }
+    librmb::RadosMailCache::get_instance().set_capacity(
+        r_storage->config->get_mail_cache_size() > 0 ? r_storage->config->get_mail_cache_size() : 0);
+    if (!r_storage->config->get_shared_cache_dir().empty() &&
+        !librmb::RadosMailFileCache::get_instance().is_open()) {
+      if (librmb::RadosMailFileCache::get_instance().open(r_storage->config->get_shared_cache_dir(),
+                                                          r_storage->config->get_shared_cache_size())) {
+        librmb::RadosMailCache::get_instance().set_file_cache(&librmb::RadosMailFileCache::get_instance());
+      } else {
+        i_warning("unable to open the shared mail cache %s", r_storage->config->get_shared_cache_dir().c_str());
+      }
+    }
   }
 
   FUNC_END();
@@ -427,6 +444,19 @@ bool is_alternate_storage_set(uint8_t flags) { return (flags & RBOX_INDEX_FLAG_A
 bool is_alternate_pool_valid(struct mailbox *_box) {
   return _box->list->set.alt_dir != NULL && strlen(_box->list->set.alt_dir) > 0;
 }
+/* librados flags for rbox_read_policy */
+static int rbox_get_read_flags(librmb::RadosDovecotCephCfg *config) {
+  const std::string &policy = config->get_read_policy();
+  if (policy == "balance") {
+    return librados::OPERATION_BALANCE_READS;
+  } else if (policy == "localize") {
+    return librados::OPERATION_LOCALIZE_READS;
+  } else if (policy != "primary") {
+    i_warning("unknown rbox_read_policy %s, reading from the primary", policy.c_str());
+  }
+  return 0;
+}
+
 /**TODO: reduce cyclomatic complexity */
 int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
   FUNC_START();
@@ -446,6 +476,7 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
     rados_storage->set_ceph_wait_method(rbox->storage->config->is_ceph_aio_wait_for_safe_and_cb()
                                             ? librmb::WAIT_FOR_SAFE_AND_CB
                                             : librmb::WAIT_FOR_COMPLETE_AND_CB);
+    rados_storage->set_read_flags(rbox_get_read_flags(rbox->storage->config));
     /* open connection to primary and alternative storage */
     ret = rados_storage->open_connection(rbox->storage->config->get_pool_name(),
                                          rbox->storage->config->get_index_pool_name(), 
@@ -461,6 +492,7 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
       rbox->storage->alt->set_ceph_wait_method(rbox->storage->config->is_ceph_aio_wait_for_safe_and_cb()
                                                    ? librmb::WAIT_FOR_SAFE_AND_CB
                                                    : librmb::WAIT_FOR_COMPLETE_AND_CB);
+      rbox->storage->alt->set_read_flags(rbox_get_read_flags(rbox->storage->config));
     }
   } catch (std::exception &e) {    
     i_error("Exception: setting up ceph connection: %s",e.what());
@@ -669,6 +701,11 @@ int rbox_mailbox_open(struct mailbox *box) {
 
   memcpy(rbox->mailbox_guid, hdr.mailbox_guid, sizeof(rbox->mailbox_guid));
 
+  if (box->inbox_user && (box->flags & MAILBOX_FLAG_SAVEONLY) == 0) {
+    // the client fetches the newest mails while it is still busy with the login
+    rbox_mail_warmup(box);
+  }
+
   FUNC_END();
   return 0;
 }
@@ -704,6 +741,7 @@ static void rbox_mailbox_close(struct mailbox *box) {
     (void)rbox_sync(rbox, static_cast<enum rbox_sync_flags>(0));
   }
 
+  rbox_mail_warmup_free(box);
   index_storage_mailbox_close(box);
   FUNC_END();
 }
@@ -83,6 +83,8 @@ extern bool rbox_header_have_flag(struct mailbox *box, uint32_t ext_id, unsigned
 
 #define SDBOX_INDEX_HEADER_MIN_SIZE (sizeof(uint32_t))
 
+struct rbox_mail_warmup;
+
 struct obox_mail_index_record {
   unsigned char guid[GUID_128_SIZE];
   unsigned char oid[GUID_128_SIZE];
@@ -101,6 +103,8 @@ struct rbox_mailbox {
   uint32_t ext_id;
   /** unique identifier **/
   guid_128_t mailbox_guid;
+  /** reads of the newest mails, started when the mailbox is opened (rbox_mail_warmup) **/
+  struct rbox_mail_warmup *warmup;
 };
 
 enum rbox_index_header_flags {
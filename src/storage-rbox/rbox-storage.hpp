@@ -46,6 +46,8 @@ struct rbox_storage {
 
   uint32_t corrupted_rebuild_count;
   bool corrupted;
+  // mails read async by rbox_mail_prefetch, not yet consumed (bounded by rbox_prefetch_window)
+  unsigned int prefetch_count;
 };
 
 #endif
@@ -22,6 +22,10 @@ extern "C" {
 #include "debug-helper.h"
 }
 #include "rados-util.h"
+#include "rados-single-instance.h"
+#include "rados-striping.h"
+#include "rados-mail-cache.h"
+#include "rados-counters.h"
 #include "rbox-storage.hpp"
 #include "rbox-mail.h"
 #include "rbox-sync-rebuild.h"
@@ -138,6 +142,55 @@ static int update_extended_metadata(struct rbox_sync_context *ctx, uint32_t seq1
   return ret;
 }
 
+static librmb::RadosCounters *rbox_sync_get_counters(struct rbox_sync_context *ctx) {
+  if (ctx->counters == NULL) {
+    ctx->counters = new librmb::RadosCounters();
+  }
+  return ctx->counters;
+}
+
+/* expunged mails and alt storage moves are applied to the counters with one operation */
+static void rbox_sync_update_counters(struct rbox_sync_context *ctx) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)ctx->rbox->box.storage;
+  if (ctx->counters == NULL) {
+    return;
+  }
+  if (!ctx->counters->is_empty()) {
+    const char *mailbox_guid = guid_128_to_string(ctx->rbox->mailbox_guid);
+    int ret = r_storage->s->update_counters(mailbox_guid, *ctx->counters);
+    if (ret < 0) {
+      i_error("updating the counters of mailbox %s failed: %d (doveadm rmb counters -r recalculates them)",
+              mailbox_guid, ret);
+    }
+  }
+  delete ctx->counters;
+  ctx->counters = NULL;
+}
+
+/* physical size of the mail, which has been added to the counters when the mail was saved, -1 if unknown */
+static int64_t rbox_sync_get_counted_size(librmb::RadosMail *mail) {
+  std::map<std::string, ceph::bufferlist>::iterator it =
+      mail->get_metadata()->find(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_PHYSICAL_SIZE));
+  if (it == mail->get_metadata()->end()) {
+    return -1;
+  }
+  try {
+    return std::stoll(it->second.to_str());
+  } catch (const std::exception &e) {
+    return -1;
+  }
+}
+
+static int64_t rbox_sync_load_counted_size(struct rbox_storage *r_storage, librmb::RadosStorage *rados_storage,
+                                           const std::string &oid) {
+  librmb::RadosMail mail;
+  mail.set_oid(oid);
+  r_storage->ms->get_storage()->set_io_ctx(&rados_storage->get_io_ctx());
+  int ret = r_storage->ms->get_storage()->load_metadata(&mail);
+  r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
+  return ret < 0 ? -1 : rbox_sync_get_counted_size(&mail);
+}
+
 static int move_to_alt(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2, bool inverse) {
   struct mailbox *box = &ctx->rbox->box;
   struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
@@ -152,6 +205,12 @@ static int move_to_alt(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t se
     if (rbox_get_oid_from_index(ctx->sync_view, seq1, ((struct rbox_mailbox *)&ctx->rbox->box)->ext_id, &index_oid) >= 0) {
       std::string oid = guid_128_to_string(index_oid);
       ret = librmb::RadosUtils::move_to_alt(oid, r_storage->s, r_storage->alt, r_storage->ms, inverse);
+      if (ret >= 0 && r_storage->config->is_mailbox_counters()) {
+        int64_t size = rbox_sync_load_counted_size(r_storage, inverse ? r_storage->s : r_storage->alt, oid);
+        if (size > 0) {
+          rbox_sync_get_counters(ctx)->alt_bytes += inverse ? -size : size;
+        }
+      }
       if (ret >= 0) {
         if (inverse) {
           mail_index_update_flags(ctx->trans, seq1, MODIFY_REMOVE, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
@@ -424,6 +483,7 @@ int rbox_sync_begin(struct rbox_mailbox *rbox, struct rbox_sync_context **ctx_r,
     mail_index_sync_rollback(&ctx->index_sync_ctx);
     if (ret < 0) {
       index_storage_expunging_deinit(&ctx->rbox->box);
+      rbox_sync_update_counters(ctx);
       array_delete(&ctx->expunged_items, array_count(&ctx->expunged_items) - 1, 1);
       array_free(&ctx->expunged_items);
       i_free(ctx);
@@ -452,6 +512,31 @@ static int rbox_sync_object_expunge(struct rbox_sync_context *ctx, struct expung
     return ret_remove;
   }
   librmb::RadosStorage *rados_storage = item->alt_storage ? r_storage->alt : r_storage->s;
+
+  // single instance storage: release the reference to the shared body, after the mail object is gone.
+  // striping: remove the stripes, after the mail object is gone.
+  // both are read from the xattrs of the mail regardless of the config, which may have changed since the
+  // mail was saved.
+  // counters: the size of the mail is read from its metadata.
+  librados::bufferlist ext_ref;
+  librados::bufferlist stripes;
+  librmb::RadosMetadataRead metadata_read;
+  bool count = r_storage->config->is_mailbox_counters();
+  int ext_ref_err = 0;
+  int stripes_err = 0;
+  librados::ObjectReadOperation read_op;
+  read_op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_EXT_REF), &ext_ref, &ext_ref_err);
+  read_op.set_op_flags2(librados::OP_FAILOK);
+  read_op.getxattr(librmb::rbox_metadata_key_to_char(librmb::RBOX_METADATA_STRIPES), &stripes, &stripes_err);
+  read_op.set_op_flags2(librados::OP_FAILOK);
+  if (count) {
+    r_storage->ms->get_storage()->set_io_ctx(&rados_storage->get_io_ctx());
+    r_storage->ms->get_storage()->add_load_metadata(&read_op, &metadata_read);
+    r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
+  }
+  rados_storage->get_io_ctx().operate(oid, &read_op, NULL);
+  librmb::RadosMailCache::get_instance().remove(
+      librmb::RadosMailCache::get_key(rados_storage->get_pool_name(), rados_storage->get_namespace(), oid));
   ret_remove = rados_storage->get_io_ctx().remove(oid);
   if (ret_remove < 0) {
     if(ret_remove == -ETIMEDOUT) {
@@ -476,6 +561,34 @@ static int rbox_sync_object_expunge(struct rbox_sync_context *ctx, struct expung
             item->alt_storage);
     }
   }
+  // a mail removed by another process (-ENOENT) has been counted there
+  if (ret_remove >= 0 && count) {
+    librmb::RadosMail mail;
+    int64_t size = r_storage->ms->get_storage()->load_metadata(&mail, &metadata_read) >= 0
+                       ? rbox_sync_get_counted_size(&mail)
+                       : -1;
+    rbox_sync_get_counters(ctx)->messages--;
+    if (size > 0) {
+      rbox_sync_get_counters(ctx)->bytes -= size;
+      if (item->alt_storage) {
+        rbox_sync_get_counters(ctx)->alt_bytes -= size;
+      }
+    }
+  }
+  if (ret_remove >= 0 && ext_ref.length() > 0) {
+    int ret_ref = librmb::RadosSingleInstance::remove_ref(&rados_storage->get_io_ctx(), ext_ref.to_str());
+    if (ret_ref < 0) {
+      i_error("rbox_sync_object_expunge: releasing shared body %s of oid(%s) failed with %d",
+              ext_ref.to_str().c_str(), oid, ret_ref);
+    }
+  }
+  if (ret_remove >= 0 && stripes.length() > 0) {
+    int ret_stripes = librmb::RadosStriping::remove_stripes(&rados_storage->get_io_ctx(), oid, stripes.to_str());
+    if (ret_stripes < 0) {
+      i_error("rbox_sync_object_expunge: removing stripes (%s) of oid(%s) failed with %d", stripes.to_str().c_str(),
+              oid, ret_stripes);
+    }
+  }
  // directly notify
   mailbox_sync_notify(box, item->uid, MAILBOX_SYNC_TYPE_EXPUNGE);    
 
@@ -529,6 +642,8 @@ int rbox_sync_finish(struct rbox_sync_context **_ctx, bool success) {
     mail_index_sync_rollback(&ctx->index_sync_ctx);
   }
   index_storage_expunging_deinit(&ctx->rbox->box);
+  // alt storage moves are done, even if the index sync failed
+  rbox_sync_update_counters(ctx);
 
   if (array_is_created(&ctx->expunged_items)) {
     if (array_count(&ctx->expunged_items) > 0) {
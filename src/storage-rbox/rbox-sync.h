@@ -14,6 +14,10 @@
 
 #include "dovecot-all.h"
 
+namespace librmb {
+struct RadosCounters;
+}
+
 enum rbox_sync_flags { RBOX_SYNC_FLAG_FORCE = 0x01, RBOX_SYNC_FLAG_FSYNC = 0x02, RBOX_SYNC_FLAG_FORCE_REBUILD = 0x04 };
 
 /**
@@ -45,6 +49,8 @@ struct rbox_sync_context {
   uint32_t uid_validity;
   /** list of expunged mails**/
   ARRAY(struct expunged_item *) expunged_items;
+  /** changes of the mailbox counters (expunged mails, mails moved to/from alt storage), NULL if none **/
+  librmb::RadosCounters *counters;
 };
 /**
  * @brief: callback data used to send a notification callback
@@ -23,6 +23,8 @@
 #include "../../librmb/rados-util.h"
 #include "../../librmb/tools/rmb/rmb-commands.h"
 #include "../../librmb/rados-save-log.h"
+#include "../../librmb/rados-single-instance.h"
+#include "../../librmb/rados-counters.h"
 
 using ::testing::AtLeast;
 using ::testing::Return;
@@ -632,6 +634,122 @@ TEST(librmb, test_default_metadata_load_attributes) {
   // tear down
   cluster.deinit();
 }
+/**
+ * Test metadata and mail data are read with one read operation
+ */
+TEST(librmb, test_default_metadata_load_with_read_op) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("test");
+  std::string ns("t1");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+
+  librmb::RadosMetadataStorageDefault ms(&storage.get_io_ctx());
+
+  librmb::RadosMail obj;
+  librados::bufferlist buffer;
+  obj.set_mail_buffer(&buffer);
+  obj.get_mail_buffer()->append("abcdefghijklmn");
+  obj.set_mail_size(obj.get_mail_buffer()->length());
+  obj.set_oid("test_read_op");
+  librmb::RadosMetadata attr(librmb::RBOX_METADATA_GUID, "guid");
+  obj.add_metadata(attr);
+  librmb::RadosMetadata ext_metadata("k_1", "1");
+  obj.add_extended_metadata(ext_metadata);
+
+  librados::ObjectWriteOperation op;
+  ms.save_metadata(&op, &obj);
+  EXPECT_EQ(0, storage.split_buffer_and_exec_op(&obj, &op, 100));
+  storage.wait_for_write_operations_complete(obj.get_completion(), obj.get_write_operation());
+
+  librmb::RadosMail obj2;
+  obj2.set_oid("test_read_op");
+  librados::bufferlist data;
+  int read_err = 0;
+  librmb::RadosMetadataRead metadata;
+  librados::ObjectReadOperation read_op;
+  read_op.read(0, 4, &data, &read_err);
+  ms.add_load_metadata(&read_op, &metadata);
+  EXPECT_EQ(0, storage.read_operate(*obj2.get_oid(), &read_op, &data));
+  EXPECT_EQ(0, ms.load_metadata(&obj2, &metadata));
+
+  EXPECT_EQ("abcd", data.to_str());
+  char *guid = NULL;
+  librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_GUID, obj2.get_metadata(), &guid);
+  EXPECT_STREQ("guid", guid);
+  EXPECT_EQ(1u, obj2.get_extended_metadata()->size());
+
+  storage.delete_mail(&obj);
+  // tear down
+  cluster.deinit();
+}
+/**
+ * Test keywords are kept in xattrs, if the pool does not support omap (erasure coded pool)
+ */
+TEST(librmb, test_default_metadata_keywords_without_omap) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("test");
+  std::string ns("t1");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+  // replicated pool
+  EXPECT_FALSE(storage.is_erasure_coded());
+  EXPECT_EQ(0, storage.get_stripe_alignment());
+
+  // behave like an erasure coded pool
+  librmb::RadosUtils::set_omap_supported(storage.get_io_ctx().get_id(), false);
+  librmb::RadosMetadataStorageDefault ms(&storage.get_io_ctx());
+
+  librmb::RadosMail obj;
+  obj.set_oid("test_keywords_xattr");
+  librmb::RadosMetadata attr(librmb::RBOX_METADATA_GUID, "guid");
+  obj.add_metadata(attr);
+  std::string keyword_idx("1");
+  std::string keyword("$Junk");
+  librmb::RadosMetadata ext_metadata(keyword_idx, keyword);
+  obj.add_extended_metadata(ext_metadata);
+
+  librados::ObjectWriteOperation op;
+  ms.save_metadata(&op, &obj);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(*obj.get_oid(), &op));
+
+  std::map<std::string, ceph::bufferlist> omap;
+  EXPECT_EQ(0, librmb::RadosUtils::get_all_keys_and_values(&storage.get_io_ctx(), *obj.get_oid(), &omap));
+  EXPECT_EQ(0, omap.size());
+
+  librmb::RadosMail obj2;
+  obj2.set_oid("test_keywords_xattr");
+  EXPECT_LE(0, ms.load_metadata(&obj2));
+  EXPECT_EQ(1, obj2.get_extended_metadata()->size());
+  EXPECT_EQ(obj2.get_metadata()->end(),
+            obj2.get_metadata()->find(librmb::RadosUtils::get_keyword_xattr_key(keyword_idx)));
+
+  std::string keyword_idx2("2");
+  std::string keyword2("$Label1");
+  librmb::RadosMetadata ext_metadata2(keyword_idx2, keyword2);
+  EXPECT_EQ(0, ms.update_keyword_metadata("test_keywords_xattr", &ext_metadata2));
+  EXPECT_EQ(0, ms.remove_keyword_metadata("test_keywords_xattr", keyword_idx));
+  std::set<std::string> keys;
+  keys.insert(keyword_idx);
+  keys.insert(keyword_idx2);
+  std::map<std::string, ceph::bufferlist> keywords;
+  EXPECT_EQ(0, ms.load_keyword_metadata("test_keywords_xattr", keys, &keywords));
+  EXPECT_EQ(1, keywords.size());
+  EXPECT_EQ(keywords.end(), keywords.find(keyword_idx));
+
+  librmb::RadosUtils::set_omap_supported(storage.get_io_ctx().get_id(), true);
+  storage.delete_mail("test_keywords_xattr");
+  // tear down
+  cluster.deinit();
+}
 /**
  * Test LoadMetadata default reader
  */
@@ -871,6 +989,137 @@ TEST(librmb, increment_sub_from_existing_key) {
   // tear down
   cluster.deinit();
 }
+/**
+ * mailbox and user counters are updated with one operation (cls numops)
+ */
+TEST(librmb, mailbox_counters) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("counters");
+  std::string ns("t1");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+
+  std::string oid = librmb::RadosCounters::get_oid(ns);
+  librmb::RadosCounters counters;
+  // nothing counted yet
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb1", &counters));
+  EXPECT_TRUE(counters.is_empty());
+
+  librmb::RadosCounters delta;
+  delta.messages = 2;
+  delta.bytes = 300;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb1", delta));
+  delta.messages = 1;
+  delta.bytes = 50;
+  delta.alt_bytes = 50;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb2", delta));
+  delta.messages = -1;
+  delta.bytes = -100;
+  delta.alt_bytes = 0;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb1", delta));
+
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb1", &counters));
+  EXPECT_EQ(1, counters.messages);
+  EXPECT_EQ(200, counters.bytes);
+  EXPECT_EQ(0, counters.alt_bytes);
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "", &counters));
+  EXPECT_EQ(2, counters.messages);
+  EXPECT_EQ(250, counters.bytes);
+  EXPECT_EQ(50, counters.alt_bytes);
+
+  // values >= 1e10 are exact
+  delta.clear();
+  delta.bytes = 20000000000;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb3", delta));
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb3", &counters));
+  EXPECT_EQ(20000000000, counters.bytes);
+  delta.bytes = 12345678912 - 20000000000;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb3", delta));
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb3", &counters));
+  EXPECT_EQ(12345678912, counters.bytes);
+
+  // many small adds on a large base do not drift
+  counters.clear();
+  counters.bytes = 100000000000;
+  ASSERT_EQ(0, librmb::RadosCounters::write(&storage.get_io_ctx(), oid, "mb4", counters));
+  delta.clear();
+  delta.messages = 1;
+  delta.bytes = 7;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb4", delta));
+  }
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb4", &counters));
+  EXPECT_EQ(1000, counters.messages);
+  EXPECT_EQ(100000007000, counters.bytes);
+
+  // values written by numops (older versions) are read
+  std::map<std::string, librados::bufferlist> legacy;
+  legacy[librmb::RadosCounters::get_key("mb5", RBOX_COUNTERS_BYTES)].append("1.234567891e+10");
+  ASSERT_EQ(0, storage.get_io_ctx().omap_set(oid, legacy));
+  delta.clear();
+  delta.bytes = 1;
+  ASSERT_EQ(0, librmb::RadosCounters::update(&storage.get_io_ctx(), oid, "mb5", delta));
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb5", &counters));
+  EXPECT_EQ(12345678911, counters.bytes);
+
+  // recalculated counters
+  counters.clear();
+  counters.messages = 5;
+  ASSERT_EQ(0, librmb::RadosCounters::write(&storage.get_io_ctx(), oid, "mb1", counters));
+  ASSERT_EQ(0, librmb::RadosCounters::read(&storage.get_io_ctx(), oid, "mb1", &counters));
+  EXPECT_EQ(5, counters.messages);
+  EXPECT_EQ(0, counters.bytes);
+
+  storage.get_io_ctx().remove(oid);
+  // tear down
+  cluster.deinit();
+}
+/**
+ * single instance storage: body is stored once and removed with the last reference
+ */
+TEST(librmb, single_instance_body_refcount) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("single_instance");
+  std::string ns("t1");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+
+  std::string body_oid = librmb::RadosSingleInstance::get_body_oid("0123456789abcdef");
+  ceph::bufferlist body;
+  body.append("From: user@domain.org\r\nSubject: newsletter\r\n\r\nbody");
+
+  // first recipient stores the body, second one only adds a reference
+  ASSERT_EQ(0, librmb::RadosSingleInstance::add_body(&storage.get_io_ctx(), body_oid, body));
+  ASSERT_EQ(0, librmb::RadosSingleInstance::add_body(&storage.get_io_ctx(), body_oid, body));
+  ASSERT_EQ(0, librmb::RadosSingleInstance::add_ref(&storage.get_io_ctx(), body_oid));
+
+  ceph::bufferlist read_body;
+  EXPECT_LE(0, librmb::RadosSingleInstance::read_body(&storage.get_io_ctx(), body_oid, &read_body));
+  EXPECT_TRUE(body.contents_equal(read_body));
+
+  EXPECT_EQ(0, librmb::RadosSingleInstance::remove_ref(&storage.get_io_ctx(), body_oid));
+  EXPECT_EQ(0, librmb::RadosSingleInstance::remove_ref(&storage.get_io_ctx(), body_oid));
+  read_body.clear();
+  EXPECT_LE(0, librmb::RadosSingleInstance::read_body(&storage.get_io_ctx(), body_oid, &read_body));
+
+  // last reference removes the body
+  EXPECT_EQ(0, librmb::RadosSingleInstance::remove_ref(&storage.get_io_ctx(), body_oid));
+  read_body.clear();
+  EXPECT_EQ(-ENOENT, librmb::RadosSingleInstance::read_body(&storage.get_io_ctx(), body_oid, &read_body));
+  EXPECT_EQ(-ENOENT, librmb::RadosSingleInstance::add_ref(&storage.get_io_ctx(), body_oid));
+
+  // tear down
+  cluster.deinit();
+}
+
 /**
  * RmbCommands load objects
  */
@@ -22,7 +22,14 @@
 #include "rados-types.h"
 #include "rados-save-log.h"
 #include "rados-mail.h"
+#include "rados-compression.h"
+#include "rados-checksum.h"
+#include "rados-striping.h"
+#include "rados-mail-cache.h"
+#include "rados-mail-file-cache.h"
+#include "rados-hedged-read.h"
 #include <cstdio>
+#include <cstdlib>
 #include <pthread.h>
 
 using ::testing::AtLeast;
@@ -278,6 +285,62 @@ TEST(librmb, append_to_existing_file_log_file) {
   std::remove(test_file_name.c_str());
 }
 
+TEST(librmb, save_log_group_commit) {
+  std::string test_file_name = "test_group_commit.log";
+  librmb::RadosSaveLog csv_log(test_file_name);
+  EXPECT_EQ(true, csv_log.open());
+  csv_log.append(librmb::RadosSaveLogEntry("abc", "ns_1", "mail_storage", "save"));
+  EXPECT_EQ(true, csv_log.close());
+
+  librmb::RadosSaveLog log_file(test_file_name);
+  log_file.set_group_commit(65536, 60000, false);
+  EXPECT_EQ(true, log_file.open());
+  log_file.append(librmb::RadosSaveLogEntry("def", "ns_1", "mail_storage", "cpy"));
+  log_file.append(librmb::RadosSaveLogEntry("ghi", "ns_2", "mail_storage", "mv:ns_1:def:user;U=1"));
+
+  // buffered until flush
+  std::ifstream size_check(test_file_name, std::ifstream::binary | std::ifstream::ate);
+  std::streamoff csv_size = size_check.tellg();
+  size_check.close();
+  EXPECT_EQ(true, log_file.flush());
+  std::ifstream size_check2(test_file_name, std::ifstream::binary | std::ifstream::ate);
+  EXPECT_GT(size_check2.tellg(), csv_size);
+  size_check2.close();
+  EXPECT_EQ(true, log_file.close());
+
+  std::ifstream read(test_file_name, std::ifstream::binary);
+  librmb::RadosSaveLogReader reader(&read);
+  librmb::RadosSaveLogEntry entry1;
+  EXPECT_EQ(1, reader.read(&entry1));
+  EXPECT_EQ("abc", entry1.oid);
+  librmb::RadosSaveLogEntry entry2;
+  EXPECT_EQ(1, reader.read(&entry2));
+  EXPECT_EQ("def", entry2.oid);
+  EXPECT_EQ("cpy", entry2.op);
+  librmb::RadosSaveLogEntry entry3;
+  EXPECT_EQ(1, reader.read(&entry3));
+  EXPECT_EQ("ghi", entry3.oid);
+  EXPECT_EQ("ns_2", entry3.ns);
+  EXPECT_EQ("def", entry3.src_oid);
+  EXPECT_EQ(1, entry3.metadata.size());
+  librmb::RadosSaveLogEntry entry4;
+  EXPECT_EQ(0, reader.read(&entry4));
+  read.close();
+
+  // corrupt the payload of the last record
+  std::fstream corrupt(test_file_name, std::fstream::in | std::fstream::out | std::fstream::binary | std::fstream::ate);
+  corrupt.seekp(-1, std::ios_base::end);
+  corrupt.put('X');
+  corrupt.close();
+  std::ifstream read2(test_file_name, std::ifstream::binary);
+  librmb::RadosSaveLogReader reader2(&read2);
+  EXPECT_EQ(1, reader2.read(&entry1));
+  EXPECT_EQ(1, reader2.read(&entry2));
+  EXPECT_EQ(-1, reader2.read(&entry3));
+  read2.close();
+  std::remove(test_file_name.c_str());
+}
+
 __attribute__((noreturn)) static void *write_to_save_file(void *threadid) {
   std::string test_file_name = "test1.log";
   librmb::RadosSaveLog log_file(test_file_name);
@@ -352,6 +415,345 @@ TEST(librmb, test_max_object_size_calculation) {
 
 }
 
+TEST(librmb, compression_round_trip) {
+  EXPECT_EQ(nullptr, librmb::RadosCompression::get_codec("none"));
+  EXPECT_TRUE(librmb::RadosCompression::is_valid_codec("none"));
+  EXPECT_FALSE(librmb::RadosCompression::is_valid_codec("gzip"));
+
+  // mail body spread over several segments
+  librados::bufferlist mail;
+  for (int i = 0; i < 1000; i++) {
+    mail.append("Subject: test mail\r\nFrom: user@domain.org\r\n\r\nbody ");
+    mail.append(std::to_string(i));
+    mail.append_zero(i % 7);
+  }
+  const char *codecs[] = {"zstd", "lz4"};
+  for (const char *name : codecs) {
+    librmb::RadosCompression *codec = librmb::RadosCompression::get_codec(name);
+    if (codec == nullptr) {
+      // not compiled in
+      EXPECT_FALSE(librmb::RadosCompression::is_valid_codec(name));
+      continue;
+    }
+    EXPECT_EQ(name, codec->get_name());
+    librados::bufferlist compressed;
+    EXPECT_EQ(0, codec->compress(mail, &compressed, 0));
+    EXPECT_LT(compressed.length(), mail.length());
+
+    librados::bufferlist decompressed;
+    EXPECT_EQ(0, codec->decompress(compressed, &decompressed));
+    EXPECT_TRUE(mail.contents_equal(decompressed));
+
+    // truncated object
+    librados::bufferlist truncated;
+    truncated.substr_of(compressed, 0, compressed.length() / 2);
+    librados::bufferlist out;
+    EXPECT_GT(0, codec->decompress(truncated, &out));
+  }
+}
+
+TEST(librmb, compression_dict) {
+  std::string name;
+  uint32_t dict_id = 1;
+  EXPECT_EQ("zstd", librmb::RadosCompression::to_marker("zstd", 0));
+  EXPECT_TRUE(librmb::RadosCompression::parse_marker("zstd", &name, &dict_id));
+  EXPECT_EQ("zstd", name);
+  EXPECT_EQ(0u, dict_id);
+  EXPECT_TRUE(librmb::RadosCompression::parse_marker(librmb::RadosCompression::to_marker("zstd", 42), &name, &dict_id));
+  EXPECT_EQ("zstd", name);
+  EXPECT_EQ(42u, dict_id);
+  EXPECT_FALSE(librmb::RadosCompression::parse_marker("zstd:abc", &name, &dict_id));
+  EXPECT_FALSE(librmb::RadosCompression::parse_marker("", &name, &dict_id));
+
+  librmb::RadosCompression *codec = librmb::RadosCompression::get_codec("zstd");
+  if (codec == nullptr) {
+    // not compiled in
+    return;
+  }
+  EXPECT_TRUE(codec->is_dict_supported());
+  std::list<librados::bufferlist> samples;
+  for (int i = 0; i < 2000; i++) {
+    librados::bufferlist sample;
+    sample.append("Return-Path: <user" + std::to_string(i % 13) + "@domain.org>\r\nSubject: notification " +
+                  std::to_string(i) + "\r\nContent-Type: text/plain; charset=utf-8\r\n\r\nhello " +
+                  std::to_string(i * 7) + "\r\n");
+    samples.push_back(sample);
+  }
+  librados::bufferlist dict_buffer;
+  ASSERT_EQ(0, librmb::RadosCompression::train_dict(samples, 4096, &dict_buffer, &dict_id));
+  EXPECT_GT(dict_id, 0u);
+  librmb::RadosCompressionDict dict(dict_id, dict_buffer);
+
+  librados::bufferlist &mail = samples.front();
+  librados::bufferlist compressed;
+  librados::bufferlist compressed_no_dict;
+  EXPECT_EQ(0, codec->compress(mail, &compressed, 0, &dict));
+  EXPECT_EQ(0, codec->compress(mail, &compressed_no_dict, 0));
+  EXPECT_LT(compressed.length(), compressed_no_dict.length());
+
+  librados::bufferlist decompressed;
+  EXPECT_EQ(0, codec->decompress(compressed, &decompressed, &dict));
+  EXPECT_TRUE(mail.contents_equal(decompressed));
+  // dictionary is required
+  librados::bufferlist out;
+  EXPECT_GT(0, codec->decompress(compressed, &out));
+}
+
+TEST(librmb, checksum_crc32c) {
+  // crc32c check value
+  EXPECT_EQ(0xe3069283, librmb::RadosChecksum::crc32c(0, "123456789", 9));
+  EXPECT_EQ(0u, librmb::RadosChecksum::crc32c(0, "", 0));
+
+  // segmented data has the same checksum as contiguous data
+  std::string data;
+  librados::bufferlist segmented;
+  for (int i = 0; i < 500; i++) {
+    std::string line = "line " + std::to_string(i) + "\r\n";
+    data.append(line);
+    segmented.append(line);
+  }
+  uint32_t crc = librmb::RadosChecksum::crc32c(0, data.c_str(), data.length());
+  EXPECT_EQ(crc, librmb::RadosChecksum::crc32c(0, segmented));
+  EXPECT_EQ(crc, librmb::RadosChecksum::crc32c(librmb::RadosChecksum::crc32c(0, data.c_str(), 13),
+                                               data.c_str() + 13, data.length() - 13));
+
+  uint32_t parsed = 0;
+  EXPECT_EQ("e3069283", librmb::RadosChecksum::to_string(0xe3069283));
+  EXPECT_TRUE(librmb::RadosChecksum::from_string("e3069283", &parsed));
+  EXPECT_EQ(0xe3069283, parsed);
+  EXPECT_FALSE(librmb::RadosChecksum::from_string("e30692", &parsed));
+  EXPECT_FALSE(librmb::RadosChecksum::from_string("e306928x", &parsed));
+}
+
+TEST(librmb, striping_manifest_extents) {
+  EXPECT_EQ("3:100:250", librmb::RadosStriping::to_manifest(100, 250));
+  EXPECT_EQ(1u, librmb::RadosStriping::get_stripe_count(100, 100));
+  EXPECT_EQ(2u, librmb::RadosStriping::get_stripe_count(100, 101));
+  EXPECT_EQ(1u, librmb::RadosStriping::get_stripe_count(0, 101));
+  EXPECT_EQ("abc.2", librmb::RadosStriping::get_stripe_oid("abc", 2));
+
+  uint32_t stripe_count = 0;
+  uint64_t stripe_size = 0;
+  uint64_t size = 0;
+  EXPECT_TRUE(librmb::RadosStriping::parse_manifest("3:100:250", &stripe_count, &stripe_size, &size));
+  EXPECT_EQ(3u, stripe_count);
+  EXPECT_EQ(100u, stripe_size);
+  EXPECT_EQ(250u, size);
+  // single stripe, inconsistent count and invalid values
+  EXPECT_FALSE(librmb::RadosStriping::parse_manifest("1:100:50", &stripe_count, &stripe_size, &size));
+  EXPECT_FALSE(librmb::RadosStriping::parse_manifest("2:100:250", &stripe_count, &stripe_size, &size));
+  EXPECT_FALSE(librmb::RadosStriping::parse_manifest("3:0:250", &stripe_count, &stripe_size, &size));
+  EXPECT_FALSE(librmb::RadosStriping::parse_manifest("3:100", &stripe_count, &stripe_size, &size));
+  EXPECT_FALSE(librmb::RadosStriping::parse_manifest("a:100:250", &stripe_count, &stripe_size, &size));
+
+  std::vector<librmb::RadosStripeExtent> extents;
+  librmb::RadosStriping::get_extents(90, 120, 100, &extents);
+  ASSERT_EQ(3u, extents.size());
+  EXPECT_EQ(0u, extents[0].index);
+  EXPECT_EQ(90u, extents[0].object_offset);
+  EXPECT_EQ(0u, extents[0].buffer_offset);
+  EXPECT_EQ(10u, extents[0].length);
+  EXPECT_EQ(1u, extents[1].index);
+  EXPECT_EQ(0u, extents[1].object_offset);
+  EXPECT_EQ(10u, extents[1].buffer_offset);
+  EXPECT_EQ(100u, extents[1].length);
+  EXPECT_EQ(2u, extents[2].index);
+  EXPECT_EQ(0u, extents[2].object_offset);
+  EXPECT_EQ(110u, extents[2].buffer_offset);
+  EXPECT_EQ(10u, extents[2].length);
+}
+
+TEST(librmb, scan_header_end) {
+  int state = 0;
+  std::string mail = "From: a@b.c\r\nSubject: test\r\n\r\nbody\r\n";
+  EXPECT_EQ(30, librmb::RadosUtils::scan_header_end(mail.c_str(), mail.length(), &state));
+
+  // LF only
+  state = 0;
+  mail = "From: a@b.c\nSubject: test\n\nbody\n";
+  EXPECT_EQ(27, librmb::RadosUtils::scan_header_end(mail.c_str(), mail.length(), &state));
+
+  // empty header
+  state = 0;
+  EXPECT_EQ(2, librmb::RadosUtils::scan_header_end("\r\nbody", 6, &state));
+
+  // no body
+  state = 0;
+  mail = "From: a@b.c\r\nSubject: test\r\n";
+  EXPECT_EQ(-1, librmb::RadosUtils::scan_header_end(mail.c_str(), mail.length(), &state));
+
+  // empty line split between two parts
+  state = 0;
+  std::string part1 = "Subject: test\r\n\r";
+  std::string part2 = "\nbody";
+  EXPECT_EQ(-1, librmb::RadosUtils::scan_header_end(part1.c_str(), part1.length(), &state));
+  EXPECT_EQ(1, librmb::RadosUtils::scan_header_end(part2.c_str(), part2.length(), &state));
+}
+
+TEST(librmb, mail_cache_lru) {
+  librmb::RadosMailCache cache(400);
+  librados::bufferlist mail;
+  mail.append(std::string(100, 'a'));
+  librados::bufferlist part;
+  part.append(std::string(50, 'b'));
+  mail.append(part);
+  time_t save_date = 0;
+  librados::bufferlist read;
+
+  std::string key1 = librmb::RadosMailCache::get_key("mail_storage", "ns", "oid1");
+  std::string key2 = librmb::RadosMailCache::get_key("mail_storage", "ns", "oid2");
+  std::string key3 = librmb::RadosMailCache::get_key("mail_storage", "ns", "oid3");
+  EXPECT_FALSE(cache.get(key1, &read, &save_date));
+
+  cache.put(key1, mail, 1);
+  EXPECT_TRUE(cache.get(key1, &read, &save_date));
+  EXPECT_EQ(1, save_date);
+  EXPECT_EQ(150u, read.length());
+  EXPECT_TRUE(read.contents_equal(mail));
+  EXPECT_TRUE(read.is_contiguous());
+
+  // key1 is the least recently used mail
+  cache.put(key2, mail, 2);
+  EXPECT_TRUE(cache.get(key1, &read, &save_date));
+  cache.put(key3, mail, 3);
+  EXPECT_EQ(300u, cache.get_size());
+  EXPECT_FALSE(cache.get(key2, &read, &save_date));
+  EXPECT_TRUE(cache.get(key1, &read, &save_date));
+  EXPECT_TRUE(cache.get(key3, &read, &save_date));
+
+  // larger than a quarter of the capacity
+  librados::bufferlist large;
+  large.append(std::string(101, 'c'));
+  cache.put(key2, large, 2);
+  EXPECT_FALSE(cache.get(key2, &read, &save_date));
+
+  cache.remove(key1);
+  EXPECT_FALSE(cache.get(key1, &read, &save_date));
+  EXPECT_EQ(150u, cache.get_size());
+
+  cache.set_capacity(0);
+  EXPECT_EQ(0u, cache.get_size());
+  cache.put(key1, mail, 1);
+  EXPECT_FALSE(cache.get(key1, &read, &save_date));
+}
+
+TEST(librmb, mail_file_cache) {
+  char dir[] = "/tmp/rbox_mail_file_cache_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  librmb::RadosMailFileCache file_cache;
+  EXPECT_FALSE(file_cache.open(dir, 0));
+  ASSERT_TRUE(file_cache.open(dir, 1000));
+
+  librados::bufferlist mail;
+  mail.append(std::string(100, 'a'));
+  time_t save_date = 0;
+  librados::bufferlist read;
+  std::string key1 = librmb::RadosMailCache::get_key("mail_storage", "ns", "oid1");
+  std::string key2 = librmb::RadosMailCache::get_key("mail_storage", "ns", "oid2");
+  EXPECT_FALSE(file_cache.get(key1, &read, &save_date));
+
+  file_cache.put(key1, mail, 1);
+  EXPECT_TRUE(file_cache.get(key1, &read, &save_date));
+  EXPECT_EQ(1, save_date);
+  EXPECT_TRUE(read.contents_equal(mail));
+  EXPECT_LT(0u, file_cache.get_size());
+
+  // a second process sees the mail
+  librmb::RadosMailFileCache other;
+  ASSERT_TRUE(other.open(dir, 1000));
+  EXPECT_TRUE(other.get(key1, &read, &save_date));
+
+  // second level of the process cache
+  librmb::RadosMailCache cache(400);
+  cache.set_file_cache(&other);
+  cache.put(key2, mail, 2);
+  EXPECT_TRUE(file_cache.get(key2, &read, &save_date));
+  EXPECT_EQ(2, save_date);
+  cache.remove(key2);
+  EXPECT_FALSE(file_cache.get(key2, &read, &save_date));
+  EXPECT_FALSE(cache.get(key2, &read, &save_date));
+
+  file_cache.remove(key1);
+  EXPECT_FALSE(other.get(key1, &read, &save_date));
+  file_cache.evict();
+  EXPECT_EQ(0u, file_cache.get_size());
+
+  file_cache.close();
+  other.close();
+  std::string cmd = std::string("rm -rf ") + dir;
+  EXPECT_EQ(0, system(cmd.c_str()));
+}
+
+/**
+ * the least recently used mails are evicted, based on the index (no directory scan)
+ */
+TEST(librmb, mail_file_cache_lru) {
+  char dir[] = "/tmp/rbox_mail_file_cache_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  librmb::RadosMailFileCache file_cache;
+  ASSERT_TRUE(file_cache.open(dir, 1000));
+
+  librados::bufferlist mail;
+  mail.append(std::string(200, 'a'));
+  time_t save_date = 0;
+  librados::bufferlist read;
+  for (int i = 0; i < 4; i++) {
+    file_cache.put(librmb::RadosMailCache::get_key("mail_storage", "ns", "oid" + std::to_string(i)), mail, i);
+  }
+  uint64_t size = file_cache.get_size();
+  EXPECT_LT(800u, size);
+  EXPECT_TRUE(file_cache.get(librmb::RadosMailCache::get_key("mail_storage", "ns", "oid0"), &read, &save_date));
+
+  // exceeds the capacity: oid1 has not been accessed for the longest time
+  file_cache.put(librmb::RadosMailCache::get_key("mail_storage", "ns", "oid4"), mail, 4);
+  EXPECT_EQ(size, file_cache.get_size());
+  EXPECT_FALSE(file_cache.get(librmb::RadosMailCache::get_key("mail_storage", "ns", "oid1"), &read, &save_date));
+  for (int i : {0, 2, 3, 4}) {
+    EXPECT_TRUE(file_cache.get(librmb::RadosMailCache::get_key("mail_storage", "ns", "oid" + std::to_string(i)),
+                               &read, &save_date));
+  }
+
+  // the index is shared, a reopened cache knows the mails
+  file_cache.close();
+  ASSERT_TRUE(file_cache.open(dir, 1000));
+  EXPECT_EQ(size, file_cache.get_size());
+  file_cache.close();
+  std::string cmd = std::string("rm -rf ") + dir;
+  EXPECT_EQ(0, system(cmd.c_str()));
+}
+
+TEST(librmb, read_latency_deadline) {
+  librmb::RadosReadLatency latency;
+  // not enough samples
+  latency.add(100000);
+  EXPECT_EQ(5000u, latency.get_deadline(95, 5000));
+
+  for (uint64_t i = 1; i <= 100; i++) {
+    latency.add(i * 1000);
+  }
+  EXPECT_EQ(96000u, latency.get_deadline(95, 5000));
+  EXPECT_EQ(100000u, latency.get_deadline(100, 5000));
+  // lower bound
+  EXPECT_EQ(50000u, latency.get_deadline(1, 50000));
+}
+
+/**
+ * the pool type is cached per pool id, create_connection only asks the mon on a miss
+ */
+TEST(librmb, omap_supported_cache) {
+  bool supported = false;
+  EXPECT_FALSE(librmb::RadosUtils::get_omap_supported(4711, &supported));
+
+  librmb::RadosUtils::set_omap_supported(4711, true);
+  EXPECT_TRUE(librmb::RadosUtils::get_omap_supported(4711, &supported));
+  EXPECT_TRUE(supported);
+
+  librmb::RadosUtils::set_omap_supported(4711, false);
+  EXPECT_TRUE(librmb::RadosUtils::get_omap_supported(4711, &supported));
+  EXPECT_FALSE(supported);
+  EXPECT_FALSE(librmb::RadosUtils::get_omap_supported(4712, &supported));
+  librmb::RadosUtils::set_omap_supported(4711, true);
+}
 
 TEST(librmb, mock_obj) {}
 int main(int argc, char **argv) {
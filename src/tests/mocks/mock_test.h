@@ -43,6 +43,8 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD0(get_max_write_size, int());
   MOCK_METHOD0(get_max_write_size_bytes, int());
   MOCK_METHOD0(get_max_object_size, int());
+  MOCK_METHOD0(is_erasure_coded, bool());
+  MOCK_METHOD0(get_stripe_alignment, uint64_t());
   
   MOCK_METHOD2(execute_operation, bool(std::string &oid, librados::ObjectWriteOperation *write_op_xattr));
 
@@ -55,10 +57,15 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD1(delete_mail, int(const std::string &oid));
   MOCK_METHOD4(aio_operate, int(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                                 librados::ObjectWriteOperation *op));
+  MOCK_METHOD6(aio_read, int(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                             librados::bufferlist *pbl, size_t len, uint64_t off));
   MOCK_METHOD1(find_mails, librados::NObjectIterator(const RadosMetadata *attr));
   MOCK_METHOD1(open_connection, int(const std::string &poolname));
   MOCK_METHOD2(open_connection, int(const std::string &poolname, const std::string &index_pool));
   MOCK_METHOD3(read_operate, int(const std::string &oid, librados::ObjectReadOperation *read_operation,librados::bufferlist *bufferlist));
+  MOCK_METHOD5(aio_read_operate, int(const std::string &oid, librados::AioCompletion *c,
+                                     librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist,
+                                     int flags));
 
   MOCK_METHOD4(find_mails_async, std::set<std::string>(const RadosMetadata *attr, std::string &pool_name,int num_threads, void (*ptr)(std::string&)));
 
@@ -71,7 +78,10 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD2(wait_for_write_operations_complete,
                bool(librados::AioCompletion *completion, librados::ObjectWriteOperation *write_operation));
   MOCK_METHOD1(wait_for_rados_operations, bool(const std::list<librmb::RadosMail *> &object_list));
+  MOCK_METHOD1(wait_for_read_operation_complete, int(librados::AioCompletion *completion));
   MOCK_METHOD1(set_ceph_wait_method, void(enum librmb::rbox_ceph_aio_wait_method wait_method));
+  MOCK_METHOD1(set_read_flags, void(int read_flags));
+  MOCK_METHOD0(get_read_flags, int());
   MOCK_METHOD2(read_mail, int(const std::string &oid, librados::bufferlist *buffer));
   MOCK_METHOD6(move, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                          std::list<RadosMetadata> &to_update, bool delete_source));
@@ -94,12 +104,17 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD1(ceph_index_overwrite,int(const std::set<std::string> &oids));
   MOCK_METHOD0(ceph_index_read,std::set<std::string>());
   MOCK_METHOD0(ceph_index_delete,int());
+  MOCK_METHOD2(update_counters,int(const std::string &mailbox_guid, const librmb::RadosCounters &delta));
+  MOCK_METHOD2(read_counters,int(const std::string &mailbox_guid, librmb::RadosCounters *counters));
+  MOCK_METHOD2(write_counters,int(const std::string &mailbox_guid, const librmb::RadosCounters &counters));
 };
 
 class RadosStorageMetadataMock : public RadosStorageMetadataModule {
  public:
   MOCK_METHOD1(set_io_ctx, void(librados::IoCtx *io_ctx));
   MOCK_METHOD1(load_metadata, int(RadosMail *mail));
+  MOCK_METHOD2(add_load_metadata, void(librados::ObjectReadOperation *read_op, librmb::RadosMetadataRead *read));
+  MOCK_METHOD2(load_metadata, int(RadosMail *mail, librmb::RadosMetadataRead *read));
   MOCK_METHOD2(set_metadata, int(RadosMail *mail, RadosMetadata &xattr));
   MOCK_METHOD3(set_metadata, int(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op));
 
@@ -159,6 +174,7 @@ class RadosClusterMock : public RadosCluster {
   MOCK_METHOD2(set_config_option, void(const char *option, const char *value));
   MOCK_METHOD1(list_pgs_for_pool, std::vector<std::string>(std::string &pool_name));
   MOCK_METHOD1(list_pgs_osd_for_pool, std::map<std::string, std::vector<std::string>> (std::string &pool_name));
+  MOCK_METHOD1(is_erasure_coded_pool, bool(const std::string &pool_name));
 };
 
 using librmb::RadosDovecotCephCfg;
@@ -168,6 +184,10 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD0(get_rados_cluster_name, const std::string &());
   MOCK_METHOD0(get_rados_username, const std::string &());
   MOCK_METHOD0(get_rados_save_log_file, const std::string &());
+  MOCK_METHOD0(is_save_log_group_commit, bool());
+  MOCK_METHOD0(get_save_log_flush_size, int());
+  MOCK_METHOD0(get_save_log_flush_interval, int());
+  MOCK_METHOD0(is_save_log_fsync, bool());
 
   // dovecot configuration
   MOCK_METHOD1(is_mail_attribute, bool(enum librmb::rbox_metadata_key key));
@@ -176,7 +196,25 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD0(is_ceph_posix_bugfix_enabled, bool());
   MOCK_METHOD0(is_ceph_aio_wait_for_safe_and_cb, bool());
   MOCK_METHOD0(is_write_chunks, bool());
+  MOCK_METHOD0(is_verify_checksum, bool());
   MOCK_METHOD0(get_chunk_size,int());
+  MOCK_METHOD0(get_stream_watermark,int());
+  MOCK_METHOD0(get_save_inflight_window,int());
+  MOCK_METHOD0(get_header_read_size,int());
+  MOCK_METHOD0(get_read_chunk_size,int());
+  MOCK_METHOD0(get_read_ahead,int());
+  MOCK_METHOD0(get_prefetch_window,int());
+  MOCK_METHOD0(get_mail_cache_size,int());
+  MOCK_METHOD0(get_shared_cache_dir,const std::string &());
+  MOCK_METHOD0(get_shared_cache_size,uint64_t());
+  MOCK_METHOD0(get_read_policy,const std::string &());
+  MOCK_METHOD0(get_hedged_read_percentile,int());
+  MOCK_METHOD0(get_hedged_read_min_delay,int());
+  MOCK_METHOD0(get_warmup_count,int());
+  MOCK_METHOD0(is_warmup_headers,bool());
+  MOCK_METHOD0(get_pop3_preload_window,int());
+  MOCK_METHOD0(is_mailbox_counters,bool());
+  MOCK_METHOD0(get_chunk_write_window,int());
   MOCK_METHOD0(get_write_method,int());
 
   MOCK_METHOD0(get_object_search_method,int());
@@ -225,6 +263,15 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD1(set_io_ctx_namespace, void(const std::string &namespace_));
   MOCK_METHOD0(get_metadata_storage_module, std::string &());
   MOCK_METHOD0(get_metadata_storage_attribute, std::string &());
+  MOCK_METHOD0(get_compression, librmb::RadosCompression *());
+  MOCK_METHOD0(get_compression_level, int());
+  MOCK_METHOD0(get_compression_dict_id, uint32_t());
+  MOCK_METHOD0(get_compression_dict_mail_size, uint64_t());
+  MOCK_METHOD1(load_compression_dict, librmb::RadosCompressionDict *(uint32_t dict_id));
+  MOCK_METHOD0(is_single_instance, bool());
+  MOCK_METHOD0(get_single_instance_min_size, uint64_t());
+  MOCK_METHOD0(is_striping, bool());
+  MOCK_METHOD0(get_stripe_size, uint64_t());
 
   MOCK_METHOD0(is_rbox_check_empty_mailboxes, bool());
 };
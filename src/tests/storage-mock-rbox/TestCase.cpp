@@ -13,6 +13,8 @@
 
 #include <errno.h>
 
+#include "gmock/gmock.h"
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wshadow"           // turn off warnings for Dovecot :-(
 #pragma GCC diagnostic ignored "-Wundef"            // turn off warnings for Dovecot :-(
@@ -38,6 +40,9 @@ extern "C" {
 #include "libstorage-rbox-plugin.h"
 }
 
+#include "rbox-storage.hpp"
+#include "../mocks/mock_test.h"
+
 #pragma GCC diagnostic pop
 
 #if DOVECOT_PREREQ(2, 3)
@@ -152,6 +157,41 @@ void StorageTest::TearDownTestCase() {
   master_service_deinit(&master_service);
 }
 
+librmbtest::RadosDovecotCephCfgMock *StorageTest::set_cfg_mock(struct mailbox *box) {
+  // referenced by the mock, which is only deleted by the next test
+  static std::string user = "client.admin";
+  static std::string cluster = "ceph";
+  static std::string read_policy = "primary";
+  static std::string pool = "mail_storage";
+  static std::string suffix = "_u";
+
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(::testing::Return(true));
+  EXPECT_CALL(*cfg_mock, is_write_chunks()).WillRepeatedly(::testing::Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_posix_bugfix_enabled()).WillRepeatedly(::testing::Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillRepeatedly(::testing::Return(false));
+  EXPECT_CALL(*cfg_mock, load_rados_config()).WillRepeatedly(::testing::Return(0));
+  EXPECT_CALL(*cfg_mock, is_mail_attribute(::testing::_)).WillRepeatedly(::testing::Return(true));
+  EXPECT_CALL(*cfg_mock, is_user_mapping()).WillRepeatedly(::testing::Return(false));
+  EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(::testing::ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(::testing::Return(0));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(::testing::ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(::testing::ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(::testing::ReturnRef(read_policy));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(::testing::ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(::testing::ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(::testing::Return(1));
+  EXPECT_CALL(*cfg_mock, get_chunk_size()).WillRepeatedly(::testing::Return(100));
+  EXPECT_CALL(*cfg_mock, get_hedged_read_percentile()).WillRepeatedly(::testing::Return(0));
+  EXPECT_CALL(*cfg_mock, get_prefetch_window()).WillRepeatedly(::testing::Return(0));
+
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+  return cfg_mock;
+}
+
 void StorageTest::SetUp() {}
 
 void StorageTest::TearDown() {}
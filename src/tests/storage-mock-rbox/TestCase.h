@@ -19,6 +19,11 @@
 #include "gtest/gtest.h"
 
 typedef struct pool *pool_t;
+struct mailbox;
+
+namespace librmbtest {
+class RadosDovecotCephCfgMock;
+}
 
 /**
  * These test cases create a temporary pool that lives as long as the
@@ -35,6 +40,13 @@ class StorageTest : public ::testing::Test {
 
   static pool_t get_test_pool() { return s_test_pool; }
 
+  /**
+   * Replaces the configuration of the rbox storage of box with a mock: valid, connects to the pool
+   * mail_storage as client.admin, default read and write settings. Tests add their own expectations
+   * to the returned mock, it is owned by the storage.
+   */
+  static librmbtest::RadosDovecotCephCfgMock *set_cfg_mock(struct mailbox *box);
+
  protected:
   static void SetUpTestCase();
   static void TearDownTestCase();
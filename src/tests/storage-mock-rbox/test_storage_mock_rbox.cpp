@@ -13,6 +13,7 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include <fstream>
+#include <vector>
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wshadow"           // turn off warnings for Dovecot :-(
 #pragma GCC diagnostic ignored "-Wundef"            // turn off warnings for Dovecot :-(
@@ -44,10 +45,14 @@ extern "C" {
 #include "rbox-mail.h"
 #include "../mocks/mock_test.h"
 #include "rados-dovecot-ceph-cfg-impl.h"
+#include "rados-mail-cache.h"
 #include "../../storage-rbox/istream-bufferlist.h"
+#include "../../storage-rbox/istream-decompress.h"
+#include "../../storage-rbox/istream-rados.h"
 #include "../../storage-rbox/ostream-bufferlist.h"
 using ::testing::_;
 using ::testing::AtLeast;
+using ::testing::Invoke;
 using ::testing::Matcher;
 using ::testing::Return;
 using ::testing::ReturnRef;
@@ -281,13 +286,15 @@ TEST_F(StorageTest, save_mail_fail_test) {
       .Times(AtLeast(1))
       .WillRepeatedly(Return(65000));
 
+  // mail does not fit into one write op => chunked append
   EXPECT_CALL(*storage_mock, get_max_write_size_bytes())
       .Times(AtLeast(1))
-      .WillRepeatedly(Return(65000));
+      .WillRepeatedly(Return(100));
 
   EXPECT_CALL(*storage_mock, execute_operation(_,_)).WillRepeatedly(Return(true));
-  // save will fail.
-  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).WillRepeatedly(Return(false));
+  // save will fail, writing the first chunk fails.
+  EXPECT_CALL(*storage_mock, aio_operate(_,_,_,_)).Times(1).WillOnce(Return(-1));
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).Times(0);
 
   librmb::RadosMail *test_obj = new librmb::RadosMail();
   test_obj->set_mail_buffer(nullptr);
@@ -309,12 +316,14 @@ TEST_F(StorageTest, save_mail_fail_test) {
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";
   std::string suffix = "_u";
   EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
@@ -424,9 +433,10 @@ TEST_F(StorageTest, write_op_fails) {
       .Times(AtLeast(1))
       .WillRepeatedly(Return(65000));
 
-  EXPECT_CALL(*storage_mock, execute_operation(_,_)).WillRepeatedly(Return(false));
-  // save will fail.
-  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).WillRepeatedly(Return(true));
+  // metadata and mail are written in one operation, save will fail.
+  EXPECT_CALL(*storage_mock, execute_operation(_,_)).Times(1).WillRepeatedly(Return(false));
+  // mail fits into one write op, no chunked append.
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).Times(0);
 
   librmb::RadosMail *test_obj = new librmb::RadosMail();
   test_obj->set_mail_buffer(nullptr);
@@ -448,12 +458,14 @@ TEST_F(StorageTest, write_op_fails) {
 
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";
   std::string suffix = "_u";
   EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
@@ -535,47 +547,17 @@ TEST_F(StorageTest, write_op_fails) {
 /**
  * Error test:
  *
- * - eval copy from input to output stream
- */
-TEST_F(StorageTest, copy_input_to_output_stream) {
-  librados::bufferlist *buffer = new librados::bufferlist();
-  // librados::bufferlist buffer_out;
-  librmb::RadosMail mail;
-  buffer->append("\r\t\0\nJAN");
-  unsigned long physical_size = buffer->length();
-  struct istream *input;  // = *stream_r;
-  struct ostream *output;
-
-  librados::bufferlist buffer2;
-  mail.set_mail_buffer(&buffer2);
-  output = o_stream_create_bufferlist(&mail, nullptr, false);
-  input = i_stream_create_from_bufferlist(buffer, physical_size);
-
-  do {
-    if (o_stream_send_istream(output, input) < 0) {
-      EXPECT_EQ(1, -1);
-    }
-
-  } while (i_stream_read(input) > 0);
-
-  EXPECT_EQ(buffer->to_str(), mail.get_mail_buffer()->to_str());
-  o_stream_unref(&output);
-  i_stream_unref(&input);
-}
-
-/**
- * Error test:
+ * - async save: write completes with error, mailbox_transaction_commit fails
  *
- * - copy mail fails due to storage.copy call returns -1
  */
-TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
-  struct mailbox_transaction_context *desttrans;
-  struct mail_save_context *save_ctx;
-  struct mail *mail;
-  struct mail_search_context *search_ctx;
-  struct mail_search_args *search_args;
-  struct mail_search_arg *sarg;
-
+TEST_F(StorageTest, async_write_op_fails_in_commit) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", (mailbox_flags)0);
+  ASSERT_NE(box, nullptr);
+  i_debug("preparing to open");
+  ASSERT_GE(mailbox_open(box), 0);
+  i_debug("mailbox open");
   const char *message =
       "From: user@domain.org\n"
       "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
@@ -584,90 +566,208 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
       "\n"
       "body\n";
 
-  const char *mailbox = "INBOX";
+  struct istream *input = i_stream_create_from_data(message, strlen(message));
+
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
 
   librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+
+  EXPECT_CALL(*storage_mock, open_connection("mail_storage",_, "ceph", "client.admin"))
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(0));
+  
 
   EXPECT_CALL(*storage_mock, get_max_object_size())
       .Times(AtLeast(1))
       .WillRepeatedly(Return(65000));
-      
+
   EXPECT_CALL(*storage_mock, get_max_write_size_bytes())
       .Times(AtLeast(1))
       .WillRepeatedly(Return(65000));
+
+  // metadata and mail are written in one async operation
+  EXPECT_CALL(*storage_mock, execute_operation(_,_)).Times(0);
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).Times(0);
+  EXPECT_CALL(*storage_mock, aio_operate(_,_,_,_)).Times(1).WillOnce(Return(0));
+  // commit_pre waits for the write => failed, rollback waits again (nothing in flight).
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillOnce(Return(true)).WillRepeatedly(Return(false));
+  // rollback removes the object
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMail*>(_))).Times(1);
+
+  librmb::RadosMail *test_obj = new librmb::RadosMail();
+  test_obj->set_mail_buffer(nullptr);
+  librmb::RadosMail *test_obj2 = new librmb::RadosMail();
+  test_obj2->set_mail_buffer(nullptr);
+  EXPECT_CALL(*storage_mock, alloc_rados_mail()).Times(2).WillOnce(Return(test_obj)).WillOnce(Return(test_obj2));
   EXPECT_CALL(*storage_mock, set_ceph_wait_method(_)).Times(1);
 
   EXPECT_CALL(*storage_mock, free_rados_mail(_)).Times(2);
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = set_cfg_mock(box);
+  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillOnce(Return(false));
+  EXPECT_CALL(*cfg_mock, load_rados_config()).WillOnce(Return(0));
+  EXPECT_CALL(*cfg_mock, get_chunk_size()).WillOnce(Return(100));
+  EXPECT_CALL(*cfg_mock, get_save_inflight_window()).WillRepeatedly(Return(16));
+  storage->s = storage_mock;
 
-  librados::IoCtx test_ioctx;
-  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
- 
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
 
-  librmb::RadosMail *test_obj_save = new librmb::RadosMail();
-  librmb::RadosMail *test_obj_save2 = new librmb::RadosMail();
-  test_obj_save->set_mail_buffer(nullptr);
-  test_obj_save2->set_mail_buffer(nullptr);
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(*ms_p_mock, create_metadata_storage(_,_)).Times(1);
 
-  EXPECT_CALL(*storage_mock, alloc_rados_mail())
-      .Times(2)
-      .WillOnce(Return(test_obj_save))
-      .WillOnce(Return(test_obj_save2));
+  bool save_failed = FALSE;
+
+  if (mailbox_save_begin(&save_ctx, input) < 0) {
+    i_error("Saving failed: %s", mailbox_get_last_internal_error(box, NULL));
+    mailbox_transaction_rollback(&trans);
+    FAIL() << "saving failed: " << mailbox_get_last_internal_error(box, NULL);
+  } else {
+    ssize_t ret;
+    do {
+      if (mailbox_save_continue(save_ctx) < 0) {
+        save_failed = TRUE;
+        ret = -1;
+        FAIL() << "mailbox_save_continue() failed";
+        break;
+      }
+    } while ((ret = i_stream_read(input)) > 0);
+    EXPECT_EQ(ret, -1);
 
+    if (input->stream_errno != 0) {
+      FAIL() << "read(msg input) failed: " << i_stream_get_error(input);
+    } else if (save_failed) {
+      FAIL() << "Saving failed: " << mailbox_get_last_internal_error(box, NULL);
+    } else if (mailbox_save_finish(&save_ctx) < 0) {
+      FAIL() << "async save should not fail before commit";
+      mailbox_transaction_rollback(&trans);
 
-  EXPECT_CALL(*storage_mock, open_connection("mail_storage",_, "ceph", "client.admin"))
-      .Times(AtLeast(1))
-      .WillRepeatedly(Return(0));
+    } else if (mailbox_transaction_commit(&trans) < 0) {
+      SUCCEED() << "failed at correct place";
+    } else {
+      FAIL() << "transaction should not succeed";
+    }
+    EXPECT_EQ(save_ctx, nullptr);
+    if (save_ctx != nullptr){
+      i_info("save_ctx != nullptr");
+      mailbox_save_cancel(&save_ctx);
+    }  
 
+    EXPECT_EQ(trans, nullptr);
+    if (trans != nullptr){
+      i_info("transcation rollback");
+      mailbox_transaction_rollback(&trans);
+    }
+      
 
-  EXPECT_CALL(*storage_mock, execute_operation(_,_)).WillRepeatedly(Return(true));
-  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).WillRepeatedly(Return(true));
+    EXPECT_TRUE(input->eof);
+    i_info("input eof %ld",ret);
+    EXPECT_GE(ret, -1);
+    
+  }
+  i_stream_unref(&input);
+  mailbox_free(&box);
+ 
+  SUCCEED() << "should be ok here";
 
-  i_info("adding mail");
-  // testdata
-  testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
-  i_info("adding mail done");
-  
-  search_args = mail_search_build_init();
-  sarg = mail_search_build_add(search_args, SEARCH_ALL);
-  ASSERT_NE(sarg, nullptr);
+}
 
+/**
+ * Error test:
+ *
+ * - ceph index (object_search_method=2) is not updated, if the async write
+ *   fails in commit.
+ */
+TEST_F(StorageTest, ceph_index_append_in_commit_pre) {
   struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
   ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", (mailbox_flags)0);
+  ASSERT_NE(box, nullptr);
+  i_debug("preparing to open");
+  ASSERT_GE(mailbox_open(box), 0);
+  i_debug("mailbox open");
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
 
-  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_SAVEONLY);
+  struct istream *input = i_stream_create_from_data(message, strlen(message));
 
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
   // set the Mock storage
   struct rbox_storage *storage = (struct rbox_storage *)box->storage;
   delete storage->s;
 
-  librmbtest::RadosStorageMock *storage_mock_copy = new librmbtest::RadosStorageMock();
-  librmb::RadosMail *test_object = new librmb::RadosMail();
-  librmb::RadosMail *test_object2 = new librmb::RadosMail();
-  test_object->set_mail_buffer(nullptr);
-  test_object2->set_mail_buffer(nullptr);
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
 
-  librmb::RadosMetadata recv_date = librmb::RadosMetadata(librmb::RBOX_METADATA_RECEIVED_TIME, time(NULL));
-  test_object->add_metadata(recv_date);
-  librmb::RadosMetadata guid = librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, "67ffff24efc0e559194f00009c60b9f7");
-  test_object->add_metadata(guid);
+  EXPECT_CALL(*storage_mock, open_connection("mail_storage",_, "ceph", "client.admin"))
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(0));
+  
 
-  EXPECT_CALL(*storage_mock_copy, alloc_rados_mail())
-      .Times(2)
-      .WillOnce(Return(test_object))
-      .WillOnce(Return(test_object2));
+  EXPECT_CALL(*storage_mock, get_max_object_size())
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(65000));
 
+  EXPECT_CALL(*storage_mock, get_max_write_size_bytes())
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(65000));
 
-  EXPECT_CALL(*storage_mock_copy, copy(_, _, _, _, _)).WillRepeatedly(Return(-1));
-  EXPECT_CALL(*storage_mock_copy, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  // metadata and mail are written in one async operation
+  EXPECT_CALL(*storage_mock, execute_operation(_,_)).Times(0);
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).Times(0);
+  EXPECT_CALL(*storage_mock, aio_operate(_,_,_,_)).Times(1).WillOnce(Return(0));
+  // commit_pre waits for the write => failed, rollback waits again (nothing in flight).
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillOnce(Return(true)).WillRepeatedly(Return(false));
+  // rollback removes the object
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMail*>(_))).Times(1);
+  // the ceph index is appended once per transaction in commit_pre, after all writes
+  // succeeded. Not per mail in save_finish.
+  EXPECT_CALL(*storage_mock, ceph_index_append(Matcher<const std::string &>(_))).Times(0);
+  EXPECT_CALL(*storage_mock, ceph_index_append(Matcher<const std::set<std::string> &>(_))).Times(0);
+  EXPECT_CALL(*storage_mock, ceph_index_size()).Times(0);
 
-  storage->s = storage_mock_copy;
-  delete storage->config;
-  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
-  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
-  std::string user = "client.admin";
-  std::string cluster = "ceph";
-  std::string pool = "mail_storage";
-  std::string suffix = "_u";
+  librmb::RadosMail *test_obj = new librmb::RadosMail();
+  test_obj->set_mail_buffer(nullptr);
+  librmb::RadosMail *test_obj2 = new librmb::RadosMail();
+  test_obj2->set_mail_buffer(nullptr);
+  EXPECT_CALL(*storage_mock, alloc_rados_mail()).Times(2).WillOnce(Return(test_obj)).WillOnce(Return(test_obj2));
+  EXPECT_CALL(*storage_mock, set_ceph_wait_method(_)).Times(1);
+
+  EXPECT_CALL(*storage_mock, free_rados_mail(_)).Times(2);
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = set_cfg_mock(box);
+  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillOnce(Return(false));
+  EXPECT_CALL(*cfg_mock, load_rados_config()).WillOnce(Return(0));
+  EXPECT_CALL(*cfg_mock, get_chunk_size()).WillOnce(Return(100));
+  EXPECT_CALL(*cfg_mock, get_save_inflight_window()).WillRepeatedly(Return(16));
+  EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(2));
+  storage->s = storage_mock;
 
   delete storage->ms;
   librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
@@ -676,29 +776,549 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
   librmbtest::RadosStorageMetadataMock ms_mock;
   EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
   EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
-  EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
-  EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
-  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
-  EXPECT_CALL(*cfg_mock, is_write_chunks()).WillRepeatedly(Return(false));
-  EXPECT_CALL(*cfg_mock, is_ceph_posix_bugfix_enabled()).WillRepeatedly(Return(false));
-  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillRepeatedly(Return(false));
-  EXPECT_CALL(*cfg_mock, load_rados_config()).WillRepeatedly(Return(0));
-  EXPECT_CALL(*cfg_mock, is_mail_attribute(_)).WillRepeatedly(Return(true));
-  EXPECT_CALL(*cfg_mock, is_user_mapping()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*ms_p_mock, create_metadata_storage(_,_)).Times(1);
 
-  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
-  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
-  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
-  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
-  EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
-  
-  storage->ns_mgr->set_config(cfg_mock);
+  bool save_failed = FALSE;
 
-  storage->config = cfg_mock;
-  i_info("mailbox open");
-  if (mailbox_open(box) < 0) {
-    i_error("######################### Opening mailbox %s failed: %s", mailbox, mailbox_get_last_internal_error(box, NULL));
-    FAIL() << " Forcing a resync on mailbox INBOX Failed";
+  if (mailbox_save_begin(&save_ctx, input) < 0) {
+    i_error("Saving failed: %s", mailbox_get_last_internal_error(box, NULL));
+    mailbox_transaction_rollback(&trans);
+    FAIL() << "saving failed: " << mailbox_get_last_internal_error(box, NULL);
+  } else {
+    ssize_t ret;
+    do {
+      if (mailbox_save_continue(save_ctx) < 0) {
+        save_failed = TRUE;
+        ret = -1;
+        FAIL() << "mailbox_save_continue() failed";
+        break;
+      }
+    } while ((ret = i_stream_read(input)) > 0);
+    EXPECT_EQ(ret, -1);
+
+    if (input->stream_errno != 0) {
+      FAIL() << "read(msg input) failed: " << i_stream_get_error(input);
+    } else if (save_failed) {
+      FAIL() << "Saving failed: " << mailbox_get_last_internal_error(box, NULL);
+    } else if (mailbox_save_finish(&save_ctx) < 0) {
+      FAIL() << "async save should not fail before commit";
+      mailbox_transaction_rollback(&trans);
+
+    } else if (mailbox_transaction_commit(&trans) < 0) {
+      SUCCEED() << "failed at correct place";
+    } else {
+      FAIL() << "transaction should not succeed";
+    }
+    EXPECT_EQ(save_ctx, nullptr);
+    if (save_ctx != nullptr){
+      i_info("save_ctx != nullptr");
+      mailbox_save_cancel(&save_ctx);
+    }  
+
+    EXPECT_EQ(trans, nullptr);
+    if (trans != nullptr){
+      i_info("transcation rollback");
+      mailbox_transaction_rollback(&trans);
+    }
+      
+
+    EXPECT_TRUE(input->eof);
+    i_info("input eof %ld",ret);
+    EXPECT_GE(ret, -1);
+    
+  }
+  i_stream_unref(&input);
+  mailbox_free(&box);
+ 
+  SUCCEED() << "should be ok here";
+
+}
+
+/**
+ * Error test:
+ *
+ * - eval copy from input to output stream
+ */
+TEST_F(StorageTest, copy_input_to_output_stream) {
+  librados::bufferlist *buffer = new librados::bufferlist();
+  // librados::bufferlist buffer_out;
+  librmb::RadosMail mail;
+  buffer->append("\r\t\0\nJAN");
+  unsigned long physical_size = buffer->length();
+  struct istream *input;  // = *stream_r;
+  struct ostream *output;
+
+  librados::bufferlist buffer2;
+  mail.set_mail_buffer(&buffer2);
+  output = o_stream_create_bufferlist(&mail, nullptr, 0, 0, 0);
+  input = i_stream_create_from_bufferlist(buffer, physical_size);
+
+  do {
+    if (o_stream_send_istream(output, input) < 0) {
+      EXPECT_EQ(1, -1);
+    }
+
+  } while (i_stream_read(input) > 0);
+
+  EXPECT_EQ(buffer->to_str(), mail.get_mail_buffer()->to_str());
+  o_stream_unref(&output);
+  i_stream_unref(&input);
+}
+
+/* reads of the rados istream are served from content, the offsets of the reads are recorded */
+static void expect_rados_reads(librmbtest::RadosStorageMock *storage_mock, const std::string &content,
+                               std::vector<uint64_t> *offsets) {
+  EXPECT_CALL(*storage_mock, aio_read(_, _, _, _, _, _))
+      .WillRepeatedly(Invoke([content, offsets](librados::IoCtx *, const std::string &, librados::AioCompletion *,
+                                                librados::bufferlist *pbl, size_t len, uint64_t off) {
+        offsets->push_back(off);
+        pbl->append(content.substr(off, len));
+        return 0;
+      }));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .WillRepeatedly(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+}
+
+/* 10 chunks of 100 bytes: "a..ab..b...j..j" */
+static std::string rados_stream_content() {
+  std::string content;
+  for (int i = 0; i < 10; i++) {
+    content.append(std::string(100, 'a' + i));
+  }
+  return content;
+}
+
+/**
+ * Rados istream:
+ *
+ * - the mail is read chunk by chunk, each chunk once.
+ */
+TEST_F(StorageTest, read_rados_stream) {
+  librmbtest::RadosStorageMock storage_mock;
+  std::string content = rados_stream_content();
+  std::vector<uint64_t> offsets;
+  expect_rados_reads(&storage_mock, content, &offsets);
+
+  struct istream *input = i_stream_create_rados(&storage_mock, "test_oid", content.length(), nullptr, 100, 2, 0);
+  const unsigned char *data;
+  size_t size;
+  std::string read;
+  while (i_stream_read_data(input, &data, &size, 0) > 0) {
+    read.append(reinterpret_cast<const char *>(data), size);
+    i_stream_skip(input, size);
+  }
+  EXPECT_EQ(0, input->stream_errno);
+  EXPECT_TRUE(input->eof);
+  EXPECT_EQ(content, read);
+  std::vector<uint64_t> expected = {0, 100, 200, 300, 400, 500, 600, 700, 800, 900};
+  EXPECT_EQ(expected, offsets);
+  i_stream_unref(&input);
+}
+
+/**
+ * Rados istream:
+ *
+ * - a forward seek into a queued chunk uses the chunk
+ * - a forward seek behind the queued chunks reads from the new offset
+ * - a backward seek reads again
+ */
+TEST_F(StorageTest, seek_rados_stream) {
+  librmbtest::RadosStorageMock storage_mock;
+  std::string content = rados_stream_content();
+  std::vector<uint64_t> offsets;
+  expect_rados_reads(&storage_mock, content, &offsets);
+
+  struct istream *input = i_stream_create_rados(&storage_mock, "test_oid", content.length(), nullptr, 100, 2, 0);
+  const unsigned char *data;
+  size_t size;
+  // chunk 0 and the read ahead chunks 1 and 2
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('a', data[0]);
+  std::vector<uint64_t> expected = {0, 100, 200};
+  EXPECT_EQ(expected, offsets);
+
+  // inside of chunk 1
+  i_stream_seek(input, 150);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('b', data[0]);
+  EXPECT_EQ(content.substr(150, size), std::string(reinterpret_cast<const char *>(data), size));
+  expected = {0, 100, 200, 300, 400};
+  EXPECT_EQ(expected, offsets);
+
+  // behind the queued chunks (0-500)
+  i_stream_seek(input, 750);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('h', data[0]);
+  EXPECT_EQ(content.substr(750, size), std::string(reinterpret_cast<const char *>(data), size));
+  EXPECT_EQ(750u, offsets[5]);
+
+  // backwards
+  offsets.clear();
+  i_stream_seek(input, 50);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('a', data[0]);
+  EXPECT_EQ(50u, offsets[0]);
+
+  std::string read;
+  do {
+    read.append(reinterpret_cast<const char *>(data), size);
+    i_stream_skip(input, size);
+  } while (i_stream_read_data(input, &data, &size, 0) > 0);
+  EXPECT_EQ(0, input->stream_errno);
+  EXPECT_EQ(content.substr(50), read);
+  i_stream_unref(&input);
+}
+
+/**
+ * Rados istream:
+ *
+ * - a short read fails the stream (EIO)
+ */
+TEST_F(StorageTest, short_read_rados_stream) {
+  librmbtest::RadosStorageMock storage_mock;
+  std::string content = rados_stream_content();
+  std::vector<uint64_t> offsets;
+  expect_rados_reads(&storage_mock, content, &offsets);
+  // the read of chunk 2 returns 50 of 100 bytes
+  EXPECT_CALL(storage_mock, aio_read(_, _, _, _, _, 200))
+      .WillOnce(Invoke([content](librados::IoCtx *, const std::string &, librados::AioCompletion *,
+                                 librados::bufferlist *pbl, size_t, uint64_t off) {
+        pbl->append(content.substr(off, 50));
+        return 0;
+      }));
+
+  struct istream *input = i_stream_create_rados(&storage_mock, "test_oid", content.length(), nullptr, 100, 2, 0);
+  const unsigned char *data;
+  size_t size;
+  std::string read;
+  ssize_t ret;
+  while ((ret = i_stream_read_data(input, &data, &size, 0)) > 0) {
+    read.append(reinterpret_cast<const char *>(data), size);
+    i_stream_skip(input, size);
+  }
+  EXPECT_EQ(-1, ret);
+  EXPECT_EQ(EIO, input->stream_errno);
+  EXPECT_EQ(content.substr(0, 200), read);
+  i_stream_unref(&input);
+}
+
+/**
+ * Rados istream:
+ *
+ * - a failed aio_read fails the stream (EIO)
+ */
+TEST_F(StorageTest, failed_read_rados_stream) {
+  librmbtest::RadosStorageMock storage_mock;
+  EXPECT_CALL(storage_mock, aio_read(_, _, _, _, _, _)).WillOnce(Return(-ENOTCONN));
+  EXPECT_CALL(storage_mock, wait_for_read_operation_complete(_)).Times(0);
+
+  struct istream *input = i_stream_create_rados(&storage_mock, "test_oid", 1000, nullptr, 100, 2, 0);
+  const unsigned char *data;
+  size_t size;
+  EXPECT_EQ(-1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ(EIO, input->stream_errno);
+  i_stream_unref(&input);
+}
+
+/**
+ * Multi segment bufferlist:
+ *
+ * - the segments are read in place, seek and reads across segment boundaries
+ */
+TEST_F(StorageTest, read_segmented_bufferlist_stream) {
+  librados::bufferlist *buffer = new librados::bufferlist();
+  std::string content;
+  for (int i = 0; i < 3; i++) {
+    librados::bufferlist segment;
+    segment.append(std::string(10000, 'a' + i));
+    buffer->append(segment);
+    content.append(std::string(10000, 'a' + i));
+  }
+  ASSERT_FALSE(buffer->is_contiguous());
+  struct istream *input = i_stream_create_from_bufferlist(buffer, buffer->length());
+
+  const unsigned char *data;
+  size_t size;
+  std::string read;
+  while (i_stream_read_data(input, &data, &size, 0) > 0) {
+    read.append(reinterpret_cast<const char *>(data), size);
+    i_stream_skip(input, size);
+  }
+  EXPECT_EQ(content, read);
+  EXPECT_FALSE(buffer->is_contiguous());
+
+  // the requested bytes span two segments
+  i_stream_seek(input, 9995);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 9));
+  ASSERT_LE(10u, size);
+  EXPECT_EQ(content.substr(9995, 10), std::string(reinterpret_cast<const char *>(data), 10));
+
+  // backwards into the first segment
+  i_stream_seek(input, 5);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('a', data[0]);
+  i_stream_seek(input, 29999);
+  ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 0));
+  EXPECT_EQ('c', data[0]);
+  i_stream_skip(input, 1);
+  EXPECT_EQ(-1, i_stream_read(input));
+  i_stream_unref(&input);
+}
+
+/**
+ * decompressing stream: reads, a backward seek (decompresses again) and a forward seek
+ */
+TEST_F(StorageTest, read_decompress_stream) {
+  std::string codecs[] = {"zstd", "lz4"};
+  for (const std::string &name : codecs) {
+    librmb::RadosCompression *codec = librmb::RadosCompression::get_codec(name);
+    if (codec == nullptr) {
+      // not compiled in
+      continue;
+    }
+    std::string content;
+    for (int i = 0; i < 10000; i++) {
+      content.append("line " + std::to_string(i) + "\r\n");
+    }
+    librados::bufferlist in;
+    in.append(content);
+    librados::bufferlist *compressed = new librados::bufferlist();
+    ASSERT_EQ(0, codec->compress(in, compressed, 0));
+    ASSERT_EQ(content.length(), codec->get_content_size(*compressed));
+
+    struct istream *parent = i_stream_create_from_bufferlist(compressed, compressed->length());
+    struct istream *input = i_stream_create_decompress(parent, codec->create_decompressor(), content.length());
+    i_stream_unref(&parent);
+
+    const unsigned char *data;
+    size_t size;
+    std::string read;
+    while (i_stream_read_data(input, &data, &size, 0) > 0) {
+      read.append(reinterpret_cast<const char *>(data), size);
+      i_stream_skip(input, size);
+    }
+    EXPECT_EQ(0, input->stream_errno);
+    EXPECT_EQ(content, read);
+
+    i_stream_seek(input, 10);
+    ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 9));
+    EXPECT_EQ(content.substr(10, 10), std::string(reinterpret_cast<const char *>(data), 10));
+    i_stream_seek(input, content.length() - 5);
+    ASSERT_EQ(1, i_stream_read_data(input, &data, &size, 4));
+    EXPECT_EQ(content.substr(content.length() - 5), std::string(reinterpret_cast<const char *>(data), 5));
+
+    const struct stat *st;
+    ASSERT_EQ(0, i_stream_stat(input, TRUE, &st));
+    EXPECT_EQ((off_t)content.length(), st->st_size);
+    i_stream_unref(&input);
+  }
+}
+
+/**
+ * Streaming save:
+ *
+ * - once the watermark is reached full chunks are written async,
+ *   only the tail remains in the mail buffer.
+ */
+TEST_F(StorageTest, stream_output_chunks) {
+  librmbtest::RadosStorageMock storage_mock;
+  librados::IoCtx test_ioctx;
+  librmb::RadosMail mail;
+  mail.set_oid("test_oid");
+  librados::bufferlist buffer2;
+  mail.set_mail_buffer(&buffer2);
+
+  EXPECT_CALL(storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(storage_mock, get_max_object_size()).WillRepeatedly(Return(1024));
+  EXPECT_CALL(storage_mock, aio_operate(_, _, _, _)).Times(4).WillRepeatedly(Return(0));
+  EXPECT_CALL(storage_mock, wait_for_write_operations_complete(_, _)).Times(4).WillRepeatedly(Return(false));
+
+  struct ostream *output = o_stream_create_bufferlist(&mail, &storage_mock, 10, 5, 0);
+  std::string data = "abcdefghijklmnopqrstuvw";
+  EXPECT_EQ((ssize_t)data.length(), o_stream_send(output, data.c_str(), data.length()));
+
+  EXPECT_EQ(0, o_stream_bufferlist_wait_flushed(output));
+  EXPECT_EQ(data.length(), output->offset);
+  EXPECT_EQ("uvw", mail.get_mail_buffer()->to_str());
+  o_stream_unref(&output);
+}
+
+/**
+ * Size hint:
+ *
+ * - with a known mail size the data is written into one preallocated buffer.
+ */
+TEST_F(StorageTest, stream_output_size_hint) {
+  librmb::RadosMail mail;
+  librados::bufferlist buffer2;
+  mail.set_mail_buffer(&buffer2);
+
+  struct ostream *output = o_stream_create_bufferlist(&mail, nullptr, 0, 0, 0);
+  std::string data(10000, 'a');
+  o_stream_bufferlist_set_size_hint(output, data.length());
+  for (size_t i = 0; i < data.length(); i += 100) {
+    EXPECT_EQ(100, o_stream_send(output, data.c_str() + i, 100));
+  }
+  EXPECT_EQ(data, mail.get_mail_buffer()->to_str());
+  EXPECT_EQ(1u, mail.get_mail_buffer()->get_num_buffers());
+  o_stream_unref(&output);
+}
+
+TEST_F(StorageTest, stream_output_crc32c) {
+  librmb::RadosMail mail;
+  librados::bufferlist buffer2;
+  mail.set_mail_buffer(&buffer2);
+
+  struct ostream *output = o_stream_create_bufferlist(&mail, nullptr, 0, 0, 0);
+  o_stream_send_str(output, "12345");
+  o_stream_send_str(output, "6789");
+  uint32_t crc32c = 0;
+  EXPECT_TRUE(o_stream_bufferlist_get_crc32c(output, &crc32c));
+  EXPECT_EQ(0xe3069283, crc32c);
+  o_stream_unref(&output);
+}
+
+/**
+ * Error test:
+ *
+ * - copy mail fails due to storage.copy call returns -1
+ */
+TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
+  struct mailbox_transaction_context *desttrans;
+  struct mail_save_context *save_ctx;
+  struct mail *mail;
+  struct mail_search_context *search_ctx;
+  struct mail_search_args *search_args;
+  struct mail_search_arg *sarg;
+
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+
+  const char *mailbox = "INBOX";
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+
+  EXPECT_CALL(*storage_mock, get_max_object_size())
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(65000));
+      
+  EXPECT_CALL(*storage_mock, get_max_write_size_bytes())
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(65000));
+  EXPECT_CALL(*storage_mock, set_ceph_wait_method(_)).Times(1);
+
+  EXPECT_CALL(*storage_mock, free_rados_mail(_)).Times(2);
+
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+ 
+
+  librmb::RadosMail *test_obj_save = new librmb::RadosMail();
+  librmb::RadosMail *test_obj_save2 = new librmb::RadosMail();
+  test_obj_save->set_mail_buffer(nullptr);
+  test_obj_save2->set_mail_buffer(nullptr);
+
+  EXPECT_CALL(*storage_mock, alloc_rados_mail())
+      .Times(2)
+      .WillOnce(Return(test_obj_save))
+      .WillOnce(Return(test_obj_save2));
+
+
+  EXPECT_CALL(*storage_mock, open_connection("mail_storage",_, "ceph", "client.admin"))
+      .Times(AtLeast(1))
+      .WillRepeatedly(Return(0));
+
+
+  EXPECT_CALL(*storage_mock, execute_operation(_,_)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).WillRepeatedly(Return(true));
+
+  i_info("adding mail");
+  // testdata
+  testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
+  i_info("adding mail done");
+  
+  search_args = mail_search_build_init();
+  sarg = mail_search_build_add(search_args, SEARCH_ALL);
+  ASSERT_NE(sarg, nullptr);
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_SAVEONLY);
+
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+
+  librmbtest::RadosStorageMock *storage_mock_copy = new librmbtest::RadosStorageMock();
+  librmb::RadosMail *test_object = new librmb::RadosMail();
+  librmb::RadosMail *test_object2 = new librmb::RadosMail();
+  test_object->set_mail_buffer(nullptr);
+  test_object2->set_mail_buffer(nullptr);
+
+  librmb::RadosMetadata recv_date = librmb::RadosMetadata(librmb::RBOX_METADATA_RECEIVED_TIME, time(NULL));
+  test_object->add_metadata(recv_date);
+  librmb::RadosMetadata guid = librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, "67ffff24efc0e559194f00009c60b9f7");
+  test_object->add_metadata(guid);
+
+  EXPECT_CALL(*storage_mock_copy, alloc_rados_mail())
+      .Times(2)
+      .WillOnce(Return(test_object))
+      .WillOnce(Return(test_object2));
+
+
+  EXPECT_CALL(*storage_mock_copy, copy(_, _, _, _, _)).WillRepeatedly(Return(-1));
+  EXPECT_CALL(*storage_mock_copy, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+
+  storage->s = storage_mock_copy;
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string read_policy = "primary";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, is_write_chunks()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_posix_bugfix_enabled()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, load_rados_config()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, is_mail_attribute(_)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, is_user_mapping()).WillRepeatedly(Return(false));
+
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
+  
+  storage->ns_mgr->set_config(cfg_mock);
+
+  storage->config = cfg_mock;
+  i_info("mailbox open");
+  if (mailbox_open(box) < 0) {
+    i_error("######################### Opening mailbox %s failed: %s", mailbox, mailbox_get_last_internal_error(box, NULL));
+    FAIL() << " Forcing a resync on mailbox INBOX Failed";
   }
 
 #ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
@@ -806,12 +1426,14 @@ TEST_F(StorageTest, save_mail_cancel) {
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";  
   std::string suffix = "_u";
   EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
@@ -839,6 +1461,554 @@ TEST_F(StorageTest, save_mail_cancel) {
 }
 
 
+static const char *warmup_message =
+    "From: user@domain.org\n"
+    "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+    "Mime-Version: 1.0\n"
+    "Content-Type: text/plain; charset=us-ascii\n"
+    "\n"
+    "body\n";
+
+static const char *warmup_guid = "67ffff24efc0e559194f00009c60b9f7";
+
+/* installs the mocks for box (before it is opened). They are kept until the next test installs its own,
+ * so the io_ctx is static. */
+static librmbtest::RadosDovecotCephCfgMock *set_warmup_mocks(struct mailbox *box,
+                                                             librmbtest::RadosStorageMock *storage_mock,
+                                                             librmbtest::RadosStorageMetadataMock *ms_mock) {
+  static librados::IoCtx test_ioctx;
+
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+
+  EXPECT_CALL(*storage_mock, get_max_object_size()).WillRepeatedly(Return(65000));
+  EXPECT_CALL(*storage_mock, get_max_write_size_bytes()).WillRepeatedly(Return(65000));
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, open_connection("mail_storage", _, "ceph", "client.admin")).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, alloc_rados_mail()).WillRepeatedly(Invoke([]() { return new librmb::RadosMail(); }));
+  EXPECT_CALL(*storage_mock, free_rados_mail(_)).WillRepeatedly(Invoke([](librmb::RadosMail *mail) { delete mail; }));
+  EXPECT_CALL(*storage_mock, execute_operation(_, _)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*storage_mock, append_to_object(_, _, _)).WillRepeatedly(Return(true));
+  delete storage->s;
+  storage->s = storage_mock;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(ms_mock));
+  EXPECT_CALL(*ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  storage->ms = ms_p_mock;
+
+  return StorageTest::set_cfg_mock(box);
+}
+
+/* saves count mails to the opened box */
+static void save_warmup_mails(struct mailbox *box, int count) {
+  for (int i = 0; i < count; i++) {
+    librados::bufferlist *i_stream_buffer = new librados::bufferlist();
+    i_stream_buffer->append(warmup_message);
+    struct istream *input = i_stream_create_from_bufferlist(i_stream_buffer, i_stream_buffer->length());
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+    struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+    char reason[256];
+    memset(reason, '\0', sizeof(reason));
+    struct mailbox_transaction_context *trans =
+        mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+    struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
+    testutils::ItUtils::add_mail(save_ctx, input, box, trans);
+    i_stream_unref(&input);
+  }
+}
+
+/* adds count mails to INBOX and opens it with the given warmup configuration (rbox_mail_warmup) */
+static struct mailbox *open_warmup_inbox(librmbtest::RadosStorageMock *storage_mock,
+                                         librmbtest::RadosStorageMetadataMock *ms_mock, int count,
+                                         int warmup_count, bool warmup_headers) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(StorageTest::s_test_mail_user->namespaces);
+  EXPECT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_SAVEONLY);
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = set_warmup_mocks(box, storage_mock, ms_mock);
+  EXPECT_CALL(*cfg_mock, get_warmup_count()).WillRepeatedly(Return(warmup_count));
+  EXPECT_CALL(*cfg_mock, is_warmup_headers()).WillRepeatedly(Return(warmup_headers));
+  EXPECT_CALL(*cfg_mock, get_header_read_size()).WillRepeatedly(Return(1024));
+  EXPECT_CALL(*cfg_mock, get_read_chunk_size()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, is_verify_checksum()).WillRepeatedly(Return(false));
+  EXPECT_GE(mailbox_open(box), 0);
+  save_warmup_mails(box, count);
+  mailbox_free(&box);
+
+  // not save only: the newest mails are read async
+  box = mailbox_alloc(ns->list, "INBOX", (mailbox_flags)0);
+  EXPECT_GE(mailbox_open(box), 0);
+  return box;
+}
+
+/**
+ * Warmup (rbox_mail_warmup):
+ *
+ * - the metadata of the newest mail is read, when INBOX is opened.
+ * - the access uses it, there is no synchronous read.
+ */
+TEST_F(StorageTest, mail_warmup_hit) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(1)
+      .WillOnce(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(0);
+  EXPECT_CALL(ms_mock, load_metadata(_)).Times(0);
+  EXPECT_CALL(ms_mock, load_metadata(_, _))
+      .Times(1)
+      .WillOnce(Invoke([](librmb::RadosMail *mail, librmb::RadosMetadataRead *) {
+        mail->add_metadata(librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, warmup_guid));
+        return 0;
+      }));
+
+  // metadata only
+  struct mailbox *box = open_warmup_inbox(storage_mock, &ms_mock, 1, 1, false);
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail *mail = mail_alloc(trans, (mail_fetch_field)0, NULL);
+  mail_set_seq(mail, mail_index_view_get_messages_count(box->view));
+  const char *guid = NULL;
+  EXPECT_EQ(0, mail_get_special(mail, MAIL_FETCH_GUID, &guid));
+  EXPECT_STREQ(warmup_guid, guid);
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+}
+
+/**
+ * Warmup (rbox_mail_warmup):
+ *
+ * - the warmup read of the header range is not used for a read of the whole mail.
+ * - it is freed, when the mailbox is closed.
+ */
+TEST_F(StorageTest, mail_warmup_miss_read_size) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(0);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(1)
+      .WillOnce(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+  // the synchronous read of the whole mail
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(1).WillOnce(Return(-EIO));
+
+  struct mailbox *box = open_warmup_inbox(storage_mock, &ms_mock, 1, 1, true);
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail *mail = mail_alloc(trans, (mail_fetch_field)0, NULL);
+  mail_set_seq(mail, mail_index_view_get_messages_count(box->view));
+  struct istream *input = NULL;
+  EXPECT_EQ(-1, mail_get_stream(mail, NULL, NULL, &input));
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
+/**
+ * Header read (rbox_header_read_size):
+ *
+ * - ENVELOPE alone is served by the read of the header range (warmup).
+ * - ENVELOPE and BODYSTRUCTURE of the same mail: the body is parsed with the header, so the whole mail
+ *   is read, not the header range.
+ */
+TEST_F(StorageTest, mail_header_read_body_parsed) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(0);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(2).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(2)
+      .WillRepeatedly(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+  // the synchronous reads of the whole mail
+  int reads = 0;
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _))
+      .WillRepeatedly(Invoke([&reads](const std::string &, librados::ObjectReadOperation *, librados::bufferlist *) {
+        reads++;
+        return -EIO;
+      }));
+
+  struct mailbox *box = open_warmup_inbox(storage_mock, &ms_mock, 2, 2, true);
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  const char *value = NULL;
+  struct mail *mail = mail_alloc(trans, MAIL_FETCH_IMAP_ENVELOPE, NULL);
+  mail_set_seq(mail, 2);
+  // served by the warmup read, the mock read has no size (stat), so the stream is not created
+  EXPECT_EQ(-1, mail_get_special(mail, MAIL_FETCH_IMAP_ENVELOPE, &value));
+  EXPECT_EQ(0, reads);
+  mail_free(&mail);
+
+  mail = mail_alloc(trans, (mail_fetch_field)(MAIL_FETCH_IMAP_ENVELOPE | MAIL_FETCH_IMAP_BODYSTRUCTURE), NULL);
+  mail_set_seq(mail, 1);
+  // the warmup read of the header range is not used
+  EXPECT_EQ(-1, mail_get_special(mail, MAIL_FETCH_IMAP_ENVELOPE, &value));
+  EXPECT_EQ(1, reads);
+  EXPECT_EQ(-1, mail_get_special(mail, MAIL_FETCH_IMAP_BODYSTRUCTURE, &value));
+  EXPECT_LE(1, reads);
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
+/**
+ * Warmup (rbox_mail_warmup):
+ *
+ * - a failed read stops the warmup, the other mails are not read async.
+ */
+TEST_F(StorageTest, mail_warmup_failed_read) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(-ENOTCONN));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_)).Times(0);
+
+  struct mailbox *box = open_warmup_inbox(storage_mock, &ms_mock, 2, 3, false);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+}
+
+/**
+ * Warmup (rbox_mail_warmup):
+ *
+ * - the reads of the mails, which have not been accessed, are waited for and freed, when the mailbox is closed.
+ */
+TEST_F(StorageTest, mail_warmup_free_on_close) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(2).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(2)
+      .WillRepeatedly(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+  EXPECT_CALL(ms_mock, load_metadata(_, _)).Times(0);
+
+  struct mailbox *box = open_warmup_inbox(storage_mock, &ms_mock, 2, 2, true);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+}
+
+/**
+ * POP3 preload (rbox_mail_warmup_pop3):
+ *
+ * - the metadata of the first accessed mail and the following ones is read async, window reads at a time.
+ * - all mails are served by the preload, there is no synchronous metadata read.
+ */
+TEST_F(StorageTest, mail_warmup_pop3_preload) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(3).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(3)
+      .WillRepeatedly(Invoke([](librados::AioCompletion *c) {
+        c->release();
+        return 0;
+      }));
+  EXPECT_CALL(ms_mock, load_metadata(_)).Times(0);
+  EXPECT_CALL(ms_mock, load_metadata(_, _))
+      .Times(3)
+      .WillRepeatedly(Invoke([](librmb::RadosMail *mail, librmb::RadosMetadataRead *) {
+        mail->add_metadata(librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, warmup_guid));
+        return 0;
+      }));
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "pop3_preload", MAILBOX_FLAG_SAVEONLY);
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = set_warmup_mocks(box, storage_mock, &ms_mock);
+  EXPECT_CALL(*cfg_mock, get_warmup_count()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, get_pop3_preload_window()).WillRepeatedly(Return(2));
+  ASSERT_GE(mailbox_create(box, NULL, FALSE), 0);
+  ASSERT_GE(mailbox_open(box), 0);
+  save_warmup_mails(box, 3);
+  mailbox_free(&box);
+
+  box = mailbox_alloc(ns->list, "pop3_preload", (mailbox_flags)0);
+  ASSERT_GE(mailbox_open(box), 0);
+  const char *service = box->storage->user->service;
+  box->storage->user->service = "pop3";
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail *mail = mail_alloc(trans, (mail_fetch_field)0, NULL);
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  EXPECT_EQ(3u, messages);
+  for (uint32_t seq = 1; seq <= messages; seq++) {
+    mail_set_seq(mail, seq);
+    const char *guid = NULL;
+    EXPECT_EQ(0, mail_get_special(mail, MAIL_FETCH_GUID, &guid));
+    EXPECT_STREQ(warmup_guid, guid);
+  }
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  box->storage->user->service = service;
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+}
+
+/* adds count mails to INBOX and opens it, up to window reads are prefetched (rbox_mail_prefetch) */
+static struct mailbox *open_prefetch_inbox(librmbtest::RadosStorageMock *storage_mock,
+                                           librmbtest::RadosStorageMetadataMock *ms_mock, int count, int window) {
+  struct mailbox *box = open_warmup_inbox(storage_mock, ms_mock, count, 0, false);
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock =
+      static_cast<librmbtest::RadosDovecotCephCfgMock *>(((struct rbox_storage *)box->storage)->config);
+  EXPECT_CALL(*cfg_mock, get_prefetch_window()).WillRepeatedly(Return(window));
+  return box;
+}
+
+static int release_completion(librados::AioCompletion *c) {
+  c->release();
+  return 0;
+}
+
+/**
+ * Prefetch (rbox_mail_prefetch):
+ *
+ * - the read of the mail is started async and counted.
+ * - the stream access consumes it, there is no synchronous read.
+ */
+TEST_F(StorageTest, mail_prefetch_hit) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(0);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_)).Times(1).WillOnce(Invoke(release_completion));
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(0);
+
+  struct mailbox *box = open_prefetch_inbox(storage_mock, &ms_mock, 1, 2);
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail *mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+  mail_set_seq(mail, mail_index_view_get_messages_count(box->view));
+  EXPECT_FALSE(mail_prefetch(mail));
+  EXPECT_EQ(1u, r_storage->prefetch_count);
+  // in flight: no second read
+  EXPECT_FALSE(mail_prefetch(mail));
+  EXPECT_EQ(1u, r_storage->prefetch_count);
+
+  struct istream *input = NULL;
+  // the mock read has no size (stat), so the stream is not created
+  EXPECT_EQ(-1, mail_get_stream(mail, NULL, NULL, &input));
+  EXPECT_EQ(0u, r_storage->prefetch_count);
+  EXPECT_EQ(nullptr, ((struct rbox_mail *)mail)->prefetch);
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
+/**
+ * Prefetch (rbox_mail_prefetch):
+ *
+ * - the prefetched header range does not match the read of the whole mail: it is dropped and
+ *   the mail is read again.
+ */
+TEST_F(StorageTest, mail_prefetch_miss_read_size) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(0);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_)).Times(1).WillOnce(Invoke(release_completion));
+  // the synchronous read of the whole mail
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(1).WillOnce(Return(-EIO));
+
+  struct mailbox *box = open_prefetch_inbox(storage_mock, &ms_mock, 1, 2);
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  // header range only (rbox_header_read_size)
+  struct mail *mail = mail_alloc(trans, MAIL_FETCH_STREAM_HEADER, NULL);
+  mail_set_seq(mail, mail_index_view_get_messages_count(box->view));
+  EXPECT_FALSE(mail_prefetch(mail));
+  EXPECT_EQ(1u, r_storage->prefetch_count);
+
+  struct istream *input = NULL;
+  EXPECT_EQ(-1, mail_get_stream(mail, NULL, NULL, &input));
+  EXPECT_EQ(0u, r_storage->prefetch_count);
+  EXPECT_EQ(nullptr, ((struct rbox_mail *)mail)->prefetch);
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
+/**
+ * Prefetch (rbox_mail_prefetch):
+ *
+ * - at most rbox_prefetch_window reads are in flight, the other mails are read synchronously.
+ * - closing the mails frees the reads and the window.
+ */
+TEST_F(StorageTest, mail_prefetch_window_full) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(0);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(2).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_))
+      .Times(2)
+      .WillRepeatedly(Invoke(release_completion));
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(0);
+
+  struct mailbox *box = open_prefetch_inbox(storage_mock, &ms_mock, 3, 2);
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  ASSERT_LE(3u, messages);
+  struct mail *mails[3];
+  for (int i = 0; i < 3; i++) {
+    mails[i] = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+    mail_set_seq(mails[i], messages - i);
+  }
+  EXPECT_FALSE(mail_prefetch(mails[0]));
+  EXPECT_FALSE(mail_prefetch(mails[1]));
+  // window full
+  EXPECT_TRUE(mail_prefetch(mails[2]));
+  EXPECT_EQ(2u, r_storage->prefetch_count);
+  EXPECT_EQ(nullptr, ((struct rbox_mail *)mails[2])->prefetch);
+
+  mail_free(&mails[0]);
+  EXPECT_EQ(1u, r_storage->prefetch_count);
+  mail_free(&mails[1]);
+  mail_free(&mails[2]);
+  EXPECT_EQ(0u, r_storage->prefetch_count);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
+/**
+ * Prefetch (rbox_mail_prefetch):
+ *
+ * - a mail closed with its read in flight waits for the read and frees it (rbox_mail_close).
+ * - a cached mail is not prefetched.
+ */
+TEST_F(StorageTest, mail_prefetch_free_on_close) {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  uint64_t capacity = librmb::RadosMailCache::get_instance().get_capacity();
+  librmb::RadosMailCache::get_instance().set_capacity(1024 * 1024);
+
+  EXPECT_CALL(*storage_mock, aio_read_operate(_, _, _, _, _)).Times(1).WillOnce(Return(0));
+  EXPECT_CALL(*storage_mock, wait_for_read_operation_complete(_)).Times(1).WillOnce(Invoke(release_completion));
+  EXPECT_CALL(*storage_mock, read_operate(_, _, _)).Times(0);
+  EXPECT_CALL(*storage_mock, get_pool_name()).WillRepeatedly(Return("mail_storage"));
+  EXPECT_CALL(*storage_mock, get_namespace()).WillRepeatedly(Return("prefetch"));
+
+  struct mailbox *box = open_prefetch_inbox(storage_mock, &ms_mock, 2, 2);
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  struct mail *mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+  mail_set_seq(mail, messages);
+  EXPECT_FALSE(mail_prefetch(mail));
+  EXPECT_EQ(1u, r_storage->prefetch_count);
+  mail_free(&mail);
+  EXPECT_EQ(0u, r_storage->prefetch_count);
+
+  mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+  mail_set_seq(mail, messages - 1);
+  librados::bufferlist cached;
+  cached.append(warmup_message);
+  librmb::RadosMailCache::get_instance().put(
+      librmb::RadosMailCache::get_key("mail_storage", "prefetch", *((struct rbox_mail *)mail)->rados_mail->get_oid()),
+      cached, 0);
+  // read from the cache by rbox_mail_get_stream
+  EXPECT_TRUE(mail_prefetch(mail));
+  EXPECT_EQ(0u, r_storage->prefetch_count);
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  EXPECT_TRUE(::testing::Mock::VerifyAndClearExpectations(storage_mock));
+  librmb::RadosMailCache::get_instance().clear();
+  librmb::RadosMailCache::get_instance().set_capacity(capacity);
+}
+
 TEST_F(StorageTest, deinit) {}
 
 int main(int argc, char **argv) {
@@ -151,6 +151,7 @@ TEST_F(StorageTest, save_mail_rados_connection_failed) {
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";
   std::string suffix = "_u";
 
@@ -158,6 +159,7 @@ TEST_F(StorageTest, save_mail_rados_connection_failed) {
   EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
@@ -257,7 +259,9 @@ TEST_F(StorageTest, save_mail_success) {
   EXPECT_CALL(*storage_mock, wait_for_write_operations_complete(_,_)).WillRepeatedly(Return(false));//failed = false
   librados::IoCtx io_ctx;
   EXPECT_CALL(*storage_mock, execute_operation(_,_)).WillRepeatedly(Return(true));
-  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).WillRepeatedly(Return(true));
+  // chunks (max write size 10) are written in parallel
+  EXPECT_CALL(*storage_mock, aio_operate(_,_,_,_)).Times(AtLeast(2)).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, append_to_object(_,_,_)).Times(0);
 
   EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(io_ctx));
 
@@ -304,11 +308,13 @@ TEST_F(StorageTest, save_mail_success) {
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";
   std::string suffix = "_u";
   EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
@@ -79,12 +79,14 @@ void ItUtils::add_mail(const char *message, const char *mailbox, struct mail_nam
 
   std::string user = "client.admin";
   std::string cluster = "ceph";
+  std::string read_policy = "primary";
   std::string pool = "mail_storage";
   std::string suffix = "_u";
 
   EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_read_policy()).WillRepeatedly(ReturnRef(read_policy));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
   EXPECT_CALL(*cfg_mock, get_chunk_size()).WillOnce(Return(100));